@@ -7,10 +7,20 @@
 #include<ctype.h> 
 #include<locale.h>
 #include <time.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
 #include "libs/cJSON.h"
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <libgen.h>
+#include <pthread.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define WITH_AVX2_KERNEL // Built whatever the compiler flags, used only if the CPU has AVX2 (see normalizeSequence())
+#endif
 
 #define RESET "\033[0m"
 #define ERROR_COLOR "\033[31m"
@@ -36,10 +46,11 @@ typedef int bool;
 
 //const int MAX_LENGTH_OF_PROMPTS = 100;
 // const int HISTORY_RECORDS_SIZE = 500;
-char* START_CODONS[] = {"AUG", "GUG", "UUG"}; // Source: https://bio.libretexts.org/Bookshelves/Introductory_and_General_Biology/General_Biology_(Boundless)/15%3A_Genes_and_Proteins/15.03%3A_Prokaryotic_Transcription_-_Transcription_in_Prokaryotes
-const int NUM_OF_START_CODONS = 3;
-char* STOP_CODONS[] = {"UAA", "UAG", "UGA"}; // Source: https://microbenotes.com/codon-chart-table-amino-acids/
-const int NUM_OF_STOP_CODONS = 3;
+// Codons that are STARTs/STOPs in one of the genetic codes (see GENETIC_CODES), for the history's codon queries
+char* START_CODONS[] = {"AUG", "GUG", "UUG", "CUG", "AUU", "AUC", "AUA", "UUA"}; // Source: https://bio.libretexts.org/Bookshelves/Introductory_and_General_Biology/General_Biology_(Boundless)/15%3A_Genes_and_Proteins/15.03%3A_Prokaryotic_Transcription_-_Transcription_in_Prokaryotes
+const int NUM_OF_START_CODONS = 8;
+char* STOP_CODONS[] = {"UAA", "UAG", "UGA", "AGA", "AGG"}; // Source: https://microbenotes.com/codon-chart-table-amino-acids/
+const int NUM_OF_STOP_CODONS = 5;
 char* VALID_CHARS[] = {"A", "U", "C", "G"};
 const int NUM_OF_VALID_CHARS = 4;
 
@@ -58,6 +69,22 @@ typedef enum
     REVERSE     // 1
 } direction;
 
+typedef enum
+{
+    MENU_ANALYZE = 1,
+    MENU_HISTORY,
+    MENU_COMPACT_ARCHIVE,
+    MENU_MANAGE_SHARDS,
+    MENU_FIND_BY_POSITION,
+    MENU_CODON_SITES,
+    MENU_REANALYZE_EDITS,
+    MENU_VARIANT_EFFECTS,
+    MENU_MOTIF_SEARCH,
+    MENU_TOP_ORFS,
+    MENU_TRANSLATE,
+    MENU_EXIT           // Always the last option
+} menuChoice;
+
 typedef struct
 {   
   specialCodonType type;           
@@ -71,8 +98,9 @@ typedef struct
   direction seqDirection;
   int positionInSupersequence;
   bool isCodingSequence;
+  uint64_t sequenceHash;          // Hash of the (normalized) input sequence this ORF was found in, 0 if unknown
+  time_t analysisTime;            // When the ORF was found, 0 if unknown
   // char* sequenceText;
-  // char* analysisDatetime;
   SpecialSubsequence specialCodons[];
 } Sequence;
 
@@ -136,19 +164,30 @@ const direction stringToReadDirection(char* readDirection)
 
 // Sequence "constructor"
 
-Sequence* createSequence(int length, direction seqDirection, int positionInSupersequence, bool isCodingSequence, int numOfCodons)
+// A Sequence is one block of memory: the struct, its codons, then the codons' strings, so a single free() releases it
+size_t getSequenceSize(int numOfCodons)
 {
+    return sizeof(Sequence) + (sizeof(SpecialSubsequence) + CODONS_LENGTH + 1) * numOfCodons;
+}
+
+// Lays a Sequence out in 'memory' (of getSequenceSize(numOfCodons) bytes)
+Sequence* initSequence(void* memory, int length, direction seqDirection, int positionInSupersequence, bool isCodingSequence, int numOfCodons)
+{
+    Sequence* sequence = (Sequence*) memory;
+    if (sequence == NULL) return NULL;
 
-    Sequence* sequence = (Sequence*) malloc(sizeof(Sequence) + sizeof(SpecialSubsequence) * numOfCodons);
     sequence->length = length;
     sequence->seqDirection = seqDirection;
     sequence->positionInSupersequence = positionInSupersequence;
     sequence->isCodingSequence = isCodingSequence;
+    sequence->sequenceHash = 0;
+    sequence->analysisTime = 0;
 
+    char* codonStrings = (char*) &sequence->specialCodons[numOfCodons];
     for (int i = 0; i < numOfCodons; ++i) // Initialize with dummy values 
     { 
         sequence->specialCodons[i].type = PLAIN;
-        sequence->specialCodons[i].codonSequence = malloc( (CODONS_LENGTH+1) * sizeof(char));
+        sequence->specialCodons[i].codonSequence = codonStrings + i * (CODONS_LENGTH+1);
         strcpy(sequence->specialCodons[i].codonSequence, "AUG");
         sequence->specialCodons[i].positionInSequence = i * CODONS_LENGTH;
     }
@@ -156,15 +195,42 @@ Sequence* createSequence(int length, direction seqDirection, int positionInSuper
     return sequence;
 }
 
+Sequence* createSequence(int length, direction seqDirection, int positionInSupersequence, bool isCodingSequence, int numOfCodons)
+{
+    return initSequence(malloc(getSequenceSize(numOfCodons)), length, seqDirection, positionInSupersequence, isCodingSequence, numOfCodons);
+}
+
+// Copies 'codons' (strings included), so the new Sequence doesn't point into memory of whoever found them
 Sequence* createSequence2(int length, direction seqDirection, int positionInSupersequence, bool isCodingSequence, SpecialSubsequence* codons, int codonsArraySize)
 {
+    Sequence* sequence = createSequence(length, seqDirection, positionInSupersequence, isCodingSequence, codonsArraySize);
 
-    Sequence* sequence = (Sequence*) malloc(sizeof(Sequence) + sizeof(SpecialSubsequence) * codonsArraySize);
-    sequence->length = length;
-    sequence->seqDirection = seqDirection;
-    sequence->positionInSupersequence = positionInSupersequence;
-    sequence->isCodingSequence = isCodingSequence;
-    memcpy(sequence->specialCodons, codons, sizeof(SpecialSubsequence) * codonsArraySize);
+    for (int i = 0; i < codonsArraySize; ++i)
+    {
+        sequence->specialCodons[i].type = codons[i].type;
+        strncpy(sequence->specialCodons[i].codonSequence, codons[i].codonSequence, CODONS_LENGTH);
+        sequence->specialCodons[i].codonSequence[CODONS_LENGTH] = '\0';
+        sequence->specialCodons[i].positionInSequence = codons[i].positionInSequence;
+    }
+
+    return sequence;
+}
+
+// Deep copy, codon strings included, so that the copy doesn't share memory with the original
+Sequence* copySequence(Sequence* original)
+{
+    int numOfCodons = original->length / CODONS_LENGTH;
+    Sequence* sequence = createSequence(original->length, original->seqDirection, original->positionInSupersequence, original->isCodingSequence, numOfCodons);
+    sequence->sequenceHash = original->sequenceHash;
+    sequence->analysisTime = original->analysisTime;
+
+    for (int i = 0; i < numOfCodons; ++i)
+    {
+        sequence->specialCodons[i].type = original->specialCodons[i].type;
+        strncpy(sequence->specialCodons[i].codonSequence, original->specialCodons[i].codonSequence, CODONS_LENGTH);
+        sequence->specialCodons[i].codonSequence[CODONS_LENGTH] = '\0';
+        sequence->specialCodons[i].positionInSequence = original->specialCodons[i].positionInSequence;
+    }
 
     return sequence;
 }
@@ -297,46 +363,50 @@ void removeFromList(DoublyLinkedList* list, ListNode* node)
     list->size--;
 }
 
-// Print the contents of the list
-void printList(FILE* output_stream, DoublyLinkedList* list)
+// Print one sequence and its codons
+void printSequence(FILE* output_stream, Sequence* seq)
 {
+    fprintf(output_stream, "\nSequence (Length: %d, Direction: %s, Position: %d, IsCodingSequence: %s)\n\n",
+           seq->length,
+           readDirectionToString(seq->seqDirection),
+           seq->positionInSupersequence,
+           seq->isCodingSequence ? "YES" : "NO");
 
-    ListNode* current = list->head;
+    for (int i = 0; i < (seq->length / CODONS_LENGTH); ++i)
+    {
+        fprintf(output_stream, "\t%d)\tType: ", i);
 
-    while (current) {
-        Sequence *seq = current->data;
+        // Color coding for special codons
+        if (seq->specialCodons[i].type == START)
+        {
+        	fprintf(output_stream, SUCCESS_COLOR "%s" RESET, codonTypeToString(seq->specialCodons[i].type));
+        	fprintf(output_stream, "\tPosition: %d,\tCodon: ", seq->specialCodons[i].positionInSequence);
+        	fprintf(output_stream, SUCCESS_COLOR "%s\n" RESET, seq->specialCodons[i].codonSequence);
 
-        fprintf(output_stream, "\nSequence (Length: %d, Direction: %s, Position: %d, IsCodingSequence: %s)\n\n",
-               seq->length,
-               readDirectionToString(seq->seqDirection),
-               seq->positionInSupersequence,
-               seq->isCodingSequence ? "YES" : "NO");
+        } else if (seq->specialCodons[i].type == STOP)
+        {
+        	fprintf(output_stream, ERROR_COLOR "%s" RESET, codonTypeToString(seq->specialCodons[i].type));
+        	fprintf(output_stream, "\tPosition: %d,\tCodon: ", seq->specialCodons[i].positionInSequence);
+        	fprintf(output_stream, ERROR_COLOR "%s\n" RESET, seq->specialCodons[i].codonSequence);
 
-        for (int i = 0; i < (seq->length / CODONS_LENGTH); ++i)
+        } else
         {
-            fprintf(output_stream, "\t%d)\tType: ", i);
+        	fprintf(output_stream, "%s", codonTypeToString(seq->specialCodons[i].type));
+        	fprintf(output_stream, "\tPosition: %d,\tCodon: ", seq->specialCodons[i].positionInSequence);
+        	fprintf(output_stream, "%s\n", seq->specialCodons[i].codonSequence);
+        }
 
-            // Color coding for special codons
-            if (seq->specialCodons[i].type == START)
-            {
-            	fprintf(output_stream, SUCCESS_COLOR "%s" RESET, codonTypeToString(seq->specialCodons[i].type));
-            	fprintf(output_stream, "\tPosition: %d,\tCodon: ", seq->specialCodons[i].positionInSequence);
-            	fprintf(output_stream, SUCCESS_COLOR "%s\n" RESET, seq->specialCodons[i].codonSequence);
+    }
+}
 
-            } else if (seq->specialCodons[i].type == STOP)
-            {
-            	fprintf(output_stream, ERROR_COLOR "%s" RESET, codonTypeToString(seq->specialCodons[i].type));
-            	fprintf(output_stream, "\tPosition: %d,\tCodon: ", seq->specialCodons[i].positionInSequence);
-            	fprintf(output_stream, ERROR_COLOR "%s\n" RESET, seq->specialCodons[i].codonSequence);
+// Print the contents of the list
+void printList(FILE* output_stream, DoublyLinkedList* list)
+{
 
-            } else
-            {
-            	fprintf(output_stream, "%s", codonTypeToString(seq->specialCodons[i].type));
-            	fprintf(output_stream, "\tPosition: %d,\tCodon: ", seq->specialCodons[i].positionInSequence);
-            	fprintf(output_stream, "%s\n", seq->specialCodons[i].codonSequence);
-            }
+    ListNode* current = list->head;
 
-        }
+    while (current) {
+        printSequence(output_stream, current->data);
         if (current->next == NULL) break;
         current = current->next;
     }
@@ -351,7 +421,7 @@ void freeList(DoublyLinkedList* list)
     while (current)
     {
         ListNode* next = current->next;
-        free(current->data); // Free Sequence
+        free(current->data); // Free Sequence (codon strings included)
         free(current);       // Free node
         current = next;
     }
@@ -386,146 +456,419 @@ void mergeDoublyLinkedLists(DoublyLinkedList* list1, DoublyLinkedList* list2)
 }
 
 
-// **************************************  Archive functions  *****************************************************************
+// Parses "YYYY-MM-DD HH:MM:SS" (or just "YYYY-MM-DD") as local time. Returns 0 if the text isn't a date.
+time_t parseDatetime(const char* datetimeString)
+{
+    struct tm datetime = { 0 };
+    int numOfFields = sscanf(datetimeString, "%d-%d-%d %d:%d:%d", &datetime.tm_year, &datetime.tm_mon, &datetime.tm_mday,
+                             &datetime.tm_hour, &datetime.tm_min, &datetime.tm_sec);
+    if (numOfFields < 3) return 0;
+
+    datetime.tm_year -= 1900;
+    datetime.tm_mon -= 1;
+    datetime.tm_isdst = -1; // Let mktime figure out daylight saving time
+    return mktime(&datetime);
+}
+
+// **************************************  Arena allocator  *****************************************************************
+
+#define ARENA_BLOCK_SIZE (1 << 20) // 1 MB per block; bigger requests get a dedicated block
+#define ARENA_ALIGNMENT 16
 
-FILE* getArchiveFile(FILE* output_stream, const char* pathToFile, bool defaultFile, char* openMode)
+typedef struct ArenaBlock
 {
-	FILE* archiveFile = NULL;
+    struct ArenaBlock* next;
+    size_t capacity;
+    size_t used;
+    unsigned char data[];
+} ArenaBlock;
 
-	if (defaultFile)
-	{
-		archiveFile = fopen("./ARCHIVE_FILE.txt", openMode);
-	    if (archiveFile == NULL)
-	    {
-	    	fprintf(output_stream, ERROR_COLOR "Error creating archive file './ARCHIVE_FILE.txt' :\t%s\a\n" RESET, strerror(errno));
-	        return NULL;
-	    }
+// Bump allocator: every allocation is carved out of big blocks and everything is released at once
+typedef struct
+{
+    ArenaBlock* first;
+    ArenaBlock* current;
+    size_t blockSize;
+    size_t numOfAllocations;
+    size_t bytesRequested;
+    size_t bytesReserved;
+    int numOfBlocks;
+} Arena;
+
+ArenaBlock* createArenaBlock(size_t capacity)
+{
+    ArenaBlock* block = (ArenaBlock*) malloc(sizeof(ArenaBlock) + capacity);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+    block->next = NULL;
+    block->capacity = capacity;
+    block->used = 0;
+    return block;
+}
 
-	    return archiveFile;
-	}
+Arena* createArena(size_t blockSize)
+{
+    Arena* arena = (Arena*) malloc(sizeof(Arena));
+    if (arena == NULL)
+    {
+        return NULL;
+    }
+    arena->blockSize = blockSize;
+    arena->first = createArenaBlock(blockSize);
+    if (arena->first == NULL)
+    {
+        free(arena);
+        return NULL;
+    }
+    arena->current = arena->first;
+    arena->numOfAllocations = 0;
+    arena->bytesRequested = 0;
+    arena->bytesReserved = blockSize;
+    arena->numOfBlocks = 1;
+    return arena;
+}
 
-	archiveFile = fopen(pathToFile, "r"); // We first try to open it in read mode just to check if it exists, so that we can inform user accordingly
-	if (archiveFile == NULL)
-	{
-        // File does not exist, create it in append-read mode
-        fprintf(output_stream, ERROR_COLOR "File '%s' doesn't exist\a\n" RESET, pathToFile);
-        fprintf(output_stream, "Creating file '%s'...\n", pathToFile);
-
-        archiveFile = fopen(pathToFile, openMode);
-        if (archiveFile == NULL)
-        {
-        	fprintf(output_stream, ERROR_COLOR "Error creating archive file:\t%s\a\n" RESET, strerror(errno));
-        	fprintf(output_stream, "Trying to create default archive file './ARCHIVE_FILE.txt'...\n");
-        	archiveFile = fopen("./ARCHIVE_FILE.txt", openMode);
-		    if (archiveFile == NULL)
-		    {
-		    	fprintf(output_stream, ERROR_COLOR "Error creating archive file './ARCHIVE_FILE.txt' :\t%s\a\n" RESET, strerror(errno));
-		        return NULL;
-		    }
-        }
-    } else
+void* arenaAlloc(Arena* arena, size_t size)
+{
+    size_t alignedSize = (size + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+    ArenaBlock* block = arena->current;
+
+    while (block->used + alignedSize > block->capacity)
     {
-    	fclose(archiveFile);
-    	archiveFile = fopen(pathToFile, openMode);
-        if (archiveFile == NULL)
-        {
-        	fprintf(output_stream, ERROR_COLOR "Error opening archive file:\t%s\a\n" RESET, strerror(errno));
-            fprintf(output_stream, "Trying to use default archive file './ARCHIVE_FILE.txt' instead...\n");
-        	archiveFile = fopen("./ARCHIVE_FILE.txt", openMode);
-		    if (archiveFile == NULL)
-		    {
-		    	fprintf(output_stream, ERROR_COLOR "Error creating/opening archive file './ARCHIVE_FILE.txt' :\t%s\a\n" RESET, strerror(errno));
-		        return NULL;
-		    }
+        if (block->next == NULL) // No spare block left from a previous reset, so we chain a new one
+        {
+            size_t capacity = alignedSize > arena->blockSize ? alignedSize : arena->blockSize;
+            ArenaBlock* newBlock = createArenaBlock(capacity);
+            if (newBlock == NULL)
+            {
+                return NULL;
+            }
+            block->next = newBlock;
+            arena->bytesReserved += capacity;
+            arena->numOfBlocks++;
         }
+        block = block->next;
+        block->used = 0; // Blocks after 'current' may still hold data from before the last reset
+        arena->current = block;
     }
 
-    return archiveFile; 
+    void* memory = block->data + block->used;
+    block->used += alignedSize;
+    arena->numOfAllocations++;
+    arena->bytesRequested += size;
+    return memory;
 }
 
-char* serializeListToJson(DoublyLinkedList *list) {
-    cJSON* jsonList = cJSON_CreateArray();
+void freeArena(Arena* arena)
+{
+    if (arena == NULL) return;
 
-    ListNode* current = list->head;
-    while (current) {
-        Sequence* seq = current->data;
+    ArenaBlock* block = arena->first;
+    while (block)
+    {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+// Releases everything allocated so far in O(1): blocks are kept and reused by the next allocations
+void resetArena(Arena* arena)
+{
+    arena->current = arena->first;
+    arena->first->used = 0;
+    arena->numOfAllocations = 0;
+    arena->bytesRequested = 0;
+}
+
+void printArenaStats(FILE* output_stream, const char* label, Arena* arena)
+{
+    fprintf(output_stream, DIM "%s: %zu allocations, %.1f KB requested, %.1f KB reserved in %d block(s)\n" RESET,
+            label, arena->numOfAllocations, arena->bytesRequested / 1024.0, arena->bytesReserved / 1024.0, arena->numOfBlocks);
+}
+
+// cJSON only knows about malloc/free-like hooks, so the arena in use is kept here while a parse/print is running.
+// Thread-local, so that shards can be parsed in parallel, each thread into its own arena.
+static _Thread_local Arena* activeJsonArena = NULL;
+
+static void* jsonArenaMalloc(size_t size)
+{
+    if (activeJsonArena == NULL) // No arena in this thread: behave like plain malloc
+    {
+        return malloc(size);
+    }
+    return arenaAlloc(activeJsonArena, size);
+}
+
+static void jsonArenaFree(void* pointer)
+{
+    if (activeJsonArena == NULL)
+    {
+        free(pointer);
+    }
+    // Otherwise nothing to do, memory goes away together with the arena
+}
+
+// Installed once at start-up; from then on each thread chooses its own arena with beginJsonArena()
+void installJsonArenaHooks()
+{
+    cJSON_Hooks hooks = { jsonArenaMalloc, jsonArenaFree };
+    cJSON_InitHooks(&hooks);
+}
+
+// Routes every cJSON allocation of the calling thread to 'arena' until endJsonArena() is called
+void beginJsonArena(Arena* arena)
+{
+    activeJsonArena = arena;
+}
+
+void endJsonArena()
+{
+    activeJsonArena = NULL; // Back to plain malloc/free
+}
+
+// **************************************  Archive functions  *****************************************************************
+
+cJSON* sequenceToJson(Sequence* seq)
+{
+    char hashString[16+1];
+    snprintf(hashString, sizeof(hashString), "%016" PRIx64, seq->sequenceHash); // As text, since JSON numbers can't hold 64 bits
+
+    cJSON* jsonSeq = cJSON_CreateObject();
+    cJSON_AddNumberToObject(jsonSeq, "length", seq->length);
+    cJSON_AddStringToObject(jsonSeq, "direction", readDirectionToString(seq->seqDirection));
+    cJSON_AddNumberToObject(jsonSeq, "positionInSupersequence", seq->positionInSupersequence);
+    cJSON_AddBoolToObject(jsonSeq, "isCodingSequence", seq->isCodingSequence);
+    cJSON_AddStringToObject(jsonSeq, "sequenceHash", hashString);
+    if (seq->analysisTime != 0)
+    {
+        char datetimeString[20+1];
+        strftime(datetimeString, sizeof(datetimeString), "%Y-%m-%d %H:%M:%S", localtime(&seq->analysisTime));
+        cJSON_AddStringToObject(jsonSeq, "analysisDatetime", datetimeString);
+    }
+
+    cJSON* jsonCodons = cJSON_CreateArray();
+    for (int i = 0; i < seq->length/CODONS_LENGTH; i++)
+    {
+        SpecialSubsequence* codon = &seq->specialCodons[i];
+        cJSON* jsonCodon = cJSON_CreateObject();
+        cJSON_AddStringToObject(jsonCodon, "type", codonTypeToString(codon->type));
+        cJSON_AddStringToObject(jsonCodon, "codonSequence", codon->codonSequence);
+        cJSON_AddNumberToObject(jsonCodon, "positionInSequence", codon->positionInSequence);
+        cJSON_AddItemToArray(jsonCodons, jsonCodon);
+    }
+
+    cJSON_AddItemToObject(jsonSeq, "sequenceCodons", jsonCodons);
+    return jsonSeq;
+}
+
+Sequence* jsonToSequence(cJSON* jsonSeq)
+{
+    int length = cJSON_GetObjectItem(jsonSeq, "length")->valueint;
+    char* directionStr = cJSON_GetObjectItem(jsonSeq, "direction")->valuestring;
+    int position = cJSON_GetObjectItem(jsonSeq, "positionInSupersequence")->valueint;
+    bool isCodingSequence = cJSON_GetObjectItem(jsonSeq, "isCodingSequence")->valueint;
+    cJSON* jsonHash = cJSON_GetObjectItem(jsonSeq, "sequenceHash"); // Missing from archives written by older versions
+    cJSON* jsonDatetime = cJSON_GetObjectItem(jsonSeq, "analysisDatetime"); // Same
+
+    direction seqDirection = stringToReadDirection(directionStr);
+    cJSON* jsonCodons = cJSON_GetObjectItem(jsonSeq, "sequenceCodons");
+    int codonsCount = cJSON_GetArraySize(jsonCodons);
+
+    Sequence* seq = createSequence(length, seqDirection, position, isCodingSequence, codonsCount);
+    if (cJSON_IsString(jsonHash))
+    {
+        seq->sequenceHash = strtoull(jsonHash->valuestring, NULL, 16);
+    }
+    if (cJSON_IsString(jsonDatetime))
+    {
+        seq->analysisTime = parseDatetime(jsonDatetime->valuestring);
+    }
+
+    int i = 0;
+    cJSON* jsonCodon;
+    cJSON_ArrayForEach(jsonCodon, jsonCodons)
+    {
+        char* typeStr = cJSON_GetObjectItem(jsonCodon, "type")->valuestring;
+        char* codonSequence = cJSON_GetObjectItem(jsonCodon, "codonSequence")->valuestring;
+        int codonPosition = cJSON_GetObjectItem(jsonCodon, "positionInSequence")->valueint;
+
+        seq->specialCodons[i].type = stringToCodonType(typeStr);
+        strncpy(seq->specialCodons[i].codonSequence, codonSequence, CODONS_LENGTH);
+        seq->specialCodons[i].positionInSequence = codonPosition;
+        i++;
+    }
 
-        cJSON* jsonSeq = cJSON_CreateObject();
-        cJSON_AddNumberToObject(jsonSeq, "length", seq->length);
-        cJSON_AddStringToObject(jsonSeq, "direction", readDirectionToString(seq->seqDirection));
-        cJSON_AddNumberToObject(jsonSeq, "positionInSupersequence", seq->positionInSupersequence);
-        cJSON_AddBoolToObject(jsonSeq, "isCodingSequence", seq->isCodingSequence);
+    return seq;
+}
 
-        cJSON* jsonCodons = cJSON_CreateArray();
-        for (int i = 0; i < seq->length/CODONS_LENGTH; i++)
+// Whether 'jsonSeq' has every field jsonToSequence() reads, of the right type, and a codon for every 3 bases. Records
+// of files that may be damaged (e.g. the journal, after a crash) are checked with it first
+bool jsonIsValidSequence(cJSON* jsonSeq)
+{
+    cJSON* jsonLength = cJSON_GetObjectItem(jsonSeq, "length");
+    cJSON* jsonDirection = cJSON_GetObjectItem(jsonSeq, "direction");
+    cJSON* jsonCodons = cJSON_GetObjectItem(jsonSeq, "sequenceCodons");
+    if (!cJSON_IsNumber(jsonLength) || jsonLength->valueint < 0 || !cJSON_IsString(jsonDirection)
+        || (int) stringToReadDirection(jsonDirection->valuestring) < 0
+        || !cJSON_IsNumber(cJSON_GetObjectItem(jsonSeq, "positionInSupersequence"))
+        || !cJSON_IsBool(cJSON_GetObjectItem(jsonSeq, "isCodingSequence"))
+        || !cJSON_IsArray(jsonCodons) || cJSON_GetArraySize(jsonCodons) != jsonLength->valueint / CODONS_LENGTH)
+    {
+        return FALSE;
+    }
+    cJSON* jsonCodon;
+    cJSON_ArrayForEach(jsonCodon, jsonCodons)
+    {
+        cJSON* jsonType = cJSON_GetObjectItem(jsonCodon, "type");
+        if (!cJSON_IsString(jsonType) || (int) stringToCodonType(jsonType->valuestring) < 0
+            || !cJSON_IsString(cJSON_GetObjectItem(jsonCodon, "codonSequence"))
+            || !cJSON_IsNumber(cJSON_GetObjectItem(jsonCodon, "positionInSequence")))
         {
-            SpecialSubsequence* codon = &seq->specialCodons[i];
-            cJSON* jsonCodon = cJSON_CreateObject();
-            cJSON_AddStringToObject(jsonCodon, "type", codonTypeToString(codon->type));
-            cJSON_AddStringToObject(jsonCodon, "codonSequence", codon->codonSequence);
-            cJSON_AddNumberToObject(jsonCodon, "positionInSequence", codon->positionInSequence);
-            cJSON_AddItemToArray(jsonCodons, jsonCodon);
+            return FALSE;
         }
+    }
+    return TRUE;
+}
 
-        cJSON_AddItemToObject(jsonSeq, "sequenceCodons", jsonCodons);
-        cJSON_AddItemToArray(jsonList, jsonSeq);
+// Array of the records from 'firstNode' up to the end of its list
+cJSON* nodesToJsonArray(ListNode* firstNode)
+{
+    cJSON* jsonList = cJSON_CreateArray();
 
+    ListNode* current = firstNode;
+    while (current) {
+        cJSON_AddItemToArray(jsonList, sequenceToJson(current->data));
         current = current->next;
     }
 
-    char *jsonString = cJSON_Print(jsonList);
-    cJSON_Delete(jsonList);
+    return jsonList;
+}
+
+cJSON* listToJsonArray(DoublyLinkedList* list)
+{
+    return nodesToJsonArray(list->head);
+}
+
+DoublyLinkedList* jsonArrayToList(cJSON* jsonList)
+{
+    DoublyLinkedList* list = createList();
+
+    cJSON* jsonSeq;
+    cJSON_ArrayForEach(jsonSeq, jsonList)
+    {
+        appendToList(list, jsonToSequence(jsonSeq));
+    }
+
+    return list;
+}
+
+// Copies text printed by cJSON out of the (arena) memory it was printed in
+char* copyPrintedJson(char* printedJSON)
+{
+    if (printedJSON == NULL) return NULL;
+
+    size_t jsonLength = strlen(printedJSON);
+    char* jsonString = (char*) malloc(jsonLength + 1);
+    if (jsonString != NULL)
+    {
+        memcpy(jsonString, printedJSON, jsonLength + 1);
+    }
     return jsonString;
 }
 
 DoublyLinkedList* deserializeJsonToList(FILE* output_stream, char *jsonString)
 {
+    Arena* jsonArena = createArena(ARENA_BLOCK_SIZE);
+    if (jsonArena == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for parsing the history.\n%s\a\n" RESET, strerror(errno));
+        return NULL;
+    }
+    beginJsonArena(jsonArena);
+
     cJSON* jsonList = cJSON_Parse(jsonString);
     if (!jsonList)
     {
         fprintf(output_stream, ERROR_COLOR "Error parsing JSON.\n%s\a\n" RESET, strerror(errno));
+        endJsonArena();
+        freeArena(jsonArena);
         return NULL;
     }
 
-    DoublyLinkedList* list = createList();
+    DoublyLinkedList* list = jsonArrayToList(jsonList);
 
-    cJSON* jsonSeq;
-    cJSON_ArrayForEach(jsonSeq, jsonList)
-    {
-        int length = cJSON_GetObjectItem(jsonSeq, "length")->valueint;
-        char* directionStr = cJSON_GetObjectItem(jsonSeq, "direction")->valuestring;
-        int position = cJSON_GetObjectItem(jsonSeq, "positionInSupersequence")->valueint;
-        bool isCodingSequence = cJSON_GetObjectItem(jsonSeq, "isCodingSequence")->valueint;
+    // Strings were copied into the list above, so the parsed tree can go away in one shot with the arena
+    endJsonArena();
+    printArenaStats(output_stream, "JSON parsing arena", jsonArena);
+    freeArena(jsonArena);
+    return list;
+}
 
-        direction seqDirection = stringToReadDirection(directionStr);
-        cJSON* jsonCodons = cJSON_GetObjectItem(jsonSeq, "sequenceCodons");
-        int codonsCount = cJSON_GetArraySize(jsonCodons);
+#define ATOMIC_WRITE_TMP_SUFFIX ".tmp"
 
-        Sequence* seq = createSequence(length, seqDirection, position, isCodingSequence, codonsCount);
+long getFileSize(const char* path)
+{
+    struct stat fileInfo;
+    if (stat(path, &fileInfo) != 0) return 0;
+    return (long) fileInfo.st_size;
+}
 
-        for (int i = 0; i < codonsCount; i++)
-        {
-            cJSON* jsonCodon = cJSON_GetArrayItem(jsonCodons, i);
-            char* typeStr = cJSON_GetObjectItem(jsonCodon, "type")->valuestring;
-            char* codonSequence = cJSON_GetObjectItem(jsonCodon, "codonSequence")->valuestring;
-            int codonPosition = cJSON_GetObjectItem(jsonCodon, "positionInSequence")->valueint;
+// Flushes both the stdio and the OS buffers of a file, so that its contents survive a crash, and closes it
+bool syncAndCloseFile(FILE* file)
+{
+    bool isSynced = (fflush(file) == 0) && (fsync(fileno(file)) == 0);
+    return (fclose(file) == 0) && isSynced;
+}
 
-            seq->specialCodons[i].type = stringToCodonType(typeStr);
-            strncpy(seq->specialCodons[i].codonSequence, codonSequence, CODONS_LENGTH);
-            seq->specialCodons[i].positionInSequence = codonPosition;
-        }
+// After a rename, the directory entry must reach the disk too, otherwise the old file may come back after a crash
+void syncParentDirectory(const char* path)
+{
+    char* pathCopy = strdup(path);
+    if (pathCopy == NULL) return;
 
-        appendToList(list, seq);
+    int directoryDescriptor = open(dirname(pathCopy), O_RDONLY);
+    if (directoryDescriptor >= 0)
+    {
+        fsync(directoryDescriptor);
+        close(directoryDescriptor);
     }
-
-    cJSON_Delete(jsonList);
-    return list;
+    free(pathCopy);
 }
 
-int saveJsonToFile(FILE* file, char* jsonString)
+// Writes into a temporary file that then replaces 'path' with a rename, so a crash leaves either the old or the new file, never half of one
+int saveJsonToFileAtomically(FILE* output_stream, const char* path, const char* jsonString)
 {
-    fprintf(file, "%s", jsonString);
-    fclose(file);
+    if (jsonString == NULL) return 0;
+
+    char* tmpPath = (char*) malloc(strlen(path) + strlen(ATOMIC_WRITE_TMP_SUFFIX) + 1);
+    if (tmpPath == NULL) return 0;
+    strcpy(tmpPath, path);
+    strcat(tmpPath, ATOMIC_WRITE_TMP_SUFFIX);
+
+    FILE* tmpFile = fopen(tmpPath, "w");
+    if (tmpFile == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't create temporary file '%s':\t%s\a\n" RESET, tmpPath, strerror(errno));
+        free(tmpPath);
+        return 0;
+    }
+
+    bool isWritten = fputs(jsonString, tmpFile) != EOF;
+    isWritten = syncAndCloseFile(tmpFile) && isWritten;
+    if (!isWritten || rename(tmpPath, path) != 0)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't write '%s':\t%s\a\n" RESET, path, strerror(errno));
+        remove(tmpPath);
+        free(tmpPath);
+        return 0;
+    }
+    syncParentDirectory(path);
+
+    free(tmpPath);
     return 1; // Indicate success
 }
 
@@ -553,12 +896,22 @@ char* readJsonFromFile(FILE* output_stream, FILE* file)
     return jsonString;
 }
 
+// Files that go with the archive sit next to it, e.g. ARCHIVE_FILE.txt -> ARCHIVE_FILE.txt.cache
+char* getSidecarPath(const char* archivePath, const char* suffix)
+{
+    char* sidecarPath = (char*) malloc(strlen(archivePath) + strlen(suffix) + 1);
+    if (sidecarPath == NULL) return NULL;
+
+    strcpy(sidecarPath, archivePath);
+    strcat(sidecarPath, suffix);
+    return sidecarPath;
+}
+
 // **************************************  Generic, utility functions  *****************************************************************
 
 void toUpperCase(char *str)
 {
-	setlocale(LC_ALL, "C");
-
+    // The program never leaves the "C" locale it starts in, so it isn't set here on every call
     while (*str)
     {
         *str = toupper(*str);  // Convert each character to uppercase
@@ -592,7 +945,7 @@ bool has_valid_chars(char* sequence, int seqLength, char** validChars, int numOf
 	return TRUE;
 }
 
-char* reverseString(FILE* output_stream, char* str, int strLength)
+char* reverseString(FILE* output_stream, Arena* arena, char* str, int strLength)
 {
 
     if (str == NULL)
@@ -600,7 +953,7 @@ char* reverseString(FILE* output_stream, char* str, int strLength)
         return NULL;
     }
 
-    char* reversed = (char*) malloc((strLength + 1) * sizeof(char));
+    char* reversed = (char*) arenaAlloc(arena, (strLength + 1) * sizeof(char));
 
     if (reversed == NULL)
     {
@@ -617,6 +970,49 @@ char* reverseString(FILE* output_stream, char* str, int strLength)
     return reversed;
 }
 
+// 64-bit hash of a sequence (xxHash64-style mixing over 8-byte words), used to recognise sequences analyzed before
+#define HASH_PRIME_1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME_3 0x165667B19E3779F9ULL
+#define HASH_PRIME_4 0x85EBCA77C2B2AE63ULL
+#define HASH_PRIME_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotateLeft64(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t hashSequence64(const char* sequence, size_t sequenceLength)
+{
+    uint64_t hash = HASH_PRIME_5 + (uint64_t) sequenceLength;
+    size_t i = 0;
+
+    for (; i + 8 <= sequenceLength; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, sequence + i, sizeof(word));
+        word *= HASH_PRIME_2;
+        word = rotateLeft64(word, 31);
+        word *= HASH_PRIME_1;
+        hash ^= word;
+        hash = rotateLeft64(hash, 27) * HASH_PRIME_1 + HASH_PRIME_4;
+    }
+
+    for (; i < sequenceLength; i++) // Remaining (less than 8) bytes
+    {
+        hash ^= ((unsigned char) sequence[i]) * HASH_PRIME_5;
+        hash = rotateLeft64(hash, 11) * HASH_PRIME_1;
+    }
+
+    // Final avalanche, so that every input bit affects every output bit
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME_2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
 char* getCurrentDatetime() {
 	time_t now = time(NULL);
 	int dateStringSize = 20+1;
@@ -628,6 +1024,11 @@ char* getCurrentDatetime() {
     return time_buffer;
 }
 
+double millisecondsBetween(struct timespec* from, struct timespec* to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000.0 + (to->tv_nsec - from->tv_nsec) / 1000000.0;
+}
+
 void debugListStructure(DoublyLinkedList* list) {
     ListNode* current = list->head;
     while (current) {
@@ -636,232 +1037,8066 @@ void debugListStructure(DoublyLinkedList* list) {
     }
 }
 
-// ****************************************************  Sequencing-related functions  ***************************************************
+// **************************************  Packed ORF records  *****************************************************************
 
-int is_start_codon(char* codon) {
+// Compact form of a Sequence, for ORFs kept in memory: a 12-byte header, then one byte per codon (2 bits of type,
+// 6 bits of codon index among the 64 A/C/G/U triplets). Codon positions are not stored: codon i sits at
+// firstCodonPosition + i*CODONS_LENGTH (minus for reverse ORFs), and positionInSupersequence is the position of the
+// last START codon, exactly as the scanner sets them. Sequence hash and analysis time are the same for all ORFs of
+// one analysis, so they are kept once per analysis by the owner of the records (analysisIndex).
+#define PACKED_ORF_REVERSE 0x01
+#define PACKED_ORF_CODING_SHIFT 1   // 2 bits: isCodingSequence + 1 (it can be UNDEFINED)
+#define PACKED_ORF_UNPACKED 0x08    // Doesn't fit the packed form (e.g. hand-edited archive), kept as a whole Sequence
 
-	for (int i = 0; i < NUM_OF_START_CODONS; ++i)
-	{
-		if ( strncmp(codon, START_CODONS[i], CODONS_LENGTH) == 0 )
-		{
-			return i;
-		}
-	}
-	return -1;
+typedef struct
+{
+    int32_t firstCodonPosition;
+    uint32_t numOfCodons;           // For PACKED_ORF_UNPACKED records: index of the whole Sequence in its owner's list
+    uint16_t analysisIndex;
+    uint8_t flags;
+    uint8_t reserved;
+} PackedOrfHeader;
+
+// Index (0-63) of a codon among all A/C/G/U triplets, -1 if it has any other character
+// Code of each base plus one (0 for anything else), so the table is filled at compile time
+static const unsigned char BASE_CODES_PLUS_ONE[256] = { ['A'] = 1, ['C'] = 2, ['G'] = 3, ['U'] = 4 };
+
+int codonToIndex(const char* codon)
+{
+    int first = BASE_CODES_PLUS_ONE[(unsigned char) codon[0]];
+    int second = BASE_CODES_PLUS_ONE[(unsigned char) codon[1]];
+    int third = BASE_CODES_PLUS_ONE[(unsigned char) codon[2]];
+    if (first == 0 || second == 0 || third == 0) return -1;
+    return ((first - 1) << 4) | ((second - 1) << 2) | (third - 1);
 }
 
-int is_stop_codon(char* codon) {
+void indexToCodon(int index, char* codon)
+{
+    static const char bases[] = "ACGU";
+    for (int i = CODONS_LENGTH - 1; i >= 0; i--)
+    {
+        codon[i] = bases[index & 3];
+        index >>= 2;
+    }
+    codon[CODONS_LENGTH] = '\0';
+}
 
-	for (int i = 0; i < NUM_OF_STOP_CODONS; ++i)
-	{
-		if ( strncmp(codon, STOP_CODONS[i], CODONS_LENGTH) == 0 )
-		{
-			return i;
-		}
-	}
-	return -1;
+// Reading position of codon slot k (bases 3k..3k+2, 0-based), as tokenize_seq() gives it (1-based): the first
+// base on the forward strand, the last one on the reverse, which reads the bases backwards
+int getSlotPosition(int slot, direction strand)
+{
+    return slot * CODONS_LENGTH + ((strand == FORWARD) ? 1 : CODONS_LENGTH);
 }
 
-Sequence** tokenize_seq(FILE* output_stream, int numOfRuns, char* sequence, int sequenceLength) { 
-	
-	toUpperCase(sequence); // convert to upper case for uniformity and easier processing
+int getSlotOfPosition(int position, direction strand)
+{
+    return (position - ((strand == FORWARD) ? 1 : CODONS_LENGTH)) / CODONS_LENGTH;
+}
 
-	Sequence** givenAndReversedSeq = malloc(2 * sizeof(Sequence*));
-	if (givenAndReversedSeq == NULL) {
-	    fprintf(output_stream, ERROR_COLOR "Memory allocation failed. Couldn't store sequence.\n%s\a\n" RESET, strerror(errno));
-	    exit(EXIT_FAILURE);
-	}
+int getCodonStep(direction seqDirection)
+{
+    return (seqDirection == FORWARD) ? CODONS_LENGTH : -CODONS_LENGTH;
+}
 
-	int numOfCodons = sequenceLength/CODONS_LENGTH;
-	Sequence* forwardSequence = createSequence(sequenceLength, FORWARD, 0, UNDEFINED, numOfCodons);
-    Sequence* backwardSequence = createSequence(sequenceLength, REVERSE, 0, UNDEFINED, numOfCodons);
+// Position of the last START codon: where the scanner puts positionInSupersequence
+int getLastStartPosition(Sequence* seq)
+{
+    for (int i = seq->length / CODONS_LENGTH - 1; i >= 0; i--)
+    {
+        if (seq->specialCodons[i].type == START) return seq->specialCodons[i].positionInSequence;
+    }
+    return seq->positionInSupersequence;
+}
 
-	for (int seqIndex = 0; seqIndex < sequenceLength; /*seqIndex + CODONS_LENGTH, but it's done at the last step of each iteration */ )
+size_t getPackedOrfSize(int numOfCodons)
+{
+    return sizeof(PackedOrfHeader) + numOfCodons;
+}
+
+// Writes 'seq' to 'packed' (of getPackedOrfSize(length/CODONS_LENGTH) bytes). Returns FALSE, with 'packed' left
+// half-written, if 'seq' doesn't fit the packed form: a codon that isn't A/C/G/U, positions that don't follow
+// one another, or a positionInSupersequence other than the scanner's
+bool packSequence(Sequence* seq, uint16_t analysisIndex, unsigned char* packed)
+{
+    int numOfCodons = seq->length / CODONS_LENGTH;
+    if (seq->length % CODONS_LENGTH != 0 || numOfCodons == 0) return FALSE;
+    if (getLastStartPosition(seq) != seq->positionInSupersequence) return FALSE;
+
+    int step = getCodonStep(seq->seqDirection);
+    for (int i = 0; i < numOfCodons; i++)
+    {
+        SpecialSubsequence* codon = &seq->specialCodons[i];
+        int codonIndex = codonToIndex(codon->codonSequence);
+        if (codonIndex < 0 || codon->type < START || codon->type > PLAIN) return FALSE;
+        if (i > 0 && codon->positionInSequence != seq->specialCodons[i-1].positionInSequence + step) return FALSE;
+        packed[sizeof(PackedOrfHeader) + i] = (unsigned char) ((codon->type << 6) | codonIndex);
+    }
+
+    PackedOrfHeader header = { 0 };
+    header.firstCodonPosition = seq->specialCodons[0].positionInSequence;
+    header.numOfCodons = numOfCodons;
+    header.analysisIndex = analysisIndex;
+    header.flags = ((seq->seqDirection == REVERSE) ? PACKED_ORF_REVERSE : 0) | (((seq->isCodingSequence + 1) & 3) << PACKED_ORF_CODING_SHIFT);
+    memcpy(packed, &header, sizeof(header)); // Records are byte-aligned, so the header is copied rather than cast
+    return TRUE;
+}
+
+PackedOrfHeader getPackedOrfHeader(const unsigned char* packed)
+{
+    PackedOrfHeader header;
+    memcpy(&header, packed, sizeof(header));
+    return header;
+}
+
+// Codon 'codonIndex' of a packed record, as text (at least CODONS_LENGTH+1 chars) and type
+specialCodonType getPackedCodon(const unsigned char* packed, int codonIndex, char* codon)
+{
+    unsigned char codonByte = packed[sizeof(PackedOrfHeader) + codonIndex];
+    if (codon != NULL) indexToCodon(codonByte & 0x3F, codon);
+    return (specialCodonType) (codonByte >> 6);
+}
+
+// Back to a (malloc'ed) Sequence
+Sequence* unpackSequence(const unsigned char* packed, uint64_t sequenceHash, time_t analysisTime)
+{
+    PackedOrfHeader header = getPackedOrfHeader(packed);
+    direction seqDirection = (header.flags & PACKED_ORF_REVERSE) ? REVERSE : FORWARD;
+    bool isCodingSequence = ((header.flags >> PACKED_ORF_CODING_SHIFT) & 3) - 1;
+    int step = getCodonStep(seqDirection);
+
+    Sequence* seq = createSequence(header.numOfCodons * CODONS_LENGTH, seqDirection, 0, isCodingSequence, header.numOfCodons);
+    seq->sequenceHash = sequenceHash;
+    seq->analysisTime = analysisTime;
+    for (uint32_t i = 0; i < header.numOfCodons; i++)
+    {
+        seq->specialCodons[i].type = getPackedCodon(packed, i, seq->specialCodons[i].codonSequence);
+        seq->specialCodons[i].positionInSequence = header.firstCodonPosition + (int) i * step;
+    }
+    seq->positionInSupersequence = getLastStartPosition(seq);
+    return seq;
+}
+
+
+
+// **************************************  Sequence normalization functions  *****************************************************************
+
+// Sequences may be typed in as DNA, in either case, and with N or the other IUPAC ambiguity codes. normalizeSequence()
+// turns them into the RNA, upper case form the scanners read, checks them, counts what it found by class and packs the
+// bases 2 bits each, all in one pass (AVX2, when the CPU has it, for blocks of plain bases). Codes are kept as they
+// are: a codon with one of them is no codon index (see codonToIndex()), so it's neither START nor STOP
+typedef enum
+{
+    BASE_CLASS_INVALID,         // 0, so that anything not in the tables is invalid
+    BASE_CLASS_BASE,            // A, C, G, U
+    BASE_CLASS_THYMINE,         // T, read as U
+    BASE_CLASS_UNKNOWN,         // N
+    BASE_CLASS_AMBIGUOUS,       // R, Y, S, W, K, M, B, D, H, V
+    NUM_OF_BASE_CLASSES
+} baseClass;
+#define BASE_CLASS_LOWER_CASE 8 // Added to the class of a lower case letter
+
+#define BASE_CLASS_OF(upper, class) [upper] = class, [(upper) + ('a' - 'A')] = (class) | BASE_CLASS_LOWER_CASE
+static const unsigned char BASE_CLASSES[256] = {
+    BASE_CLASS_OF('A', BASE_CLASS_BASE), BASE_CLASS_OF('C', BASE_CLASS_BASE), BASE_CLASS_OF('G', BASE_CLASS_BASE),
+    BASE_CLASS_OF('U', BASE_CLASS_BASE), BASE_CLASS_OF('T', BASE_CLASS_THYMINE), BASE_CLASS_OF('N', BASE_CLASS_UNKNOWN),
+    BASE_CLASS_OF('R', BASE_CLASS_AMBIGUOUS), BASE_CLASS_OF('Y', BASE_CLASS_AMBIGUOUS), BASE_CLASS_OF('S', BASE_CLASS_AMBIGUOUS),
+    BASE_CLASS_OF('W', BASE_CLASS_AMBIGUOUS), BASE_CLASS_OF('K', BASE_CLASS_AMBIGUOUS), BASE_CLASS_OF('M', BASE_CLASS_AMBIGUOUS),
+    BASE_CLASS_OF('B', BASE_CLASS_AMBIGUOUS), BASE_CLASS_OF('D', BASE_CLASS_AMBIGUOUS), BASE_CLASS_OF('H', BASE_CLASS_AMBIGUOUS),
+    BASE_CLASS_OF('V', BASE_CLASS_AMBIGUOUS)
+};
+
+// Bits that turn each character into its normalized form when XOR'ed in: the case bit of lower case letters, and the
+// one between T and U. 0 for the rest, which stay as they are
+#define CASE_FLIP_OF(upper, flip) [upper] = flip, [(upper) + ('a' - 'A')] = (flip) ^ ('a' ^ 'A')
+static const unsigned char NORMALIZING_FLIPS[256] = {
+    CASE_FLIP_OF('A', 0), CASE_FLIP_OF('C', 0), CASE_FLIP_OF('G', 0), CASE_FLIP_OF('U', 0), CASE_FLIP_OF('T', 'T' ^ 'U'),
+    CASE_FLIP_OF('N', 0), CASE_FLIP_OF('R', 0), CASE_FLIP_OF('Y', 0), CASE_FLIP_OF('S', 0), CASE_FLIP_OF('W', 0),
+    CASE_FLIP_OF('K', 0), CASE_FLIP_OF('M', 0), CASE_FLIP_OF('B', 0), CASE_FLIP_OF('D', 0), CASE_FLIP_OF('H', 0),
+    CASE_FLIP_OF('V', 0)
+};
+
+// 2-bit code of every base (see codonToIndex()) for the packed form, by the character as typed; codes for more than
+// one base, and anything else, are packed as A, so packed codons are only read if there are none (see the stats)
+#define PACKING_CODE_OF(upper, code) [upper] = code, [(upper) + ('a' - 'A')] = code
+static const unsigned char PACKING_CODES[256] = {
+    PACKING_CODE_OF('A', 0), PACKING_CODE_OF('C', 1), PACKING_CODE_OF('G', 2), PACKING_CODE_OF('U', 3), PACKING_CODE_OF('T', 3)
+};
+
+// Packed form: 4 bases per byte, the first in the top 2 bits, so a codon's index can be read straight out of it
+#define PACKED_BASES_PER_BYTE 4
+
+// Bytes to allocate for the packed form of 'length' bases, with one to spare for getPackedCodonIndex()
+int getPackedSize(int length)
+{
+    return (length + PACKED_BASES_PER_BYTE - 1) / PACKED_BASES_PER_BYTE + 1;
+}
+
+// Soft mask: one bit per base (the lowest bit of a byte for its first base), set for those typed in lower case, which
+// assemblies use to mark repeats. It's recorded alongside the normalization, as the case itself is normalized away
+int getSoftMaskSize(int length)
+{
+    return (length + 7) / 8 + sizeof(uint32_t); // With room for a 32-bit store at the end of the last block
+}
+
+// Whether any base from 'firstBase' to 'lastBase' (0-based) is soft-masked
+bool isSoftMasked(const uint8_t* softMask, int firstBase, int lastBase)
+{
+    for (int base = firstBase; base <= lastBase; )
+    {
+        if (base % 8 == 0 && base + 7 <= lastBase) // Whole bytes at a time
+        {
+            if (softMask[base / 8] != 0) return TRUE;
+            base += 8;
+        } else
+        {
+            if (softMask[base / 8] & (1 << (base % 8))) return TRUE;
+            base++;
+        }
+    }
+    return FALSE;
+}
+
+// What's done with ORFs that overlap soft-masked bases (option --soft-mask)
+typedef enum
+{
+    SOFT_MASK_IGNORED,          // Lower case is read like upper case
+    SOFT_MASK_FLAGGED,          // They're listed as such
+    SOFT_MASK_SKIPPED           // They're left out of the results
+} softMaskMode;
+
+// An ORF spans from its first codon's base on, downwards for the reverse strand (see find_all_sequences())
+bool isOrfSoftMasked(const uint8_t* softMask, Sequence* orf)
+{
+    int first = orf->specialCodons[0].positionInSequence - 1; // Forward: the codon's first base; reverse: its last
+    return (orf->seqDirection == FORWARD) ? isSoftMasked(softMask, first, first + orf->length - 1)
+                                          : isSoftMasked(softMask, first - orf->length + 1, first);
+}
+
+// ORFs (numbered as listed) with soft-masked bases
+void printSoftMaskedOrfs(FILE* output_stream, DoublyLinkedList* orfs, const uint8_t* softMask)
+{
+    int i = 0, numOfMasked = 0;
+    for (ListNode* current = orfs->head; current != NULL; current = current->next)
+    {
+        i++;
+        if (!isOrfSoftMasked(softMask, current->data)) continue;
+        fprintf(output_stream, (numOfMasked++ == 0) ? DIM "ORF(s) overlapping soft-masked (lower case) bases: %d" : ", %d", i);
+    }
+    if (numOfMasked > 0) fprintf(output_stream, " (%d of %d).\n" RESET, numOfMasked, orfs->size);
+}
+
+// Same as codonToIndex() of the codon that starts at 'base'
+static inline int getPackedCodonIndex(const uint8_t* packedBases, int base)
+{
+    int word = (packedBases[base / PACKED_BASES_PER_BYTE] << 8) | packedBases[base / PACKED_BASES_PER_BYTE + 1];
+    return (word >> (10 - 2 * (base % PACKED_BASES_PER_BYTE))) & 0x3F; // 6 bits: 3 bases
+}
+
+typedef struct
+{
+    long numOfChars[NUM_OF_BASE_CLASSES];   // By class, whatever the case
+    long numOfLowerCase;
+    long numOfAmbiguousCodons;              // Codons of any frame with an N or other code
+    int firstInvalid;                       // Position (0-based) of the first character that stands for no base, -1 if none
+} NormalizationStats;
+
+// What the kernels count as they go
+typedef struct
+{
+    long ofClass[2 * BASE_CLASS_LOWER_CASE]; // By class, lower case apart (see BASE_CLASSES)
+    long numOfAmbiguousCodons;              // Codons (by their first base) with the N or other codes so far...
+    int lastAmbiguous;                      // ...the last of which is here; -1 if none yet
+} BaseCounts;
+
+// An N or other code at 'position' makes the codons that start at the 3 bases up to it ambiguous, some already counted
+static void countAmbiguousCodons(BaseCounts* counts, int position)
+{
+    int first = position - (CODONS_LENGTH - 1);
+    if (first <= counts->lastAmbiguous) first = counts->lastAmbiguous + 1;
+    if (first < 0) first = 0;
+    counts->numOfAmbiguousCodons += position - first + 1;
+    counts->lastAmbiguous = position;
+}
+
+// Bases 'from' (a multiple of 8) to 'to', a byte of the packed form (and half a byte of the soft mask) at a time
+static void normalizeBases(unsigned char* chars, int from, int to, uint8_t* packedBases, uint8_t* softMask, BaseCounts* counts)
+{
+    for (int i = from; i < to; i += PACKED_BASES_PER_BYTE)
+    {
+        int end = (i + PACKED_BASES_PER_BYTE < to) ? i + PACKED_BASES_PER_BYTE : to;
+        unsigned int packedByte = 0, maskBits = 0;
+        for (int j = i; j < end; j++) // Table lookups only, but for the rare N or other codes
+        {
+            unsigned char c = chars[j];
+            unsigned char baseClass = BASE_CLASSES[c];
+            counts->ofClass[baseClass]++;
+            chars[j] = c ^ NORMALIZING_FLIPS[c];
+            maskBits |= (unsigned int) (baseClass >> 3) << (j - i); // BASE_CLASS_LOWER_CASE
+            if ((baseClass & ~BASE_CLASS_LOWER_CASE) >= BASE_CLASS_UNKNOWN) countAmbiguousCodons(counts, j); // Seldom taken
+            packedByte = (packedByte << 2) | PACKING_CODES[c];
+        }
+        if (packedBases != NULL) packedBases[i / PACKED_BASES_PER_BYTE] = (uint8_t) (packedByte << (2 * (i + PACKED_BASES_PER_BYTE - end)));
+        if (softMask != NULL && i % 8 == 0) softMask[i / 8] = (uint8_t) maskBits;
+        else if (softMask != NULL) softMask[i / 8] |= (uint8_t) (maskBits << 4);
+    }
+}
+
+#ifdef WITH_AVX2_KERNEL
+// The same, 32 bases at a time, for blocks of A, C, G, U and T only (in either case), the usual input; blocks with
+// anything else are left to normalizeBases(). Returns the bases done, the last full block's end
+__attribute__((target("avx2,popcnt")))
+static int normalizeBasesAvx2(unsigned char* chars, int length, uint8_t* packedBases, uint8_t* softMask, BaseCounts* counts)
+{
+    const __m256i caseBit = _mm256_set1_epi8('a' ^ 'A');
+    const __m256i thymineToUracil = _mm256_set1_epi8('T' ^ 'U');
+    const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+    const __m256i thymine = _mm256_set1_epi8('T');
+    // By the low nibble of a character, in each 128-bit lane: the base (upper case) it must be to be A (1), C (3),
+    // G (7), T (4) or U (5), and that base's code
+    const __m256i basesByNibble = _mm256_setr_epi8(-1, 'A', -1, 'C', 'T', 'U', -1, 'G', -1, -1, -1, -1, -1, -1, -1, -1,
+                                                   -1, 'A', -1, 'C', 'T', 'U', -1, 'G', -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i codesByNibble = _mm256_setr_epi8(0, 0, 0, 1, 3, 3, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                   0, 0, 0, 1, 3, 3, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i packingWeights = _mm256_set1_epi32(0x01041040); // 64, 16, 4, 1: the first base in the top bits
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i firstBytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i firstDwords = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+    long numOfBlocks = 0, numOfThymines = 0, numOfLowerCase = 0, numOfLowerThymines = 0; // Kept apart from 'counts', in registers
+    int i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i typed = _mm256_loadu_si256((const __m256i*) (chars + i));
+        __m256i nibbles = _mm256_and_si256(typed, lowNibble);
+        __m256i upper = _mm256_andnot_si256(caseBit, typed); // Only letters turn into letters
+        __m256i isBase = _mm256_cmpeq_epi8(upper, _mm256_shuffle_epi8(basesByNibble, nibbles));
+        if ((uint32_t) _mm256_movemask_epi8(isBase) != 0xFFFFFFFFu)
+        {
+            normalizeBases(chars, i, i + 32, packedBases, softMask, counts);
+            continue;
+        }
+        __m256i isThymine = _mm256_cmpeq_epi8(upper, thymine);
+        uint32_t thymines = (uint32_t) _mm256_movemask_epi8(isThymine);
+        uint32_t lowerCase = (uint32_t) _mm256_movemask_epi8(_mm256_slli_epi16(typed, 2)); // The case bit, moved to the top
+        if (softMask != NULL) memcpy(softMask + i / 8, &lowerCase, sizeof(uint32_t)); // The bits are already in base order
+        numOfBlocks++;
+        numOfThymines += __builtin_popcount(thymines);
+        numOfLowerCase += __builtin_popcount(lowerCase);
+        numOfLowerThymines += __builtin_popcount(thymines & lowerCase);
+
+        __m256i normalized = _mm256_xor_si256(upper, _mm256_and_si256(isThymine, thymineToUracil));
+        _mm256_storeu_si256((__m256i*) (chars + i), normalized);
+        if (packedBases != NULL)
+        {
+            __m256i codes = _mm256_shuffle_epi8(codesByNibble, nibbles);
+            __m256i packed = _mm256_madd_epi16(_mm256_maddubs_epi16(codes, packingWeights), ones); // One byte per 32 bits
+            packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(packed, firstBytes), firstDwords);
+            _mm_storel_epi64((__m128i*) (packedBases + i / PACKED_BASES_PER_BYTE), _mm256_castsi256_si128(packed));
+        }
+    }
+    counts->ofClass[BASE_CLASS_BASE] += 32 * numOfBlocks - numOfThymines - numOfLowerCase + numOfLowerThymines;
+    counts->ofClass[BASE_CLASS_BASE | BASE_CLASS_LOWER_CASE] += numOfLowerCase - numOfLowerThymines;
+    counts->ofClass[BASE_CLASS_THYMINE] += numOfThymines - numOfLowerThymines;
+    counts->ofClass[BASE_CLASS_THYMINE | BASE_CLASS_LOWER_CASE] += numOfLowerThymines;
+    return i;
+}
+#endif
+
+// Validates, normalizes (in place) and packs (into 'packedBases' of getPackedSize() bytes, if not NULL) 'sequence'
+// in a single pass, recording its soft mask into 'softMask' (of getSoftMaskSize() bytes, if not NULL); FALSE if it
+// has characters that stand for no base, which are left as they are
+bool normalizeSequence(char* sequence, int length, uint8_t* packedBases, uint8_t* softMask, NormalizationStats* stats)
+{
+    BaseCounts counts = { .lastAmbiguous = -1 };
+    unsigned char* chars = (unsigned char*) sequence;
+    int done = 0;
+#ifdef WITH_AVX2_KERNEL
+    if (__builtin_cpu_supports("avx2")) done = normalizeBasesAvx2(chars, length, packedBases, softMask, &counts);
+#endif
+    normalizeBases(chars, done, length, packedBases, softMask, &counts);
+    if (packedBases != NULL) packedBases[getPackedSize(length) - 1] = 0;
+
+    memset(stats, 0, sizeof(NormalizationStats));
+    for (int c = 0; c < NUM_OF_BASE_CLASSES; c++)
+    {
+        stats->numOfChars[c] = counts.ofClass[c] + counts.ofClass[c | BASE_CLASS_LOWER_CASE];
+        if (c != BASE_CLASS_INVALID) stats->numOfLowerCase += counts.ofClass[c | BASE_CLASS_LOWER_CASE];
+    }
+    stats->numOfAmbiguousCodons = counts.numOfAmbiguousCodons; // Less those that would start in the last 2 bases
+    if (counts.lastAmbiguous > length - CODONS_LENGTH) stats->numOfAmbiguousCodons -= counts.lastAmbiguous - (length - CODONS_LENGTH);
+    if (length < CODONS_LENGTH) stats->numOfAmbiguousCodons = 0;
+    stats->firstInvalid = -1;
+    if (stats->numOfChars[BASE_CLASS_INVALID] > 0)
+    {
+        for (int i = 0; stats->firstInvalid < 0; i++)
+        {
+            if (BASE_CLASSES[chars[i]] == BASE_CLASS_INVALID) stats->firstInvalid = i;
+        }
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Only if the sequence wasn't already upper case RNA of A, C, G and U
+void printNormalizationStats(FILE* output_stream, const NormalizationStats* stats)
+{
+    long numOfUnknown = stats->numOfChars[BASE_CLASS_UNKNOWN], numOfAmbiguous = stats->numOfChars[BASE_CLASS_AMBIGUOUS];
+    if (stats->numOfChars[BASE_CLASS_THYMINE] + stats->numOfLowerCase + numOfUnknown + numOfAmbiguous == 0) return;
+    fprintf(output_stream, DIM "Normalized: %ld T read as U, %ld lower case; %ld N and %ld other ambiguity code(s), in %ld codon(s) of the 3 frames that are neither START nor STOP.\n" RESET,
+            stats->numOfChars[BASE_CLASS_THYMINE], stats->numOfLowerCase, numOfUnknown, numOfAmbiguous, stats->numOfAmbiguousCodons);
+}
+
+// Run with: <program> --benchmark-normalization [number of bases]
+void benchmarkNormalization(FILE* output_stream, int numOfBases)
+{
+    char* typed = (char*) malloc(numOfBases + 1);
+    char* scalar = (char*) malloc(numOfBases + 1);
+    char* fused = (char*) malloc(numOfBases + 1);
+    uint8_t* scalarPacked = (uint8_t*) malloc(getPackedSize(numOfBases));
+    uint8_t* fusedPacked = (uint8_t*) malloc(getPackedSize(numOfBases));
+    uint8_t* scalarMask = (uint8_t*) malloc(getSoftMaskSize(numOfBases));
+    uint8_t* fusedMask = (uint8_t*) malloc(getSoftMaskSize(numOfBases));
+    if (typed == NULL || scalar == NULL || fused == NULL || scalarPacked == NULL || fusedPacked == NULL || scalarMask == NULL || fusedMask == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the benchmark.\n%s\a\n" RESET, strerror(errno));
+        free(typed); free(scalar); free(fused); free(scalarPacked); free(fusedPacked); free(scalarMask); free(fusedMask);
+        return;
+    }
+    memset(scalarPacked, 0, getPackedSize(numOfBases)); // Touched once, so that page faults aren't timed
+    memset(fusedPacked, 0, getPackedSize(numOfBases));
+    memset(scalarMask, 0, getSoftMaskSize(numOfBases));
+    memset(fusedMask, 0, getSoftMaskSize(numOfBases));
+    static const char* INPUTS[] = { "Upper case RNA", "Lower case DNA, an N every ~1000 bases" };
+    fprintf(output_stream, BOLD "\n%d bases\t\t\t\t\tThree passes (ms)\tScalar kernel (ms)\tFused kernel (ms)\tFused (GB/s)\tSame results\n" RESET, numOfBases);
+    srand(1);
+    for (int input = 0; input < 2; input++)
+    {
+        for (int i = 0; i < numOfBases; i++)
+        {
+            typed[i] = (input == 0) ? "ACGU"[rand() % 4] : (rand() % 1000 == 0) ? 'n' : "acgt"[rand() % 4];
+        }
+        typed[numOfBases] = '\0';
+        struct timespec t0, t1;
+        long checksum = 0;
+
+        // As before: check the characters, upper-case the sequence, then read every codon from the letters
+        double threePassTime = 0.0;
+        if (input == 0)
+        {
+            memcpy(scalar, typed, numOfBases + 1);
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            if (has_valid_chars(scalar, numOfBases, VALID_CHARS, NUM_OF_VALID_CHARS))
+            {
+                toUpperCase(scalar);
+                for (int i = 0; i + CODONS_LENGTH <= numOfBases; i += CODONS_LENGTH) checksum += codonToIndex(&scalar[i]);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            threePassTime = millisecondsBetween(&t0, &t1);
+        }
+
+        BaseCounts counts = { .lastAmbiguous = -1 };
+        memcpy(scalar, typed, numOfBases + 1);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        normalizeBases((unsigned char*) scalar, 0, numOfBases, scalarPacked, scalarMask, &counts);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double scalarTime = millisecondsBetween(&t0, &t1);
+        scalarPacked[getPackedSize(numOfBases) - 1] = 0;
+
+        NormalizationStats stats;
+        memcpy(fused, typed, numOfBases + 1);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        normalizeSequence(fused, numOfBases, fusedPacked, fusedMask, &stats);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double fusedTime = millisecondsBetween(&t0, &t1);
+
+        bool isSame = memcmp(scalar, fused, numOfBases) == 0 && memcmp(scalarPacked, fusedPacked, getPackedSize(numOfBases)) == 0
+                      && memcmp(scalarMask, fusedMask, numOfBases / 8) == 0
+                      && stats.numOfLowerCase == counts.ofClass[BASE_CLASS_BASE | BASE_CLASS_LOWER_CASE] + counts.ofClass[BASE_CLASS_THYMINE | BASE_CLASS_LOWER_CASE]
+                                                 + counts.ofClass[BASE_CLASS_UNKNOWN | BASE_CLASS_LOWER_CASE];
+        for (int i = 0; isSame && i + CODONS_LENGTH <= numOfBases; i++)
+        {
+            int codonIndex = codonToIndex(&fused[i]);
+            isSame = (codonIndex < 0) || codonIndex == getPackedCodonIndex(fusedPacked, i);
+        }
+        fprintf(output_stream, "%-40s\t", INPUTS[input]);
+        if (input == 0) fprintf(output_stream, "%-17.1f\t", threePassTime);
+        else fprintf(output_stream, "%-17s\t", "(rejects DNA)");
+        fprintf(output_stream, "%-18.1f\t%-17.1f\t%-12.2f\t%s\n", scalarTime, fusedTime,
+                (fusedTime > 0) ? numOfBases / (fusedTime * 1e6) : 0.0, isSame ? "yes" : ERROR_COLOR "no!" RESET);
+    }
+#ifdef WITH_AVX2_KERNEL
+    fprintf(output_stream, DIM "Fused kernel: %s. Both kernels also pack the bases (2 bits each) and record the soft mask (1 bit each); codons read from the packed bases were checked against the letters.\n" RESET,
+            __builtin_cpu_supports("avx2") ? "AVX2, 32 bases at a time" : "scalar (no AVX2 on this CPU)");
+#else
+    fprintf(output_stream, DIM "Fused kernel: scalar (built without the AVX2 kernel). Both kernels also pack the bases (2 bits each) and record the soft mask (1 bit each).\n" RESET);
+#endif
+    free(typed);
+    free(scalar);
+    free(fused);
+    free(scalarPacked);
+    free(fusedPacked);
+    free(scalarMask);
+    free(fusedMask);
+}
+
+
+
+// **************************************  Chunked ORF store  *****************************************************************
+
+// History of ORFs in fixed-size chunks instead of one list node per ORF. Fields that scans and indexes look at
+// are kept as arrays (struct of arrays), so going over them doesn't touch the records at all; the records
+// themselves are packed (see above) one after the other in the chunk's data.
+// Appending is O(1), and so is concatenating two stores: chunks are linked, a chunk doesn't have to be full.
+#define ORF_STORE_CHUNK_SIZE 1024
+#define ORF_STORE_INITIAL_DATA_BYTES (16 << 10)
+
+typedef struct OrfStoreChunk
+{
+    int count;
+    int start[ORF_STORE_CHUNK_SIZE];            // positionInSupersequence
+    int end[ORF_STORE_CHUNK_SIZE];              // Position of the last (stop) codon
+    int length[ORF_STORE_CHUNK_SIZE];
+    unsigned char strand[ORF_STORE_CHUNK_SIZE]; // direction
+    unsigned char frame[ORF_STORE_CHUNK_SIZE];
+    uint32_t offsets[ORF_STORE_CHUNK_SIZE];     // Of each packed record in 'data'
+    unsigned char* data;
+    size_t dataSize, dataCapacity;
+    uint64_t* analysisHashes;                   // Per analysis of the chunk (PackedOrfHeader.analysisIndex)...
+    time_t* analysisTimes;
+    int numOfAnalyses, analysesCapacity;
+    Sequence** unpacked;                        // Records that couldn't be packed
+    int numOfUnpacked;
+    struct OrfStoreChunk* next;
+} OrfStoreChunk;
+
+typedef struct
+{
+    OrfStoreChunk* head;
+    OrfStoreChunk* tail;
+    int size;
+} OrfStore;
+
+// Position of one ORF in a store; 'chunk' is NULL past the last ORF
+typedef struct
+{
+    OrfStoreChunk* chunk;
+    int index;
+} OrfStoreIterator;
+
+// Frame of an ORF, derived from where its first codon sits in the input sequence
+int getFrameOfSequence(Sequence* seq)
+{
+    if (seq->seqDirection == FORWARD)
+    {
+        return (seq->positionInSupersequence - 1) % CODONS_LENGTH; // Forward positions point to the codon's first base (1-based)
+    }
+    return seq->positionInSupersequence % CODONS_LENGTH; // Reverse positions point to the codon's last base (1-based)
+}
+
+OrfStore* createOrfStore()
+{
+    return (OrfStore*) calloc(1, sizeof(OrfStore));
+}
+
+OrfStoreChunk* createOrfStoreChunk()
+{
+    OrfStoreChunk* chunk = (OrfStoreChunk*) malloc(sizeof(OrfStoreChunk));
+    if (chunk == NULL) return NULL;
+
+    chunk->count = 0;
+    chunk->data = NULL;
+    chunk->dataSize = chunk->dataCapacity = 0;
+    chunk->analysisHashes = NULL;
+    chunk->analysisTimes = NULL;
+    chunk->numOfAnalyses = chunk->analysesCapacity = 0;
+    chunk->unpacked = NULL;
+    chunk->numOfUnpacked = 0;
+    chunk->next = NULL;
+    return chunk;
+}
+
+// Row of (hash, time) in the chunk's analyses; ORFs of one analysis come one after the other, so only the last row is checked
+uint16_t getChunkAnalysisIndex(OrfStoreChunk* chunk, uint64_t sequenceHash, time_t analysisTime)
+{
+    int last = chunk->numOfAnalyses - 1;
+    if (last >= 0 && chunk->analysisHashes[last] == sequenceHash && chunk->analysisTimes[last] == analysisTime)
+    {
+        return (uint16_t) last;
+    }
+    if (chunk->numOfAnalyses == chunk->analysesCapacity)
+    {
+        chunk->analysesCapacity = chunk->analysesCapacity ? chunk->analysesCapacity * 2 : 8;
+        chunk->analysisHashes = (uint64_t*) realloc(chunk->analysisHashes, sizeof(uint64_t) * chunk->analysesCapacity);
+        chunk->analysisTimes = (time_t*) realloc(chunk->analysisTimes, sizeof(time_t) * chunk->analysesCapacity);
+    }
+    chunk->analysisHashes[chunk->numOfAnalyses] = sequenceHash;
+    chunk->analysisTimes[chunk->numOfAnalyses] = analysisTime;
+    return (uint16_t) chunk->numOfAnalyses++;
+}
+
+// Copies 'seq' into the store (packed whenever possible); the caller still owns 'seq'
+void appendToOrfStore(OrfStore* store, Sequence* seq)
+{
+    if (store->tail == NULL || store->tail->count == ORF_STORE_CHUNK_SIZE)
+    {
+        OrfStoreChunk* chunk = createOrfStoreChunk();
+        if (store->tail != NULL) store->tail->next = chunk;
+        else store->head = chunk;
+        store->tail = chunk;
+    }
+
+    OrfStoreChunk* chunk = store->tail;
+    int i = chunk->count++;
+    int numOfCodons = seq->length / CODONS_LENGTH;
+    chunk->start[i] = seq->positionInSupersequence;
+    chunk->end[i] = (numOfCodons > 0) ? seq->specialCodons[numOfCodons - 1].positionInSequence : seq->positionInSupersequence;
+    chunk->length[i] = seq->length;
+    chunk->strand[i] = (unsigned char) seq->seqDirection;
+    chunk->frame[i] = (unsigned char) getFrameOfSequence(seq);
+
+    size_t recordSize = getPackedOrfSize(numOfCodons); // Reserved for the packed form, given back if it doesn't fit
+    if (chunk->dataSize + recordSize > chunk->dataCapacity)
+    {
+        size_t capacity = chunk->dataCapacity ? chunk->dataCapacity : ORF_STORE_INITIAL_DATA_BYTES;
+        while (capacity < chunk->dataSize + recordSize) capacity *= 2;
+        chunk->data = (unsigned char*) realloc(chunk->data, capacity);
+        chunk->dataCapacity = capacity;
+    }
+    chunk->offsets[i] = (uint32_t) chunk->dataSize;
+    unsigned char* packed = chunk->data + chunk->dataSize;
+
+    if (packSequence(seq, getChunkAnalysisIndex(chunk, seq->sequenceHash, seq->analysisTime), packed))
+    {
+        chunk->dataSize += recordSize;
+    } else
+    {
+        PackedOrfHeader header = { 0 };
+        header.numOfCodons = chunk->numOfUnpacked;
+        header.flags = PACKED_ORF_UNPACKED;
+        memcpy(packed, &header, sizeof(header));
+        chunk->dataSize += sizeof(header);
+        chunk->unpacked = (Sequence**) realloc(chunk->unpacked, sizeof(Sequence*) * (chunk->numOfUnpacked + 1));
+        chunk->unpacked[chunk->numOfUnpacked++] = copySequence(seq);
+    }
+    store->size++;
+}
+
+// Moves all ORFs of 'other' to the end of 'store' in O(1); 'other' is left empty
+void concatOrfStores(OrfStore* store, OrfStore* other)
+{
+    if (other->head == NULL) return;
+
+    if (store->tail != NULL) store->tail->next = other->head;
+    else store->head = other->head;
+    store->tail = other->tail;
+    store->size += other->size;
+
+    other->head = other->tail = NULL;
+    other->size = 0;
+}
+
+// Copies the records of 'list' to the end of 'store', then frees the list and its records
+void appendListToOrfStore(OrfStore* store, DoublyLinkedList* list)
+{
+    for (ListNode* current = list->head; current != NULL; current = current->next)
+    {
+        appendToOrfStore(store, current->data);
+    }
+    freeList(list);
+}
+
+void freeOrfStore(OrfStore* store)
+{
+    if (store == NULL) return;
+
+    OrfStoreChunk* chunk = store->head;
+    while (chunk != NULL)
+    {
+        OrfStoreChunk* next = chunk->next;
+        for (int i = 0; i < chunk->numOfUnpacked; i++)
+        {
+            free(chunk->unpacked[i]);
+        }
+        free(chunk->unpacked);
+        free(chunk->data);
+        free(chunk->analysisHashes);
+        free(chunk->analysisTimes);
+        free(chunk);
+        chunk = next;
+    }
+    free(store);
+}
+
+// Skips (possibly) empty chunks, so that the iterator points to an ORF or past the end
+void settleOrfStoreIterator(OrfStoreIterator* iterator)
+{
+    while (iterator->chunk != NULL && iterator->index >= iterator->chunk->count)
+    {
+        iterator->index -= iterator->chunk->count;
+        iterator->chunk = iterator->chunk->next;
+    }
+}
+
+// Iterator at the ORF with index 'position'; whole chunks are skipped, so this is O(number of chunks)
+OrfStoreIterator orfStoreIteratorAt(OrfStore* store, int position)
+{
+    OrfStoreIterator iterator = { store->head, position > 0 ? position : 0 };
+    settleOrfStoreIterator(&iterator);
+    return iterator;
+}
+
+bool orfStoreHasNext(OrfStoreIterator* iterator)
+{
+    return iterator->chunk != NULL;
+}
+
+void orfStoreAdvance(OrfStoreIterator* iterator)
+{
+    iterator->index++;
+    settleOrfStoreIterator(iterator);
+}
+
+const unsigned char* getStoredOrfRecord(OrfStoreIterator* iterator)
+{
+    return iterator->chunk->data + iterator->chunk->offsets[iterator->index];
+}
+
+// The whole Sequence if the current ORF couldn't be packed, NULL otherwise
+Sequence* getUnpackedStoredOrf(OrfStoreIterator* iterator)
+{
+    PackedOrfHeader header = getPackedOrfHeader(getStoredOrfRecord(iterator));
+    return (header.flags & PACKED_ORF_UNPACKED) ? iterator->chunk->unpacked[header.numOfCodons] : NULL;
+}
+
+uint64_t getStoredOrfHash(OrfStoreIterator* iterator)
+{
+    Sequence* unpacked = getUnpackedStoredOrf(iterator);
+    if (unpacked != NULL) return unpacked->sequenceHash;
+    return iterator->chunk->analysisHashes[getPackedOrfHeader(getStoredOrfRecord(iterator)).analysisIndex];
+}
+
+time_t getStoredOrfTime(OrfStoreIterator* iterator)
+{
+    Sequence* unpacked = getUnpackedStoredOrf(iterator);
+    if (unpacked != NULL) return unpacked->analysisTime;
+    return iterator->chunk->analysisTimes[getPackedOrfHeader(getStoredOrfRecord(iterator)).analysisIndex];
+}
+
+// Position of the first codon (the first START) of the current ORF
+int getStoredOrfFirstPosition(OrfStoreIterator* iterator)
+{
+    Sequence* unpacked = getUnpackedStoredOrf(iterator);
+    if (unpacked != NULL) return (unpacked->length >= CODONS_LENGTH) ? unpacked->specialCodons[0].positionInSequence : unpacked->positionInSupersequence;
+    return getPackedOrfHeader(getStoredOrfRecord(iterator)).firstCodonPosition;
+}
+
+// First or last codon of the current ORF as text (at least CODONS_LENGTH+1 chars); FALSE if it has no codons
+bool getStoredOrfCodon(OrfStoreIterator* iterator, bool isLast, char* codon)
+{
+    Sequence* unpacked = getUnpackedStoredOrf(iterator);
+    if (unpacked != NULL)
+    {
+        if (unpacked->length < CODONS_LENGTH) return FALSE;
+        strncpy(codon, unpacked->specialCodons[isLast ? unpacked->length/CODONS_LENGTH - 1 : 0].codonSequence, CODONS_LENGTH + 1);
+        return TRUE;
+    }
+    const unsigned char* packed = getStoredOrfRecord(iterator);
+    getPackedCodon(packed, isLast ? getPackedOrfHeader(packed).numOfCodons - 1 : 0, codon);
+    return TRUE;
+}
+
+// The current ORF as a (malloc'ed) Sequence, for whatever needs the whole record
+Sequence* getStoredOrf(OrfStoreIterator* iterator)
+{
+    Sequence* unpacked = getUnpackedStoredOrf(iterator);
+    if (unpacked != NULL) return copySequence(unpacked);
+    return unpackSequence(getStoredOrfRecord(iterator), getStoredOrfHash(iterator), getStoredOrfTime(iterator));
+}
+
+// JSON conversions use the archive's schema, same as sequenceToJson()/jsonToSequence()
+cJSON* storedOrfToJson(OrfStoreIterator* iterator)
+{
+    Sequence* seq = getStoredOrf(iterator);
+    cJSON* jsonSeq = sequenceToJson(seq);
+    free(seq);
+    return jsonSeq;
+}
+
+// Array of the records from 'position' up to the end of the store
+cJSON* orfStoreToJsonArray(OrfStore* store, int position)
+{
+    cJSON* jsonList = cJSON_CreateArray();
+    for (OrfStoreIterator it = orfStoreIteratorAt(store, position); orfStoreHasNext(&it); orfStoreAdvance(&it))
+    {
+        cJSON_AddItemToArray(jsonList, storedOrfToJson(&it));
+    }
+    return jsonList;
+}
+
+OrfStore* jsonArrayToOrfStore(cJSON* jsonList)
+{
+    OrfStore* store = createOrfStore();
+
+    cJSON* jsonSeq;
+    cJSON_ArrayForEach(jsonSeq, jsonList)
+    {
+        Sequence* seq = jsonToSequence(jsonSeq);
+        appendToOrfStore(store, seq);
+        free(seq);
+    }
+
+    return store;
+}
+
+// Records before 'firstRecordIndex' are not serialized (they are kept in sealed archive shards)
+char* serializeOrfStoreToJson(FILE* output_stream, OrfStore* store, int firstRecordIndex)
+{
+    Arena* jsonArena = createArena(ARENA_BLOCK_SIZE);
+    if (jsonArena == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for serializing the history.\n%s\a\n" RESET, strerror(errno));
+        return NULL;
+    }
+    beginJsonArena(jsonArena);
+
+    cJSON* jsonList = orfStoreToJsonArray(store, firstRecordIndex);
+    char* jsonString = copyPrintedJson(cJSON_Print(jsonList)); // The printed text lives in the arena too, so the caller gets its own copy
+
+    // No cJSON_Delete(): the whole tree and the printed text are released at once with the arena
+    endJsonArena();
+    printArenaStats(output_stream, "JSON serialization arena", jsonArena);
+    freeArena(jsonArena);
+    return jsonString;
+}
+
+// Builds the same history as a list of Sequences and as a store, then times building, scanning and freeing both.
+// List nodes and records are allocated back to back here, their best case; in a real session they are scattered.
+// Run with: <program> --benchmark-store [number of ORFs]
+void benchmarkOrfStore(FILE* output_stream, int numOfOrfs)
+{
+    static char startCodon[] = "AUG", plainCodon[] = "GCU", stopCodon[] = "UAA";
+    SpecialSubsequence codons[9];
+    struct timespec t0, t1, t2, t3, t4, t5, t6;
+    long long listChecksum = 0, storeChecksum = 0;
+    size_t listBytes = 0, storeBytes = 0;
+
+    Sequence** records = (Sequence**) malloc(sizeof(Sequence*) * numOfOrfs);
+    if (records == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the benchmark.\n%s\a\n" RESET, strerror(errno));
+        return;
+    }
+    for (int i = 0; i < numOfOrfs; i++) // ORFs of 3 to 9 codons, alternating strands, as the scanner would find them
+    {
+        int numOfCodons = 3 + i % 7;
+        direction seqDirection = (i % 2) ? REVERSE : FORWARD;
+        int firstPosition = (seqDirection == FORWARD) ? 1 + i * CODONS_LENGTH : 1 + (i + numOfCodons) * CODONS_LENGTH;
+        for (int j = 0; j < numOfCodons; j++)
+        {
+            codons[j].type = (j == 0) ? START : (j == numOfCodons - 1) ? STOP : PLAIN;
+            codons[j].codonSequence = (j == 0) ? startCodon : (j == numOfCodons - 1) ? stopCodon : plainCodon;
+            codons[j].positionInSequence = firstPosition + j * getCodonStep(seqDirection);
+        }
+        records[i] = createSequence2(numOfCodons * CODONS_LENGTH, seqDirection, firstPosition, TRUE, codons, numOfCodons);
+        listBytes += sizeof(ListNode) + getSequenceSize(numOfCodons);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    DoublyLinkedList* list = createList();
+    for (int i = 0; i < numOfOrfs; i++)
+    {
+        appendToList(list, records[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    OrfStore* store = createOrfStore();
+    for (int i = 0; i < numOfOrfs; i++)
+    {
+        appendToOrfStore(store, records[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    // Same question to both: total length of the forward ORFs
+    for (ListNode* current = list->head; current != NULL; current = current->next)
+    {
+        if (current->data->seqDirection == FORWARD) listChecksum += current->data->length;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t3);
+    int numOfChunks = 0;
+    for (OrfStoreChunk* chunk = store->head; chunk != NULL; chunk = chunk->next)
+    {
+        for (int i = 0; i < chunk->count; i++)
+        {
+            if (chunk->strand[i] == FORWARD) storeChecksum += chunk->length[i];
+        }
+        storeBytes += sizeof(OrfStoreChunk) + chunk->dataCapacity + chunk->analysesCapacity * (sizeof(uint64_t) + sizeof(time_t));
+        numOfChunks++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t4);
+
+    // The list owns the records, the store its packed copies
+    freeList(list);
+    clock_gettime(CLOCK_MONOTONIC, &t5);
+    freeOrfStore(store);
+    clock_gettime(CLOCK_MONOTONIC, &t6);
+    free(records);
+
+    fprintf(output_stream, BOLD "\n%d ORFs\t\t%-18s %-18s\n" RESET, numOfOrfs, "Linked list", "Chunked store");
+    fprintf(output_stream, "Build (ms)\t%-18.2f %-18.2f\n", millisecondsBetween(&t0, &t1), millisecondsBetween(&t1, &t2));
+    fprintf(output_stream, "Scan (ms)\t%-18.2f %-18.2f\n", millisecondsBetween(&t2, &t3), millisecondsBetween(&t3, &t4));
+    fprintf(output_stream, "Free (ms)\t%-18.2f %-18.2f\n", millisecondsBetween(&t4, &t5), millisecondsBetween(&t5, &t6));
+    fprintf(output_stream, "Bytes per ORF\t%-18.1f %-18.1f\n", (double) listBytes / numOfOrfs, (double) storeBytes / numOfOrfs);
+    fprintf(output_stream, "Allocations\t%-18d %-18d\n", 2 * numOfOrfs, 4 * numOfChunks); // Chunk, its data, its two analyses arrays
+    fprintf(output_stream, DIM "Bytes per ORF include the records and leave out the allocator's own overhead, paid once per allocation. Checksums: %lld / %lld\n" RESET,
+            listChecksum, storeChecksum);
+}
+
+// ****************************************************  Codon usage functions  ***************************************************
+
+#define NUM_OF_CODON_INDEXES 64
+
+// Codon counts, by codonToIndex(), of an ORF read in its strand's direction or of a whole input sequence (forward,
+// frame 0). GC and GC3 follow from the counts, so they aren't counted separately
+typedef struct
+{
+    int codonCounts[NUM_OF_CODON_INDEXES];
+    int numOfCodons;
+} CodonUsage;
+
+// Gathered by find_all_sequences() while it scans: the input's codon usage and each found ORF's, in list order.
+// Starts zeroed; the records are reused by the next analysis, so only the first ones allocate
+typedef struct
+{
+    CodonUsage ofSequence;
+    CodonUsage* ofOrfs;
+    int numOfOrfs, capacity;
+} AnalysisCodonUsage;
+
+void addCodonToUsage(CodonUsage* usage, int codonIndex)
+{
+    if (codonIndex < 0 || codonIndex >= NUM_OF_CODON_INDEXES) return;
+    usage->codonCounts[codonIndex]++;
+    usage->numOfCodons++;
+}
+
+// Cleared record for the next ORF's counts, which becomes part of the list once counted; NULL if out of memory
+CodonUsage* getNextOrfCodonUsage(AnalysisCodonUsage* analysisUsage)
+{
+    if (analysisUsage->numOfOrfs == analysisUsage->capacity)
+    {
+        int capacity = analysisUsage->capacity ? analysisUsage->capacity * 2 : 16;
+        CodonUsage* grown = (CodonUsage*) realloc(analysisUsage->ofOrfs, sizeof(CodonUsage) * capacity);
+        if (grown == NULL) return NULL;
+        analysisUsage->ofOrfs = grown;
+        analysisUsage->capacity = capacity;
+    }
+    CodonUsage* next = &analysisUsage->ofOrfs[analysisUsage->numOfOrfs];
+    memset(next, 0, sizeof(CodonUsage));
+    return next;
+}
+
+void resetAnalysisCodonUsage(AnalysisCodonUsage* analysisUsage)
+{
+    memset(&analysisUsage->ofSequence, 0, sizeof(CodonUsage));
+    analysisUsage->numOfOrfs = 0;
+}
+
+void freeAnalysisCodonUsage(AnalysisCodonUsage* analysisUsage)
+{
+    free(analysisUsage->ofOrfs);
+    memset(analysisUsage, 0, sizeof(AnalysisCodonUsage));
+}
+
+// Fractions of G or C among all bases and among third codon bases (bases are coded A 0, C 1, G 2, U 3)
+void getGcContent(CodonUsage* usage, double* gc, double* gc3)
+{
+    long gcBases = 0, gc3Bases = 0;
+    for (int i = 0; i < NUM_OF_CODON_INDEXES; i++)
+    {
+        if (usage->codonCounts[i] == 0) continue;
+        int isGc1 = ((i >> 4) == 1 || (i >> 4) == 2), isGc2 = (((i >> 2) & 3) == 1 || ((i >> 2) & 3) == 2), isGc3 = ((i & 3) == 1 || (i & 3) == 2);
+        gcBases += (long) usage->codonCounts[i] * (isGc1 + isGc2 + isGc3);
+        gc3Bases += (long) usage->codonCounts[i] * isGc3;
+    }
+    *gc = usage->numOfCodons ? (double) gcBases / (CODONS_LENGTH * usage->numOfCodons) : 0.0;
+    *gc3 = usage->numOfCodons ? (double) gc3Bases / usage->numOfCodons : 0.0;
+}
+
+// For results that weren't scanned now (e.g. from the analysis cache): the same counts, from the ORFs' codons
+void getCodonUsageOfOrfs(DoublyLinkedList* orfs, const char* sequence, int sequenceLength, AnalysisCodonUsage* analysisUsage)
+{
+    resetAnalysisCodonUsage(analysisUsage);
+    for (int base = 0; base + CODONS_LENGTH <= sequenceLength; base += CODONS_LENGTH)
+    {
+        addCodonToUsage(&analysisUsage->ofSequence, codonToIndex(&sequence[base]));
+    }
+    for (ListNode* current = orfs->head; current != NULL; current = current->next)
+    {
+        CodonUsage* orfUsage = getNextOrfCodonUsage(analysisUsage);
+        if (orfUsage == NULL) break;
+        for (int i = 0; i < current->data->length / CODONS_LENGTH; i++)
+        {
+            addCodonToUsage(orfUsage, codonToIndex(current->data->specialCodons[i].codonSequence));
+        }
+        analysisUsage->numOfOrfs++;
+    }
+}
+
+void printCodonUsageRow(FILE* output_stream, const char* label, const char* strand, int position, CodonUsage* usage)
+{
+    double gc, gc3;
+    getGcContent(usage, &gc, &gc3);
+    fprintf(output_stream, "%s\t%s\t", label, strand);
+    if (position > 0) fprintf(output_stream, "%d", position);
+    else fprintf(output_stream, "-");
+    fprintf(output_stream, "\t%d\t%.1f\t%.1f\t", usage->numOfCodons, 100.0 * gc, 100.0 * gc3);
+    for (int i = 0; i < NUM_OF_CODON_INDEXES; i++)
+    {
+        if (usage->codonCounts[i] == 0) continue;
+        char codon[CODONS_LENGTH + 1];
+        indexToCodon(i, codon);
+        fprintf(output_stream, "%s:%d ", codon, usage->codonCounts[i]);
+    }
+    fprintf(output_stream, "\n");
+}
+
+// Optional columns of an analysis: codon counts, GC and GC3 of every ORF (numbered as listed) and of the input
+void printCodonUsage(FILE* output_stream, DoublyLinkedList* orfs, AnalysisCodonUsage* analysisUsage)
+{
+    fprintf(output_stream, BOLD "\nCodon usage\n" RESET);
+    fprintf(output_stream, "ORF\tSTRAND\tPOSITION\tCODONS\tGC%%\tGC3%%\tCODON COUNTS\n");
+    int i = 0;
+    for (ListNode* current = orfs->head; current != NULL && i < analysisUsage->numOfOrfs; current = current->next, i++)
+    {
+        char label[16];
+        snprintf(label, sizeof(label), "%d", i + 1);
+        printCodonUsageRow(output_stream, label, readDirectionToString(current->data->seqDirection), current->data->positionInSupersequence, &analysisUsage->ofOrfs[i]);
+    }
+    printCodonUsageRow(output_stream, "input", readDirectionToString(FORWARD), 0, &analysisUsage->ofSequence);
+}
+
+
+
+// ****************************************************  Approximate matching functions  ***************************************************
+
+// Myers' bit-vector algorithm: the edit distance (mismatches, insertions, deletions) between a pattern of up to 64
+// bases and the best-matching stretch of the text that ends at each base, in a few word operations per base. The
+// column of the dynamic programming table is kept as its differences between rows: bit i of 'pv'/'mv' is set if
+// row i+1 is one more/less than row i. Patterns may use IUPAC codes: a base matches a code that stands for it
+#define MYERS_MAX_LENGTH 64
+
+// Bases (bit of each base code, see codonToIndex()) that each IUPAC code stands for; T is read as U
+static const unsigned char IUPAC_BASE_MASKS[256] = {
+    ['A'] = 1, ['C'] = 2, ['G'] = 4, ['U'] = 8, ['T'] = 8,
+    ['R'] = 1|4, ['Y'] = 2|8, ['S'] = 2|4, ['W'] = 1|8, ['K'] = 4|8, ['M'] = 1|2,
+    ['B'] = 2|4|8, ['D'] = 1|4|8, ['H'] = 1|2|8, ['V'] = 1|2|4, ['N'] = 1|2|4|8
+};
+
+int getBaseCode(char base)
+{
+    return (int) BASE_CODES_PLUS_ONE[(unsigned char) base] - 1;
+}
+
+typedef struct
+{
+    uint64_t peq[4];                // By base code: bit i set if pattern base i stands for the base
+    uint64_t pv, mv;
+    uint64_t lastRow;               // Bit of the pattern's last base, whose row is the distance
+    int length;
+    int distance;                   // At the last base stepped over
+} MyersMatcher;
+
+// The matcher of 'pattern', or of it read backwards, at the start of a text
+void initMyersMatcher(MyersMatcher* matcher, const char* pattern, int length, bool isReversed)
+{
+    memset(matcher, 0, sizeof(MyersMatcher));
+    for (int i = 0; i < length; i++)
+    {
+        int mask = IUPAC_BASE_MASKS[(unsigned char) pattern[isReversed ? length - 1 - i : i]];
+        for (int code = 0; code < 4; code++)
+        {
+            if (mask & (1 << code)) matcher->peq[code] |= 1ULL << i;
+        }
+    }
+    matcher->pv = ~0ULL;
+    matcher->lastRow = 1ULL << (length - 1);
+    matcher->length = length;
+    matcher->distance = length;
+}
+
+// Steps over one base (its code, -1 for one that matches nothing); returns the distance of the best match ending at it
+static inline int stepMyersMatcher(MyersMatcher* matcher, int code)
+{
+    uint64_t eq = (code < 0) ? 0 : matcher->peq[code];
+    uint64_t xv = eq | matcher->mv;
+    uint64_t xh = (((eq & matcher->pv) + matcher->pv) ^ matcher->pv) | eq;
+    uint64_t ph = matcher->mv | ~(xh | matcher->pv);
+    uint64_t mh = matcher->pv & xh;
+    matcher->distance += ((ph & matcher->lastRow) != 0) - ((mh & matcher->lastRow) != 0); // Branch-free: random bases defeat prediction
+    ph <<= 1; // Row 0 stays 0: a match may start at any base
+    mh <<= 1;
+    matcher->pv = mh | ~(xv | ph);
+    matcher->mv = ph & xv;
+    return matcher->distance;
+}
+
+// First base of the shortest match, with 'distance' edits, of the pattern (or of it read backwards) that ends at
+// 'lastBase'. The matcher only gives where matches end, so their start is found by aligning back from there
+int getApproximateMatchFirst(const char* pattern, int length, bool isReversed, const char* text, int lastBase, int distance)
+{
+    int column[MYERS_MAX_LENGTH + 1]; // Distance between the last i pattern bases and the last l text bases
+    for (int i = 0; i <= length; i++) column[i] = i;
+    for (int l = 1; l <= length + distance && l <= lastBase + 1; l++)
+    {
+        int code = getBaseCode(text[lastBase - l + 1]);
+        int diagonal = column[0];
+        column[0] = l;
+        for (int i = 1; i <= length; i++)
+        {
+            int mask = IUPAC_BASE_MASKS[(unsigned char) pattern[isReversed ? i - 1 : length - i]];
+            int cost = diagonal + ((code >= 0 && (mask & (1 << code))) ? 0 : 1);
+            diagonal = column[i];
+            if (column[i] + 1 < cost) cost = column[i] + 1;
+            if (column[i - 1] + 1 < cost) cost = column[i - 1] + 1;
+            column[i] = cost;
+        }
+        if (column[length] <= distance) return lastBase - l + 1;
+    }
+    return lastBase - length + 1; // Not reached for a distance the matcher gave
+}
+
+// The same distances by filling in the dynamic programming table column by column (Sellers), for the benchmark
+int stepNaiveMatcher(const char* pattern, int length, int* column, int code)
+{
+    int diagonal = 0; // Row 0 stays 0
+    for (int i = 1; i <= length; i++)
+    {
+        int mask = IUPAC_BASE_MASKS[(unsigned char) pattern[i - 1]];
+        int cost = diagonal + ((code >= 0 && (mask & (1 << code))) ? 0 : 1);
+        diagonal = column[i];
+        if (column[i] + 1 < cost) cost = column[i] + 1;
+        if (column[i - 1] + 1 < cost) cost = column[i - 1] + 1;
+        column[i] = cost;
+    }
+    return column[length];
+}
+
+// Run with: <program> --benchmark-motifs [number of bases]
+void benchmarkApproximateMatching(FILE* output_stream, int numOfBases)
+{
+    static const int PATTERN_LENGTHS[] = { 8, 16, 32, 64 };
+    char* text = (char*) malloc(numOfBases + 1);
+    if (text == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the benchmark.\n%s\a\n" RESET, strerror(errno));
+        return;
+    }
+    srand(1);
+    for (int i = 0; i < numOfBases; i++) text[i] = "ACGU"[rand() % 4];
+    text[numOfBases] = '\0';
+
+    fprintf(output_stream, BOLD "\n%d bases\tEdits\tBit-vector (ms)\tDynamic programming (ms)\tSpeed-up\tMatches\n" RESET, numOfBases);
+    for (int p = 0; p < (int) (sizeof(PATTERN_LENGTHS) / sizeof(PATTERN_LENGTHS[0])); p++)
+    {
+        int length = PATTERN_LENGTHS[p], maxErrors = length / 4;
+        char pattern[MYERS_MAX_LENGTH + 1];
+        int column[MYERS_MAX_LENGTH + 1];
+        for (int i = 0; i < length; i++) pattern[i] = "ACGUN"[rand() % 5 < 4 ? rand() % 4 : 4];
+        pattern[length] = '\0';
+
+        struct timespec t0, t1, t2;
+        long myersMatches = 0, naiveMatches = 0;
+        MyersMatcher matcher;
+        initMyersMatcher(&matcher, pattern, length, FALSE);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int i = 0; i < numOfBases; i++)
+        {
+            myersMatches += (stepMyersMatcher(&matcher, getBaseCode(text[i])) <= maxErrors);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        for (int i = 0; i <= length; i++) column[i] = i;
+        for (int i = 0; i < numOfBases; i++)
+        {
+            naiveMatches += (stepNaiveMatcher(pattern, length, column, getBaseCode(text[i])) <= maxErrors);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+
+        double myersTime = millisecondsBetween(&t0, &t1), naiveTime = millisecondsBetween(&t1, &t2);
+        fprintf(output_stream, "%d-mer\t\t%d\t%-15.2f\t%-24.2f\t%-8.1f\t%ld%s\n", length, maxErrors, myersTime, naiveTime,
+                myersTime > 0 ? naiveTime / myersTime : 0, myersMatches, (myersMatches == naiveMatches) ? "" : ERROR_COLOR " (differ!)" RESET);
+    }
+    fprintf(output_stream, DIM "Matches: bases where a match with at most that many edits ends, by either method. Random bases; patterns have some N.\n" RESET);
+    free(text);
+}
+
+
+
+// ****************************************************  Ribosome binding site functions  ***************************************************
+
+// Shine-Dalgarno variants looked for upstream of each START, longest first (consensus UAAGGAGGU). Matches are
+// found in the same pass that tokenizes the sequence, by one Aho-Corasick automaton that has every variant twice:
+// as read on the forward strand, and backwards, for the reverse strand (read backwards by tokenize_seq()). Optionally,
+// the consensus (the first variant) is also matched with a few edits, by two bit-vector matchers in the same pass
+char* SHINE_DALGARNO_MOTIFS[] = { "AGGAGGU", "AGGAGG", "GGAGGU", "AGGAG", "GGAGG", "GAGGU", "AGGA", "GGAG", "GAGG" };
+const int NUM_OF_SHINE_DALGARNO_MOTIFS = 9;
+#define RBS_DEFAULT_WINDOW 20       // Bases upstream of a START that are searched
+#define RBS_BEST_SPACER 7           // Bases between motif and START that work best; breaks ties between matches
+#define RBS_MAX_STATES 128
+#define RBS_MAX_EDITS 3
+
+typedef struct
+{
+    int next[RBS_MAX_STATES][4];            // By base code (see codonToIndex()): failures already folded in
+    uint16_t forwardMotifs[RBS_MAX_STATES]; // Bit m set if motif m, as read forwards, ends at the state
+    uint16_t reverseMotifs[RBS_MAX_STATES]; // Same, for the motifs read backwards
+    int motifLengths[16];
+    int numOfStates;
+    int windowLength;
+    int maxEdits;                           // Of the approximate matches of the consensus, 0 for none
+} RbsAutomaton;
+
+// State of the automaton after each base (0-based) of one sequence, in the analysis arena. The motifs of that
+// state end at the base: their last base when read forwards, their first one when read backwards. With edits, also
+// the distance of the best match of the consensus that ends at the base (at its highest base, on either strand)
+typedef struct
+{
+    const char* sequence;
+    unsigned char* stateAt;
+    unsigned char* forwardDistanceAt;       // NULL if there are no approximate matches
+    unsigned char* reverseDistanceAt;
+    MyersMatcher forwardMatcher, reverseMatcher;
+} RbsMatches;
+
+// The motif upstream of one START of a found ORF
+typedef struct
+{
+    int orfNumber;                  // 1-based, in the order the ORFs are listed
+    int startPosition;              // As in the ORF's codons
+    int motif;                      // Index in SHINE_DALGARNO_MOTIFS, -1 if there is none in the window
+    int spacer;                     // Bases between the motif and the START
+    int edits;                      // 0 for an exact match; otherwise the motif is the consensus
+} RbsSite;
+
+// Starts annotated by find_all_sequences(); starts zeroed and is reused by the next analysis, like codon usage
+typedef struct
+{
+    RbsSite* sites;
+    int numOfSites, capacity;
+} RbsAnnotations;
+
+void addRbsPattern(RbsAutomaton* automaton, const char* motif, int motifIndex, bool isReversed)
+{
+    int length = strlen(motif), state = 0;
+    for (int i = 0; i < length; i++)
+    {
+        int code = getBaseCode(motif[isReversed ? length - 1 - i : i]);
+        if (automaton->next[state][code] == 0)
+        {
+            automaton->next[state][code] = automaton->numOfStates++;
+        }
+        state = automaton->next[state][code];
+    }
+    if (isReversed) automaton->reverseMotifs[state] |= (uint16_t) (1 << motifIndex);
+    else automaton->forwardMotifs[state] |= (uint16_t) (1 << motifIndex);
+}
+
+RbsAutomaton* buildRbsAutomaton(int windowLength, int maxEdits)
+{
+    RbsAutomaton* automaton = (RbsAutomaton*) calloc(1, sizeof(RbsAutomaton));
+    if (automaton == NULL) return NULL;
+    automaton->windowLength = windowLength;
+    automaton->maxEdits = maxEdits;
+    automaton->numOfStates = 1;
+    for (int i = 0; i < NUM_OF_SHINE_DALGARNO_MOTIFS; i++)
+    {
+        automaton->motifLengths[i] = strlen(SHINE_DALGARNO_MOTIFS[i]);
+        addRbsPattern(automaton, SHINE_DALGARNO_MOTIFS[i], i, FALSE);
+        addRbsPattern(automaton, SHINE_DALGARNO_MOTIFS[i], i, TRUE);
+    }
+
+    // Breadth first, every state's failure (longest proper suffix that is a state) is done before the state
+    int failure[RBS_MAX_STATES] = { 0 }, queue[RBS_MAX_STATES], head = 0, tail = 0;
+    for (int code = 0; code < 4; code++)
+    {
+        if (automaton->next[0][code] != 0) queue[tail++] = automaton->next[0][code];
+    }
+    while (head < tail)
+    {
+        int state = queue[head++];
+        // Motifs ending at the failure end here too
+        automaton->forwardMotifs[state] |= automaton->forwardMotifs[failure[state]];
+        automaton->reverseMotifs[state] |= automaton->reverseMotifs[failure[state]];
+        for (int code = 0; code < 4; code++)
+        {
+            int child = automaton->next[state][code];
+            if (child != 0)
+            {
+                failure[child] = automaton->next[failure[state]][code];
+                queue[tail++] = child;
+            } else
+            {
+                automaton->next[state][code] = automaton->next[failure[state]][code];
+            }
+        }
+    }
+    return automaton;
+}
+
+// One base of the pass over the sequence; returns the automaton's new state
+int stepRbsAutomaton(RbsAutomaton* automaton, RbsMatches* matches, int state, const char* sequence, int base)
+{
+    int code = getBaseCode(sequence[base]);
+    state = (code < 0) ? 0 : automaton->next[state][code];
+    matches->stateAt[base] = (unsigned char) state;
+    return state;
+}
+
+// The same base, for the approximate matches of the consensus (only if edits are allowed)
+void stepRbsMatchers(RbsMatches* matches, int base)
+{
+    int code = getBaseCode(matches->sequence[base]);
+    matches->forwardDistanceAt[base] = (unsigned char) stepMyersMatcher(&matches->forwardMatcher, code);
+    matches->reverseDistanceAt[base] = (unsigned char) stepMyersMatcher(&matches->reverseMatcher, code);
+}
+
+bool allocateRbsMatches(RbsAutomaton* automaton, Arena* arena, RbsMatches* matches, const char* sequence, int sequenceLength)
+{
+    memset(matches, 0, sizeof(RbsMatches));
+    matches->sequence = sequence;
+    matches->stateAt = (unsigned char*) arenaAlloc(arena, sequenceLength + 1); // Every base is stepped over
+    if (matches->stateAt == NULL) return FALSE;
+    if (automaton->maxEdits > 0)
+    {
+        matches->forwardDistanceAt = (unsigned char*) arenaAlloc(arena, sequenceLength + 1);
+        matches->reverseDistanceAt = (unsigned char*) arenaAlloc(arena, sequenceLength + 1);
+        if (matches->forwardDistanceAt == NULL || matches->reverseDistanceAt == NULL) return FALSE;
+        initMyersMatcher(&matches->forwardMatcher, SHINE_DALGARNO_MOTIFS[0], automaton->motifLengths[0], FALSE);
+        initMyersMatcher(&matches->reverseMatcher, SHINE_DALGARNO_MOTIFS[0], automaton->motifLengths[0], TRUE);
+    }
+    return TRUE;
+}
+
+// Matches are ranked by how many bases they have in common with the motif (its length, less the edits), then exact
+// ones first, then by how close their spacer is to RBS_BEST_SPACER
+void considerRbsMatch(RbsSite* site, int* bestScore, int motif, int score, int edits, int spacer)
+{
+    if (score > *bestScore || (score == *bestScore && (edits < site->edits ||
+        (edits == site->edits && abs(spacer - RBS_BEST_SPACER) < abs(site->spacer - RBS_BEST_SPACER)))))
+    {
+        *bestScore = score;
+        site->motif = motif;
+        site->spacer = spacer;
+        site->edits = edits;
+    }
+}
+
+// The best motif in the window upstream of the START in codon slot 'slot' (see considerRbsMatch())
+RbsSite findRbsOfStart(RbsAutomaton* automaton, RbsMatches* matches, int sequenceLength, direction strand, int slot)
+{
+    RbsSite site = { 0, getSlotPosition(slot, strand), -1, 0, 0 };
+    int bestScore = 0;
+    for (int distance = 0; distance < automaton->windowLength; distance++)
+    {
+        // Forward: motifs ending 'distance' bases below the codon. Reverse: ending (read backwards) that far above it,
+        // so found by the pass at their highest base
+        int base = (strand == FORWARD) ? slot * CODONS_LENGTH - 1 - distance : (slot + 1) * CODONS_LENGTH + distance;
+        if (base < 0 || base >= sequenceLength) break;
+
+        int state = matches->stateAt[base];
+        uint16_t motifs = (strand == FORWARD) ? automaton->forwardMotifs[state] : automaton->reverseMotifs[state];
+        for (int motif = 0; motifs != 0; motif++, motifs >>= 1)
+        {
+            if (!(motifs & 1)) continue;
+            int length = automaton->motifLengths[motif];
+            int spacer = (strand == FORWARD) ? distance : distance - length + 1;
+            if (spacer < 0 || spacer + length > automaton->windowLength) continue; // Overlaps the START, or sticks out of the window
+            considerRbsMatch(&site, &bestScore, motif, length, 0, spacer);
+        }
+
+        int edits = (matches->forwardDistanceAt == NULL) ? 0 : (strand == FORWARD) ? matches->forwardDistanceAt[base] : matches->reverseDistanceAt[base];
+        if (edits == 0 || edits > automaton->maxEdits) continue; // Exact matches of the consensus are found above
+        int first = getApproximateMatchFirst(SHINE_DALGARNO_MOTIFS[0], automaton->motifLengths[0], strand == REVERSE, matches->sequence, base, edits);
+        int spacer = (strand == FORWARD) ? distance : first - (slot + 1) * CODONS_LENGTH;
+        if (spacer < 0 || spacer + (base - first + 1) > automaton->windowLength) continue;
+        considerRbsMatch(&site, &bestScore, 0, automaton->motifLengths[0] - edits, edits, spacer);
+    }
+    return site;
+}
+
+void addRbsSite(RbsAnnotations* annotations, RbsSite* site)
+{
+    if (annotations->numOfSites == annotations->capacity)
+    {
+        int capacity = annotations->capacity ? annotations->capacity * 2 : 64;
+        RbsSite* grown = (RbsSite*) realloc(annotations->sites, sizeof(RbsSite) * capacity);
+        if (grown == NULL) return;
+        annotations->sites = grown;
+        annotations->capacity = capacity;
+    }
+    annotations->sites[annotations->numOfSites++] = *site;
+}
+
+// Annotates every START of an ORF, numbered 'orfNumber' in its list
+void annotateRbsOfOrf(RbsAutomaton* automaton, RbsMatches* matches, int sequenceLength, Sequence* orf, int orfNumber, RbsAnnotations* annotations)
+{
+    for (int i = 0; i < orf->length / CODONS_LENGTH; i++)
+    {
+        if (orf->specialCodons[i].type != START) continue;
+        RbsSite site = findRbsOfStart(automaton, matches, sequenceLength, orf->seqDirection, getSlotOfPosition(orf->specialCodons[i].positionInSequence, orf->seqDirection));
+        site.orfNumber = orfNumber;
+        addRbsSite(annotations, &site);
+    }
+}
+
+// For results that weren't scanned now (e.g. from the analysis cache): the same pass, on its own
+void annotateRbsOfOrfs(RbsAutomaton* automaton, Arena* arena, DoublyLinkedList* orfs, const char* sequence, int sequenceLength, RbsAnnotations* annotations)
+{
+    RbsMatches matches;
+    annotations->numOfSites = 0;
+    if (!allocateRbsMatches(automaton, arena, &matches, sequence, sequenceLength)) return;
+
+    int state = 0, orfNumber = 0;
+    for (int base = 0; base < sequenceLength; base++)
+    {
+        state = stepRbsAutomaton(automaton, &matches, state, sequence, base);
+        if (matches.forwardDistanceAt != NULL) stepRbsMatchers(&matches, base);
+    }
+    for (ListNode* current = orfs->head; current != NULL; current = current->next)
+    {
+        annotateRbsOfOrf(automaton, &matches, sequenceLength, current->data, ++orfNumber, annotations);
+    }
+}
+
+// Optional columns of an analysis: the Shine-Dalgarno motif found upstream of every START of every ORF
+void printRbsAnnotations(FILE* output_stream, DoublyLinkedList* orfs, RbsAnnotations* annotations, int windowLength)
+{
+    fprintf(output_stream, BOLD "\nRibosome binding sites (Shine-Dalgarno, up to %d bases upstream)\n" RESET, windowLength);
+    fprintf(output_stream, "ORF\tSTRAND\tSTART\tMOTIF\tSPACER\tEDITS\n");
+    ListNode* current = orfs->head;
+    int orfNumber = 1, numOfOrfsWithRbs = 0;
+    bool hasRbs = FALSE;
+    for (int i = 0; i < annotations->numOfSites; i++)
+    {
+        RbsSite* site = &annotations->sites[i];
+        while (current != NULL && orfNumber < site->orfNumber) // Sites come in the ORFs' order
+        {
+            numOfOrfsWithRbs += hasRbs;
+            hasRbs = FALSE;
+            current = current->next;
+            orfNumber++;
+        }
+        if (current == NULL) break;
+
+        fprintf(output_stream, "%d\t%s\t%d\t", site->orfNumber, readDirectionToString(current->data->seqDirection), site->startPosition);
+        if (site->motif < 0)
+        {
+            fprintf(output_stream, "-\t-\t-\n");
+            continue;
+        }
+        fprintf(output_stream, SUCCESS_COLOR "%s" RESET "\t%d\t%d\n", SHINE_DALGARNO_MOTIFS[site->motif], site->spacer, site->edits);
+        // The ORF's own START is its last one (its position)
+        if (site->startPosition == current->data->positionInSupersequence) hasRbs = TRUE;
+    }
+    numOfOrfsWithRbs += hasRbs;
+    fprintf(output_stream, DIM "%d of %d ORF(s) have a Shine-Dalgarno motif upstream of their START.\n" RESET, numOfOrfsWithRbs, orfs->size);
+}
+
+
+
+// ****************************************************  Genetic code functions  ***************************************************
+
+// NCBI translation tables (https://www.ncbi.nlm.nih.gov/Taxonomy/Utils/wprintgc.cgi), as NCBI lists them: the amino
+// acid of every codon in TCAG order (TTT, TTC, TTA, TTG, TCT, ...) and the codons that may be STARTs (M). Each is
+// turned once, by initGeneticCodes(), into its own tables by codon index (see codonToIndex()), so scanners classify a
+// codon with one lookup whatever the code. A sequence is read with the code of the session (--genetic-code), unless
+// its record names its own ("transl_table=N" or "gcode=N" in a FASTA header, or as "[transl_table=N]" before a typed
+// sequence)
+#define NUM_OF_GENETIC_CODES 8
+#define DEFAULT_GENETIC_CODE 0
+
+typedef struct
+{
+    int id;                         // NCBI table number, 0 for the default
+    const char* name;
+    const char* aminoAcids;
+    const char* starts;
+} NcbiTranslationTable;
+
+static const NcbiTranslationTable NCBI_TRANSLATION_TABLES[NUM_OF_GENETIC_CODES] = {
+    // The STARTs looked for before codes could be chosen: the usual ones of table 11
+    { 0, "Bacterial, Archaeal and Plant Plastid, AUG/GUG/UUG STARTs only",
+      "FFLLSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG",
+      "---M-------------------------------M---------------M------------" },
+    { 1, "Standard",
+      "FFLLSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG",
+      "---M---------------M---------------M----------------------------" },
+    { 2, "Vertebrate Mitochondrial",
+      "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIMMTTTTNNKKSS**VVVVAAAADDEEGGGG",
+      "--------------------------------MMMM---------------M------------" },
+    { 3, "Yeast Mitochondrial",
+      "FFLLSSSSYY**CCWWTTTTPPPPHHQQRRRRIIMMTTTTNNKKSSRRVVVVAAAADDEEGGGG",
+      "----------------------------------MM---------------M------------" },
+    { 4, "Mold, Protozoan, and Coelenterate Mitochondrial; Mycoplasma/Spiroplasma",
+      "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG",
+      "--MM---------------M------------MMMM---------------M------------" },
+    { 5, "Invertebrate Mitochondrial",
+      "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIMMTTTTNNKKSSSSVVVVAAAADDEEGGGG",
+      "---M----------------------------MMMM---------------M------------" },
+    { 6, "Ciliate, Dasycladacean and Hexamita Nuclear",
+      "FFLLSSSSYYQQCC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG",
+      "-----------------------------------M----------------------------" },
+    { 11, "Bacterial, Archaeal and Plant Plastid",
+      "FFLLSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG",
+      "---M---------------M------------MMMM---------------M------------" }
+};
+
+typedef struct
+{
+    int id;
+    const char* name;
+    char aminoAcids[NUM_OF_CODON_INDEXES + 1];          // By codon index; * for STOP
+    signed char codonTypes[NUM_OF_CODON_INDEXES];       // specialCodonType of every codon, read forwards...
+    signed char reverseCodonTypes[NUM_OF_CODON_INDEXES]; // ...and backwards, as the reverse strand reads it
+} GeneticCode;
+
+static GeneticCode GENETIC_CODES[NUM_OF_GENETIC_CODES]; // Filled by initGeneticCodes(), read-only afterwards
+
+// Index of the same three bases read backwards, as the reverse strand reads them (see reverseString())
+int reverseCodonIndex(int codonIndex)
+{
+    return ((codonIndex & 3) << 4) | (codonIndex & 12) | (codonIndex >> 4);
+}
+
+// Fills the lookup tables of every code from its NCBI table. Called once at start-up, before any thread is started
+void initGeneticCodes(void)
+{
+    static const int TCAG_ORDER[4] = { 2, 1, 3, 0 }; // Of A, C, G, U
+    for (int c = 0; c < NUM_OF_GENETIC_CODES; c++)
+    {
+        const NcbiTranslationTable* table = &NCBI_TRANSLATION_TABLES[c];
+        GeneticCode* code = &GENETIC_CODES[c];
+        code->id = table->id;
+        code->name = table->name;
+        for (int i = 0; i < NUM_OF_CODON_INDEXES; i++)
+        {
+            int ncbiIndex = (TCAG_ORDER[i >> 4] << 4) | (TCAG_ORDER[(i >> 2) & 3] << 2) | TCAG_ORDER[i & 3];
+            code->aminoAcids[i] = table->aminoAcids[ncbiIndex];
+            code->codonTypes[i] = (code->aminoAcids[i] == '*') ? STOP : (table->starts[ncbiIndex] == 'M') ? START : PLAIN;
+        }
+        code->aminoAcids[NUM_OF_CODON_INDEXES] = '\0';
+        for (int i = 0; i < NUM_OF_CODON_INDEXES; i++)
+        {
+            code->reverseCodonTypes[i] = code->codonTypes[reverseCodonIndex(i)];
+        }
+    }
+}
+
+// Table 'id'; NULL if it isn't one of GENETIC_CODES
+const GeneticCode* getGeneticCode(int id)
+{
+    for (int c = 0; c < NUM_OF_GENETIC_CODES; c++)
+    {
+        if (GENETIC_CODES[c].id == id) return &GENETIC_CODES[c];
+    }
+    return NULL;
+}
+
+// Type of a codon given by its index, in genetic code 'code'
+specialCodonType getTypeOfCodonIndex(const GeneticCode* code, int codonIndex)
+{
+    return (codonIndex >= 0 && codonIndex < NUM_OF_CODON_INDEXES) ? (specialCodonType) code->codonTypes[codonIndex] : PLAIN;
+}
+
+// Table number of "transl_table=N" or "gcode=N" in a FASTA header or typed tag, -1 if there's none
+int findGeneticCodeTag(const char* text)
+{
+    const char* tag = strstr(text, "transl_table=");
+    if (tag != NULL) return atoi(tag + strlen("transl_table="));
+    tag = strstr(text, "gcode=");
+    if (tag != NULL && (tag == text || !isalpha((unsigned char) tag[-1]))) return atoi(tag + strlen("gcode=")); // Not "mgcode="
+    return -1;
+}
+
+// Code of a record whose header (or typed tag) is 'header': its own, or 'defaultCode' if it has none or an unknown one
+const GeneticCode* getGeneticCodeOfRecord(FILE* output_stream, const char* header, const char* name, const GeneticCode* defaultCode)
+{
+    int id = (header != NULL) ? findGeneticCodeTag(header) : -1;
+    if (id < 0) return defaultCode;
+    const GeneticCode* code = getGeneticCode(id);
+    if (code == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "%s: genetic code %d isn't supported, so it's read with code %d.\a\n" RESET, name, id, defaultCode->id);
+        return defaultCode;
+    }
+    return code;
+}
+
+// Takes a leading "[transl_table=N]" (or "[gcode=N]") off a typed sequence; returns N, or -1 if there's no such tag
+int takeGeneticCodeTag(char* line, int* length)
+{
+    char* end = (line[0] == '[') ? strchr(line, ']') : NULL;
+    if (end == NULL) return -1;
+    *end = '\0';
+    int id = findGeneticCodeTag(line);
+    if (id < 0)
+    {
+        *end = ']';
+        return -1;
+    }
+    end++;
+    while (isspace((unsigned char) *end)) end++;
+    *length -= (int) (end - line);
+    memmove(line, end, *length + 1);
+    return id;
+}
+
+void printGeneticCodes(FILE* stream)
+{
+    for (int c = 0; c < NUM_OF_GENETIC_CODES; c++)
+    {
+        fprintf(stream, "  %2d: %s%s\n", GENETIC_CODES[c].id, GENETIC_CODES[c].name, (GENETIC_CODES[c].id == DEFAULT_GENETIC_CODE) ? " (default)" : "");
+    }
+}
+
+// The same sequence gives other ORFs with another code, so results (cached, indexed) are told apart by code too.
+// With the default code, it's just the sequence's hash
+uint64_t hashAnalyzedSequence(const char* sequence, size_t sequenceLength, const GeneticCode* code)
+{
+    return hashSequence64(sequence, sequenceLength) ^ ((uint64_t) code->id * HASH_PRIME_1);
+}
+
+
+
+// ****************************************************  Sequencing-related functions  ***************************************************
+
+// Optional inputs and outputs of find_all_sequences(), the outputs gathered in its scan; the ones left NULL aren't used
+typedef struct
+{
+    AnalysisCodonUsage* codonUsage;
+    RbsAutomaton* rbsAutomaton;
+    RbsAnnotations* rbsAnnotations;
+    const uint8_t* softMask;        // ORFs that overlap its masked bases are left out, and counted here:
+    int numOfSkippedOrfs;
+    const uint8_t* packedBases;     // The input as normalizeSequence() packed it, so codons are read from it...
+    const NormalizationStats* normalization; // ...unless these counts say it holds N or other codes, which don't pack
+    const GeneticCode* geneticCode; // Of the input; NULL reads it with DEFAULT_GENETIC_CODE
+} ScanExtras;
+
+int is_start_codon(char* codon) {
+
+	for (int i = 0; i < NUM_OF_START_CODONS; ++i)
+	{
+		if ( strncmp(codon, START_CODONS[i], CODONS_LENGTH) == 0 )
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+int is_stop_codon(char* codon) {
+
+	for (int i = 0; i < NUM_OF_STOP_CODONS; ++i)
+	{
+		if ( strncmp(codon, STOP_CODONS[i], CODONS_LENGTH) == 0 )
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Like createSequence(), but in an arena: released together with everything else of the same analysis
+Sequence* createSequenceInArena(Arena* arena, int length, direction seqDirection, int positionInSupersequence, bool isCodingSequence, int numOfCodons)
+{
+    return initSequence(arenaAlloc(arena, getSequenceSize(numOfCodons)), length, seqDirection, positionInSupersequence, isCodingSequence, numOfCodons);
+}
+
+// Everything allocated here comes from 'analysisArena', so one resetArena() releases it all once the results are copied out.
+// If 'codonIndexes' isn't NULL, it gets the codonToIndex() of every forward codon, for the codon usage; with an
+// 'rbsAutomaton', Shine-Dalgarno motifs are matched base by base into 'rbsMatches'.
+// 'sequence' is already normalized; with its 'packedBases' (NULL if it has N or other codes, which don't pack), each
+// codon is read from the packed bases, and its letters on both strands are written from its codon index
+Sequence** tokenize_seq(FILE* output_stream, Arena* analysisArena, char* sequence, int sequenceLength, const uint8_t* packedBases,
+                        const GeneticCode* geneticCode, signed char* codonIndexes, RbsAutomaton* rbsAutomaton, RbsMatches* rbsMatches) { 
+
+	int numOfCodons = sequenceLength/CODONS_LENGTH;
+	Sequence** givenAndReversedSeq = (Sequence**) arenaAlloc(analysisArena, 2 * sizeof(Sequence*));
+	Sequence* forwardSequence = createSequenceInArena(analysisArena, sequenceLength, FORWARD, 0, UNDEFINED, numOfCodons);
+    Sequence* backwardSequence = createSequenceInArena(analysisArena, sequenceLength, REVERSE, 0, UNDEFINED, numOfCodons);
+	if (givenAndReversedSeq == NULL || forwardSequence == NULL || backwardSequence == NULL) {
+	    fprintf(output_stream, ERROR_COLOR "Memory allocation failed. Couldn't store sequence.\n%s\a\n" RESET, strerror(errno));
+	    exit(EXIT_FAILURE);
+	}
+
+	// Codons are classified by the tables of the sequence's genetic code, looked up once here
+	const signed char* forwardTypes = geneticCode->codonTypes;
+	const signed char* reverseTypes = geneticCode->reverseCodonTypes;
+
+	int rbsState = 0;
+	for (int seqIndex = 0; seqIndex < sequenceLength; /*seqIndex + CODONS_LENGTH, but it's done at the last step of each iteration */ )
 	{	
 		int codonsForwardIndex = seqIndex/CODONS_LENGTH; // We scan sequence in frames of length CODONS_LENGTH, but array with sequence's codons have an index that's inceremnted by one
 		int codonsBackwardIndex = (sequenceLength - seqIndex)/CODONS_LENGTH - 1; // Follow the logic as above, but start from the end of the array and move backwards in reverse order
 		
-		char* forwardCodon = (char*)malloc(sizeof(char) * CODONS_LENGTH + 1); // +1 is for null termination
-		strncpy(forwardCodon, &sequence[seqIndex], CODONS_LENGTH);
-		forwardCodon[CODONS_LENGTH] = '\0';
+		int codonIndex = (packedBases != NULL) ? getPackedCodonIndex(packedBases, seqIndex) : codonToIndex(&sequence[seqIndex]);
+		if (codonIndexes != NULL)
+		{
+			codonIndexes[codonsForwardIndex] = (signed char) codonIndex;
+		}
+		if (rbsAutomaton != NULL)
+		{
+			for (int base = seqIndex; base < seqIndex + CODONS_LENGTH; base++)
+			{
+				rbsState = stepRbsAutomaton(rbsAutomaton, rbsMatches, rbsState, sequence, base);
+			}
+			for (int base = seqIndex; rbsMatches->forwardDistanceAt != NULL && base < seqIndex + CODONS_LENGTH; base++)
+			{
+				stepRbsMatchers(rbsMatches, base);
+			}
+		}
+
+		char* forwardCodon = forwardSequence->specialCodons[codonsForwardIndex].codonSequence; // Written straight in, no temporary strings
+		if (codonIndex >= 0) indexToCodon(codonIndex, forwardCodon);
+		else
+		{
+			memcpy(forwardCodon, &sequence[seqIndex], CODONS_LENGTH); // With an N or other code: as typed
+			forwardCodon[CODONS_LENGTH] = '\0';
+		}
+
+		forwardSequence->specialCodons[codonsForwardIndex].type = (codonIndex < 0) ? PLAIN : (specialCodonType) forwardTypes[codonIndex];
+		forwardSequence->specialCodons[codonsForwardIndex].positionInSequence = seqIndex+1; // human-readable ordering
+
+
+    	//  ****************************  check reverse codon  **********************************************
+
+		char* reverseCodon = backwardSequence->specialCodons[codonsBackwardIndex].codonSequence;
+		if (codonIndex >= 0) indexToCodon(reverseCodonIndex(codonIndex), reverseCodon);
+		else
+		{
+			for (int base = 0; base < CODONS_LENGTH; base++)
+			{
+				reverseCodon[base] = sequence[seqIndex + CODONS_LENGTH - 1 - base];
+			}
+			reverseCodon[CODONS_LENGTH] = '\0';
+		}
+
+		backwardSequence->specialCodons[codonsBackwardIndex].type = (codonIndex < 0) ? PLAIN : (specialCodonType) reverseTypes[codonIndex];
+		backwardSequence->specialCodons[codonsBackwardIndex].positionInSequence = seqIndex + CODONS_LENGTH; 
+
+        seqIndex += CODONS_LENGTH;
+	}
+
+	givenAndReversedSeq[0] = forwardSequence;
+	givenAndReversedSeq[1] = backwardSequence;
+	
+	return givenAndReversedSeq;
+}
+
+// Found ORFs are copied out of the arena (createSequence2), so they outlive the next resetArena(analysisArena).
+// With 'extras' (NULL for none), the codons of the input and of every ORF are counted during the same walk, and
+// the STARTs of every ORF are annotated with the Shine-Dalgarno motif upstream of them
+DoublyLinkedList* find_all_sequences(FILE* output_stream, Arena* analysisArena, char* sequence, int sequenceLength, ScanExtras* extras) {
+
+	int numOfSlots = sequenceLength/CODONS_LENGTH;
+	AnalysisCodonUsage* codonUsage = (extras != NULL) ? extras->codonUsage : NULL;
+	RbsAutomaton* rbsAutomaton = (extras != NULL) ? extras->rbsAutomaton : NULL;
+	const uint8_t* softMask = (extras != NULL) ? extras->softMask : NULL;
+	if (extras != NULL) extras->numOfSkippedOrfs = 0;
+	const NormalizationStats* normalization = (extras != NULL) ? extras->normalization : NULL;
+	const uint8_t* packedBases = (normalization != NULL && normalization->numOfChars[BASE_CLASS_UNKNOWN] + normalization->numOfChars[BASE_CLASS_AMBIGUOUS] == 0)
+	                             ? extras->packedBases : NULL;
+	const GeneticCode* geneticCode = (extras != NULL && extras->geneticCode != NULL) ? extras->geneticCode : getGeneticCode(DEFAULT_GENETIC_CODE);
+	signed char* codonIndexes = NULL;
+	CodonUsage* orfUsage = NULL; // Counted in place, in the next record of 'codonUsage'
+	RbsMatches rbsMatches;
+	if (codonUsage != NULL)
+	{
+		resetAnalysisCodonUsage(codonUsage);
+		codonIndexes = (signed char*) arenaAlloc(analysisArena, numOfSlots + 1);
+	}
+	if (rbsAutomaton != NULL)
+	{
+		extras->rbsAnnotations->numOfSites = 0;
+		if (!allocateRbsMatches(rbsAutomaton, analysisArena, &rbsMatches, sequence, sequenceLength)) rbsAutomaton = NULL;
+	}
+	Sequence** givenAndReversedSeq = tokenize_seq(output_stream, analysisArena, sequence, sequenceLength, packedBases, geneticCode, codonIndexes, rbsAutomaton, &rbsMatches);
+	DoublyLinkedList* validSequencesList = createList();
+
+	Sequence* newValidSequence;
+
+	// An ORF's codons sit next to each other in the tokenized sequence, from its first START up to the STOP, so
+	// they are handed to createSequence2() in place instead of being collected one by one
+	int firstCodonIndex = 0;
+  	int codonsArraySize = 0;
+
+	bool foundStartCodon = FALSE;
+	int positionInSupersequence;
+
+	// *********************     FORWARD SEQUENCE :    ***********************************************************
+
+	for (int i = 0; i < givenAndReversedSeq[0]->length/CODONS_LENGTH; i++)
+	{
+
+		if ( givenAndReversedSeq[0]->specialCodons[i].type == START )
+		{
+			if (!foundStartCodon)
+			{
+				firstCodonIndex = i;
+				if (codonUsage != NULL) orfUsage = getNextOrfCodonUsage(codonUsage);
+			}
+			foundStartCodon = TRUE;
+			positionInSupersequence = givenAndReversedSeq[0]->specialCodons[i].positionInSequence; // TODO: doesn't give the super-sequence's position, but newValidSeq's. Change that! ---> Most probably SOLVED!
+		}
+
+		if (codonUsage != NULL && codonIndexes[i] >= 0) // Counts only: the numbers of codons are known at the end
+		{
+			codonUsage->ofSequence.codonCounts[(int) codonIndexes[i]]++;
+			if (foundStartCodon && orfUsage != NULL) orfUsage->codonCounts[(int) codonIndexes[i]]++;
+		}
+
+		if (foundStartCodon && givenAndReversedSeq[0]->specialCodons[i].type == STOP && softMask != NULL
+		    && isSoftMasked(softMask, givenAndReversedSeq[0]->specialCodons[firstCodonIndex].positionInSequence - 1, givenAndReversedSeq[0]->specialCodons[i].positionInSequence + 1))
+		{
+			// Left out before anything is made of it; its codon usage record is cleared for the next ORF
+			extras->numOfSkippedOrfs++;
+			orfUsage = NULL;
+			foundStartCodon = FALSE;
+		}
+
+		if (foundStartCodon && givenAndReversedSeq[0]->specialCodons[i].type == STOP)
+		{
+			// Found a valid sequence, so we create the struct that will kepp its info and we store it to the array with all valid sequences
+			codonsArraySize = i - firstCodonIndex + 1;
+			newValidSequence = createSequence2(codonsArraySize*CODONS_LENGTH, givenAndReversedSeq[0]->seqDirection, positionInSupersequence, TRUE, &givenAndReversedSeq[0]->specialCodons[firstCodonIndex], codonsArraySize);
+			appendToList(validSequencesList, newValidSequence);
+			if (rbsAutomaton != NULL)
+			{
+				annotateRbsOfOrf(rbsAutomaton, &rbsMatches, sequenceLength, newValidSequence, validSequencesList->size, extras->rbsAnnotations);
+			}
+			if (orfUsage != NULL)
+			{
+				orfUsage->numOfCodons = codonsArraySize;
+				codonUsage->numOfOrfs++;
+				orfUsage = NULL;
+			}
+			foundStartCodon = FALSE;
+		}
+	}
+
+		
+	if (codonUsage != NULL)
+	{
+		codonUsage->ofSequence.numOfCodons = numOfSlots;
+	}
+
+	// *********************     BACKWARD SEQUENCE :    ***********************************************************
+
+	foundStartCodon = FALSE;
+
+	for (int i = 0; i < givenAndReversedSeq[1]->length/CODONS_LENGTH; i++)
+	{
+
+		if ( givenAndReversedSeq[1]->specialCodons[i].type == START )
+		{
+			if (!foundStartCodon)
+			{
+				firstCodonIndex = i;
+				if (codonUsage != NULL) orfUsage = getNextOrfCodonUsage(codonUsage);
+			}
+			foundStartCodon = TRUE;
+			positionInSupersequence = givenAndReversedSeq[1]->specialCodons[i].positionInSequence;
+		}
+
+		if (orfUsage != NULL && foundStartCodon && codonIndexes[numOfSlots - 1 - i] >= 0) // Reverse slot i holds the forward codon numOfSlots-1-i, read backwards
+		{
+			orfUsage->codonCounts[reverseCodonIndex(codonIndexes[numOfSlots - 1 - i])]++;
+		}
+
+		if (foundStartCodon && givenAndReversedSeq[1]->specialCodons[i].type == STOP && softMask != NULL
+		    && isSoftMasked(softMask, givenAndReversedSeq[1]->specialCodons[i].positionInSequence - CODONS_LENGTH, givenAndReversedSeq[1]->specialCodons[firstCodonIndex].positionInSequence - 1))
+		{
+			extras->numOfSkippedOrfs++;
+			orfUsage = NULL;
+			foundStartCodon = FALSE;
+		}
+
+		if (foundStartCodon && givenAndReversedSeq[1]->specialCodons[i].type == STOP)
+		{
+			// Found a valid sequence, so we create the struct that will kepp its info and we store it to the array with all valid sequences
+			codonsArraySize = i - firstCodonIndex + 1;
+			newValidSequence = createSequence2(codonsArraySize*CODONS_LENGTH, givenAndReversedSeq[1]->seqDirection, positionInSupersequence, TRUE, &givenAndReversedSeq[1]->specialCodons[firstCodonIndex], codonsArraySize);
+			appendToList(validSequencesList, newValidSequence);
+			if (rbsAutomaton != NULL)
+			{
+				annotateRbsOfOrf(rbsAutomaton, &rbsMatches, sequenceLength, newValidSequence, validSequencesList->size, extras->rbsAnnotations);
+			}
+			if (orfUsage != NULL)
+			{
+				orfUsage->numOfCodons = codonsArraySize;
+				codonUsage->numOfOrfs++;
+				orfUsage = NULL;
+			}
+			foundStartCodon = FALSE;
+		}
+	}
+
+	return validSequencesList;
+}
+
+
+
+
+// ****************************************************  Archive sharding functions  ***************************************************
+
+// The archive file given by the user is the active shard, where new results are written. Once it grows past
+// ARCHIVE_SHARD_MAX_BYTES, or holds results older than ARCHIVE_SHARD_MAX_AGE_SECONDS, it is sealed: renamed to
+// <archive>.shard-NNNNNN and listed in <archive>.manifest. Sealed shards are never rewritten by a session, and
+// can be dropped one by one, or compressed (see the block-compressed archive functions).
+#define ARCHIVE_SHARD_MAX_BYTES (64L << 20)
+#define ARCHIVE_SHARD_MAX_AGE_SECONDS (24*60*60)
+#define MANIFEST_SUFFIX ".manifest"
+#define CORRUPT_SUFFIX ".corrupt"
+#define MAX_CORRUPT_COPIES 100
+#define MAX_LOADER_THREADS 16
+#define ACTIVE_SHARD_ID -1
+
+typedef struct
+{
+    int id;
+    int numOfRecords;
+    long bytes;
+    time_t firstTime, lastTime;     // Oldest and newest analysis in the shard
+    bool isCompressed;              // Block-compressed shards stay on disk, queries read them block by block
+    int firstLoadedRecord;          // Where its records start in the loaded history, -1 if they aren't in it
+} ArchiveShard;
+
+// Sealed shards, oldest first
+typedef struct
+{
+    ArchiveShard* shards;
+    int numOfShards;
+    int capacity;
+    int nextShardId;
+    bool hasPendingActiveShard;     // A compaction's new active shard is still to be moved over the archive file:
+    int pendingActiveShardId;       // this one (see finishPendingActiveShard())
+} ArchiveManifest;
+
+char* getShardPath(const char* archivePath, int shardId)
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".shard-%06d", shardId);
+    return getSidecarPath(archivePath, suffix);
+}
+
+void addShardToManifest(ArchiveManifest* manifest, ArchiveShard* shard)
+{
+    if (manifest->numOfShards == manifest->capacity)
+    {
+        manifest->capacity = manifest->capacity ? manifest->capacity * 2 : 8;
+        manifest->shards = (ArchiveShard*) realloc(manifest->shards, sizeof(ArchiveShard) * manifest->capacity);
+    }
+    manifest->shards[manifest->numOfShards++] = *shard;
+    if (shard->id >= manifest->nextShardId)
+    {
+        manifest->nextShardId = shard->id + 1;
+    }
+}
+
+void removeShardFromManifest(ArchiveManifest* manifest, int position)
+{
+    memmove(&manifest->shards[position], &manifest->shards[position + 1], sizeof(ArchiveShard) * (manifest->numOfShards - position - 1));
+    manifest->numOfShards--;
+}
+
+ArchiveShard* findArchiveShard(ArchiveManifest* manifest, int shardId)
+{
+    for (int i = 0; i < manifest->numOfShards; i++)
+    {
+        if (manifest->shards[i].id == shardId) return &manifest->shards[i];
+    }
+    return NULL;
+}
+
+// The shard that record 'record' of the loaded history comes from, and its index in that shard
+int getShardOfHistoryRecord(ArchiveManifest* manifest, int numOfSealedRecords, int record, int* indexInShard)
+{
+    ArchiveShard* shard = NULL;
+    for (int i = 0; i < manifest->numOfShards && record < numOfSealedRecords; i++)
+    {
+        if (manifest->shards[i].firstLoadedRecord >= 0 && manifest->shards[i].firstLoadedRecord <= record) shard = &manifest->shards[i];
+    }
+    if (shard == NULL)
+    {
+        *indexInShard = record - numOfSealedRecords;
+        return ACTIVE_SHARD_ID;
+    }
+    *indexInShard = record - shard->firstLoadedRecord;
+    return shard->id;
+}
+
+void freeArchiveManifest(ArchiveManifest* manifest)
+{
+    if (manifest == NULL) return;
+    free(manifest->shards);
+    free(manifest);
+}
+
+void addDatetimeToJson(cJSON* jsonObject, const char* name, time_t datetime)
+{
+    char datetimeString[20+1] = "";
+    if (datetime != 0)
+    {
+        strftime(datetimeString, sizeof(datetimeString), "%Y-%m-%d %H:%M:%S", localtime(&datetime));
+    }
+    cJSON_AddStringToObject(jsonObject, name, datetimeString);
+}
+
+time_t getDatetimeFromJson(cJSON* jsonObject, const char* name)
+{
+    cJSON* jsonDatetime = cJSON_GetObjectItem(jsonObject, name);
+    return cJSON_IsString(jsonDatetime) ? parseDatetime(jsonDatetime->valuestring) : 0;
+}
+
+// A missing manifest just means the archive has no sealed shards (yet)
+ArchiveManifest* loadArchiveManifest(FILE* output_stream, const char* archivePath)
+{
+    ArchiveManifest* manifest = (ArchiveManifest*) calloc(1, sizeof(ArchiveManifest));
+    if (manifest == NULL) return NULL;
+
+    char* manifestPath = getSidecarPath(archivePath, MANIFEST_SUFFIX);
+    FILE* manifestFile = (manifestPath != NULL) ? fopen(manifestPath, "r") : NULL;
+    char* manifestJSON = (manifestFile != NULL) ? readJsonFromFile(output_stream, manifestFile) : NULL;
+    free(manifestPath);
+    if (manifestJSON == NULL) return manifest;
+
+    Arena* jsonArena = createArena(ARENA_BLOCK_SIZE);
+    if (jsonArena == NULL)
+    {
+        free(manifestJSON);
+        return manifest;
+    }
+    beginJsonArena(jsonArena);
+
+    cJSON* jsonManifest = cJSON_Parse(manifestJSON);
+    if (jsonManifest == NULL && strlen(manifestJSON) > 0)
+    {
+        fprintf(output_stream, ERROR_COLOR "Archive manifest of '%s' is corrupted, sealed shards are ignored.\a\n" RESET, archivePath);
+    }
+    cJSON* jsonNextShardId = cJSON_GetObjectItem(jsonManifest, "nextShardId");
+    cJSON* jsonShard;
+    cJSON_ArrayForEach(jsonShard, cJSON_GetObjectItem(jsonManifest, "shards"))
+    {
+        cJSON* jsonId = cJSON_GetObjectItem(jsonShard, "id");
+        if (!cJSON_IsNumber(jsonId)) continue;
+
+        ArchiveShard shard = { 0 };
+        shard.id = jsonId->valueint;
+        shard.numOfRecords = cJSON_IsNumber(cJSON_GetObjectItem(jsonShard, "numOfRecords")) ? cJSON_GetObjectItem(jsonShard, "numOfRecords")->valueint : 0;
+        shard.bytes = cJSON_IsNumber(cJSON_GetObjectItem(jsonShard, "bytes")) ? (long) cJSON_GetObjectItem(jsonShard, "bytes")->valuedouble : 0;
+        shard.firstTime = getDatetimeFromJson(jsonShard, "firstDatetime");
+        shard.lastTime = getDatetimeFromJson(jsonShard, "lastDatetime");
+        cJSON* jsonFormat = cJSON_GetObjectItem(jsonShard, "format");
+        shard.isCompressed = cJSON_IsString(jsonFormat) && strcmp(jsonFormat->valuestring, "blocks") == 0;
+        addShardToManifest(manifest, &shard);
+    }
+    if (cJSON_IsNumber(jsonNextShardId) && jsonNextShardId->valueint > manifest->nextShardId)
+    {
+        manifest->nextShardId = jsonNextShardId->valueint;
+    }
+    cJSON* jsonPendingActiveShardId = cJSON_GetObjectItem(jsonManifest, "pendingActiveShardId");
+    manifest->hasPendingActiveShard = cJSON_IsNumber(jsonPendingActiveShardId);
+    manifest->pendingActiveShardId = manifest->hasPendingActiveShard ? jsonPendingActiveShardId->valueint : 0;
+
+    endJsonArena();
+    freeArena(jsonArena);
+    free(manifestJSON);
+    return manifest;
+}
+
+int saveArchiveManifest(FILE* output_stream, const char* archivePath, ArchiveManifest* manifest)
+{
+    Arena* jsonArena = createArena(ARENA_BLOCK_SIZE);
+    if (jsonArena == NULL) return 0;
+    beginJsonArena(jsonArena);
+
+    cJSON* jsonManifest = cJSON_CreateObject();
+    cJSON_AddNumberToObject(jsonManifest, "nextShardId", manifest->nextShardId);
+    if (manifest->hasPendingActiveShard)
+    {
+        cJSON_AddNumberToObject(jsonManifest, "pendingActiveShardId", manifest->pendingActiveShardId);
+    }
+    cJSON* jsonShards = cJSON_AddArrayToObject(jsonManifest, "shards");
+    for (int i = 0; i < manifest->numOfShards; i++)
+    {
+        cJSON* jsonShard = cJSON_CreateObject();
+        cJSON_AddNumberToObject(jsonShard, "id", manifest->shards[i].id);
+        cJSON_AddNumberToObject(jsonShard, "numOfRecords", manifest->shards[i].numOfRecords);
+        cJSON_AddNumberToObject(jsonShard, "bytes", manifest->shards[i].bytes);
+        addDatetimeToJson(jsonShard, "firstDatetime", manifest->shards[i].firstTime);
+        addDatetimeToJson(jsonShard, "lastDatetime", manifest->shards[i].lastTime);
+        cJSON_AddStringToObject(jsonShard, "format", manifest->shards[i].isCompressed ? "blocks" : "json");
+        cJSON_AddItemToArray(jsonShards, jsonShard);
+    }
+    char* manifestJSON = copyPrintedJson(cJSON_Print(jsonManifest));
+
+    endJsonArena();
+    freeArena(jsonArena);
+
+    char* manifestPath = getSidecarPath(archivePath, MANIFEST_SUFFIX);
+    int isSaved = (manifestPath != NULL) && saveJsonToFileAtomically(output_stream, manifestPath, manifestJSON);
+    free(manifestPath);
+    free(manifestJSON);
+    return isSaved;
+}
+
+// A compaction is committed by saving the manifest that names its new shards, the last of them as the pending
+// active shard; the old active file is then replaced by it. If that step was cut short by a crash, or failed, it's
+// done here before the archive is loaded (a pending shard that's gone was moved already). If it can't be, the
+// program stops, as the old active file's records are in the new shards too
+void finishPendingActiveShard(FILE* output_stream, const char* archivePath, ArchiveManifest* manifest)
+{
+    if (!manifest->hasPendingActiveShard) return;
+
+    char* pendingPath = getShardPath(archivePath, manifest->pendingActiveShardId);
+    if (pendingPath == NULL || (access(pendingPath, F_OK) == 0 && rename(pendingPath, archivePath) != 0))
+    {
+        fprintf(output_stream, ERROR_COLOR "Compaction of '%s' couldn't be finished (%s), so the program stops; it's finished at the next start.\a\n" RESET,
+                archivePath, (pendingPath != NULL) ? strerror(errno) : "out of memory");
+        exit(EXIT_FAILURE);
+    }
+    syncParentDirectory(archivePath);
+    free(pendingPath);
+
+    manifest->hasPendingActiveShard = FALSE;
+    saveArchiveManifest(output_stream, archivePath, manifest); // If it isn't saved, the next start finds the pending shard gone
+}
+
+// One shard file to be parsed by the loader threads
+typedef struct
+{
+    char* path;
+    OrfStore* store;
+    size_t numOfAllocations;
+    bool isMissing;
+    bool isCorrupt;                 // Not valid JSON: nothing of it is loaded
+} ShardLoadTask;
+
+typedef struct
+{
+    ShardLoadTask* tasks;
+    int numOfTasks;
+    int nextTask;
+    pthread_mutex_t lock;
+} ShardLoadQueue;
+
+void loadShardFile(ShardLoadTask* task)
+{
+    if (task->path == NULL) return; // Compressed shard, not loaded
+
+    FILE* shardFile = fopen(task->path, "r");
+    if (shardFile == NULL)
+    {
+        task->isMissing = TRUE;
+        return;
+    }
+
+    char* shardJSON = readJsonFromFile(stderr, shardFile);
+    Arena* jsonArena = createArena(ARENA_BLOCK_SIZE);
+    if (shardJSON == NULL || jsonArena == NULL)
+    {
+        free(shardJSON);
+        freeArena(jsonArena);
+        return;
+    }
+    beginJsonArena(jsonArena); // This thread's own arena, so threads never share allocator state
+
+    cJSON* jsonList = cJSON_Parse(shardJSON);
+    if (jsonList != NULL)
+    {
+        task->store = jsonArrayToOrfStore(jsonList);
+    } else
+    {
+        task->isCorrupt = (shardJSON[strspn(shardJSON, " \t\r\n")] != '\0'); // An empty file is just an empty shard
+    }
+
+    endJsonArena();
+    task->numOfAllocations = jsonArena->numOfAllocations;
+    freeArena(jsonArena);
+    free(shardJSON);
+}
+
+void* shardLoaderThread(void* argument)
+{
+    ShardLoadQueue* queue = (ShardLoadQueue*) argument;
+
+    while (TRUE)
+    {
+        pthread_mutex_lock(&queue->lock);
+        int taskIndex = queue->nextTask++;
+        pthread_mutex_unlock(&queue->lock);
+        if (taskIndex >= queue->numOfTasks) break;
+
+        loadShardFile(&queue->tasks[taskIndex]);
+    }
+    return NULL;
+}
+
+// A corrupt active shard would be replaced by the session's results at the next save, so it's moved aside first, to
+// ARCHIVE_FILE.txt.corrupt (or .corrupt.2, ... if that's taken). If it can't be, the program stops instead
+void moveCorruptActiveShard(FILE* output_stream, const char* archivePath)
+{
+    char suffix[32];
+    char* corruptPath = NULL;
+    for (int i = 1; i <= MAX_CORRUPT_COPIES; i++)
+    {
+        if (i == 1) snprintf(suffix, sizeof(suffix), "%s", CORRUPT_SUFFIX);
+        else snprintf(suffix, sizeof(suffix), "%s.%d", CORRUPT_SUFFIX, i);
+        free(corruptPath);
+        corruptPath = getSidecarPath(archivePath, suffix);
+        if (corruptPath == NULL || access(corruptPath, F_OK) != 0) break;
+    }
+    if (corruptPath != NULL && access(corruptPath, F_OK) != 0 && rename(archivePath, corruptPath) == 0)
+    {
+        syncParentDirectory(archivePath);
+        fprintf(output_stream, ERROR_COLOR "Archive file '%s' is corrupted, its results are not in the history. It was moved to '%s', and a new one will be started.\a\n" RESET,
+                archivePath, corruptPath);
+        free(corruptPath);
+        return;
+    }
+    fprintf(output_stream, ERROR_COLOR "Archive file '%s' is corrupted, and couldn't be moved aside (%s), so the program stops rather than overwrite it.\a\n" RESET,
+            archivePath, (corruptPath != NULL) ? strerror(errno) : "out of memory");
+    free(corruptPath);
+    exit(EXIT_FAILURE);
+}
+
+// Loads all sealed shards and the active one, in parallel, into one history list (oldest shard first).
+// Compressed shards are left on disk. The number of loaded records that live in sealed shards is returned
+// through 'numOfSealedRecords'.
+OrfStore* loadShardedArchive(FILE* output_stream, const char* archivePath, ArchiveManifest* manifest, int* numOfSealedRecords)
+{
+    finishPendingActiveShard(output_stream, archivePath, manifest);
+    int numOfTasks = manifest->numOfShards + 1;
+    ShardLoadQueue queue = { 0 };
+    queue.tasks = (ShardLoadTask*) calloc(numOfTasks, sizeof(ShardLoadTask));
+    queue.numOfTasks = numOfTasks;
+    if (queue.tasks == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for loading the archive.\n%s\a\n" RESET, strerror(errno));
+        return createOrfStore();
+    }
+    int numOfCompressed = 0;
+    for (int i = 0; i < manifest->numOfShards; i++)
+    {
+        if (manifest->shards[i].isCompressed)
+        {
+            numOfCompressed++;
+            continue;
+        }
+        queue.tasks[i].path = getShardPath(archivePath, manifest->shards[i].id);
+    }
+    queue.tasks[numOfTasks - 1].path = strdup(archivePath); // Active shard goes last
+    pthread_mutex_init(&queue.lock, NULL);
+
+    struct timespec startTime, endTime;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+    long numOfCores = sysconf(_SC_NPROCESSORS_ONLN);
+    int numOfThreads = (numOfCores > 0) ? (int) numOfCores : 1;
+    if (numOfThreads > numOfTasks) numOfThreads = numOfTasks;
+    if (numOfThreads > MAX_LOADER_THREADS) numOfThreads = MAX_LOADER_THREADS;
+
+    pthread_t threads[MAX_LOADER_THREADS];
+    int numOfStarted = 0;
+    for (int i = 1; i < numOfThreads; i++) // The calling thread is a loader too
+    {
+        if (pthread_create(&threads[numOfStarted], NULL, shardLoaderThread, &queue) == 0)
+        {
+            numOfStarted++;
+        }
+    }
+    shardLoaderThread(&queue);
+    for (int i = 0; i < numOfStarted; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&queue.lock);
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+    // Concatenation keeps the shards' order; each one is O(1)
+    OrfStore* history = createOrfStore();
+    size_t numOfAllocations = 0;
+    *numOfSealedRecords = 0;
+    for (int i = 0; i < numOfTasks; i++)
+    {
+        if (i < numOfTasks - 1) manifest->shards[i].firstLoadedRecord = (queue.tasks[i].store != NULL) ? history->size : -1;
+        if (queue.tasks[i].isMissing && i < numOfTasks - 1)
+        {
+            fprintf(output_stream, ERROR_COLOR "Archive shard '%s' is missing, its results are not in the history.\a\n" RESET, queue.tasks[i].path);
+        } else if (queue.tasks[i].isMissing)
+        {
+            fprintf(output_stream, DIM "Archive file '%s' doesn't exist yet, it will be created at the end of the analysis session.\n" RESET, archivePath);
+        }
+        if (queue.tasks[i].isCorrupt && i < numOfTasks - 1)
+        {
+            fprintf(output_stream, ERROR_COLOR "Archive shard '%s' is corrupted, its results are not in the history.\a\n" RESET, queue.tasks[i].path);
+        } else if (queue.tasks[i].isCorrupt)
+        {
+            moveCorruptActiveShard(output_stream, archivePath);
+        }
+        if (queue.tasks[i].store != NULL)
+        {
+            if (i < numOfTasks - 1) *numOfSealedRecords += queue.tasks[i].store->size;
+            concatOrfStores(history, queue.tasks[i].store);
+            free(queue.tasks[i].store);
+        }
+        numOfAllocations += queue.tasks[i].numOfAllocations;
+        free(queue.tasks[i].path);
+    }
+    free(queue.tasks);
+
+    fprintf(output_stream, DIM "Loaded %d ORF(s) from %d archive shard(s) with %d thread(s) in %.1f ms (%zu JSON allocations, all arena-backed)\n" RESET,
+            history->size, numOfTasks - numOfCompressed, numOfStarted + 1, millisecondsBetween(&startTime, &endTime), numOfAllocations);
+    if (numOfCompressed > 0)
+    {
+        fprintf(output_stream, DIM "%d compressed shard(s) stay on disk, queries read only the blocks they need\n" RESET, numOfCompressed);
+    }
+    return history;
+}
+
+// Seals the active shard: it gets listed in the manifest, moved to its shard file, and an empty active shard takes its place
+bool sealActiveShard(FILE* output_stream, const char* archivePath, ArchiveManifest* manifest, OrfStore* history, int* numOfSealedRecords)
+{
+    ArchiveShard shard = { 0 };
+    shard.id = manifest->nextShardId;
+    shard.bytes = getFileSize(archivePath);
+    shard.firstLoadedRecord = *numOfSealedRecords;
+    for (OrfStoreIterator it = orfStoreIteratorAt(history, *numOfSealedRecords); orfStoreHasNext(&it); orfStoreAdvance(&it))
+    {
+        time_t analysisTime = getStoredOrfTime(&it);
+        if (analysisTime != 0 && (shard.firstTime == 0 || analysisTime < shard.firstTime)) shard.firstTime = analysisTime;
+        if (analysisTime > shard.lastTime) shard.lastTime = analysisTime;
+        shard.numOfRecords++;
+    }
+    if (shard.numOfRecords == 0) return FALSE;
+
+    // Manifest first: if we crash before the rename, the shard is reported missing but its records are still in the active file
+    addShardToManifest(manifest, &shard);
+    char* shardPath = getShardPath(archivePath, shard.id);
+    bool isSealed = saveArchiveManifest(output_stream, archivePath, manifest)
+        && rename(archivePath, shardPath) == 0;
+    if (!isSealed) // The records stay in the active shard, so the manifest (also the one on disk) doesn't list the shard
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't seal archive shard '%s':\t%s\a\n" RESET, shardPath, strerror(errno));
+        removeShardFromManifest(manifest, manifest->numOfShards - 1);
+        saveArchiveManifest(output_stream, archivePath, manifest);
+        free(shardPath);
+        return FALSE;
+    }
+
+    // Renamed, so the records are in the shard now, whether or not the empty active shard can be written
+    syncParentDirectory(archivePath);
+    *numOfSealedRecords += shard.numOfRecords;
+    fprintf(output_stream, DIM "Archive shard sealed: '%s' (%d ORFs, %ld bytes)\n" RESET, shardPath, shard.numOfRecords, shard.bytes);
+    if (!saveJsonToFileAtomically(output_stream, archivePath, "[]"))
+    {
+        fprintf(output_stream, DIM "Archive file '%s' will be created again at the end of the analysis session.\n" RESET, archivePath);
+    }
+    free(shardPath);
+    return TRUE;
+}
+
+// Size bound is checked after the active shard is written, age bound before a session adds new results to it
+bool activeShardIsFull(const char* archivePath)
+{
+    return getFileSize(archivePath) >= ARCHIVE_SHARD_MAX_BYTES;
+}
+
+bool activeShardIsOld(OrfStore* history, int numOfSealedRecords)
+{
+    time_t now = time(NULL);
+    for (OrfStoreIterator it = orfStoreIteratorAt(history, numOfSealedRecords); orfStoreHasNext(&it); orfStoreAdvance(&it))
+    {
+        time_t analysisTime = getStoredOrfTime(&it);
+        if (analysisTime != 0 && now - analysisTime >= ARCHIVE_SHARD_MAX_AGE_SECONDS)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void printArchiveShards(FILE* output_stream, const char* archivePath, ArchiveManifest* manifest, OrfStore* history, int numOfSealedRecords)
+{
+    fprintf(output_stream, BOLD "\n%-8s %-12s %-14s %-8s %-21s %-21s\n" RESET, "Shard", "ORFs", "Bytes", "Format", "First analysis", "Last analysis");
+    for (int i = 0; i < manifest->numOfShards; i++)
+    {
+        ArchiveShard* shard = &manifest->shards[i];
+        char first[20+1] = "-", last[20+1] = "-";
+        if (shard->firstTime != 0) strftime(first, sizeof(first), "%Y-%m-%d %H:%M:%S", localtime(&shard->firstTime));
+        if (shard->lastTime != 0) strftime(last, sizeof(last), "%Y-%m-%d %H:%M:%S", localtime(&shard->lastTime));
+        fprintf(output_stream, "%-8d %-12d %-14ld %-8s %-21s %-21s\n", shard->id, shard->numOfRecords, shard->bytes, shard->isCompressed ? "blocks" : "json", first, last);
+    }
+    fprintf(output_stream, "%-8s %-12d %-14ld %-8s (new results are written here)\n", "active", history->size - numOfSealedRecords, getFileSize(archivePath), "json");
+}
+
+// Drops one sealed shard (and its results) without touching any other shard
+bool dropArchiveShard(FILE* output_stream, const char* archivePath, ArchiveManifest* manifest, int shardId)
+{
+    for (int i = 0; i < manifest->numOfShards; i++)
+    {
+        if (manifest->shards[i].id != shardId) continue;
+
+        removeShardFromManifest(manifest, i);
+        if (!saveArchiveManifest(output_stream, archivePath, manifest))
+        {
+            return FALSE;
+        }
+        char* shardPath = getShardPath(archivePath, shardId);
+        remove(shardPath);
+        fprintf(output_stream, SUCCESS_COLOR "Shard %d ('%s') dropped.\n" RESET, shardId, shardPath);
+        free(shardPath);
+        return TRUE;
+    }
+
+    fprintf(output_stream, ERROR_COLOR "There is no sealed shard with id %d.\a\n" RESET, shardId);
+    return FALSE;
+}
+
+// ****************************************************  Block-compressed archive functions  ***************************************************
+
+// Container for sealed shards, much smaller than pretty-printed JSON:
+//   "ORFB" + version | block | block | ... | block index | index offset (8 bytes) + number of blocks (4 bytes) + "ORFB"
+// Every block (about ORF_BLOCK_TARGET_BYTES) decodes on its own. Inside a block, records are delta encoded
+// (positions, analysis time, repeated sequence hash) and codons are dictionary encoded: 2 bits of type + the 6-bit
+// index of the codon among the 64 possible ones, i.e. one byte per codon. The block index keeps the value ranges
+// of each block, so a query decodes only the blocks that may hold matching records.
+#define ORF_BLOCK_MAGIC "ORFB"
+#define ORF_BLOCK_VERSION 1
+#define ORF_BLOCK_TARGET_BYTES (128 << 10)
+#define ORF_BLOCK_HEADER_BYTES 5
+#define ORF_BLOCK_FOOTER_BYTES 16
+
+// Record flags
+#define ORF_FLAG_REVERSE 0x01
+#define ORF_FLAG_CODING_SHIFT 1            // 2 bits: isCodingSequence + 1 (it can be UNDEFINED)
+#define ORF_FLAG_SAME_HASH 0x08
+#define ORF_FLAG_SAME_TIME 0x10
+#define ORF_FLAG_IMPLIED_POSITIONS 0x20    // Codon i sits at first + i*CODONS_LENGTH (or - for reverse ORFs)
+#define ORF_FLAG_RAW_CODONS 0x40           // Some codon isn't made of A/C/G/U, so codons are stored as text
+#define ORF_FLAG_EXPLICIT_LENGTH 0x80      // Length isn't simply numOfCodons * CODONS_LENGTH
+
+typedef struct
+{
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} ByteBuffer;
+
+typedef struct
+{
+    const unsigned char* current;
+    const unsigned char* end;
+    bool failed;
+} ByteReader;
+
+// Value ranges of the records of one block, so that a block can be skipped without decoding it
+typedef struct
+{
+    uint64_t offset;
+    uint32_t encodedBytes;
+    uint32_t numOfRecords;
+    int32_t minPosition, maxPosition;
+    int32_t minLength, maxLength;
+    int64_t minTime, maxTime;
+    uint8_t directionMask;         // Bit FORWARD/REVERSE set if the block has records in that direction
+} OrfBlockInfo;
+
+typedef struct
+{
+    FILE* file;
+    OrfBlockInfo* blocks;
+    uint32_t numOfBlocks;
+} OrfBlockFile;
+
+void putBytes(ByteBuffer* buffer, const void* bytes, size_t numOfBytes)
+{
+    if (buffer->size + numOfBytes > buffer->capacity)
+    {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (capacity < buffer->size + numOfBytes) capacity *= 2;
+        buffer->data = (unsigned char*) realloc(buffer->data, capacity);
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, bytes, numOfBytes);
+    buffer->size += numOfBytes;
+}
+
+void putByte(ByteBuffer* buffer, unsigned char byte)
+{
+    putBytes(buffer, &byte, 1);
+}
+
+// LEB128: 7 bits per byte, so small numbers (e.g. deltas) take a single byte
+void putVarint(ByteBuffer* buffer, uint64_t value)
+{
+    unsigned char bytes[10];
+    int numOfBytes = 0;
+    do
+    {
+        bytes[numOfBytes] = value & 0x7F;
+        value >>= 7;
+        if (value) bytes[numOfBytes] |= 0x80;
+        numOfBytes++;
+    } while (value);
+    putBytes(buffer, bytes, numOfBytes);
+}
+
+// Zigzag: small negative numbers become small positive ones (0, -1, 1, -2... -> 0, 1, 2, 3...)
+void putSignedVarint(ByteBuffer* buffer, int64_t value)
+{
+    putVarint(buffer, ((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+}
+
+void putFixed(ByteBuffer* buffer, uint64_t value, int numOfBytes) // Little endian, whatever the machine is
+{
+    unsigned char bytes[8];
+    for (int i = 0; i < numOfBytes; i++)
+    {
+        bytes[i] = (value >> (8*i)) & 0xFF;
+    }
+    putBytes(buffer, bytes, numOfBytes);
+}
+
+unsigned char getByte(ByteReader* reader)
+{
+    if (reader->current >= reader->end)
+    {
+        reader->failed = TRUE;
+        return 0;
+    }
+    return *reader->current++;
+}
+
+uint64_t getVarint(ByteReader* reader)
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        unsigned char byte = getByte(reader);
+        value |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    return value;
+}
+
+int64_t getSignedVarint(ByteReader* reader)
+{
+    uint64_t value = getVarint(reader);
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+uint64_t getFixed(const unsigned char* bytes, int numOfBytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < numOfBytes; i++)
+    {
+        value |= (uint64_t) bytes[i] << (8*i);
+    }
+    return value;
+}
+
+// Previous record of the block, which the next record is delta encoded against
+typedef struct
+{
+    int position;
+    uint64_t sequenceHash;
+    int64_t analysisTime;
+} OrfBlockState;
+
+void encodeOrfRecord(ByteBuffer* buffer, Sequence* seq, OrfBlockState* previous)
+{
+    int numOfCodons = seq->length / CODONS_LENGTH;
+    int step = (seq->seqDirection == FORWARD) ? CODONS_LENGTH : -CODONS_LENGTH;
+    unsigned char flags = (seq->seqDirection == REVERSE) ? ORF_FLAG_REVERSE : 0;
+
+    flags |= ((seq->isCodingSequence + 1) & 3) << ORF_FLAG_CODING_SHIFT;
+    if (seq->sequenceHash == previous->sequenceHash) flags |= ORF_FLAG_SAME_HASH;
+    if ((int64_t) seq->analysisTime == previous->analysisTime) flags |= ORF_FLAG_SAME_TIME;
+    if (seq->length != numOfCodons * CODONS_LENGTH) flags |= ORF_FLAG_EXPLICIT_LENGTH;
+
+    flags |= ORF_FLAG_IMPLIED_POSITIONS;
+    for (int i = 1; i < numOfCodons; i++)
+    {
+        if (seq->specialCodons[i].positionInSequence != seq->specialCodons[i-1].positionInSequence + step)
+        {
+            flags &= ~ORF_FLAG_IMPLIED_POSITIONS;
+            break;
+        }
+    }
+    for (int i = 0; i < numOfCodons; i++)
+    {
+        if (codonToIndex(seq->specialCodons[i].codonSequence) < 0 || seq->specialCodons[i].type > PLAIN)
+        {
+            flags |= ORF_FLAG_RAW_CODONS;
+            break;
+        }
+    }
+
+    putByte(buffer, flags);
+    putSignedVarint(buffer, (int64_t) seq->positionInSupersequence - previous->position);
+    putVarint(buffer, numOfCodons);
+    if (flags & ORF_FLAG_EXPLICIT_LENGTH) putVarint(buffer, seq->length);
+    if (!(flags & ORF_FLAG_SAME_HASH)) putFixed(buffer, seq->sequenceHash, 8);
+    if (!(flags & ORF_FLAG_SAME_TIME)) putSignedVarint(buffer, (int64_t) seq->analysisTime - previous->analysisTime);
+
+    if (numOfCodons > 0)
+    {
+        putSignedVarint(buffer, (int64_t) seq->specialCodons[0].positionInSequence - seq->positionInSupersequence);
+    }
+    if (!(flags & ORF_FLAG_IMPLIED_POSITIONS))
+    {
+        for (int i = 1; i < numOfCodons; i++)
+        {
+            putSignedVarint(buffer, (int64_t) seq->specialCodons[i].positionInSequence - seq->specialCodons[i-1].positionInSequence - step);
+        }
+    }
+
+    for (int i = 0; i < numOfCodons; i++)
+    {
+        SpecialSubsequence* codon = &seq->specialCodons[i];
+        if (flags & ORF_FLAG_RAW_CODONS)
+        {
+            putByte(buffer, (unsigned char) codon->type);
+            putBytes(buffer, codon->codonSequence, CODONS_LENGTH);
+        } else
+        {
+            putByte(buffer, (unsigned char) ((codon->type << 6) | codonToIndex(codon->codonSequence)));
+        }
+    }
+
+    previous->position = seq->positionInSupersequence;
+    previous->sequenceHash = seq->sequenceHash;
+    previous->analysisTime = (int64_t) seq->analysisTime;
+}
+
+Sequence* decodeOrfRecord(ByteReader* reader, OrfBlockState* previous)
+{
+    unsigned char flags = getByte(reader);
+    int position = previous->position + (int) getSignedVarint(reader);
+    int numOfCodons = (int) getVarint(reader);
+    int length = (flags & ORF_FLAG_EXPLICIT_LENGTH) ? (int) getVarint(reader) : numOfCodons * CODONS_LENGTH;
+    if (reader->failed || numOfCodons < 0 || numOfCodons > (reader->end - reader->current))
+    {
+        reader->failed = TRUE;
+        return NULL;
+    }
+
+    if (!(flags & ORF_FLAG_SAME_HASH))
+    {
+        if (reader->end - reader->current < 8)
+        {
+            reader->failed = TRUE;
+            return NULL;
+        }
+        previous->sequenceHash = getFixed(reader->current, 8);
+        reader->current += 8;
+    }
+    if (!(flags & ORF_FLAG_SAME_TIME))
+    {
+        previous->analysisTime += getSignedVarint(reader);
+    }
+
+    direction seqDirection = (flags & ORF_FLAG_REVERSE) ? REVERSE : FORWARD;
+    int step = (seqDirection == FORWARD) ? CODONS_LENGTH : -CODONS_LENGTH;
+    bool isCodingSequence = ((flags >> ORF_FLAG_CODING_SHIFT) & 3) - 1;
+
+    Sequence* seq = createSequence(length, seqDirection, position, isCodingSequence, numOfCodons);
+    seq->sequenceHash = previous->sequenceHash;
+    seq->analysisTime = (time_t) previous->analysisTime;
+
+    if (numOfCodons > 0)
+    {
+        seq->specialCodons[0].positionInSequence = position + (int) getSignedVarint(reader);
+    }
+    for (int i = 1; i < numOfCodons; i++)
+    {
+        int delta = (flags & ORF_FLAG_IMPLIED_POSITIONS) ? 0 : (int) getSignedVarint(reader);
+        seq->specialCodons[i].positionInSequence = seq->specialCodons[i-1].positionInSequence + step + delta;
+    }
+    for (int i = 0; i < numOfCodons; i++)
+    {
+        SpecialSubsequence* codon = &seq->specialCodons[i];
+        if (flags & ORF_FLAG_RAW_CODONS)
+        {
+            codon->type = (specialCodonType) getByte(reader);
+            for (int j = 0; j < CODONS_LENGTH; j++) codon->codonSequence[j] = (char) getByte(reader);
+            codon->codonSequence[CODONS_LENGTH] = '\0';
+        } else
+        {
+            unsigned char byte = getByte(reader);
+            codon->type = (specialCodonType) (byte >> 6);
+            indexToCodon(byte & 0x3F, codon->codonSequence);
+        }
+    }
+
+    previous->position = position;
+    return seq;
+}
+
+void updateBlockInfo(OrfBlockInfo* info, Sequence* seq)
+{
+    if (info->numOfRecords == 0)
+    {
+        info->minPosition = info->maxPosition = seq->positionInSupersequence;
+        info->minLength = info->maxLength = seq->length;
+        info->minTime = info->maxTime = (int64_t) seq->analysisTime;
+    }
+    if (seq->positionInSupersequence < info->minPosition) info->minPosition = seq->positionInSupersequence;
+    if (seq->positionInSupersequence > info->maxPosition) info->maxPosition = seq->positionInSupersequence;
+    if (seq->length < info->minLength) info->minLength = seq->length;
+    if (seq->length > info->maxLength) info->maxLength = seq->length;
+    if ((int64_t) seq->analysisTime < info->minTime) info->minTime = (int64_t) seq->analysisTime;
+    if ((int64_t) seq->analysisTime > info->maxTime) info->maxTime = (int64_t) seq->analysisTime;
+    info->directionMask |= 1 << seq->seqDirection;
+    info->numOfRecords++;
+}
+
+bool writeOrfBlockFile(const char* path, DoublyLinkedList* list)
+{
+    FILE* blockFile = fopen(path, "wb");
+    if (blockFile == NULL) return FALSE;
+
+    ByteBuffer block = { 0 }, index = { 0 };
+    OrfBlockInfo info = { 0 };
+    OrfBlockState previous = { 0 };
+    uint64_t offset = ORF_BLOCK_HEADER_BYTES;
+    uint32_t numOfBlocks = 0;
+    bool isWritten = fwrite(ORF_BLOCK_MAGIC, 1, 4, blockFile) == 4 && fputc(ORF_BLOCK_VERSION, blockFile) != EOF;
+
+    for (ListNode* current = list->head; isWritten && current != NULL; current = current->next)
+    {
+        encodeOrfRecord(&block, current->data, &previous);
+        updateBlockInfo(&info, current->data);
+
+        if (block.size >= ORF_BLOCK_TARGET_BYTES || current->next == NULL) // Block full (or last one): flush it and its index entry
+        {
+            isWritten = fwrite(block.data, 1, block.size, blockFile) == block.size;
+            putFixed(&index, offset, 8);
+            putFixed(&index, block.size, 4);
+            putFixed(&index, info.numOfRecords, 4);
+            putFixed(&index, (uint32_t) info.minPosition, 4);
+            putFixed(&index, (uint32_t) info.maxPosition, 4);
+            putFixed(&index, (uint32_t) info.minLength, 4);
+            putFixed(&index, (uint32_t) info.maxLength, 4);
+            putFixed(&index, (uint64_t) info.minTime, 8);
+            putFixed(&index, (uint64_t) info.maxTime, 8);
+            putByte(&index, info.directionMask);
+
+            offset += block.size;
+            numOfBlocks++;
+            block.size = 0;
+            memset(&info, 0, sizeof(info));
+            memset(&previous, 0, sizeof(previous)); // Next block must decode without this one
+        }
+    }
+
+    ByteBuffer footer = { 0 };
+    putFixed(&footer, offset, 8);
+    putFixed(&footer, numOfBlocks, 4);
+    putBytes(&footer, ORF_BLOCK_MAGIC, 4);
+    isWritten = isWritten
+        && fwrite(index.data, 1, index.size, blockFile) == index.size
+        && fwrite(footer.data, 1, footer.size, blockFile) == footer.size;
+    isWritten = syncAndCloseFile(blockFile) && isWritten;
+
+    free(block.data);
+    free(index.data);
+    free(footer.data);
+    return isWritten;
+}
+
+bool isOrfBlockFile(const char* path)
+{
+    char magic[4];
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return FALSE;
+
+    bool isBlockFile = fread(magic, 1, 4, file) == 4 && memcmp(magic, ORF_BLOCK_MAGIC, 4) == 0;
+    fclose(file);
+    return isBlockFile;
+}
+
+#define ORF_BLOCK_INDEX_ENTRY_BYTES 49
+
+void closeOrfBlockFile(OrfBlockFile* blockFile)
+{
+    if (blockFile == NULL) return;
+    if (blockFile->file != NULL) fclose(blockFile->file);
+    free(blockFile->blocks);
+    free(blockFile);
+}
+
+// Reads only the footer and the block index; blocks themselves are read on demand
+OrfBlockFile* openOrfBlockFile(const char* path)
+{
+    OrfBlockFile* blockFile = (OrfBlockFile*) calloc(1, sizeof(OrfBlockFile));
+    if (blockFile == NULL) return NULL;
+
+    unsigned char footer[ORF_BLOCK_FOOTER_BYTES];
+    blockFile->file = fopen(path, "rb");
+    if (blockFile->file == NULL
+        || fseek(blockFile->file, -ORF_BLOCK_FOOTER_BYTES, SEEK_END) != 0
+        || fread(footer, 1, ORF_BLOCK_FOOTER_BYTES, blockFile->file) != ORF_BLOCK_FOOTER_BYTES
+        || memcmp(footer + 12, ORF_BLOCK_MAGIC, 4) != 0)
+    {
+        closeOrfBlockFile(blockFile);
+        return NULL;
+    }
+
+    uint64_t indexOffset = getFixed(footer, 8);
+    blockFile->numOfBlocks = (uint32_t) getFixed(footer + 8, 4);
+    size_t indexBytes = (size_t) blockFile->numOfBlocks * ORF_BLOCK_INDEX_ENTRY_BYTES;
+    unsigned char* index = (unsigned char*) malloc(indexBytes > 0 ? indexBytes : 1);
+    blockFile->blocks = (OrfBlockInfo*) calloc(blockFile->numOfBlocks > 0 ? blockFile->numOfBlocks : 1, sizeof(OrfBlockInfo));
+    if (index == NULL || blockFile->blocks == NULL
+        || fseek(blockFile->file, (long) indexOffset, SEEK_SET) != 0
+        || fread(index, 1, indexBytes, blockFile->file) != indexBytes)
+    {
+        free(index);
+        closeOrfBlockFile(blockFile);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < blockFile->numOfBlocks; i++)
+    {
+        const unsigned char* entry = index + (size_t) i * ORF_BLOCK_INDEX_ENTRY_BYTES;
+        OrfBlockInfo* info = &blockFile->blocks[i];
+        info->offset = getFixed(entry, 8);
+        info->encodedBytes = (uint32_t) getFixed(entry + 8, 4);
+        info->numOfRecords = (uint32_t) getFixed(entry + 12, 4);
+        info->minPosition = (int32_t) getFixed(entry + 16, 4);
+        info->maxPosition = (int32_t) getFixed(entry + 20, 4);
+        info->minLength = (int32_t) getFixed(entry + 24, 4);
+        info->maxLength = (int32_t) getFixed(entry + 28, 4);
+        info->minTime = (int64_t) getFixed(entry + 32, 8);
+        info->maxTime = (int64_t) getFixed(entry + 40, 8);
+        info->directionMask = entry[48];
+    }
+    free(index);
+    return blockFile;
+}
+
+// Decodes block 'blockIndex' and appends its records to 'list'; if 'keepRecord' is given, only the records it accepts
+bool decodeOrfBlock(OrfBlockFile* blockFile, uint32_t blockIndex, DoublyLinkedList* list, bool (*keepRecord)(Sequence*, void*), void* context)
+{
+    OrfBlockInfo* info = &blockFile->blocks[blockIndex];
+    unsigned char* encoded = (unsigned char*) malloc(info->encodedBytes > 0 ? info->encodedBytes : 1);
+    if (encoded == NULL
+        || fseek(blockFile->file, (long) info->offset, SEEK_SET) != 0
+        || fread(encoded, 1, info->encodedBytes, blockFile->file) != info->encodedBytes)
+    {
+        free(encoded);
+        return FALSE;
+    }
+
+    ByteReader reader = { encoded, encoded + info->encodedBytes, FALSE };
+    OrfBlockState previous = { 0 };
+    for (uint32_t i = 0; i < info->numOfRecords && !reader.failed; i++)
+    {
+        Sequence* seq = decodeOrfRecord(&reader, &previous);
+        if (seq == NULL) continue;
+
+        if (keepRecord == NULL || keepRecord(seq, context))
+        {
+            appendToList(list, seq);
+        } else
+        {
+            free(seq);
+        }
+    }
+    free(encoded);
+    return !reader.failed;
+}
+
+// Rewrites a sealed JSON shard as a block-compressed one (in place, through a temporary file and a rename)
+bool compressArchiveShard(FILE* output_stream, const char* archivePath, ArchiveManifest* manifest, int shardId)
+{
+    ArchiveShard* shard = NULL;
+    for (int i = 0; i < manifest->numOfShards; i++)
+    {
+        if (manifest->shards[i].id == shardId) shard = &manifest->shards[i];
+    }
+    if (shard == NULL || shard->isCompressed)
+    {
+        fprintf(output_stream, ERROR_COLOR "There is no uncompressed sealed shard with id %d.\a\n" RESET, shardId);
+        return FALSE;
+    }
+
+    char* shardPath = getShardPath(archivePath, shardId);
+    char* tmpPath = getSidecarPath(shardPath, ATOMIC_WRITE_TMP_SUFFIX);
+    FILE* shardFile = fopen(shardPath, "r");
+    char* shardJSON = (shardFile != NULL) ? readJsonFromFile(output_stream, shardFile) : NULL;
+    DoublyLinkedList* records = (shardJSON != NULL) ? deserializeJsonToList(output_stream, shardJSON) : NULL;
+    free(shardJSON);
+
+    bool isCompressed = records != NULL && writeOrfBlockFile(tmpPath, records) && rename(tmpPath, shardPath) == 0;
+    if (isCompressed)
+    {
+        syncParentDirectory(shardPath);
+        long bytesBefore = shard->bytes;
+        shard->bytes = getFileSize(shardPath);
+        shard->isCompressed = TRUE;
+        saveArchiveManifest(output_stream, archivePath, manifest);
+        fprintf(output_stream, SUCCESS_COLOR "Shard %d compressed: %ld -> %ld bytes (%.1fx smaller).\n" RESET,
+                shardId, bytesBefore, shard->bytes, shard->bytes > 0 ? (double) bytesBefore / shard->bytes : 0.0);
+    } else
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't compress shard %d:\t%s\a\n" RESET, shardId, strerror(errno));
+        remove(tmpPath);
+    }
+
+    if (records != NULL) freeList(records);
+    free(tmpPath);
+    free(shardPath);
+    return isCompressed;
+}
+
+// ****************************************************  Analysis cache functions  ***************************************************
+
+// The cache doesn't keep ORFs of its own: an analysis' ORFs are archived next to each other, so an entry is a
+// reference to them (shard and record), and they are read from the archive when the sequence is looked up. The
+// cache file holds just these references; without it, the cache is rebuilt from the sequenceHash of every record
+#define ANALYSIS_CACHE_INITIAL_CAPACITY 64 // Must be a power of two
+#define ANALYSIS_CACHE_SUFFIX ".cache"
+#define UNRESOLVED_SHARD_ID -2              // Its ORFs aren't in the archive (any more), so a lookup misses
+#define UNKNOWN_SEQUENCE_LENGTH -1          // Rebuilt from the archive, which doesn't keep it: matched by hash alone
+
+// One analyzed input sequence: its hash and where its ORFs are
+typedef struct
+{
+    uint64_t sequenceHash;
+    int sequenceLength;
+    bool isUsed;                    // FALSE marks an empty slot
+    int numOfOrfs;
+    int shardId;                    // Shard of its ORFs (ACTIVE_SHARD_ID for the archive file)...
+    int firstRecord;                // ...and the first of them in it
+    DoublyLinkedList* orfs;         // Read from the archive on the first lookup, NULL until then
+} AnalysisCacheEntry;
+
+// Open-addressing (linear probing) hash table, keyed by the hash of the normalized input sequence
+typedef struct
+{
+    AnalysisCacheEntry* entries;
+    int capacity;
+    int size;
+    const char* archivePath;        // The archive that the references point into...
+    ArchiveManifest* manifest;
+    OrfStore* history;              // ...and its loaded records (see linkAnalysisCacheToHistory())
+    int* numOfSealedRecords;
+} AnalysisCache;
+
+AnalysisCache* createAnalysisCache(int capacity, const char* archivePath, ArchiveManifest* manifest)
+{
+    AnalysisCache* cache = (AnalysisCache*) malloc(sizeof(AnalysisCache));
+    if (cache == NULL) return NULL;
+
+    cache->entries = (AnalysisCacheEntry*) calloc(capacity, sizeof(AnalysisCacheEntry));
+    if (cache->entries == NULL)
+    {
+        free(cache);
+        return NULL;
+    }
+    cache->capacity = capacity;
+    cache->size = 0;
+    cache->archivePath = archivePath;
+    cache->manifest = manifest;
+    cache->history = NULL;
+    cache->numOfSealedRecords = NULL;
+    return cache;
+}
+
+// A sequence of UNKNOWN_SEQUENCE_LENGTH matches an entry of any length, and so does an entry of unknown length
+AnalysisCacheEntry* findAnalysisCacheSlot(AnalysisCache* cache, uint64_t sequenceHash, int sequenceLength)
+{
+    int mask = cache->capacity - 1;
+    int slot = (int) (sequenceHash & mask);
+
+    while (cache->entries[slot].isUsed)
+    {
+        AnalysisCacheEntry* entry = &cache->entries[slot];
+        if (entry->sequenceHash == sequenceHash && (entry->sequenceLength == sequenceLength
+            || entry->sequenceLength == UNKNOWN_SEQUENCE_LENGTH || sequenceLength == UNKNOWN_SEQUENCE_LENGTH))
+        {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return &cache->entries[slot];
+}
+
+// The entry of an already analyzed sequence, or NULL if it was never seen before (or its ORFs aren't archived any more)
+AnalysisCacheEntry* findAnalysisCacheEntry(AnalysisCache* cache, uint64_t sequenceHash, int sequenceLength)
+{
+    if (cache == NULL) return NULL;
+    AnalysisCacheEntry* entry = findAnalysisCacheSlot(cache, sequenceHash, sequenceLength);
+    if (!entry->isUsed || (entry->shardId == UNRESOLVED_SHARD_ID && entry->numOfOrfs > 0)) return NULL;
+    if (entry->sequenceLength == UNKNOWN_SEQUENCE_LENGTH) entry->sequenceLength = sequenceLength; // Learnt now
+    return entry;
+}
+
+void growAnalysisCache(AnalysisCache* cache)
+{
+    AnalysisCacheEntry* oldEntries = cache->entries;
+    int oldCapacity = cache->capacity;
+
+    AnalysisCacheEntry* newEntries = (AnalysisCacheEntry*) calloc(oldCapacity * 2, sizeof(AnalysisCacheEntry));
+    if (newEntries == NULL) return; // Keep working with the current (fuller) table
+
+    cache->entries = newEntries;
+    cache->capacity = oldCapacity * 2;
+    for (int i = 0; i < oldCapacity; i++)
+    {
+        if (oldEntries[i].isUsed)
+        {
+            *findAnalysisCacheSlot(cache, oldEntries[i].sequenceHash, oldEntries[i].sequenceLength) = oldEntries[i];
+        }
+    }
+    free(oldEntries);
+}
+
+// The 'numOfOrfs' ORFs of the sequence are records 'firstRecord'... of shard 'shardId'
+void insertIntoAnalysisCache(AnalysisCache* cache, uint64_t sequenceHash, int sequenceLength, int shardId, int firstRecord, int numOfOrfs)
+{
+    if (cache == NULL) return;
+
+    if ((cache->size + 1) * 10 > cache->capacity * 7) // Keep load factor under 70%
+    {
+        growAnalysisCache(cache);
+    }
+
+    AnalysisCacheEntry* entry = findAnalysisCacheSlot(cache, sequenceHash, sequenceLength);
+    if (entry->isUsed)
+    {
+        if (entry->orfs != NULL) freeList(entry->orfs);
+    } else
+    {
+        cache->size++;
+    }
+    AnalysisCacheEntry newEntry = { sequenceHash, sequenceLength, TRUE, numOfOrfs, shardId, firstRecord, NULL };
+    *entry = newEntry;
+}
+
+// A new analysis, whose ORFs are about to be appended to the history (and so to the active shard)
+void insertNewAnalysisIntoCache(AnalysisCache* cache, uint64_t sequenceHash, int sequenceLength, int numOfOrfs)
+{
+    if (cache == NULL || cache->history == NULL) return;
+    insertIntoAnalysisCache(cache, sequenceHash, sequenceLength, ACTIVE_SHARD_ID, cache->history->size - *cache->numOfSealedRecords, numOfOrfs);
+}
+
+// The active shard's ORFs have just been sealed into shard 'shardId', in the same order
+void moveActiveShardOfAnalysisCache(AnalysisCache* cache, int shardId)
+{
+    for (int i = 0; cache != NULL && i < cache->capacity; i++)
+    {
+        if (cache->entries[i].isUsed && cache->entries[i].shardId == ACTIVE_SHARD_ID) cache->entries[i].shardId = shardId;
+    }
+}
+
+void setAnalysisInfoOfList(DoublyLinkedList* list, uint64_t sequenceHash, time_t analysisTime)
+{
+    for (ListNode* current = list->head; current != NULL; current = current->next)
+    {
+        current->data->sequenceHash = sequenceHash;
+        current->data->analysisTime = analysisTime;
+    }
+}
+
+// The records of a run of the history with the same sequenceHash, i.e. the ORFs of one analysis
+void linkAnalysisCacheRun(AnalysisCache* cache, uint64_t sequenceHash, int firstRecord, int numOfRecords)
+{
+    if (sequenceHash == 0) return; // Archived by older versions, without a hash
+    int recordInShard;
+    int shardId = getShardOfHistoryRecord(cache->manifest, *cache->numOfSealedRecords, firstRecord, &recordInShard);
+    AnalysisCacheEntry* entry = findAnalysisCacheSlot(cache, sequenceHash, UNKNOWN_SEQUENCE_LENGTH);
+    if (!entry->isUsed)
+    {
+        insertIntoAnalysisCache(cache, sequenceHash, UNKNOWN_SEQUENCE_LENGTH, shardId, recordInShard, numOfRecords);
+    } else if (entry->shardId == UNRESOLVED_SHARD_ID) // If it's archived twice, the first run is kept
+    {
+        entry->shardId = shardId;
+        entry->firstRecord = recordInShard;
+        entry->numOfOrfs = numOfRecords;
+    }
+}
+
+// Points the entries at where their ORFs are in the loaded history, found by the records' sequenceHash. Sequences
+// without an entry get one (of unknown length). Entries of compressed shards, which aren't loaded, keep theirs.
+// Done whenever the history is (re)loaded, as shards may have been compacted, dropped or lost since
+void linkAnalysisCacheToHistory(AnalysisCache* cache, OrfStore* history, int* numOfSealedRecords)
+{
+    if (cache == NULL) return;
+    cache->history = history;
+    cache->numOfSealedRecords = numOfSealedRecords;
+    for (int i = 0; i < cache->capacity; i++)
+    {
+        AnalysisCacheEntry* entry = &cache->entries[i];
+        ArchiveShard* shard = findArchiveShard(cache->manifest, entry->shardId);
+        if (!entry->isUsed || entry->numOfOrfs == 0 || (shard != NULL && shard->isCompressed)) continue;
+        entry->shardId = UNRESOLVED_SHARD_ID;
+        if (entry->orfs != NULL) freeList(entry->orfs);
+        entry->orfs = NULL;
+    }
+
+    uint64_t runHash = 0;
+    int runFirst = 0, record = 0;
+    for (OrfStoreIterator it = orfStoreIteratorAt(history, 0); orfStoreHasNext(&it); orfStoreAdvance(&it), record++)
+    {
+        uint64_t sequenceHash = getStoredOrfHash(&it);
+        if (record > 0 && sequenceHash != runHash)
+        {
+            linkAnalysisCacheRun(cache, runHash, runFirst, record - runFirst);
+            runFirst = record;
+        }
+        runHash = sequenceHash;
+    }
+    if (record > 0) linkAnalysisCacheRun(cache, runHash, runFirst, record - runFirst);
+}
+
+// Which records of a compressed shard are kept: the entry's, counted in the shard's order
+typedef struct
+{
+    int record;
+    int firstRecord, lastRecord;
+} CachedRecordRange;
+
+bool isInCachedRecordRange(Sequence* seq, void* context)
+{
+    CachedRecordRange* range = (CachedRecordRange*) context;
+    (void) seq;
+    range->record++;
+    return range->record - 1 >= range->firstRecord && range->record - 1 <= range->lastRecord;
+}
+
+// The entry's ORFs, read from the loaded history or, for a compressed shard, from the blocks that hold them.
+// NULL if they aren't there any more
+DoublyLinkedList* readCachedOrfs(AnalysisCache* cache, AnalysisCacheEntry* entry)
+{
+    DoublyLinkedList* orfs = createList();
+    ArchiveShard* shard = findArchiveShard(cache->manifest, entry->shardId);
+    if (entry->numOfOrfs == 0) return orfs;
+
+    if (shard != NULL && shard->isCompressed)
+    {
+        char* shardPath = getShardPath(cache->archivePath, shard->id);
+        OrfBlockFile* blockFile = (shardPath != NULL) ? openOrfBlockFile(shardPath) : NULL;
+        CachedRecordRange range = { 0, entry->firstRecord, entry->firstRecord + entry->numOfOrfs - 1 };
+        for (uint32_t b = 0; blockFile != NULL && b < blockFile->numOfBlocks && range.record <= range.lastRecord; b++)
+        {
+            if (range.record + (int) blockFile->blocks[b].numOfRecords <= range.firstRecord) // Skipped undecoded
+            {
+                range.record += blockFile->blocks[b].numOfRecords;
+                continue;
+            }
+            if (!decodeOrfBlock(blockFile, b, orfs, isInCachedRecordRange, &range)) break;
+        }
+        closeOrfBlockFile(blockFile);
+        free(shardPath);
+    } else if (entry->shardId == ACTIVE_SHARD_ID || (shard != NULL && shard->firstLoadedRecord >= 0))
+    {
+        int firstRecord = ((shard != NULL) ? shard->firstLoadedRecord : *cache->numOfSealedRecords) + entry->firstRecord;
+        OrfStoreIterator it = orfStoreIteratorAt(cache->history, firstRecord);
+        for (int i = 0; i < entry->numOfOrfs && firstRecord + i < cache->history->size; i++, orfStoreAdvance(&it))
+        {
+            appendToList(orfs, getStoredOrf(&it));
+        }
+    }
+
+    bool isFound = (orfs->size == entry->numOfOrfs);
+    for (ListNode* current = orfs->head; isFound && current != NULL; current = current->next)
+    {
+        isFound = (current->data->sequenceHash == entry->sequenceHash);
+    }
+    if (!isFound)
+    {
+        freeList(orfs);
+        return NULL;
+    }
+    return orfs;
+}
+
+// Returns the stored ORFs of an already analyzed sequence, or NULL if it was never seen before. The cache keeps them
+DoublyLinkedList* lookupAnalysisCache(AnalysisCache* cache, uint64_t sequenceHash, int sequenceLength)
+{
+    AnalysisCacheEntry* entry = findAnalysisCacheEntry(cache, sequenceHash, sequenceLength);
+    if (entry == NULL) return NULL;
+    if (entry->orfs == NULL) entry->orfs = readCachedOrfs(cache, entry);
+    if (entry->orfs == NULL) entry->shardId = UNRESOLVED_SHARD_ID; // Analyzed anew, then
+    return entry->orfs;
+}
+
+// Entries of the cache file come first, for what the archive doesn't keep (sequence lengths, analyses without ORFs,
+// ORFs in compressed shards); the loaded history then fills in the rest (see linkAnalysisCacheToHistory())
+AnalysisCache* loadAnalysisCache(FILE* output_stream, const char* cachePath, const char* archivePath, ArchiveManifest* manifest,
+                                 OrfStore* history, int* numOfSealedRecords)
+{
+    AnalysisCache* cache = createAnalysisCache(ANALYSIS_CACHE_INITIAL_CAPACITY, archivePath, manifest);
+    if (cache == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the analysis cache.\n%s\a\n" RESET, strerror(errno));
+        return NULL;
+    }
+
+    FILE* cacheFile = fopen(cachePath, "r");
+    char* cacheJSON = (cacheFile != NULL) ? readJsonFromFile(output_stream, cacheFile) : NULL; // No file yet, e.g. first run with this archive
+    Arena* jsonArena = (cacheJSON != NULL && strlen(cacheJSON) > 0) ? createArena(ARENA_BLOCK_SIZE) : NULL;
+    if (jsonArena != NULL)
+    {
+        beginJsonArena(jsonArena);
+        cJSON* jsonEntries = cJSON_Parse(cacheJSON);
+        if (jsonEntries == NULL)
+        {
+            fprintf(output_stream, ERROR_COLOR "Analysis cache '%s' is corrupted, it's rebuilt from the archive.\a\n" RESET, cachePath);
+        }
+
+        cJSON* jsonEntry;
+        cJSON_ArrayForEach(jsonEntry, jsonEntries)
+        {
+            cJSON* jsonHash = cJSON_GetObjectItem(jsonEntry, "sequenceHash");
+            cJSON* jsonLength = cJSON_GetObjectItem(jsonEntry, "sequenceLength");
+            cJSON* jsonShardId = cJSON_GetObjectItem(jsonEntry, "shardId");
+            cJSON* jsonFirstRecord = cJSON_GetObjectItem(jsonEntry, "firstRecord");
+            cJSON* jsonNumOfOrfs = cJSON_GetObjectItem(jsonEntry, "numOfOrfs");
+            if (!cJSON_IsString(jsonHash) || !cJSON_IsNumber(jsonLength) || !cJSON_IsNumber(jsonShardId)
+                || !cJSON_IsNumber(jsonFirstRecord) || !cJSON_IsNumber(jsonNumOfOrfs))
+            {
+                continue; // E.g. of an older version, which kept the ORFs themselves: rebuilt from the archive
+            }
+            insertIntoAnalysisCache(cache, strtoull(jsonHash->valuestring, NULL, 16), jsonLength->valueint,
+                                    jsonShardId->valueint, jsonFirstRecord->valueint, jsonNumOfOrfs->valueint);
+        }
+        endJsonArena();
+        freeArena(jsonArena);
+    }
+    free(cacheJSON);
+
+    linkAnalysisCacheToHistory(cache, history, numOfSealedRecords);
+    return cache;
+}
+
+int saveAnalysisCache(FILE* output_stream, AnalysisCache* cache, const char* cachePath)
+{
+    if (cache == NULL) return 0;
+
+    Arena* jsonArena = createArena(ARENA_BLOCK_SIZE);
+    if (jsonArena == NULL) return 0;
+    beginJsonArena(jsonArena);
+
+    cJSON* jsonEntries = cJSON_CreateArray();
+    for (int i = 0; i < cache->capacity; i++)
+    {
+        AnalysisCacheEntry* entry = &cache->entries[i];
+        if (!entry->isUsed || (entry->shardId == UNRESOLVED_SHARD_ID && entry->numOfOrfs > 0)) continue;
+
+        char hashString[16+1];
+        snprintf(hashString, sizeof(hashString), "%016" PRIx64, entry->sequenceHash);
+
+        cJSON* jsonEntry = cJSON_CreateObject();
+        cJSON_AddStringToObject(jsonEntry, "sequenceHash", hashString);
+        cJSON_AddNumberToObject(jsonEntry, "sequenceLength", entry->sequenceLength);
+        cJSON_AddNumberToObject(jsonEntry, "shardId", entry->shardId);
+        cJSON_AddNumberToObject(jsonEntry, "firstRecord", entry->firstRecord);
+        cJSON_AddNumberToObject(jsonEntry, "numOfOrfs", entry->numOfOrfs);
+        cJSON_AddItemToArray(jsonEntries, jsonEntry);
+    }
+    char* cacheJSON = copyPrintedJson(cJSON_PrintUnformatted(jsonEntries));
+
+    endJsonArena();
+    freeArena(jsonArena);
+
+    int isSaved = saveJsonToFileAtomically(output_stream, cachePath, cacheJSON);
+    free(cacheJSON);
+    return isSaved;
+}
+
+// ****************************************************  Archive journal functions  ***************************************************
+
+#define JOURNAL_SUFFIX ".journal"
+#define JOURNAL_GROUP_COMMIT_RECORDS 256    // fsync at least once every this many records...
+#define JOURNAL_GROUP_COMMIT_MS 200         // ...or once this much time has passed since the last fsync
+
+// Write-ahead journal of the ORFs found during a session, until the whole archive is rewritten at the end of it.
+// Each analyzed sequence is one group: a header line ({"sequenceHash", "sequenceLength", "numOfOrfs"}) followed by one line per ORF.
+typedef struct
+{
+    FILE* file;
+    char* path;
+    int pendingRecords;             // Written but not yet fsync'ed
+    struct timespec lastSyncTime;
+    long numOfRecords;
+    long numOfSyncs;
+    double syncMilliseconds;
+} ArchiveJournal;
+
+ArchiveJournal* openArchiveJournal(FILE* output_stream, const char* archivePath)
+{
+    ArchiveJournal* journal = (ArchiveJournal*) calloc(1, sizeof(ArchiveJournal));
+    if (journal == NULL) return NULL;
+
+    journal->path = getSidecarPath(archivePath, JOURNAL_SUFFIX);
+    journal->file = (journal->path != NULL) ? fopen(journal->path, "a") : NULL;
+    if (journal->file == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't open the archive journal, results are saved only at the end of the session:\t%s\a\n" RESET, strerror(errno));
+        free(journal->path);
+        free(journal);
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &journal->lastSyncTime);
+    return journal;
+}
+
+void syncArchiveJournal(ArchiveJournal* journal)
+{
+    if (journal == NULL || journal->pendingRecords == 0) return;
+
+    struct timespec before, after;
+    clock_gettime(CLOCK_MONOTONIC, &before);
+    fflush(journal->file);
+    fsync(fileno(journal->file));
+    clock_gettime(CLOCK_MONOTONIC, &after);
+
+    journal->syncMilliseconds += millisecondsBetween(&before, &after);
+    journal->numOfSyncs++;
+    journal->pendingRecords = 0;
+    journal->lastSyncTime = after;
+}
+
+// Group commit: many records share one fsync, instead of paying for one per record
+void commitArchiveJournalIfDue(ArchiveJournal* journal)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (journal->pendingRecords >= JOURNAL_GROUP_COMMIT_RECORDS
+        || millisecondsBetween(&journal->lastSyncTime, &now) >= JOURNAL_GROUP_COMMIT_MS)
+    {
+        syncArchiveJournal(journal);
+    }
+}
+
+// Commits are otherwise only checked for as records are written, so records pending when the session waits for
+// input would wait with it, past JOURNAL_GROUP_COMMIT_MS. Called before reading the next input: if none is ready
+// (the read may block), they're committed now
+void commitArchiveJournalBeforeInput(ArchiveJournal* journal, FILE* input_stream)
+{
+    if (journal != NULL && journal->pendingRecords > 0 && stream_is_empty(input_stream))
+    {
+        syncArchiveJournal(journal);
+    }
+}
+
+void writeJournalLine(ArchiveJournal* journal, cJSON* jsonLine)
+{
+    char* line = cJSON_PrintUnformatted(jsonLine);
+    if (line != NULL)
+    {
+        fputs(line, journal->file);
+        fputc('\n', journal->file);
+    }
+    journal->pendingRecords++;
+    journal->numOfRecords++;
+    commitArchiveJournalIfDue(journal);
+}
+
+void appendToArchiveJournal(ArchiveJournal* journal, uint64_t sequenceHash, int sequenceLength, DoublyLinkedList* orfs)
+{
+    if (journal == NULL) return;
+
+    Arena* jsonArena = createArena(ARENA_BLOCK_SIZE);
+    if (jsonArena == NULL) return;
+    beginJsonArena(jsonArena);
+
+    char hashString[16+1];
+    snprintf(hashString, sizeof(hashString), "%016" PRIx64, sequenceHash);
+    cJSON* jsonHeader = cJSON_CreateObject();
+    cJSON_AddStringToObject(jsonHeader, "sequenceHash", hashString);
+    cJSON_AddNumberToObject(jsonHeader, "sequenceLength", sequenceLength);
+    cJSON_AddNumberToObject(jsonHeader, "numOfOrfs", orfs->size);
+    writeJournalLine(journal, jsonHeader);
+
+    for (ListNode* current = orfs->head; current != NULL; current = current->next)
+    {
+        writeJournalLine(journal, sequenceToJson(current->data));
+    }
+    fflush(journal->file); // Whole group handed to the OS, so it survives the process crashing while we wait for the next input
+
+    endJsonArena();
+    freeArena(jsonArena);
+}
+
+// Called once the archive has been rewritten, so the journal's contents are safely in it
+void closeArchiveJournal(FILE* output_stream, ArchiveJournal* journal, bool removeJournal)
+{
+    if (journal == NULL) return;
+
+    syncArchiveJournal(journal);
+    fclose(journal->file);
+    if (removeJournal)
+    {
+        remove(journal->path);
+    }
+    if (journal->numOfRecords > 0)
+    {
+        fprintf(output_stream, DIM "Archive journal: %ld records, %ld fsync(s), %.1f ms spent in fsync\n" RESET,
+                journal->numOfRecords, journal->numOfSyncs, journal->syncMilliseconds);
+    }
+    free(journal->path);
+    free(journal);
+}
+
+int compareUint64(const void* value1, const void* value2)
+{
+    uint64_t v1 = *(const uint64_t*) value1, v2 = *(const uint64_t*) value2;
+    return (v1 > v2) - (v1 < v2);
+}
+
+// Re-applies the journal of a session that didn't finish (e.g. crash). Groups whose sequence is already in the
+// history (archive rewritten, but journal not yet removed) are skipped. Replay stops at the first damaged record, as
+// a crash leaves the last one torn. Returns the number of recovered ORFs.
+int replayArchiveJournal(FILE* output_stream, const char* archivePath, OrfStore* history, AnalysisCache* cache)
+{
+    char* journalPath = getSidecarPath(archivePath, JOURNAL_SUFFIX);
+    FILE* journalFile = (journalPath != NULL) ? fopen(journalPath, "r") : NULL;
+    free(journalPath);
+    if (journalFile == NULL) return 0;
+
+    // Hashes of all sequences already in the history, sorted for binary search
+    uint64_t* archivedHashes = (uint64_t*) malloc(sizeof(uint64_t) * (history->size > 0 ? history->size : 1));
+    int numOfArchivedHashes = 0;
+    for (OrfStoreIterator it = orfStoreIteratorAt(history, 0); archivedHashes != NULL && orfStoreHasNext(&it); orfStoreAdvance(&it))
+    {
+        archivedHashes[numOfArchivedHashes++] = getStoredOrfHash(&it);
+    }
+    if (archivedHashes != NULL)
+    {
+        qsort(archivedHashes, numOfArchivedHashes, sizeof(uint64_t), compareUint64);
+    }
+
+    Arena* jsonArena = createArena(ARENA_BLOCK_SIZE);
+    if (jsonArena == NULL)
+    {
+        free(archivedHashes);
+        fclose(journalFile);
+        return 0;
+    }
+    beginJsonArena(jsonArena);
+
+    int numOfRecovered = 0;
+    bool isTorn = FALSE;
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    while (getline(&line, &lineCapacity, journalFile) > 0)
+    {
+        cJSON* jsonHeader = cJSON_Parse(line);
+        cJSON* jsonHash = cJSON_GetObjectItem(jsonHeader, "sequenceHash");
+        cJSON* jsonLength = cJSON_GetObjectItem(jsonHeader, "sequenceLength");
+        cJSON* jsonNumOfOrfs = cJSON_GetObjectItem(jsonHeader, "numOfOrfs");
+        if (!cJSON_IsString(jsonHash) || !cJSON_IsNumber(jsonLength) || !cJSON_IsNumber(jsonNumOfOrfs))
+        {
+            isTorn = TRUE;
+            break; // Torn or corrupted write: nothing after this point can be trusted
+        }
+
+        uint64_t sequenceHash = strtoull(jsonHash->valuestring, NULL, 16);
+        DoublyLinkedList* group = createList();
+        while (group->size < jsonNumOfOrfs->valueint && getline(&line, &lineCapacity, journalFile) > 0)
+        {
+            cJSON* jsonSeq = cJSON_Parse(line);
+            if (!jsonIsValidSequence(jsonSeq)) break;
+            appendToList(group, jsonToSequence(jsonSeq));
+        }
+
+        bool isComplete = (group->size == jsonNumOfOrfs->valueint);
+        bool isArchived = archivedHashes != NULL
+            && bsearch(&sequenceHash, archivedHashes, numOfArchivedHashes, sizeof(uint64_t), compareUint64) != NULL;
+        if (!isComplete || isArchived)
+        {
+            freeList(group);
+            if (!isComplete)
+            {
+                isTorn = TRUE;
+                break;
+            }
+            continue;
+        }
+
+        numOfRecovered += group->size;
+        insertNewAnalysisIntoCache(cache, sequenceHash, jsonLength->valueint, group->size);
+        appendListToOrfStore(history, group);
+    }
+
+    if (isTorn)
+    {
+        fprintf(output_stream, DIM "Archive journal: a torn or damaged record was found after %d recovered ORF(s), so the rest of the journal is dropped.\n" RESET,
+                numOfRecovered);
+    }
+    endJsonArena();
+    freeArena(jsonArena);
+    free(line);
+    free(archivedHashes);
+    fclose(journalFile);
+    return numOfRecovered;
+}
+
+// ****************************************************  Archive compaction functions  ***************************************************
+
+#define COMPACTION_RUN_BYTES (32 << 20) // Memory budget for one sorted run of the external sort
+
+// Identity of an ORF: two archive records with the same key describe the same ORF of the same input sequence
+typedef struct
+{
+    uint64_t sequenceHash;
+    int seqDirection;
+    int frame;
+    int startPosition;
+    int stopPosition;
+} OrfKey;
+
+typedef struct
+{
+    OrfKey key;
+    time_t analysisTime;
+    char* text;          // The record exactly as it appears in the archive
+    size_t textLength;
+} CompactionRecord;
+
+// Streams the top-level objects of a (possibly huge) JSON array archive one by one, without loading the whole file.
+// Compressed shards are streamed one block at a time, each record turned back into its JSON text.
+typedef struct
+{
+    FILE* file;
+    char* record;
+    size_t recordLength;
+    size_t recordCapacity;
+    OrfBlockFile* blockFile;        // Set for compressed shards, then 'file' is unused
+    uint32_t nextBlock;
+    DoublyLinkedList* blockRecords; // Decoded records of the current block
+    ListNode* nextBlockRecord;
+} ArchiveRecordReader;
+
+int compareOrfKeys(const OrfKey* key1, const OrfKey* key2)
+{
+    if (key1->sequenceHash != key2->sequenceHash) return key1->sequenceHash < key2->sequenceHash ? -1 : 1;
+    if (key1->seqDirection != key2->seqDirection) return key1->seqDirection < key2->seqDirection ? -1 : 1;
+    if (key1->frame != key2->frame) return key1->frame < key2->frame ? -1 : 1;
+    if (key1->startPosition != key2->startPosition) return key1->startPosition < key2->startPosition ? -1 : 1;
+    if (key1->stopPosition != key2->stopPosition) return key1->stopPosition < key2->stopPosition ? -1 : 1;
+    return 0;
+}
+
+int compareCompactionRecords(const void* record1, const void* record2)
+{
+    return compareOrfKeys(&((const CompactionRecord*) record1)->key, &((const CompactionRecord*) record2)->key);
+}
+
+void appendToRecordBuffer(ArchiveRecordReader* reader, char ch)
+{
+    if (reader->recordLength + 1 >= reader->recordCapacity)
+    {
+        reader->recordCapacity = reader->recordCapacity ? reader->recordCapacity * 2 : 4096;
+        reader->record = (char*) realloc(reader->record, reader->recordCapacity);
+    }
+    reader->record[reader->recordLength++] = ch;
+}
+
+bool readNextBlockRecord(ArchiveRecordReader* reader)
+{
+    while (reader->nextBlockRecord == NULL)
+    {
+        if (reader->blockRecords != NULL) freeList(reader->blockRecords);
+        reader->blockRecords = NULL;
+        if (reader->nextBlock >= reader->blockFile->numOfBlocks) return FALSE;
+
+        reader->blockRecords = createList();
+        decodeOrfBlock(reader->blockFile, reader->nextBlock++, reader->blockRecords, NULL, NULL);
+        reader->nextBlockRecord = reader->blockRecords->head;
+    }
+
+    // Same text as in a JSON shard, so the rest of the compaction doesn't care where the record came from
+    char* recordText = cJSON_PrintUnformatted(sequenceToJson(reader->nextBlockRecord->data));
+    reader->nextBlockRecord = reader->nextBlockRecord->next;
+    reader->recordLength = 0;
+    for (char* ch = recordText; ch != NULL && *ch != '\0'; ch++)
+    {
+        appendToRecordBuffer(reader, *ch);
+    }
+    appendToRecordBuffer(reader, '\0');
+    reader->recordLength--;
+    return TRUE;
+}
+
+// Returns TRUE and leaves the next record in reader->record, or FALSE at the end of the archive
+bool readNextArchiveRecord(ArchiveRecordReader* reader)
+{
+    if (reader->blockFile != NULL) return readNextBlockRecord(reader);
+
+    int depth = 1; // We are always inside the top-level array between records
+    bool inString = FALSE, escaped = FALSE, inRecord = FALSE;
+    int ch;
+
+    reader->recordLength = 0;
+    while ((ch = getc(reader->file)) != EOF)
+    {
+        if (!inRecord)
+        {
+            if (ch == '{') // Start of the next record; anything else here is whitespace, commas or the array's brackets
+            {
+                inRecord = TRUE;
+                depth = 2;
+                appendToRecordBuffer(reader, ch);
+            }
+            continue;
+        }
+
+        appendToRecordBuffer(reader, ch);
+        if (inString)
+        {
+            if (escaped) escaped = FALSE;
+            else if (ch == '\\') escaped = TRUE;
+            else if (ch == '"') inString = FALSE;
+        } else if (ch == '"')
+        {
+            inString = TRUE;
+        } else if (ch == '{' || ch == '[')
+        {
+            depth++;
+        } else if (ch == '}' || ch == ']')
+        {
+            depth--;
+            if (depth == 1)
+            {
+                reader->record[reader->recordLength] = '\0';
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+// Builds the dedup key of a record straight from its JSON, without creating a Sequence
+bool getOrfKeyOfRecord(char* recordText, size_t recordLength, OrfKey* key, time_t* analysisTime)
+{
+    cJSON* jsonSeq = cJSON_ParseWithLength(recordText, recordLength);
+    if (jsonSeq == NULL) return FALSE;
+
+    cJSON* jsonLength = cJSON_GetObjectItem(jsonSeq, "length");
+    cJSON* jsonDirection = cJSON_GetObjectItem(jsonSeq, "direction");
+    cJSON* jsonPosition = cJSON_GetObjectItem(jsonSeq, "positionInSupersequence");
+    cJSON* jsonHash = cJSON_GetObjectItem(jsonSeq, "sequenceHash");
+    cJSON* jsonCodons = cJSON_GetObjectItem(jsonSeq, "sequenceCodons");
+    if (!cJSON_IsNumber(jsonLength) || !cJSON_IsString(jsonDirection) || !cJSON_IsNumber(jsonPosition))
+    {
+        return FALSE;
+    }
+
+    Sequence header = { 0 };
+    header.seqDirection = stringToReadDirection(jsonDirection->valuestring);
+    header.positionInSupersequence = jsonPosition->valueint;
+
+    key->seqDirection = header.seqDirection;
+    key->frame = getFrameOfSequence(&header);
+    key->startPosition = header.positionInSupersequence;
+    key->stopPosition = header.positionInSupersequence + (header.seqDirection == FORWARD ? 1 : -1) * (jsonLength->valueint - CODONS_LENGTH);
+
+    *analysisTime = getDatetimeFromJson(jsonSeq, "analysisDatetime");
+
+    cJSON* lastCodon = cJSON_GetArrayItem(jsonCodons, cJSON_GetArraySize(jsonCodons) - 1);
+    cJSON* lastCodonPosition = cJSON_GetObjectItem(lastCodon, "positionInSequence");
+    if (cJSON_IsNumber(lastCodonPosition))
+    {
+        key->stopPosition = lastCodonPosition->valueint;
+    }
+
+    if (cJSON_IsString(jsonHash) && strtoull(jsonHash->valuestring, NULL, 16) != 0)
+    {
+        key->sequenceHash = strtoull(jsonHash->valuestring, NULL, 16);
+    } else
+    {
+        // Records from older archives don't know their input sequence, so only byte-identical ones count as duplicates
+        key->sequenceHash = hashSequence64(recordText, recordLength);
+    }
+    return TRUE;
+}
+
+char* getRunFilePath(const char* archivePath, int runIndex)
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".run.%d", runIndex);
+    return getSidecarPath(archivePath, suffix);
+}
+
+// Sorts one memory-sized run of records and writes it (duplicates already dropped) to its own temporary file
+bool writeCompactionRun(CompactionRecord* records, int numOfRecords, const char* runPath, long* numOfDuplicates)
+{
+    FILE* runFile = fopen(runPath, "w");
+    if (runFile == NULL) return FALSE;
+
+    qsort(records, numOfRecords, sizeof(CompactionRecord), compareCompactionRecords);
+    for (int i = 0; i < numOfRecords; i++)
+    {
+        if (i > 0 && compareOrfKeys(&records[i].key, &records[i-1].key) == 0)
+        {
+            (*numOfDuplicates)++;
+            continue;
+        }
+        OrfKey* key = &records[i].key;
+        fprintf(runFile, "%016" PRIx64 " %d %d %d %d %lld %zu\n", key->sequenceHash, key->seqDirection, key->frame, key->startPosition, key->stopPosition,
+                (long long) records[i].analysisTime, records[i].textLength);
+        fwrite(records[i].text, 1, records[i].textLength, runFile);
+        fputc('\n', runFile);
+    }
+    return fclose(runFile) == 0;
+}
+
+typedef struct
+{
+    FILE* file;
+    CompactionRecord current;
+    size_t textCapacity;
+    bool exhausted;
+} CompactionRunReader;
+
+void readNextRunRecord(CompactionRunReader* run)
+{
+    OrfKey* key = &run->current.key;
+    long long analysisTime;
+    if (fscanf(run->file, "%" SCNx64 " %d %d %d %d %lld %zu", &key->sequenceHash, &key->seqDirection, &key->frame, &key->startPosition, &key->stopPosition,
+               &analysisTime, &run->current.textLength) != 7)
+    {
+        run->exhausted = TRUE;
+        return;
+    }
+    run->current.analysisTime = (time_t) analysisTime;
+    fgetc(run->file); // Newline after the header
+
+    if (run->current.textLength + 1 > run->textCapacity)
+    {
+        run->textCapacity = run->current.textLength + 1;
+        run->current.text = (char*) realloc(run->current.text, run->textCapacity);
+    }
+    if (fread(run->current.text, 1, run->current.textLength, run->file) != run->current.textLength)
+    {
+        run->exhausted = TRUE;
+        return;
+    }
+    run->current.text[run->current.textLength] = '\0';
+}
+
+// Min-heap of run indexes, ordered by the key of each run's current record
+void siftDownRunHeap(CompactionRunReader* runs, int* heap, int heapSize, int i)
+{
+    while (TRUE)
+    {
+        int smallest = i, left = 2*i + 1, right = 2*i + 2;
+        if (left < heapSize && compareOrfKeys(&runs[heap[left]].current.key, &runs[heap[smallest]].current.key) < 0) smallest = left;
+        if (right < heapSize && compareOrfKeys(&runs[heap[right]].current.key, &runs[heap[smallest]].current.key) < 0) smallest = right;
+        if (smallest == i) return;
+
+        int tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// Writes the compacted records into new shard files, starting a new one every ARCHIVE_SHARD_MAX_BYTES
+typedef struct
+{
+    const char* archivePath;
+    FILE* file;
+    ArchiveShard current;
+    ArchiveShard* written;          // Finished shards, in order
+    int numOfWritten;
+    int nextShardId;
+    bool failed;
+} ShardWriter;
+
+void finishShardWriterFile(ShardWriter* writer)
+{
+    if (writer->file == NULL) return;
+
+    fputc(']', writer->file);
+    writer->current.bytes++;
+    writer->failed = !syncAndCloseFile(writer->file) || writer->failed;
+    writer->file = NULL;
+
+    writer->written = (ArchiveShard*) realloc(writer->written, sizeof(ArchiveShard) * (writer->numOfWritten + 1));
+    writer->written[writer->numOfWritten++] = writer->current;
+}
+
+void writeRecordToShards(ShardWriter* writer, CompactionRecord* record)
+{
+    if (writer->file != NULL && writer->current.bytes >= ARCHIVE_SHARD_MAX_BYTES)
+    {
+        finishShardWriterFile(writer);
+    }
+    if (writer->file == NULL)
+    {
+        memset(&writer->current, 0, sizeof(ArchiveShard));
+        writer->current.id = writer->nextShardId++;
+        char* shardPath = getShardPath(writer->archivePath, writer->current.id);
+        writer->file = fopen(shardPath, "w");
+        free(shardPath);
+        if (writer->file == NULL)
+        {
+            writer->failed = TRUE;
+            return;
+        }
+        fputc('[', writer->file);
+        writer->current.bytes = 1;
+    } else
+    {
+        fputs(", ", writer->file);
+        writer->current.bytes += 2;
+    }
+
+    fwrite(record->text, 1, record->textLength, writer->file);
+    writer->current.bytes += record->textLength;
+    writer->current.numOfRecords++;
+    if (record->analysisTime != 0 && (writer->current.firstTime == 0 || record->analysisTime < writer->current.firstTime)) writer->current.firstTime = record->analysisTime;
+    if (record->analysisTime > writer->current.lastTime) writer->current.lastTime = record->analysisTime;
+}
+
+// K-way merge of the sorted runs into the new shards, dropping duplicates that ended up in different runs
+bool mergeCompactionRuns(const char* archivePath, int numOfRuns, ShardWriter* writer, long* numOfWritten, long* numOfDuplicates)
+{
+    CompactionRunReader* runs = (CompactionRunReader*) calloc(numOfRuns, sizeof(CompactionRunReader));
+    int* heap = (int*) malloc(sizeof(int) * (numOfRuns > 0 ? numOfRuns : 1));
+    int heapSize = 0;
+    bool isMerged = (runs != NULL && heap != NULL);
+
+    for (int i = 0; isMerged && i < numOfRuns; i++)
+    {
+        char* runPath = getRunFilePath(archivePath, i);
+        runs[i].file = fopen(runPath, "r");
+        free(runPath);
+        if (runs[i].file == NULL)
+        {
+            isMerged = FALSE;
+            break;
+        }
+        readNextRunRecord(&runs[i]);
+        if (!runs[i].exhausted)
+        {
+            heap[heapSize++] = i;
+        }
+    }
+    for (int i = heapSize/2 - 1; isMerged && i >= 0; i--)
+    {
+        siftDownRunHeap(runs, heap, heapSize, i);
+    }
+
+    OrfKey lastKey;
+    while (isMerged && heapSize > 0 && !writer->failed)
+    {
+        CompactionRunReader* run = &runs[heap[0]];
+        if (*numOfWritten > 0 && compareOrfKeys(&run->current.key, &lastKey) == 0)
+        {
+            (*numOfDuplicates)++;
+        } else
+        {
+            writeRecordToShards(writer, &run->current);
+            lastKey = run->current.key;
+            (*numOfWritten)++;
+        }
+
+        readNextRunRecord(run);
+        if (run->exhausted)
+        {
+            heap[0] = heap[--heapSize];
+        }
+        siftDownRunHeap(runs, heap, heapSize, 0);
+    }
+    finishShardWriterFile(writer);
+
+    for (int i = 0; runs != NULL && i < numOfRuns; i++)
+    {
+        if (runs[i].file != NULL) fclose(runs[i].file);
+        free(runs[i].current.text);
+    }
+    free(runs);
+    free(heap);
+    return isMerged && !writer->failed;
+}
+
+void removeRunFiles(const char* archivePath, int numOfRuns)
+{
+    for (int i = 0; i < numOfRuns; i++)
+    {
+        char* runPath = getRunFilePath(archivePath, i);
+        remove(runPath);
+        free(runPath);
+    }
+}
+
+// Phase 1 of the compaction: cuts all input files into sorted, duplicate-free runs on disk
+bool splitIntoCompactionRuns(FILE* output_stream, const char* archivePath, char** inputPaths, int numOfInputs, int* numOfRuns, long* numOfRead, long* numOfDuplicates)
+{
+    int recordsCapacity = 1024, numOfRecordsInRun = 0;
+    bool isSplit = TRUE;
+    CompactionRecord* records = (CompactionRecord*) malloc(sizeof(CompactionRecord) * recordsCapacity);
+    Arena* runArena = createArena(ARENA_BLOCK_SIZE);
+    if (records == NULL || runArena == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for compaction.\n%s\a\n" RESET, strerror(errno));
+        free(records);
+        freeArena(runArena);
+        return FALSE;
+    }
+
+    for (int input = 0; isSplit && input < numOfInputs; input++)
+    {
+        ArchiveRecordReader reader = { 0 };
+        if (isOrfBlockFile(inputPaths[input]))
+        {
+            reader.blockFile = openOrfBlockFile(inputPaths[input]);
+            if (reader.blockFile == NULL)
+            {
+                fprintf(output_stream, ERROR_COLOR "Compressed shard '%s' is unreadable.\a\n" RESET, inputPaths[input]);
+                isSplit = FALSE;
+                continue;
+            }
+        } else
+        {
+            reader.file = fopen(inputPaths[input], "r");
+            if (reader.file == NULL) continue; // e.g. active shard not created yet
+        }
+
+        bool hasMoreRecords = TRUE;
+        bool isLastInput = (input == numOfInputs - 1);
+        while (isSplit && hasMoreRecords)
+        {
+            beginJsonArena(runArena);
+            hasMoreRecords = readNextArchiveRecord(&reader);
+            if (hasMoreRecords)
+            {
+                CompactionRecord* record;
+                if (numOfRecordsInRun == recordsCapacity)
+                {
+                    recordsCapacity *= 2;
+                    records = (CompactionRecord*) realloc(records, sizeof(CompactionRecord) * recordsCapacity);
+                }
+                record = &records[numOfRecordsInRun];
+                record->textLength = reader.recordLength;
+                record->text = (char*) arenaAlloc(runArena, reader.recordLength + 1);
+                memcpy(record->text, reader.record, reader.recordLength + 1);
+                (*numOfRead)++;
+
+                if (getOrfKeyOfRecord(record->text, record->textLength, &record->key, &record->analysisTime))
+                {
+                    numOfRecordsInRun++;
+                } else
+                {
+                    fprintf(output_stream, ERROR_COLOR "Skipping unreadable record #%ld of '%s'.\a\n" RESET, *numOfRead, inputPaths[input]);
+                }
+            }
+            endJsonArena();
+
+            bool isLastRecord = !hasMoreRecords && isLastInput;
+            if (numOfRecordsInRun > 0 && (isLastRecord || runArena->bytesReserved >= COMPACTION_RUN_BYTES))
+            {
+                char* runPath = getRunFilePath(archivePath, *numOfRuns);
+                isSplit = writeCompactionRun(records, numOfRecordsInRun, runPath, numOfDuplicates);
+                free(runPath);
+                (*numOfRuns)++;
+                numOfRecordsInRun = 0;
+
+                freeArena(runArena); // The run is on disk now, so its memory is released in one go
+                runArena = createArena(ARENA_BLOCK_SIZE);
+                isSplit = isSplit && runArena != NULL;
+            }
+        }
+        if (reader.file != NULL) fclose(reader.file);
+        closeOrfBlockFile(reader.blockFile);
+        if (reader.blockRecords != NULL) freeList(reader.blockRecords);
+        free(reader.record);
+    }
+
+    if (isSplit && numOfRecordsInRun > 0) // Last input was missing, so the last run wasn't flushed yet
+    {
+        char* runPath = getRunFilePath(archivePath, *numOfRuns);
+        isSplit = writeCompactionRun(records, numOfRecordsInRun, runPath, numOfDuplicates);
+        free(runPath);
+        (*numOfRuns)++;
+    }
+    free(records);
+    freeArena(runArena);
+    return isSplit;
+}
+
+// Rewrites the whole archive (all sealed shards and the active one) without duplicate ORFs, sorted by
+// (sequence hash, strand, frame, start, stop). Memory stays bounded by COMPACTION_RUN_BYTES no matter how big
+// the archive is (external merge sort). The output is cut into new shards; the last one becomes the active shard.
+bool compactArchive(FILE* output_stream, const char* archivePath, ArchiveManifest* manifest)
+{
+    int numOfInputs = manifest->numOfShards + 1;
+    char** inputPaths = (char**) malloc(sizeof(char*) * numOfInputs);
+    if (inputPaths == NULL) return FALSE;
+
+    long bytesBefore = 0;
+    for (int i = 0; i < manifest->numOfShards; i++)
+    {
+        inputPaths[i] = getShardPath(archivePath, manifest->shards[i].id);
+        bytesBefore += getFileSize(inputPaths[i]);
+    }
+    inputPaths[numOfInputs - 1] = strdup(archivePath);
+    bytesBefore += getFileSize(archivePath);
+
+    int numOfRuns = 0;
+    long numOfRead = 0, numOfWritten = 0, numOfDuplicates = 0;
+    bool isCompacted = splitIntoCompactionRuns(output_stream, archivePath, inputPaths, numOfInputs, &numOfRuns, &numOfRead, &numOfDuplicates);
+
+    // Phase 2: merge the runs into brand new shard files; the old files are untouched until the new manifest is saved
+    ShardWriter writer = { 0 };
+    writer.archivePath = archivePath;
+    writer.nextShardId = manifest->nextShardId;
+    isCompacted = isCompacted && mergeCompactionRuns(archivePath, numOfRuns, &writer, &numOfWritten, &numOfDuplicates);
+    removeRunFiles(archivePath, numOfRuns);
+
+    if (isCompacted && writer.numOfWritten == 0) // Nothing to keep: the new active shard is an empty one
+    {
+        char* emptyPath = getShardPath(archivePath, writer.nextShardId);
+        isCompacted = (emptyPath != NULL) && saveJsonToFileAtomically(output_stream, emptyPath, "[]");
+        free(emptyPath);
+        ArchiveShard emptyShard = { 0 };
+        emptyShard.id = writer.nextShardId++;
+        writer.written = (ArchiveShard*) realloc(writer.written, sizeof(ArchiveShard));
+        writer.written[writer.numOfWritten++] = emptyShard;
+    }
+
+    // The new manifest is the commit point: all but the last new shard are sealed, the last one is the pending active shard
+    ArchiveManifest compactedManifest = { 0 };
+    compactedManifest.nextShardId = writer.nextShardId;
+    for (int i = 0; i + 1 < writer.numOfWritten; i++)
+    {
+        addShardToManifest(&compactedManifest, &writer.written[i]);
+    }
+    compactedManifest.hasPendingActiveShard = (writer.numOfWritten > 0);
+    compactedManifest.pendingActiveShardId = (writer.numOfWritten > 0) ? writer.written[writer.numOfWritten - 1].id : 0;
+    syncParentDirectory(archivePath); // New shard files are in the directory before the manifest names them
+    isCompacted = isCompacted && saveArchiveManifest(output_stream, archivePath, &compactedManifest);
+
+    if (!isCompacted)
+    {
+        fprintf(output_stream, ERROR_COLOR "Compaction of '%s' failed, the archive was left untouched:\t%s\a\n" RESET, archivePath, strerror(errno));
+        for (int i = 0; i < writer.numOfWritten; i++) // New files are not referenced by anything
+        {
+            char* shardPath = getShardPath(archivePath, writer.written[i].id);
+            remove(shardPath);
+            free(shardPath);
+        }
+    } else
+    {
+        free(manifest->shards);
+        *manifest = compactedManifest;
+        finishPendingActiveShard(output_stream, archivePath, manifest);
+        for (int i = 0; i < numOfInputs - 1; i++) // Old shards are not referenced by the new manifest any more
+        {
+            remove(inputPaths[i]);
+        }
+
+        long bytesAfter = getFileSize(archivePath);
+        for (int i = 0; i < manifest->numOfShards; i++)
+        {
+            bytesAfter += manifest->shards[i].bytes;
+        }
+        fprintf(output_stream, SUCCESS_COLOR "Archive compacted: %ld records read, %ld duplicates removed, %ld records kept (%d sorted run(s), %d shard(s)).\n" RESET,
+                numOfRead, numOfDuplicates, numOfWritten, numOfRuns, writer.numOfWritten > 0 ? writer.numOfWritten : 1);
+        fprintf(output_stream, SUCCESS_COLOR "Size: %ld -> %ld bytes (%ld bytes reclaimed).\n" RESET, bytesBefore, bytesAfter, bytesBefore - bytesAfter);
+    }
+
+    if (!isCompacted) free(compactedManifest.shards);
+    for (int i = 0; i < numOfInputs; i++)
+    {
+        free(inputPaths[i]);
+    }
+    free(inputPaths);
+    free(writer.written);
+    return isCompacted;
+}
+
+// ****************************************************  ORF interval tree functions  ***************************************************
+
+// Bases an ORF covers, from its first START to the end of its STOP codon. Forward positions point to a codon's
+// first base and reverse positions to its last, so both ends come out the same way (1-based, inclusive)
+void getBasesCovered(direction seqDirection, int firstCodonPosition, int lastCodonPosition, int* firstBase, int* lastBase)
+{
+    if (seqDirection == FORWARD)
+    {
+        *firstBase = firstCodonPosition;
+        *lastBase = lastCodonPosition + CODONS_LENGTH - 1;
+    } else
+    {
+        *firstBase = lastCodonPosition - CODONS_LENGTH + 1;
+        *lastBase = firstCodonPosition;
+    }
+}
+
+typedef struct
+{
+    int low, high;                  // Bases covered, inclusive
+    int recordIndex;                // Whatever the caller uses to find the ORF again
+} OrfInterval;
+
+// Implicit interval tree: the intervals are sorted by 'low' and the array itself is the tree, in in-order. Node i
+// is on level k if i ends in k 1-bits, and its children are i - 2^(k-1) and i + 2^(k-1), so there are no pointers,
+// only the greatest 'high' of each subtree next to the array. Queries take O(log n + matches)
+typedef struct
+{
+    OrfInterval* intervals;
+    int* maxHigh;                   // Greatest 'high' in the subtree of each node
+    int* byHigh;                    // Indexes of 'intervals' sorted by 'high', for nearest-neighbour queries
+    int numOfIntervals;
+    int rootLevel;
+} OrfIntervalTree;
+
+// Indexes (in 'intervals') of the ORFs a query found
+typedef struct
+{
+    int* indexes;
+    int size, capacity;
+} IntervalMatches;
+
+#define INTERVAL_SCAN_LEVEL 3       // Subtrees this small are scanned rather than walked
+
+int compareOrfIntervals(const void* interval1, const void* interval2)
+{
+    const OrfInterval* i1 = (const OrfInterval*) interval1;
+    const OrfInterval* i2 = (const OrfInterval*) interval2;
+    if (i1->low != i2->low) return (i1->low > i2->low) - (i1->low < i2->low);
+    if (i1->high != i2->high) return (i1->high > i2->high) - (i1->high < i2->high);
+    return i1->recordIndex - i2->recordIndex;
+}
+
+static const OrfInterval* highsToSort; // qsort() has no context argument; only used while the tree is built
+
+int compareIntervalHighs(const void* index1, const void* index2)
+{
+    int h1 = highsToSort[*(const int*) index1].high, h2 = highsToSort[*(const int*) index2].high;
+    if (h1 != h2) return (h1 > h2) - (h1 < h2);
+    return *(const int*) index1 - *(const int*) index2;
+}
+
+void freeOrfIntervalTree(OrfIntervalTree* tree)
+{
+    if (tree == NULL) return;
+    free(tree->intervals);
+    free(tree->maxHigh);
+    free(tree->byHigh);
+    free(tree);
+}
+
+// Takes ownership of 'intervals' (of any order); NULL if out of memory
+OrfIntervalTree* buildOrfIntervalTree(OrfInterval* intervals, int numOfIntervals)
+{
+    OrfIntervalTree* tree = (OrfIntervalTree*) calloc(1, sizeof(OrfIntervalTree));
+    int size = (numOfIntervals > 0) ? numOfIntervals : 1;
+    if (tree == NULL || (tree->maxHigh = (int*) malloc(sizeof(int) * size)) == NULL
+        || (tree->byHigh = (int*) malloc(sizeof(int) * size)) == NULL)
+    {
+        if (tree != NULL) free(tree->maxHigh);
+        free(tree);
+        free(intervals);
+        return NULL;
+    }
+    tree->intervals = intervals;
+    tree->numOfIntervals = numOfIntervals;
+    if (numOfIntervals == 0) return tree;
+
+    qsort(intervals, numOfIntervals, sizeof(OrfInterval), compareOrfIntervals);
+    for (int i = 0; i < numOfIntervals; i++)
+    {
+        tree->byHigh[i] = i;
+    }
+    highsToSort = intervals;
+    qsort(tree->byHigh, numOfIntervals, sizeof(int), compareIntervalHighs);
+    highsToSort = NULL;
+
+    // Leaves (level 0) are the even indexes; every level up takes the greatest 'high' of its two children. A node
+    // whose right child is past the end gets the greatest 'high' of the last real node in that direction instead
+    int lastIndex = 0, lastMaxHigh = 0;
+    for (int i = 0; i < numOfIntervals; i += 2)
+    {
+        lastIndex = i;
+        lastMaxHigh = tree->maxHigh[i] = intervals[i].high;
+    }
+    int level = 1;
+    for (; (1 << level) <= numOfIntervals; level++)
+    {
+        int halfStep = 1 << (level - 1);
+        for (int i = (1 << level) - 1; i < numOfIntervals; i += 1 << (level + 1))
+        {
+            int leftMax = tree->maxHigh[i - halfStep];
+            int rightMax = (i + halfStep < numOfIntervals) ? tree->maxHigh[i + halfStep] : lastMaxHigh;
+            int maxHigh = intervals[i].high;
+            if (leftMax > maxHigh) maxHigh = leftMax;
+            if (rightMax > maxHigh) maxHigh = rightMax;
+            tree->maxHigh[i] = maxHigh;
+        }
+        lastIndex = ((lastIndex >> level) & 1) ? lastIndex - halfStep : lastIndex + halfStep; // Parent of the last node
+        if (lastIndex < numOfIntervals && tree->maxHigh[lastIndex] > lastMaxHigh) lastMaxHigh = tree->maxHigh[lastIndex];
+    }
+    tree->rootLevel = level - 1;
+    return tree;
+}
+
+void addIntervalMatch(IntervalMatches* matches, int index)
+{
+    if (matches->size == matches->capacity)
+    {
+        matches->capacity = matches->capacity ? matches->capacity * 2 : 64;
+        matches->indexes = (int*) realloc(matches->indexes, sizeof(int) * matches->capacity);
+    }
+    matches->indexes[matches->size++] = index;
+}
+
+// All intervals sharing at least one base with [low, high], in order of 'low'
+void findOverlappingOrfs(OrfIntervalTree* tree, int low, int high, IntervalMatches* matches)
+{
+    struct { int node, level; bool leftDone; } stack[64];
+    int stackSize = 0, numOfIntervals = tree->numOfIntervals;
+    OrfInterval* intervals = tree->intervals;
+    if (numOfIntervals == 0) return;
+
+    stack[stackSize].node = (1 << tree->rootLevel) - 1;
+    stack[stackSize].level = tree->rootLevel;
+    stack[stackSize++].leftDone = FALSE;
+    while (stackSize > 0)
+    {
+        int node = stack[stackSize - 1].node, level = stack[stackSize - 1].level;
+        bool leftDone = stack[--stackSize].leftDone;
+
+        if (level <= INTERVAL_SCAN_LEVEL) // The whole subtree, left to right, until 'low' goes past the range
+        {
+            int first = node >> level << level;
+            int last = first + (1 << (level + 1)) - 1;
+            if (last > numOfIntervals) last = numOfIntervals;
+            for (int i = first; i < last && intervals[i].low <= high; i++)
+            {
+                if (intervals[i].high >= low) addIntervalMatch(matches, i);
+            }
+        } else if (!leftDone)
+        {
+            int leftChild = node - (1 << (level - 1));
+            stack[stackSize].node = node;
+            stack[stackSize].level = level;
+            stack[stackSize++].leftDone = TRUE;
+            if (leftChild >= numOfIntervals || tree->maxHigh[leftChild] >= low) // Past the end, but its left part may be real
+            {
+                stack[stackSize].node = leftChild;
+                stack[stackSize].level = level - 1;
+                stack[stackSize++].leftDone = FALSE;
+            }
+        } else if (node < numOfIntervals && intervals[node].low <= high)
+        {
+            if (intervals[node].high >= low) addIntervalMatch(matches, node);
+            stack[stackSize].node = node + (1 << (level - 1));
+            stack[stackSize].level = level - 1;
+            stack[stackSize++].leftDone = FALSE;
+        }
+    }
+}
+
+// Intervals lying entirely inside [low, high] (nested ORFs), found among the overlapping ones
+void findNestedOrfs(OrfIntervalTree* tree, int low, int high, IntervalMatches* matches)
+{
+    IntervalMatches overlapping = { NULL, 0, 0 };
+    findOverlappingOrfs(tree, low, high, &overlapping);
+    for (int i = 0; i < overlapping.size; i++)
+    {
+        OrfInterval* interval = &tree->intervals[overlapping.indexes[i]];
+        if (interval->low >= low && interval->high <= high) addIntervalMatch(matches, overlapping.indexes[i]);
+    }
+    free(overlapping.indexes);
+}
+
+// Intervals covering the whole of [low, high]
+void findContainingOrfs(OrfIntervalTree* tree, int low, int high, IntervalMatches* matches)
+{
+    IntervalMatches overlapping = { NULL, 0, 0 };
+    findOverlappingOrfs(tree, low, high, &overlapping);
+    for (int i = 0; i < overlapping.size; i++)
+    {
+        OrfInterval* interval = &tree->intervals[overlapping.indexes[i]];
+        if (interval->low <= low && interval->high >= high) addIntervalMatch(matches, overlapping.indexes[i]);
+    }
+    free(overlapping.indexes);
+}
+
+// The ORFs covering 'position' if there are any; otherwise the closest one ending before it and the closest one
+// starting after it (all of them on a tie). Both come from a binary search, so this is O(log n + matches)
+void findNearestOrfs(OrfIntervalTree* tree, int position, IntervalMatches* matches)
+{
+    findOverlappingOrfs(tree, position, position, matches);
+    if (matches->size > 0 || tree->numOfIntervals == 0) return;
+
+    int low = 0, high = tree->numOfIntervals; // Last interval ending before 'position'
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+        if (tree->intervals[tree->byHigh[middle]].high < position) low = middle + 1;
+        else high = middle;
+    }
+    for (int i = low - 1; i >= 0 && tree->intervals[tree->byHigh[i]].high == tree->intervals[tree->byHigh[low - 1]].high; i--)
+    {
+        addIntervalMatch(matches, tree->byHigh[i]);
+    }
+
+    low = 0, high = tree->numOfIntervals; // First interval starting after 'position'
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+        if (tree->intervals[middle].low <= position) low = middle + 1;
+        else high = middle;
+    }
+    for (int i = low; i < tree->numOfIntervals && tree->intervals[i].low == tree->intervals[low].low; i++)
+    {
+        addIntervalMatch(matches, i);
+    }
+}
+
+
+
+
+// ****************************************************  History query functions  ***************************************************
+
+#define ANY_VALUE -1
+#define QUERY_INPUT_SIZE 32
+
+// Filters of a history query; ANY_VALUE (or 0 for the bounds) means the filter is not used
+typedef struct
+{
+    int seqDirection;
+    int minLength, maxLength;
+    int minPosition, maxPosition;
+    int startCodonIndex;            // Index in START_CODONS
+    int stopCodonIndex;             // Index in STOP_CODONS
+    time_t fromTime, untilTime;
+} HistoryQuery;
+
+typedef struct
+{
+    int64_t key;
+    int recordIndex;
+} IndexEntry;
+
+// A posting list: indexes of all records sharing one value, in history order
+typedef struct
+{
+    int* recordIndexes;
+    int size;
+} PostingList;
+
+// What a query looks at in one ORF, taken out of the (packed) record once when the index is built
+typedef struct
+{
+    int length;
+    int position;                   // positionInSupersequence
+    time_t analysisTime;
+    int seqDirection;
+    int startCodonIndex;            // Index in START_CODONS, -1 if none
+    int stopCodonIndex;             // Index in STOP_CODONS, -1 if none
+    int firstBase, lastBase;        // Bases covered, see getBasesCovered()
+} OrfQueryFields;
+
+// The ORFs of one analyzed sequence: positions of different sequences have nothing to do with each other, so
+// each gets its own interval tree
+typedef struct
+{
+    uint64_t sequenceHash;
+    int numOfOrfs;
+    int lastRecordIndex;            // Of its latest analysis, so that sequences can be listed in history order
+    OrfIntervalTree* byInterval;
+} SequenceIntervals;
+
+// Secondary indexes over the history, so that a query only touches the records that can match
+typedef struct
+{
+    OrfQueryFields* fields;         // In history order
+    OrfStoreIterator* locations;    // Where each record is in the history, to unpack the ones that are shown
+    int numOfRecords;
+    IndexEntry* byLength;           // Sorted by key
+    IndexEntry* byPosition;
+    IndexEntry* byTime;
+    PostingList byDirection[2];
+    PostingList* byStartCodon;      // One list per entry of START_CODONS
+    PostingList* byStopCodon;       // One list per entry of STOP_CODONS
+    SequenceIntervals* bySequence;  // Bases covered, one tree per analyzed sequence, for positional queries
+    int numOfSequences;
+} HistoryIndex;
+
+int compareIndexEntries(const void* entry1, const void* entry2)
+{
+    const IndexEntry* e1 = (const IndexEntry*) entry1;
+    const IndexEntry* e2 = (const IndexEntry*) entry2;
+    if (e1->key != e2->key) return e1->key < e2->key ? -1 : 1;
+    return e1->recordIndex - e2->recordIndex;
+}
+
+int compareInts(const void* value1, const void* value2)
+{
+    int v1 = *(const int*) value1, v2 = *(const int*) value2;
+    return (v1 > v2) - (v1 < v2);
+}
+
+// Codon indexes (in START_CODONS/STOP_CODONS) of an ORF's first and last codon, -1 if not one of them
+int getStartCodonIndex(Sequence* seq)
+{
+    return (seq->length >= CODONS_LENGTH) ? is_start_codon(seq->specialCodons[0].codonSequence) : -1;
+}
+
+int getStopCodonIndex(Sequence* seq)
+{
+    return (seq->length >= CODONS_LENGTH) ? is_stop_codon(seq->specialCodons[seq->length/CODONS_LENGTH - 1].codonSequence) : -1;
+}
+
+OrfQueryFields getQueryFieldsOfSequence(Sequence* seq)
+{
+    OrfQueryFields fields = { seq->length, seq->positionInSupersequence, seq->analysisTime, seq->seqDirection,
+                              getStartCodonIndex(seq), getStopCodonIndex(seq), 0, 0 };
+    int numOfCodons = seq->length / CODONS_LENGTH;
+    if (numOfCodons > 0)
+    {
+        getBasesCovered(seq->seqDirection, seq->specialCodons[0].positionInSequence, seq->specialCodons[numOfCodons - 1].positionInSequence,
+                        &fields.firstBase, &fields.lastBase);
+    }
+    return fields;
+}
+
+OrfQueryFields getQueryFieldsOfStoredOrf(OrfStoreIterator* iterator)
+{
+    char codon[CODONS_LENGTH + 1];
+    OrfStoreChunk* chunk = iterator->chunk;
+    OrfQueryFields fields = { chunk->length[iterator->index], chunk->start[iterator->index], getStoredOrfTime(iterator),
+                              chunk->strand[iterator->index], -1, -1, 0, 0 };
+    getBasesCovered(chunk->strand[iterator->index], getStoredOrfFirstPosition(iterator), chunk->end[iterator->index],
+                    &fields.firstBase, &fields.lastBase);
+    if (getStoredOrfCodon(iterator, FALSE, codon)) fields.startCodonIndex = is_start_codon(codon);
+    if (getStoredOrfCodon(iterator, TRUE, codon)) fields.stopCodonIndex = is_stop_codon(codon);
+    return fields;
+}
+
+IndexEntry* buildSortedIndex(OrfQueryFields* records, int numOfRecords, int64_t (*getKey)(OrfQueryFields*))
+{
+    IndexEntry* entries = (IndexEntry*) malloc(sizeof(IndexEntry) * (numOfRecords > 0 ? numOfRecords : 1));
+    if (entries == NULL) return NULL;
+
+    for (int i = 0; i < numOfRecords; i++)
+    {
+        entries[i].key = getKey(&records[i]);
+        entries[i].recordIndex = i;
+    }
+    qsort(entries, numOfRecords, sizeof(IndexEntry), compareIndexEntries);
+    return entries;
+}
+
+int64_t getLengthKey(OrfQueryFields* fields) { return fields->length; }
+int64_t getPositionKey(OrfQueryFields* fields) { return fields->position; }
+int64_t getTimeKey(OrfQueryFields* fields) { return (int64_t) fields->analysisTime; }
+
+// Builds one posting list per possible value; getValue returns the value of a record, or -1 for none
+PostingList* buildPostingLists(OrfQueryFields* records, int numOfRecords, int numOfValues, int (*getValue)(OrfQueryFields*))
+{
+    PostingList* lists = (PostingList*) calloc(numOfValues, sizeof(PostingList));
+    int* values = (int*) malloc(sizeof(int) * (numOfRecords > 0 ? numOfRecords : 1));
+    if (lists == NULL || values == NULL)
+    {
+        free(lists);
+        free(values);
+        return NULL;
+    }
+
+    for (int i = 0; i < numOfRecords; i++) // First pass counts, so that every list is allocated exactly once
+    {
+        values[i] = getValue(&records[i]);
+        if (values[i] >= 0 && values[i] < numOfValues) lists[values[i]].size++;
+    }
+    for (int v = 0; v < numOfValues; v++)
+    {
+        lists[v].recordIndexes = (int*) malloc(sizeof(int) * (lists[v].size > 0 ? lists[v].size : 1));
+        lists[v].size = 0;
+    }
+    for (int i = 0; i < numOfRecords; i++)
+    {
+        if (values[i] >= 0 && values[i] < numOfValues) lists[values[i]].recordIndexes[lists[values[i]].size++] = i;
+    }
+
+    free(values);
+    return lists;
+}
+
+int getDirectionValue(OrfQueryFields* fields) { return fields->seqDirection; }
+int getStartCodonValue(OrfQueryFields* fields) { return fields->startCodonIndex; }
+int getStopCodonValue(OrfQueryFields* fields) { return fields->stopCodonIndex; }
+
+void freePostingLists(PostingList* lists, int numOfValues)
+{
+    if (lists == NULL) return;
+    for (int v = 0; v < numOfValues; v++)
+    {
+        free(lists[v].recordIndexes);
+    }
+    free(lists);
+}
+
+void freeHistoryIndex(HistoryIndex* index)
+{
+    if (index == NULL) return;
+
+    free(index->fields);
+    free(index->locations);
+    free(index->byLength);
+    free(index->byPosition);
+    free(index->byTime);
+    free(index->byDirection[FORWARD].recordIndexes);
+    free(index->byDirection[REVERSE].recordIndexes);
+    freePostingLists(index->byStartCodon, NUM_OF_START_CODONS);
+    freePostingLists(index->byStopCodon, NUM_OF_STOP_CODONS);
+    for (int i = 0; index->bySequence != NULL && i < index->numOfSequences; i++)
+    {
+        freeOrfIntervalTree(index->bySequence[i].byInterval);
+    }
+    free(index->bySequence);
+    free(index);
+}
+
+int compareSequenceIntervals(const void* sequence1, const void* sequence2)
+{
+    return ((const SequenceIntervals*) sequence1)->lastRecordIndex - ((const SequenceIntervals*) sequence2)->lastRecordIndex;
+}
+
+// Groups the records by sequence hash and builds the interval tree of each group; FALSE if out of memory
+bool buildSequenceIntervals(HistoryIndex* index)
+{
+    IndexEntry* byHash = (IndexEntry*) malloc(sizeof(IndexEntry) * (index->numOfRecords > 0 ? index->numOfRecords : 1));
+    if (byHash == NULL) return FALSE;
+    for (int i = 0; i < index->numOfRecords; i++)
+    {
+        byHash[i].key = (int64_t) getStoredOrfHash(&index->locations[i]);
+        byHash[i].recordIndex = i;
+    }
+    qsort(byHash, index->numOfRecords, sizeof(IndexEntry), compareIndexEntries); // Records of a sequence stay in history order
+
+    int numOfSequences = 0;
+    for (int i = 0; i < index->numOfRecords; i++)
+    {
+        if (i == 0 || byHash[i].key != byHash[i - 1].key) numOfSequences++;
+    }
+    index->bySequence = (SequenceIntervals*) calloc(numOfSequences > 0 ? numOfSequences : 1, sizeof(SequenceIntervals));
+    if (index->bySequence == NULL)
+    {
+        free(byHash);
+        return FALSE;
+    }
+
+    bool isBuilt = TRUE;
+    for (int first = 0, last; first < index->numOfRecords; first = last)
+    {
+        for (last = first + 1; last < index->numOfRecords && byHash[last].key == byHash[first].key; last++);
+
+        SequenceIntervals* sequence = &index->bySequence[index->numOfSequences++];
+        sequence->sequenceHash = (uint64_t) byHash[first].key;
+        sequence->numOfOrfs = last - first;
+        sequence->lastRecordIndex = byHash[last - 1].recordIndex;
+
+        OrfInterval* intervals = (OrfInterval*) malloc(sizeof(OrfInterval) * sequence->numOfOrfs);
+        for (int j = 0; intervals != NULL && j < sequence->numOfOrfs; j++)
+        {
+            int recordIndex = byHash[first + j].recordIndex;
+            intervals[j].low = index->fields[recordIndex].firstBase;
+            intervals[j].high = index->fields[recordIndex].lastBase;
+            intervals[j].recordIndex = recordIndex;
+        }
+        sequence->byInterval = (intervals != NULL) ? buildOrfIntervalTree(intervals, sequence->numOfOrfs) : NULL;
+        if (sequence->byInterval == NULL) isBuilt = FALSE;
+    }
+    qsort(index->bySequence, index->numOfSequences, sizeof(SequenceIntervals), compareSequenceIntervals);
+
+    free(byHash);
+    return isBuilt;
+}
+
+HistoryIndex* buildHistoryIndex(FILE* output_stream, OrfStore* history)
+{
+    HistoryIndex* index = (HistoryIndex*) calloc(1, sizeof(HistoryIndex));
+    if (index == NULL) return NULL;
+
+    index->numOfRecords = history->size;
+    index->fields = (OrfQueryFields*) malloc(sizeof(OrfQueryFields) * (history->size > 0 ? history->size : 1));
+    index->locations = (OrfStoreIterator*) malloc(sizeof(OrfStoreIterator) * (history->size > 0 ? history->size : 1));
+    if (index->fields == NULL || index->locations == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the history indexes.\n%s\a\n" RESET, strerror(errno));
+        freeHistoryIndex(index);
+        return NULL;
+    }
+    int i = 0;
+    for (OrfStoreIterator it = orfStoreIteratorAt(history, 0); orfStoreHasNext(&it) && i < history->size; orfStoreAdvance(&it))
+    {
+        index->locations[i] = it;
+        index->fields[i++] = getQueryFieldsOfStoredOrf(&it);
+    }
+
+    index->byLength = buildSortedIndex(index->fields, index->numOfRecords, getLengthKey);
+    index->byPosition = buildSortedIndex(index->fields, index->numOfRecords, getPositionKey);
+    index->byTime = buildSortedIndex(index->fields, index->numOfRecords, getTimeKey);
+
+    PostingList* byDirection = buildPostingLists(index->fields, index->numOfRecords, 2, getDirectionValue);
+    if (byDirection != NULL)
+    {
+        index->byDirection[FORWARD] = byDirection[FORWARD];
+        index->byDirection[REVERSE] = byDirection[REVERSE];
+        free(byDirection);
+    }
+    index->byStartCodon = buildPostingLists(index->fields, index->numOfRecords, NUM_OF_START_CODONS, getStartCodonValue);
+    index->byStopCodon = buildPostingLists(index->fields, index->numOfRecords, NUM_OF_STOP_CODONS, getStopCodonValue);
+    bool areTreesBuilt = buildSequenceIntervals(index);
+
+    if (index->byLength == NULL || index->byPosition == NULL || index->byTime == NULL || byDirection == NULL
+        || index->byStartCodon == NULL || index->byStopCodon == NULL || !areTreesBuilt)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the history indexes.\n%s\a\n" RESET, strerror(errno));
+        freeHistoryIndex(index);
+        return NULL;
+    }
+    return index;
+}
+
+// First entry with key >= value
+int lowerBoundOfIndex(IndexEntry* entries, int numOfEntries, int64_t value)
+{
+    int low = 0, high = numOfEntries;
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+        if (entries[middle].key < value) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+bool orfFieldsMatchQuery(OrfQueryFields* fields, HistoryQuery* query)
+{
+    if (query->seqDirection != ANY_VALUE && fields->seqDirection != query->seqDirection) return FALSE;
+    if (query->minLength > 0 && fields->length < query->minLength) return FALSE;
+    if (query->maxLength > 0 && fields->length > query->maxLength) return FALSE;
+    if (query->minPosition > 0 && fields->position < query->minPosition) return FALSE;
+    if (query->maxPosition > 0 && fields->position > query->maxPosition) return FALSE;
+    if (query->fromTime > 0 && fields->analysisTime < query->fromTime) return FALSE;
+    if (query->untilTime > 0 && fields->analysisTime > query->untilTime) return FALSE;
+    if (query->startCodonIndex != ANY_VALUE && fields->startCodonIndex != query->startCodonIndex) return FALSE;
+    if (query->stopCodonIndex != ANY_VALUE && fields->stopCodonIndex != query->stopCodonIndex) return FALSE;
+    return TRUE;
+}
+
+// Candidates coming from one index: either a slice of a sorted index or a whole posting list
+typedef struct
+{
+    IndexEntry* rangeEntries;
+    int* postingIndexes;
+    int size;
+} QueryCandidates;
+
+void considerRangeCandidates(QueryCandidates* best, IndexEntry* entries, int numOfEntries, int64_t minValue, int64_t maxValue)
+{
+    int first = lowerBoundOfIndex(entries, numOfEntries, minValue);
+    int last = lowerBoundOfIndex(entries, numOfEntries, maxValue + 1);
+    if (last - first < best->size)
+    {
+        best->rangeEntries = entries + first;
+        best->postingIndexes = NULL;
+        best->size = last - first;
+    }
+}
+
+void considerPostingCandidates(QueryCandidates* best, PostingList* list)
+{
+    if (list->size < best->size)
+    {
+        best->rangeEntries = NULL;
+        best->postingIndexes = list->recordIndexes;
+        best->size = list->size;
+    }
+}
+
+// Returns the (history ordered) indexes of all matching records; only the most selective index is scanned
+int* runHistoryQuery(HistoryIndex* index, HistoryQuery* query, int* numOfMatches)
+{
+    QueryCandidates best = { NULL, NULL, index->numOfRecords };
+    int64_t noUpperBound = INT64_MAX - 1;
+
+    if (query->minLength > 0 || query->maxLength > 0)
+        considerRangeCandidates(&best, index->byLength, index->numOfRecords, query->minLength, query->maxLength > 0 ? query->maxLength : noUpperBound);
+    if (query->minPosition > 0 || query->maxPosition > 0)
+        considerRangeCandidates(&best, index->byPosition, index->numOfRecords, query->minPosition, query->maxPosition > 0 ? query->maxPosition : noUpperBound);
+    if (query->fromTime > 0 || query->untilTime > 0)
+        considerRangeCandidates(&best, index->byTime, index->numOfRecords, query->fromTime, query->untilTime > 0 ? (int64_t) query->untilTime : noUpperBound);
+    if (query->seqDirection != ANY_VALUE)
+        considerPostingCandidates(&best, &index->byDirection[query->seqDirection]);
+    if (query->startCodonIndex != ANY_VALUE)
+        considerPostingCandidates(&best, &index->byStartCodon[query->startCodonIndex]);
+    if (query->stopCodonIndex != ANY_VALUE)
+        considerPostingCandidates(&best, &index->byStopCodon[query->stopCodonIndex]);
+
+    int* matches = (int*) malloc(sizeof(int) * (best.size > 0 ? best.size : 1));
+    *numOfMatches = 0;
+    if (matches == NULL) return NULL;
+
+    for (int i = 0; i < best.size; i++)
+    {
+        int recordIndex;
+        if (best.rangeEntries != NULL) recordIndex = best.rangeEntries[i].recordIndex;
+        else if (best.postingIndexes != NULL) recordIndex = best.postingIndexes[i];
+        else recordIndex = i; // No filter has an index (or none is selective), so every record is a candidate
+
+        if (orfFieldsMatchQuery(&index->fields[recordIndex], query))
+        {
+            matches[(*numOfMatches)++] = recordIndex;
+        }
+    }
+
+    if (best.rangeEntries != NULL) // Slices of sorted indexes are in key order, results are shown in history order
+    {
+        qsort(matches, *numOfMatches, sizeof(int), compareInts);
+    }
+    return matches;
+}
+
+// Zone map check: FALSE if no record of the block can match the query, so the block is never read
+bool blockMayMatchQuery(OrfBlockInfo* info, HistoryQuery* query)
+{
+    if (query->seqDirection != ANY_VALUE && !(info->directionMask & (1 << query->seqDirection))) return FALSE;
+    if (query->minLength > 0 && info->maxLength < query->minLength) return FALSE;
+    if (query->maxLength > 0 && info->minLength > query->maxLength) return FALSE;
+    if (query->minPosition > 0 && info->maxPosition < query->minPosition) return FALSE;
+    if (query->maxPosition > 0 && info->minPosition > query->maxPosition) return FALSE;
+    if (query->fromTime > 0 && info->maxTime < (int64_t) query->fromTime) return FALSE;
+    if (query->untilTime > 0 && info->minTime > (int64_t) query->untilTime) return FALSE;
+    return TRUE;
+}
+
+bool keepMatchingRecord(Sequence* seq, void* query)
+{
+    OrfQueryFields fields = getQueryFieldsOfSequence(seq);
+    return orfFieldsMatchQuery(&fields, (HistoryQuery*) query);
+}
+
+// ORFs kept in compressed shards, which are not in the history in memory
+int getNumOfCompressedRecords(ArchiveManifest* manifest)
+{
+    int numOfRecords = 0;
+    for (int i = 0; i < manifest->numOfShards; i++)
+    {
+        if (manifest->shards[i].isCompressed) numOfRecords += manifest->shards[i].numOfRecords;
+    }
+    return numOfRecords;
+}
+
+// Runs a query over the compressed shards, decoding only the blocks whose value ranges overlap the filters
+DoublyLinkedList* queryCompressedShards(FILE* output_stream, const char* archivePath, ArchiveManifest* manifest, HistoryQuery* query)
+{
+    DoublyLinkedList* matches = createList();
+    long numOfBlocks = 0, numOfDecoded = 0;
+
+    for (int i = 0; i < manifest->numOfShards; i++)
+    {
+        if (!manifest->shards[i].isCompressed) continue;
+
+        char* shardPath = getShardPath(archivePath, manifest->shards[i].id);
+        OrfBlockFile* blockFile = openOrfBlockFile(shardPath);
+        if (blockFile == NULL)
+        {
+            fprintf(output_stream, ERROR_COLOR "Compressed shard '%s' is missing or unreadable, its results are not in the query.\a\n" RESET, shardPath);
+            free(shardPath);
+            continue;
+        }
+        for (uint32_t block = 0; block < blockFile->numOfBlocks; block++)
+        {
+            numOfBlocks++;
+            if (!blockMayMatchQuery(&blockFile->blocks[block], query)) continue;
+
+            numOfDecoded++;
+            if (!decodeOrfBlock(blockFile, block, matches, keepMatchingRecord, query))
+            {
+                fprintf(output_stream, ERROR_COLOR "Block %u of compressed shard '%s' is corrupted.\a\n" RESET, block, shardPath);
+            }
+        }
+        closeOrfBlockFile(blockFile);
+        free(shardPath);
+    }
+
+    if (numOfBlocks > 0)
+    {
+        fprintf(output_stream, DIM "Compressed shards: %ld of %ld block(s) decoded\n" RESET, numOfDecoded, numOfBlocks);
+    }
+    return matches;
+}
+
+// Reads one filter value from the user; "-" (or anything not matching) leaves it unset
+void readQueryToken(FILE* output_stream, const char* prompt, char* token)
+{
+    fprintf(output_stream, "%s\t", prompt);
+    if (scanf("%31s", token) != 1)
+    {
+        strcpy(token, "-");
+    }
+}
+
+int readQueryNumber(FILE* output_stream, const char* prompt)
+{
+    char token[QUERY_INPUT_SIZE];
+    readQueryToken(output_stream, prompt, token);
+    int value = atoi(token);
+    return value > 0 ? value : 0;
+}
+
+int findCodonIndex(char* codon, char** codons, int numOfCodons)
+{
+    toUpperCase(codon);
+    for (int i = 0; i < numOfCodons; i++)
+    {
+        if (strcmp(codon, codons[i]) == 0) return i;
+    }
+    return ANY_VALUE;
+}
+
+void readHistoryQuery(FILE* output_stream, HistoryQuery* query)
+{
+    char token[QUERY_INPUT_SIZE];
+
+    fprintf(output_stream, DIM "Filter the history (enter - or 0 to skip a filter)\n" RESET);
+
+    readQueryToken(output_stream, "Direction (F: forward, R: reverse):", token);
+    query->seqDirection = (toupper(token[0]) == 'F') ? FORWARD : (toupper(token[0]) == 'R') ? REVERSE : ANY_VALUE;
+
+    query->minLength = readQueryNumber(output_stream, "Minimum length:");
+    query->maxLength = readQueryNumber(output_stream, "Maximum length:");
+    query->minPosition = readQueryNumber(output_stream, "Minimum position:");
+    query->maxPosition = readQueryNumber(output_stream, "Maximum position:");
+
+    readQueryToken(output_stream, "Start codon (e.g. AUG):", token);
+    query->startCodonIndex = findCodonIndex(token, START_CODONS, NUM_OF_START_CODONS);
+    readQueryToken(output_stream, "Stop codon (e.g. UAA):", token);
+    query->stopCodonIndex = findCodonIndex(token, STOP_CODONS, NUM_OF_STOP_CODONS);
+
+    readQueryToken(output_stream, "Analyzed from date (YYYY-MM-DD):", token);
+    query->fromTime = parseDatetime(token);
+    readQueryToken(output_stream, "Analyzed until date (YYYY-MM-DD):", token);
+    query->untilTime = parseDatetime(token);
+    if (query->untilTime > 0)
+    {
+        query->untilTime += 24*60*60 - 1; // Whole day included
+    }
+}
+
+// Results are the decoded matches of compressed shards, then the history's, which are only unpacked when shown
+void printQueryPage(FILE* output_stream, Sequence** coldResults, int numOfColdResults, OrfStoreIterator* hotResults,
+                    int numOfMatches, int pageSize, int page)
+{
+    int first = (page - 1) * pageSize;
+    int last = (first + pageSize < numOfMatches) ? first + pageSize : numOfMatches;
+
+    for (int i = first; i < last; i++)
+    {
+        if (i < numOfColdResults)
+        {
+            printSequence(output_stream, coldResults[i]);
+            continue;
+        }
+        Sequence* seq = getStoredOrf(&hotResults[i - numOfColdResults]);
+        printSequence(output_stream, seq);
+        free(seq);
+    }
+    fprintf(output_stream, SUCCESS_COLOR "\nShowing results %d-%d of %d (page %d of %d)\n" RESET,
+            first + 1, last, numOfMatches, page, (numOfMatches + pageSize - 1) / pageSize);
+}
+
+// Shows the first page of results, then any page the user asks for
+void browseQueryResults(FILE* output_stream, Sequence** coldResults, int numOfColdResults, OrfStoreIterator* hotResults,
+                        int numOfMatches, int pageSize)
+{
+    int numOfPages = (numOfMatches + pageSize - 1) / pageSize;
+    int page = 1;
+    while (page >= 1 && page <= numOfPages)
+    {
+        printQueryPage(output_stream, coldResults, numOfColdResults, hotResults, numOfMatches, pageSize, page);
+        if (numOfPages == 1) break;
+
+        fprintf(output_stream, "Page to show (1-%d, 0 to go back):\t", numOfPages);
+        if (scanf("%d", &page) != 1) break;
+    }
+}
+
+// Interactive query over the history and the compressed shards: filters, then one page of results at a time.
+// Results of compressed shards come first, then those of the history.
+void queryHistory(FILE* output_stream, HistoryIndex* index, const char* archivePath, ArchiveManifest* manifest)
+{
+    HistoryQuery query;
+    readHistoryQuery(output_stream, &query);
+
+    int pageSize = readQueryNumber(output_stream, "Results per page:");
+    if (pageSize <= 0) pageSize = 10;
+
+    int numOfIndexMatches = 0;
+    int* indexMatches = runHistoryQuery(index, &query, &numOfIndexMatches);
+    DoublyLinkedList* compressedMatches = queryCompressedShards(output_stream, archivePath, manifest, &query);
+    int numOfColdMatches = compressedMatches->size;
+    int numOfMatches = numOfIndexMatches + numOfColdMatches;
+    Sequence** coldMatches = (Sequence**) malloc(sizeof(Sequence*) * (numOfColdMatches > 0 ? numOfColdMatches : 1));
+    OrfStoreIterator* hotMatches = (OrfStoreIterator*) malloc(sizeof(OrfStoreIterator) * (numOfIndexMatches > 0 ? numOfIndexMatches : 1));
+    if (indexMatches == NULL || coldMatches == NULL || hotMatches == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the query results.\n%s\a\n" RESET, strerror(errno));
+        free(indexMatches);
+        free(coldMatches);
+        free(hotMatches);
+        freeList(compressedMatches);
+        return;
+    }
+    int i = 0;
+    for (ListNode* current = compressedMatches->head; current != NULL; current = current->next)
+    {
+        coldMatches[i++] = current->data;
+    }
+    for (int j = 0; j < numOfIndexMatches; j++)
+    {
+        hotMatches[j] = index->locations[indexMatches[j]];
+    }
+    free(indexMatches);
+
+    if (numOfMatches == 0)
+    {
+        fprintf(output_stream, "\nNo ORFs in the history match the given filters\n");
+        free(coldMatches);
+        free(hotMatches);
+        freeList(compressedMatches);
+        return;
+    }
+
+    browseQueryResults(output_stream, coldMatches, numOfColdMatches, hotMatches, numOfMatches, pageSize);
+    free(coldMatches);
+    free(hotMatches);
+    freeList(compressedMatches);
+}
+
+// Interactive positional query over the ORFs of one analyzed sequence (the latest one unless another is chosen):
+// ORFs overlapping, nested in or containing a range of bases (nested and overlapping genes, see README), or the
+// nearest ones to a base. Results are in order of position
+void findOrfsByPosition(FILE* output_stream, HistoryIndex* index, int numOfCompressedRecords)
+{
+    if (index->numOfSequences == 0)
+    {
+        fprintf(output_stream, "\nNo ORFs in the history yet\n");
+        return;
+    }
+    fprintf(output_stream, "\nAnalyzed sequences in the history:\n");
+    for (int i = 0; i < index->numOfSequences; i++)
+    {
+        fprintf(output_stream, "%d. %016" PRIx64 " (%d ORFs)\n", i + 1, index->bySequence[i].sequenceHash, index->bySequence[i].numOfOrfs);
+    }
+    int choice = readQueryNumber(output_stream, "Sequence (- or 0 for the latest):");
+    if (choice == 0) choice = index->numOfSequences;
+    if (choice > index->numOfSequences)
+    {
+        fprintf(output_stream, ERROR_COLOR "There is no sequence %d in the list.\a\n" RESET, choice);
+        return;
+    }
+    OrfIntervalTree* tree = index->bySequence[choice - 1].byInterval;
+
+    char token[QUERY_INPUT_SIZE];
+    readQueryToken(output_stream, "Find ORFs (O: overlapping a range, N: nested in a range, C: containing a range, P: nearest to a position):", token);
+    char queryType = toupper(token[0]);
+    if (strchr("ONCP", queryType) == NULL || queryType == '\0')
+    {
+        fprintf(output_stream, ERROR_COLOR "Unknown kind of positional query '%s'.\a\n" RESET, token);
+        return;
+    }
+
+    int from, to;
+    if (queryType == 'P')
+    {
+        from = to = readQueryNumber(output_stream, "Position:");
+    } else
+    {
+        from = readQueryNumber(output_stream, "From position:");
+        to = readQueryNumber(output_stream, "To position:");
+    }
+    if (from <= 0 || to < from)
+    {
+        fprintf(output_stream, ERROR_COLOR "Positions must be positive, and a range can't end before it starts.\a\n" RESET);
+        return;
+    }
+    int pageSize = readQueryNumber(output_stream, "Results per page:");
+    if (pageSize <= 0) pageSize = 10;
+
+    IntervalMatches matches = { NULL, 0, 0 };
+    switch (queryType)
+    {
+        case 'O': findOverlappingOrfs(tree, from, to, &matches); break;
+        case 'N': findNestedOrfs(tree, from, to, &matches); break;
+        case 'C': findContainingOrfs(tree, from, to, &matches); break;
+        default: findNearestOrfs(tree, from, &matches); break;
+    }
+    if (numOfCompressedRecords > 0)
+    {
+        fprintf(output_stream, DIM "%d ORF(s) in compressed shards are not searched by position.\n" RESET, numOfCompressedRecords);
+    }
+    if (matches.size == 0)
+    {
+        fprintf(output_stream, "\nNo ORFs of this sequence match the given position(s)\n");
+        return;
+    }
+
+    OrfStoreIterator* results = (OrfStoreIterator*) malloc(sizeof(OrfStoreIterator) * matches.size);
+    if (results == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the query results.\n%s\a\n" RESET, strerror(errno));
+        free(matches.indexes);
+        return;
+    }
+    qsort(matches.indexes, matches.size, sizeof(int), compareInts); // Intervals are sorted by their first base
+    for (int i = 0; i < matches.size; i++)
+    {
+        OrfInterval* interval = &tree->intervals[matches.indexes[i]];
+        results[i] = index->locations[interval->recordIndex];
+        if (queryType == 'P' && interval->high < from)
+        {
+            fprintf(output_stream, DIM "Nearest ORF before position %d: bases %d-%d, %d base(s) away\n" RESET, from, interval->low, interval->high, from - interval->high);
+        } else if (queryType == 'P' && interval->low > from)
+        {
+            fprintf(output_stream, DIM "Nearest ORF after position %d: bases %d-%d, %d base(s) away\n" RESET, from, interval->low, interval->high, interval->low - from);
+        }
+    }
+    browseQueryResults(output_stream, NULL, 0, results, matches.size, pageSize);
+    free(results);
+    free(matches.indexes);
+}
+
+
+
+
+
+
+
+
+
+
+// ****************************************************  Codon site index functions  ***************************************************
+
+// For every analyzed sequence, where its START and STOP codons are: one bitvector per strand, frame and codon type,
+// with bit i set if the codon in slot i of that frame is one (slot i of frame f starts at base f + 3i, 0-based).
+// That's 2 strands x 3 frames x 2 types x 1/3 bit = 4 bits per base. With a rank directory, counting sites in a
+// window or finding the next one in frame takes a few popcounts instead of a rescan. The indexes are appended to
+// a file next to the archive (ARCHIVE_FILE.txt.sites) and only read back when queried
+#define CODON_SITES_SUFFIX ".sites"
+#define CODON_SITES_MAGIC "ORFS"
+#define CODON_SITES_VERSION 1
+#define CODON_SITES_HEADER_BYTES 5
+#define CODON_SITES_RECORD_HEADER_BYTES 12  // Sequence hash (8), sequence length (4)
+#define RANK_SUPERBLOCK_WORDS 8             // 512 bits
+#define SELECT_SAMPLE_RATE 512              // Superblock of every 512th set bit is kept, so select() starts next to it
+
+typedef struct
+{
+    uint64_t* words;
+    uint32_t* superblockRanks;      // Set bits before each superblock, one more entry for the end
+    uint32_t* selectSamples;        // Superblock holding set bit number k*SELECT_SAMPLE_RATE
+    int numOfBits, numOfOnes;
+} RankSelectBitvector;
+
+typedef struct
+{
+    uint64_t sequenceHash;
+    int sequenceLength;
+    RankSelectBitvector sites[2][CODONS_LENGTH][2]; // [strand][frame][START or STOP]
+} CodonSiteIndex;
+
+// Sequences whose index is in the file, and where
+typedef struct
+{
+    uint64_t sequenceHash;
+    int sequenceLength;
+    long offset;
+} CodonSiteEntry;
+
+typedef struct
+{
+    char* path;
+    CodonSiteEntry* entries;
+    int numOfEntries, capacity;
+} CodonSiteCatalog;
+
+int getNumOfSlots(int sequenceLength, int frame)
+{
+    return (sequenceLength > frame) ? (sequenceLength - frame) / CODONS_LENGTH : 0;
+}
+
+int getNumOfWords(int numOfBits)
+{
+    return (numOfBits + 63) / 64;
+}
+
+long getCodonSiteRecordSize(int sequenceLength)
+{
+    long numOfWords = 0;
+    for (int frame = 0; frame < CODONS_LENGTH; frame++)
+    {
+        numOfWords += getNumOfWords(getNumOfSlots(sequenceLength, frame));
+    }
+    return CODON_SITES_RECORD_HEADER_BYTES + numOfWords * 2 * 2 * sizeof(uint64_t);
+}
+
+void freeBitvector(RankSelectBitvector* bitvector)
+{
+    free(bitvector->words);
+    free(bitvector->superblockRanks);
+    free(bitvector->selectSamples);
+}
+
+void freeCodonSiteIndex(CodonSiteIndex* index)
+{
+    if (index == NULL) return;
+    for (int strand = 0; strand < 2; strand++)
+        for (int frame = 0; frame < CODONS_LENGTH; frame++)
+            for (int type = 0; type < 2; type++)
+                freeBitvector(&index->sites[strand][frame][type]);
+    free(index);
+}
+
+// Rank directory and select samples over the already filled words
+bool buildRankSelect(RankSelectBitvector* bitvector)
+{
+    int numOfWords = getNumOfWords(bitvector->numOfBits);
+    int numOfSuperblocks = (numOfWords + RANK_SUPERBLOCK_WORDS - 1) / RANK_SUPERBLOCK_WORDS;
+    bitvector->superblockRanks = (uint32_t*) malloc(sizeof(uint32_t) * (numOfSuperblocks + 1));
+    if (bitvector->superblockRanks == NULL) return FALSE;
+
+    uint32_t ones = 0;
+    for (int i = 0; i < numOfWords; i++)
+    {
+        if (i % RANK_SUPERBLOCK_WORDS == 0) bitvector->superblockRanks[i / RANK_SUPERBLOCK_WORDS] = ones;
+        ones += __builtin_popcountll(bitvector->words[i]);
+    }
+    bitvector->superblockRanks[numOfSuperblocks] = ones;
+    bitvector->numOfOnes = ones;
+
+    bitvector->selectSamples = (uint32_t*) malloc(sizeof(uint32_t) * (ones / SELECT_SAMPLE_RATE + 1));
+    if (bitvector->selectSamples == NULL) return FALSE;
+    int superblock = 0;
+    for (uint32_t k = 0; k < ones; k += SELECT_SAMPLE_RATE)
+    {
+        while (bitvector->superblockRanks[superblock + 1] <= k) superblock++;
+        bitvector->selectSamples[k / SELECT_SAMPLE_RATE] = superblock;
+    }
+    return TRUE;
+}
+
+// Set bits before bit 'i'
+int rankBitvector(RankSelectBitvector* bitvector, int i)
+{
+    if (i <= 0) return 0;
+    if (i >= bitvector->numOfBits) return bitvector->numOfOnes;
+
+    int word = i / 64;
+    int rank = bitvector->superblockRanks[word / RANK_SUPERBLOCK_WORDS];
+    for (int w = word - word % RANK_SUPERBLOCK_WORDS; w < word; w++)
+    {
+        rank += __builtin_popcountll(bitvector->words[w]);
+    }
+    if (i % 64) rank += __builtin_popcountll(bitvector->words[word] & ((UINT64_C(1) << (i % 64)) - 1));
+    return rank;
+}
+
+// Position of set bit number 'k' (0-based), -1 if there are not that many
+int selectBitvector(RankSelectBitvector* bitvector, int k)
+{
+    if (k < 0 || k >= bitvector->numOfOnes) return -1;
+
+    int superblock = bitvector->selectSamples[k / SELECT_SAMPLE_RATE];
+    while ((int) bitvector->superblockRanks[superblock + 1] <= k) superblock++;
+
+    int remaining = k - bitvector->superblockRanks[superblock];
+    for (int w = superblock * RANK_SUPERBLOCK_WORDS; ; w++)
+    {
+        int ones = __builtin_popcountll(bitvector->words[w]);
+        if (remaining < ones)
+        {
+            uint64_t word = bitvector->words[w];
+            while (remaining-- > 0) word &= word - 1; // Drop the lower set bits
+            return w * 64 + __builtin_ctzll(word);
+        }
+        remaining -= ones;
+    }
+}
+
+CodonSiteIndex* allocateCodonSiteIndex(uint64_t sequenceHash, int sequenceLength)
+{
+    CodonSiteIndex* index = (CodonSiteIndex*) calloc(1, sizeof(CodonSiteIndex));
+    if (index == NULL) return NULL;
+
+    index->sequenceHash = sequenceHash;
+    index->sequenceLength = sequenceLength;
+    for (int strand = 0; strand < 2; strand++)
+        for (int frame = 0; frame < CODONS_LENGTH; frame++)
+            for (int type = 0; type < 2; type++)
+            {
+                RankSelectBitvector* bitvector = &index->sites[strand][frame][type];
+                bitvector->numOfBits = getNumOfSlots(sequenceLength, frame);
+                bitvector->words = (uint64_t*) calloc(getNumOfWords(bitvector->numOfBits) + 1, sizeof(uint64_t));
+                if (bitvector->words == NULL)
+                {
+                    freeCodonSiteIndex(index);
+                    return NULL;
+                }
+            }
+    return index;
+}
+
+bool finishCodonSiteIndex(CodonSiteIndex* index)
+{
+    for (int strand = 0; strand < 2; strand++)
+        for (int frame = 0; frame < CODONS_LENGTH; frame++)
+            for (int type = 0; type < 2; type++)
+                if (!buildRankSelect(&index->sites[strand][frame][type])) return FALSE;
+    return TRUE;
+}
+
+// One pass over the (upper-cased) sequence, all three frames of both strands. Reverse codons are read the way
+// tokenize_seq() reads them: the same three bases, backwards
+CodonSiteIndex* buildCodonSiteIndex(const char* sequence, int sequenceLength, uint64_t sequenceHash, const GeneticCode* geneticCode)
+{
+    CodonSiteIndex* index = allocateCodonSiteIndex(sequenceHash, sequenceLength);
+    if (index == NULL) return NULL;
+
+    for (int base = 0; base + CODONS_LENGTH <= sequenceLength; base++)
+    {
+        int codonIndex = codonToIndex(&sequence[base]);
+        if (codonIndex < 0) continue;
+
+        specialCodonType forwardType = getTypeOfCodonIndex(geneticCode, codonIndex), reverseType = getTypeOfCodonIndex(geneticCode, reverseCodonIndex(codonIndex));
+        int frame = base % CODONS_LENGTH, slot = base / CODONS_LENGTH;
+        uint64_t bit = UINT64_C(1) << (slot % 64);
+        if (forwardType != PLAIN) index->sites[FORWARD][frame][forwardType].words[slot / 64] |= bit;
+        if (reverseType != PLAIN) index->sites[REVERSE][frame][reverseType].words[slot / 64] |= bit;
+    }
+
+    if (!finishCodonSiteIndex(index))
+    {
+        freeCodonSiteIndex(index);
+        return NULL;
+    }
+    return index;
+}
+
+// Codons are reported at their first base on the forward strand and at their last one on the reverse (1-based)
+int getSitePositionOffset(direction strand)
+{
+    return (strand == FORWARD) ? 1 : CODONS_LENGTH;
+}
+
+// START (or STOP) codons at positions from..to, in one frame or, with ANY_VALUE, in all three
+int countCodonSites(CodonSiteIndex* index, direction strand, int frame, specialCodonType type, int from, int to)
+{
+    int first = from - getSitePositionOffset(strand), last = to - getSitePositionOffset(strand); // 0-based bases
+    int count = 0;
+    for (int f = 0; f < CODONS_LENGTH; f++)
+    {
+        if (frame != ANY_VALUE && f != frame) continue;
+        if (last < f) continue;
+
+        int firstSlot = (first > f) ? (first - f + CODONS_LENGTH - 1) / CODONS_LENGTH : 0;
+        int lastSlot = (last - f) / CODONS_LENGTH;
+        RankSelectBitvector* bitvector = &index->sites[strand][f][type];
+        if (firstSlot <= lastSlot) count += rankBitvector(bitvector, lastSlot + 1) - rankBitvector(bitvector, firstSlot);
+    }
+    return count;
+}
+
+// Position of the next START (or STOP) codon in the frame of 'position', going the strand's reading direction
+// (downwards on the reverse strand); -1 if there is none
+int findNextCodonSite(CodonSiteIndex* index, direction strand, specialCodonType type, int position)
+{
+    int base = position - getSitePositionOffset(strand);
+    if (base < 0 || base >= index->sequenceLength) return -1;
+
+    int frame = base % CODONS_LENGTH, slot = base / CODONS_LENGTH;
+    RankSelectBitvector* bitvector = &index->sites[strand][frame][type];
+    int next = (strand == FORWARD) ? selectBitvector(bitvector, rankBitvector(bitvector, slot + 1))
+                                   : selectBitvector(bitvector, rankBitvector(bitvector, slot) - 1);
+    return (next < 0) ? -1 : frame + next * CODONS_LENGTH + getSitePositionOffset(strand);
+}
+
+void addCodonSiteEntry(CodonSiteCatalog* catalog, uint64_t sequenceHash, int sequenceLength, long offset)
+{
+    if (catalog->numOfEntries == catalog->capacity)
+    {
+        catalog->capacity = catalog->capacity ? catalog->capacity * 2 : 16;
+        catalog->entries = (CodonSiteEntry*) realloc(catalog->entries, sizeof(CodonSiteEntry) * catalog->capacity);
+    }
+    CodonSiteEntry* entry = &catalog->entries[catalog->numOfEntries++];
+    entry->sequenceHash = sequenceHash;
+    entry->sequenceLength = sequenceLength;
+    entry->offset = offset;
+}
+
+void freeCodonSiteCatalog(CodonSiteCatalog* catalog)
+{
+    if (catalog == NULL) return;
+    free(catalog->path);
+    free(catalog->entries);
+    free(catalog);
+}
+
+// Lists the indexes in the file without reading them: each record's size follows from its sequence length.
+// A record cut short by a crash is dropped from the file, so that the next one is appended where it belongs
+CodonSiteCatalog* openCodonSiteCatalog(FILE* output_stream, const char* sitesPath)
+{
+    CodonSiteCatalog* catalog = (CodonSiteCatalog*) calloc(1, sizeof(CodonSiteCatalog));
+    if (catalog == NULL || (catalog->path = strdup(sitesPath)) == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the codon site indexes.\n%s\a\n" RESET, strerror(errno));
+        free(catalog);
+        return NULL;
+    }
+
+    FILE* sitesFile = fopen(sitesPath, "rb");
+    if (sitesFile == NULL) return catalog; // No index yet
+
+    unsigned char header[CODON_SITES_RECORD_HEADER_BYTES];
+    long fileSize = getFileSize(sitesPath), offset = CODON_SITES_HEADER_BYTES;
+    if (fread(header, 1, CODON_SITES_HEADER_BYTES, sitesFile) != CODON_SITES_HEADER_BYTES
+        || memcmp(header, CODON_SITES_MAGIC, 4) != 0 || header[4] != CODON_SITES_VERSION)
+    {
+        fprintf(output_stream, ERROR_COLOR "Codon site index '%s' is not readable, it is ignored.\a\n" RESET, sitesPath);
+        fclose(sitesFile);
+        return catalog;
+    }
+    while (fseek(sitesFile, offset, SEEK_SET) == 0 && fread(header, 1, CODON_SITES_RECORD_HEADER_BYTES, sitesFile) == CODON_SITES_RECORD_HEADER_BYTES)
+    {
+        int sequenceLength = (int) getFixed(header + 8, 4);
+        long recordSize = getCodonSiteRecordSize(sequenceLength);
+        if (offset + recordSize > fileSize) break;
+
+        addCodonSiteEntry(catalog, getFixed(header, 8), sequenceLength, offset);
+        offset += recordSize;
+    }
+    fclose(sitesFile);
+
+    if (offset < fileSize && truncate(sitesPath, offset) == 0)
+    {
+        fprintf(output_stream, DIM "Dropped an incomplete codon site index at the end of '%s'\n" RESET, sitesPath);
+    }
+    return catalog;
+}
+
+CodonSiteEntry* findCodonSiteEntry(CodonSiteCatalog* catalog, uint64_t sequenceHash, int sequenceLength)
+{
+    for (int i = 0; i < catalog->numOfEntries; i++)
+    {
+        if (catalog->entries[i].sequenceHash == sequenceHash && catalog->entries[i].sequenceLength == sequenceLength)
+        {
+            return &catalog->entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Appends the index of a newly analyzed sequence to the file (and the catalog)
+bool appendCodonSiteIndex(FILE* output_stream, CodonSiteCatalog* catalog, CodonSiteIndex* index)
+{
+    if (catalog == NULL || index == NULL) return FALSE;
+    if (findCodonSiteEntry(catalog, index->sequenceHash, index->sequenceLength) != NULL) return TRUE;
+
+    ByteBuffer record = { NULL, 0, 0 };
+    putFixed(&record, index->sequenceHash, 8);
+    putFixed(&record, (uint64_t) index->sequenceLength, 4);
+    for (int strand = 0; strand < 2; strand++)
+        for (int frame = 0; frame < CODONS_LENGTH; frame++)
+            for (int type = 0; type < 2; type++)
+            {
+                RankSelectBitvector* bitvector = &index->sites[strand][frame][type];
+                for (int w = 0; w < getNumOfWords(bitvector->numOfBits); w++) putFixed(&record, bitvector->words[w], 8);
+            }
+
+    FILE* sitesFile = fopen(catalog->path, "ab");
+    bool isWritten = sitesFile != NULL;
+    long offset = isWritten ? ftell(sitesFile) : 0;
+    if (isWritten && offset == 0) // New file
+    {
+        isWritten = fwrite(CODON_SITES_MAGIC, 1, 4, sitesFile) == 4 && fputc(CODON_SITES_VERSION, sitesFile) != EOF;
+        offset = CODON_SITES_HEADER_BYTES;
+    }
+    isWritten = isWritten && fwrite(record.data, 1, record.size, sitesFile) == record.size;
+    if (sitesFile != NULL) isWritten = (fclose(sitesFile) == 0) && isWritten;
+    free(record.data);
+
+    if (!isWritten)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't save the codon site index to '%s'.\n%s\a\n" RESET, catalog->path, strerror(errno));
+        return FALSE;
+    }
+    addCodonSiteEntry(catalog, index->sequenceHash, index->sequenceLength, offset);
+    return TRUE;
+}
+
+CodonSiteIndex* loadCodonSiteIndex(FILE* output_stream, CodonSiteCatalog* catalog, CodonSiteEntry* entry)
+{
+    long recordSize = getCodonSiteRecordSize(entry->sequenceLength);
+    unsigned char* record = (unsigned char*) malloc(recordSize);
+    FILE* sitesFile = fopen(catalog->path, "rb");
+    bool isRead = record != NULL && sitesFile != NULL && fseek(sitesFile, entry->offset, SEEK_SET) == 0
+                  && fread(record, 1, recordSize, sitesFile) == (size_t) recordSize;
+    if (sitesFile != NULL) fclose(sitesFile);
+
+    CodonSiteIndex* index = isRead ? allocateCodonSiteIndex(entry->sequenceHash, entry->sequenceLength) : NULL;
+    if (index != NULL)
+    {
+        const unsigned char* current = record + CODON_SITES_RECORD_HEADER_BYTES;
+        for (int strand = 0; strand < 2; strand++)
+            for (int frame = 0; frame < CODONS_LENGTH; frame++)
+                for (int type = 0; type < 2; type++)
+                {
+                    RankSelectBitvector* bitvector = &index->sites[strand][frame][type];
+                    for (int w = 0; w < getNumOfWords(bitvector->numOfBits); w++, current += 8) bitvector->words[w] = getFixed(current, 8);
+                }
+        if (!finishCodonSiteIndex(index))
+        {
+            freeCodonSiteIndex(index);
+            index = NULL;
+        }
+    }
+    free(record);
+
+    if (index == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't read the codon site index of sequence %016" PRIx64 " from '%s'.\n%s\a\n" RESET,
+                entry->sequenceHash, catalog->path, strerror(errno));
+    }
+    return index;
+}
+
+bool readCodonTypeAndStrand(FILE* output_stream, specialCodonType* type, direction* strand)
+{
+    char token[QUERY_INPUT_SIZE];
+    readQueryToken(output_stream, "Codon (START or STOP):", token);
+    toUpperCase(token);
+    if (strcmp(token, "START") != 0 && strcmp(token, "STOP") != 0)
+    {
+        fprintf(output_stream, ERROR_COLOR "Codon must be START or STOP.\a\n" RESET);
+        return FALSE;
+    }
+    *type = (strcmp(token, "START") == 0) ? START : STOP;
+
+    readQueryToken(output_stream, "Direction (F: forward, R: reverse):", token);
+    if (toupper(token[0]) != 'F' && toupper(token[0]) != 'R')
+    {
+        fprintf(output_stream, ERROR_COLOR "Direction must be F or R.\a\n" RESET);
+        return FALSE;
+    }
+    *strand = (toupper(token[0]) == 'F') ? FORWARD : REVERSE;
+    return TRUE;
+}
+
+// Interactive queries over the codon site index of one analyzed sequence
+void queryCodonSites(FILE* output_stream, CodonSiteCatalog* catalog)
+{
+    if (catalog == NULL || catalog->numOfEntries == 0)
+    {
+        fprintf(output_stream, "\nNo codon site indexes yet: they are built when new sequences are analyzed\n");
+        return;
+    }
+    fprintf(output_stream, "\nSequences with a codon site index:\n");
+    for (int i = 0; i < catalog->numOfEntries; i++)
+    {
+        fprintf(output_stream, "%d. %016" PRIx64 " (%d bases)\n", i + 1, catalog->entries[i].sequenceHash, catalog->entries[i].sequenceLength);
+    }
+    int choice = readQueryNumber(output_stream, "Sequence:");
+    if (choice < 1 || choice > catalog->numOfEntries)
+    {
+        fprintf(output_stream, ERROR_COLOR "There is no sequence %d in the list.\a\n" RESET, choice);
+        return;
+    }
+
+    char token[QUERY_INPUT_SIZE];
+    readQueryToken(output_stream, "Query (C: count codons in a range, N: next codon in frame after a position):", token);
+    char queryType = toupper(token[0]);
+    specialCodonType type;
+    direction strand;
+    if ((queryType != 'C' && queryType != 'N') || !readCodonTypeAndStrand(output_stream, &type, &strand))
+    {
+        if (queryType != 'C' && queryType != 'N') fprintf(output_stream, ERROR_COLOR "Unknown kind of query '%s'.\a\n" RESET, token);
+        return;
+    }
+
+    int frame = ANY_VALUE;
+    if (queryType == 'C')
+    {
+        readQueryToken(output_stream, "Frame (0, 1, 2 or - for all):", token);
+        if (token[0] >= '0' && token[0] < '0' + CODONS_LENGTH && token[1] == '\0') frame = token[0] - '0';
+    }
+    int from = readQueryNumber(output_stream, (queryType == 'C') ? "From position:" : "Position:");
+    int to = (queryType == 'C') ? readQueryNumber(output_stream, "To position:") : from;
+    if (from <= 0 || to < from)
+    {
+        fprintf(output_stream, ERROR_COLOR "Positions must be positive, and a range can't end before it starts.\a\n" RESET);
+        return;
+    }
+
+    CodonSiteIndex* index = loadCodonSiteIndex(output_stream, catalog, &catalog->entries[choice - 1]);
+    if (index == NULL) return;
+
+    const char* codonName = (type == START) ? "START" : "STOP";
+    const char* strandName = (strand == FORWARD) ? "forward" : "reverse";
+    if (queryType == 'C')
+    {
+        for (int f = 0; f < CODONS_LENGTH; f++)
+        {
+            if (frame != ANY_VALUE && f != frame) continue;
+            fprintf(output_stream, "%d %s codon(s) at positions %d-%d, %s strand, frame %d\n",
+                    countCodonSites(index, strand, f, type, from, to), codonName, from, to, strandName, f);
+        }
+        if (frame == ANY_VALUE)
+        {
+            fprintf(output_stream, BOLD "%d %s codon(s) in all frames\n" RESET, countCodonSites(index, strand, ANY_VALUE, type, from, to), codonName);
+        }
+    } else
+    {
+        int next = findNextCodonSite(index, strand, type, from);
+        int base = from - getSitePositionOffset(strand);
+        if (next > 0)
+        {
+            fprintf(output_stream, "Next in-frame %s codon after position %d (%s strand, frame %d): position %d\n",
+                    codonName, from, strandName, base % CODONS_LENGTH, next);
+        } else
+        {
+            fprintf(output_stream, "No %s codon in frame after position %d on the %s strand\n", codonName, from, strandName);
+        }
+    }
+    fprintf(output_stream, DIM "Codon site index: %.1f bits per base\n" RESET,
+            8.0 * (getCodonSiteRecordSize(index->sequenceLength) - CODON_SITES_RECORD_HEADER_BYTES) / index->sequenceLength);
+    freeCodonSiteIndex(index);
+}
+
+
+
+
+// ****************************************************  Incremental re-analysis functions  ***************************************************
+
+// After a few bases of an analyzed sequence are edited, only the codons around the edits are scanned again.
+// On both strands the scanner reads the same grid of codon slots (slot k = bases 3k..3k+2, 0-based), and every
+// ORF lies between two consecutive STOPs of its strand. So a slot whose bases were untouched, and moved by a
+// multiple of CODONS_LENGTH, is "clean": it reads the same codon as before. Around every run of dirty slots, the
+// window up to the flanking STOPs is scanned again; ORFs outside the windows are the old ones, moved.
+
+// Replaces 'deleteLength' bases from 'position' (1-based) with 'insertBases'; an insertion goes before 'position'
+typedef struct
+{
+    int position;
+    int deleteLength;
+    char* insertBases;
+    int insertLength;
+} SequenceEdit;
+
+// Slots newFirst..newLast of the edited sequence read the same codons as slots newFirst-slotShift.. before
+typedef struct
+{
+    int newFirst, newLast;
+    int slotShift;
+} CleanSlotRun;
+
+typedef struct
+{
+    int numOfSlots;                 // Per strand
+    int numOfRescannedSlots;        // Both strands
+    int numOfKeptOrfs, numOfRescannedOrfs;
+} ReanalysisStats;
+
+int compareSequenceEdits(const void* edit1, const void* edit2)
+{
+    const SequenceEdit* e1 = (const SequenceEdit*) edit1;
+    const SequenceEdit* e2 = (const SequenceEdit*) edit2;
+    if (e1->position != e2->position) return e1->position - e2->position;
+    return e1->deleteLength - e2->deleteLength; // An insertion before a base comes before a change of that base
+}
+
+// Sorts the edits and checks that they lie within a sequence of 'sequenceLength' bases without overlapping (their
+// REF bases were matched as they were read); the edited sequence's length must still be a multiple of
+// CODONS_LENGTH. Inserted bases are normalized (see normalizeSequence())
+bool validateSequenceEdits(FILE* output_stream, int sequenceLength, SequenceEdit* edits, int numOfEdits)
+{
+    qsort(edits, numOfEdits, sizeof(SequenceEdit), compareSequenceEdits);
+
+    int newLength = sequenceLength;
+    for (int i = 0; i < numOfEdits; i++)
+    {
+        SequenceEdit* edit = &edits[i];
+        if (edit->position < 1 || edit->deleteLength < 0 || edit->position + edit->deleteLength > sequenceLength + 1)
+        {
+            fprintf(output_stream, ERROR_COLOR "Edit at position %d is outside the sequence (1-%d).\a\n" RESET, edit->position, sequenceLength);
+            return FALSE;
+        }
+        if (i > 0 && edit->position < edits[i-1].position + edits[i-1].deleteLength)
+        {
+            fprintf(output_stream, ERROR_COLOR "Edits at positions %d and %d overlap.\a\n" RESET, edits[i-1].position, edit->position);
+            return FALSE;
+        }
+        NormalizationStats normalization;
+        if (!normalizeSequence(edit->insertBases, edit->insertLength, NULL, NULL, &normalization))
+        {
+            fprintf(output_stream, ERROR_COLOR "Edit at position %d inserts invalid character(s).\a\n" RESET, edit->position);
+            return FALSE;
+        }
+        newLength += edit->insertLength - edit->deleteLength;
+    }
+    if (newLength <= 0 || newLength % CODONS_LENGTH != 0)
+    {
+        fprintf(output_stream, ERROR_COLOR "The edited sequence would be %d bases long, which is not a multiple of %d.\a\n" RESET, newLength, CODONS_LENGTH);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// The edited sequence (malloc'ed), for validated edits
+char* applySequenceEdits(const char* sequence, int sequenceLength, SequenceEdit* edits, int numOfEdits, int* newLength)
+{
+    int length = sequenceLength;
+    for (int i = 0; i < numOfEdits; i++)
+    {
+        length += edits[i].insertLength - edits[i].deleteLength;
+    }
+    char* edited = (char*) malloc(length + 1);
+    if (edited == NULL) return NULL;
+
+    int oldBase = 0, newBase = 0;
+    for (int i = 0; i < numOfEdits; i++)
+    {
+        int untouched = edits[i].position - 1 - oldBase;
+        memcpy(edited + newBase, sequence + oldBase, untouched);
+        newBase += untouched;
+        for (int j = 0; j < edits[i].insertLength; j++)
+        {
+            edited[newBase++] = edits[i].insertBases[j]; // Normalized when the edits were checked
+        }
+        oldBase = edits[i].position - 1 + edits[i].deleteLength;
+    }
+    memcpy(edited + newBase, sequence + oldBase, sequenceLength - oldBase);
+    edited[length] = '\0';
+    *newLength = length;
+    return edited;
+}
+
+// Clean slots of the edited sequence, in order; the slots in between are dirty
+int buildCleanSlotRuns(int sequenceLength, SequenceEdit* edits, int numOfEdits, CleanSlotRun* runs)
+{
+    int numOfRuns = 0, oldBase = 0, shift = 0; // Untouched bases from 'oldBase' on are at oldBase + shift now
+    for (int i = 0; i <= numOfEdits; i++)
+    {
+        int oldEnd = (i < numOfEdits) ? edits[i].position - 1 : sequenceLength;
+        if (shift % CODONS_LENGTH == 0) // Otherwise these bases are read in another frame now
+        {
+            int first = (oldBase + shift + CODONS_LENGTH - 1) / CODONS_LENGTH;
+            int last = (oldEnd + shift) / CODONS_LENGTH - 1;
+            if (first <= last)
+            {
+                runs[numOfRuns].newFirst = first;
+                runs[numOfRuns].newLast = last;
+                runs[numOfRuns++].slotShift = shift / CODONS_LENGTH;
+            }
+        }
+        if (i < numOfEdits)
+        {
+            shift += edits[i].insertLength - edits[i].deleteLength;
+            oldBase = oldEnd + edits[i].deleteLength;
+        }
+    }
+    return numOfRuns;
+}
+
+specialCodonType getSlotType(const GeneticCode* geneticCode, const char* sequence, int slot, direction strand)
+{
+    int codonIndex = codonToIndex(&sequence[slot * CODONS_LENGTH]);
+    if (codonIndex < 0) return PLAIN;
+    return getTypeOfCodonIndex(geneticCode, (strand == FORWARD) ? codonIndex : reverseCodonIndex(codonIndex));
+}
+
+// The ORF from 'firstSlot' (its first START) to 'stopSlot', laid out as find_all_sequences() lays it out
+Sequence* createOrfFromSlots(const GeneticCode* geneticCode, const char* sequence, direction strand, int firstSlot, int stopSlot, int lastStartSlot)
+{
+    int step = (strand == FORWARD) ? 1 : -1;
+    int numOfCodons = (stopSlot - firstSlot) * step + 1;
+    Sequence* orf = createSequence(numOfCodons * CODONS_LENGTH, strand, getSlotPosition(lastStartSlot, strand), TRUE, numOfCodons);
+    if (orf == NULL) return NULL;
+
+    for (int i = 0; i < numOfCodons; i++)
+    {
+        int slot = firstSlot + i * step;
+        const char* bases = &sequence[slot * CODONS_LENGTH];
+        char* codon = orf->specialCodons[i].codonSequence;
+        for (int j = 0; j < CODONS_LENGTH; j++)
+        {
+            codon[j] = (strand == FORWARD) ? bases[j] : bases[CODONS_LENGTH - 1 - j];
+        }
+        codon[CODONS_LENGTH] = '\0';
+        orf->specialCodons[i].type = getSlotType(geneticCode, sequence, slot, strand);
+        orf->specialCodons[i].positionInSequence = getSlotPosition(slot, strand);
+    }
+    return orf;
+}
+
+// Slots an ORF covers, lowest first
+void getOrfSlots(Sequence* orf, int* lowSlot, int* highSlot)
+{
+    int numOfCodons = orf->length / CODONS_LENGTH;
+    int first = getSlotOfPosition(orf->specialCodons[0].positionInSequence, orf->seqDirection);
+    int last = getSlotOfPosition(orf->specialCodons[numOfCodons - 1].positionInSequence, orf->seqDirection);
+    *lowSlot = (first < last) ? first : last;
+    *highSlot = (first < last) ? last : first;
+}
+
+// An ORF with a key that gives the order find_all_sequences() returns ORFs in
+typedef struct
+{
+    Sequence* orf;
+    int64_t key;
+} OrderedOrf;
+
+int compareOrderedOrfs(const void* orf1, const void* orf2)
+{
+    int64_t k1 = ((const OrderedOrf*) orf1)->key, k2 = ((const OrderedOrf*) orf2)->key;
+    return (k1 > k2) - (k1 < k2);
+}
+
+void addOrderedOrf(OrderedOrf** orfs, int* numOfOrfs, int* capacity, Sequence* orf)
+{
+    if (*numOfOrfs == *capacity)
+    {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *orfs = (OrderedOrf*) realloc(*orfs, sizeof(OrderedOrf) * *capacity);
+    }
+    int lowSlot, highSlot;
+    getOrfSlots(orf, &lowSlot, &highSlot);
+    // Forward ORFs first, by their STOP going up, then reverse ones by their STOP going down
+    (*orfs)[*numOfOrfs].key = (orf->seqDirection == FORWARD) ? highSlot : (INT64_C(1) << 32) - lowSlot;
+    (*orfs)[(*numOfOrfs)++].orf = orf;
+}
+
+// An ORF as slots of the codon grid: its first START, its last START (its position) and its STOP
+typedef struct
+{
+    int firstSlot, lastStartSlot, stopSlot;
+} OrfSlotSpan;
+
+// ORFs in the window lowSlot..highSlot, read in the strand's direction the way find_all_sequences() reads it.
+// The window must start right after a STOP (or at the strand's first slot) for the ORFs to be the scanner's ones
+int scanWindowForOrfs(const GeneticCode* geneticCode, const char* sequence, direction strand, int lowSlot, int highSlot, OrfSlotSpan** spans, int* capacity)
+{
+    int step = (strand == FORWARD) ? 1 : -1;
+    int from = (strand == FORWARD) ? lowSlot : highSlot, to = (strand == FORWARD) ? highSlot : lowSlot;
+    bool foundStartCodon = FALSE;
+    int firstSlot = 0, lastStartSlot = 0, numOfSpans = 0;
+    for (int slot = from; slot != to + step; slot += step)
+    {
+        specialCodonType type = getSlotType(geneticCode, sequence, slot, strand);
+        if (type == START)
+        {
+            if (!foundStartCodon) firstSlot = slot;
+            foundStartCodon = TRUE;
+            lastStartSlot = slot;
+        }
+        if (foundStartCodon && type == STOP)
+        {
+            if (numOfSpans == *capacity)
+            {
+                *capacity = *capacity ? *capacity * 2 : 16;
+                *spans = (OrfSlotSpan*) realloc(*spans, sizeof(OrfSlotSpan) * *capacity);
+            }
+            (*spans)[numOfSpans].firstSlot = firstSlot;
+            (*spans)[numOfSpans].lastStartSlot = lastStartSlot;
+            (*spans)[numOfSpans++].stopSlot = slot;
+            foundStartCodon = FALSE;
+        }
+    }
+    return numOfSpans;
+}
+
+// Scans the window lowSlot..highSlot (both ends at segment boundaries) in the strand's reading direction
+void rescanWindow(const GeneticCode* geneticCode, const char* sequence, direction strand, int lowSlot, int highSlot, OrderedOrf** orfs, int* numOfOrfs, int* capacity)
+{
+    OrfSlotSpan* spans = NULL;
+    int spansCapacity = 0;
+    int numOfSpans = scanWindowForOrfs(geneticCode, sequence, strand, lowSlot, highSlot, &spans, &spansCapacity);
+    for (int i = 0; i < numOfSpans; i++)
+    {
+        addOrderedOrf(orfs, numOfOrfs, capacity, createOrfFromSlots(geneticCode, sequence, strand, spans[i].firstSlot, spans[i].stopSlot, spans[i].lastStartSlot));
+    }
+    free(spans);
+}
+
+// Next STOP of the strand from 'slot' on, going 'step' (+1 or -1); -1 or numOfSlots if there is none
+int findStopSlot(const GeneticCode* geneticCode, const char* sequence, direction strand, int slot, int step, int numOfSlots)
+{
+    while (slot >= 0 && slot < numOfSlots && getSlotType(geneticCode, sequence, slot, strand) != STOP)
+    {
+        slot += step;
+    }
+    return slot;
+}
+
+// Window to rescan between the STOPs flanking some dirty slots ('below' is -1 and 'above' numOfSlots if there is
+// none). A STOP ends the ORF before it in reading direction: the one below on the forward strand, the one above on
+// the reverse. FALSE if the window is empty
+bool getRescanWindow(direction strand, int below, int above, int numOfSlots, int* low, int* high)
+{
+    *low = (strand == FORWARD) ? below + 1 : (below < 0 ? 0 : below);
+    *high = (strand == FORWARD) ? (above >= numOfSlots ? numOfSlots - 1 : above) : above - 1;
+    return *low <= *high;
+}
+
+// ORFs of the edited sequence, in the same order as find_all_sequences() would give them, from the ORFs of the
+// original ('oldOrfs', left untouched) and validated edits. Costs O(edits + flanking STOPs) codon reads, plus
+// moving the old ORFs that are kept
+DoublyLinkedList* reanalyzeEditedSequence(const GeneticCode* geneticCode, DoublyLinkedList* oldOrfs, int oldLength, const char* editedSequence, int editedLength,
+                                          SequenceEdit* edits, int numOfEdits, ReanalysisStats* stats)
+{
+    int numOfSlots = editedLength / CODONS_LENGTH;
+    CleanSlotRun* runs = (CleanSlotRun*) malloc(sizeof(CleanSlotRun) * (numOfEdits + 1));
+    int* windows = (int*) malloc(sizeof(int) * 2 * (numOfEdits + 2) * 2); // [strand][window][low, high]
+    if (runs == NULL || windows == NULL)
+    {
+        free(runs);
+        free(windows);
+        return NULL;
+    }
+    int numOfRuns = buildCleanSlotRuns(oldLength, edits, numOfEdits, runs);
+    int numOfWindows[2] = { 0, 0 };
+    int* strandWindows[2] = { windows, windows + 2 * (numOfEdits + 2) };
+
+    OrderedOrf* orfs = NULL;
+    int numOfOrfs = 0, capacity = 0;
+    memset(stats, 0, sizeof(ReanalysisStats));
+    stats->numOfSlots = numOfSlots;
+
+    // Dirty slots are the gaps between clean runs; each one grows to the flanking STOPs, then overlapping windows merge
+    for (int strand = FORWARD; strand <= REVERSE; strand++)
+    {
+        int* strandWindow = strandWindows[strand];
+        for (int gap = 0; gap <= numOfRuns; gap++)
+        {
+            int dirtyFirst = (gap == 0) ? 0 : runs[gap-1].newLast + 1;
+            int dirtyLast = (gap == numOfRuns) ? numOfSlots - 1 : runs[gap].newFirst - 1;
+            // Deleting whole codons leaves no dirty slot, but two codons that were apart are neighbours now
+            bool isEditedEdge = numOfEdits > 0 && ((gap == 0 && edits[0].position == 1) ||
+                                (gap == numOfRuns && edits[numOfEdits-1].position - 1 + edits[numOfEdits-1].deleteLength == oldLength));
+            if (dirtyFirst > dirtyLast && (gap == 0 || gap == numOfRuns) && !isEditedEdge) continue;
+
+            int below = findStopSlot(geneticCode, editedSequence, strand, dirtyFirst - 1, -1, numOfSlots);
+            int above = findStopSlot(geneticCode, editedSequence, strand, dirtyLast + 1, +1, numOfSlots);
+            int low, high;
+            if (!getRescanWindow(strand, below, above, numOfSlots, &low, &high)) continue;
+            if (numOfWindows[strand] > 0 && low <= strandWindow[2 * numOfWindows[strand] - 1] + 1)
+            {
+                if (high > strandWindow[2 * numOfWindows[strand] - 1]) strandWindow[2 * numOfWindows[strand] - 1] = high;
+            } else
+            {
+                strandWindow[2 * numOfWindows[strand]] = low;
+                strandWindow[2 * numOfWindows[strand]++ + 1] = high;
+            }
+        }
+        for (int w = 0; w < numOfWindows[strand]; w++)
+        {
+            rescanWindow(geneticCode, editedSequence, strand, strandWindow[2*w], strandWindow[2*w + 1], &orfs, &numOfOrfs, &capacity);
+            stats->numOfRescannedSlots += strandWindow[2*w + 1] - strandWindow[2*w] + 1;
+        }
+    }
+    stats->numOfRescannedOrfs = numOfOrfs;
+
+    // Old ORFs lying in one clean run, away from every rescanned window, are still there, only moved
+    for (ListNode* current = oldOrfs->head; current != NULL; current = current->next)
+    {
+        Sequence* orf = current->data;
+        if (orf->length < CODONS_LENGTH) continue;
+
+        int lowSlot, highSlot;
+        getOrfSlots(orf, &lowSlot, &highSlot);
+        int run = 0;
+        while (run < numOfRuns && lowSlot > runs[run].newLast - runs[run].slotShift) run++; // Few runs: as many as edits
+        if (run == numOfRuns || lowSlot < runs[run].newFirst - runs[run].slotShift || highSlot > runs[run].newLast - runs[run].slotShift) continue;
+
+        int shift = runs[run].slotShift;
+        bool isRescanned = FALSE;
+        int* strandWindow = strandWindows[orf->seqDirection];
+        for (int w = 0; w < numOfWindows[orf->seqDirection] && !isRescanned; w++)
+        {
+            isRescanned = lowSlot + shift <= strandWindow[2*w + 1] && highSlot + shift >= strandWindow[2*w];
+        }
+        if (isRescanned) continue;
+
+        Sequence* moved = copySequence(orf);
+        moved->positionInSupersequence += shift * CODONS_LENGTH;
+        for (int i = 0; i < moved->length / CODONS_LENGTH; i++)
+        {
+            moved->specialCodons[i].positionInSequence += shift * CODONS_LENGTH;
+        }
+        addOrderedOrf(&orfs, &numOfOrfs, &capacity, moved);
+        stats->numOfKeptOrfs++;
+    }
+
+    if (numOfOrfs > 0) qsort(orfs, numOfOrfs, sizeof(OrderedOrf), compareOrderedOrfs);
+    DoublyLinkedList* editedOrfs = createList();
+    for (int i = 0; i < numOfOrfs; i++)
+    {
+        appendToList(editedOrfs, orfs[i].orf);
+    }
+    free(orfs);
+    free(runs);
+    free(windows);
+    return editedOrfs;
+}
+
+// Next non-empty line of input (malloc'ed, without the newline); NULL at the end of input
+char* readInputLine(FILE* output_stream, const char* prompt, int* length)
+{
+    char* line = NULL;
+    size_t capacity = 0;
+    ssize_t numOfRead;
+    fprintf(output_stream, "%s\t", prompt);
+    while ((numOfRead = getline(&line, &capacity, input_stream)) != -1)
+    {
+        while (numOfRead > 0 && (line[numOfRead - 1] == '\n' || line[numOfRead - 1] == '\r'))
+        {
+            line[--numOfRead] = '\0';
+        }
+        if (numOfRead > 0) // Skips the newline scanf() leaves behind
+        {
+            *length = (int) numOfRead;
+            return line;
+        }
+    }
+    free(line);
+    return NULL;
+}
+
+void freeSequenceEdits(SequenceEdit* edits, int numOfEdits)
+{
+    for (int i = 0; i < numOfEdits; i++)
+    {
+        free(edits[i].insertBases);
+    }
+    free(edits);
+}
+
+// Edits as lines "POS REF ALT" (VCF-like, '-' for no bases) until q; REF must be what 'sequence' has at POS
+SequenceEdit* readSequenceEdits(FILE* output_stream, const char* sequence, int sequenceLength, int* numOfEdits)
+{
+    SequenceEdit* edits = NULL;
+    int capacity = 0;
+    *numOfEdits = 0;
+    fprintf(output_stream, "Enter one edit per line as: POS REF ALT (1-based POS, - for no bases, e.g. \"12 A G\", \"30 - AUG\", \"7 CCA -\").\nEnter q when done.\n");
+    int length;
+    char* line;
+    while ((line = readInputLine(output_stream, "Edit:", &length)) != NULL)
+    {
+        char *refBases = NULL, *altBases = NULL;
+        int position = 0;
+        if (strcmp(line, "q") == 0 || strcmp(line, "Q") == 0)
+        {
+            free(line);
+            return edits;
+        }
+        refBases = (char*) malloc(length + 1);
+        altBases = (char*) malloc(length + 1);
+        if (refBases == NULL || altBases == NULL || sscanf(line, "%d %s %s", &position, refBases, altBases) != 3)
+        {
+            fprintf(output_stream, ERROR_COLOR "Couldn't read the edit. Expected: POS REF ALT\a\n" RESET);
+        } else
+        {
+            int refLength = strcmp(refBases, "-") == 0 ? 0 : (int) strlen(refBases);
+            int altLength = strcmp(altBases, "-") == 0 ? 0 : (int) strlen(altBases);
+            toUpperCase(refBases);
+            if (position < 1 || position + refLength > sequenceLength + 1 || strncmp(&sequence[position - 1], refBases, refLength) != 0)
+            {
+                fprintf(output_stream, ERROR_COLOR "REF %s doesn't match the sequence at position %d.\a\n" RESET, refBases, position);
+            } else
+            {
+                if (*numOfEdits == capacity)
+                {
+                    capacity = capacity ? capacity * 2 : 8;
+                    edits = (SequenceEdit*) realloc(edits, sizeof(SequenceEdit) * capacity);
+                }
+                altBases[altLength] = '\0';
+                edits[*numOfEdits].position = position;
+                edits[*numOfEdits].deleteLength = refLength;
+                edits[*numOfEdits].insertBases = altBases;
+                edits[(*numOfEdits)++].insertLength = altLength;
+                altBases = NULL;
+            }
+        }
+        free(refBases);
+        free(altBases);
+        free(line);
+    }
+    return edits;
+}
+
+// Reads an analyzed sequence and edits to it, then re-analyzes only around the edits. Returns the ORFs of the
+// edited sequence, which is handed back in 'editedSequence' (malloc'ed); NULL if nothing could be re-analyzed
+DoublyLinkedList* reanalyzeSequenceAfterEdits(FILE* output_stream, AnalysisCache* analysisCache, Arena* analysisArena, const GeneticCode* geneticCode,
+                                              char** editedSequence, int* editedLength)
+{
+    int sequenceLength = 0;
+    char* sequence = readInputLine(output_stream, "Enter the analyzed sequence:", &sequenceLength);
+    if (sequence == NULL) return NULL;
+    NormalizationStats normalization;
+    uint8_t* packedBases = (uint8_t*) malloc(getPackedSize(sequenceLength));
+    if (packedBases == NULL || sequenceLength % CODONS_LENGTH != 0 || !normalizeSequence(sequence, sequenceLength, packedBases, NULL, &normalization))
+    {
+        free(packedBases);
+        fprintf(output_stream, ERROR_COLOR "The sequence must consist of valid characters and be a multiple of %d long.\a\n" RESET, CODONS_LENGTH);
+        free(sequence);
+        return NULL;
+    }
+
+    // Edits are made to the previous result; a sequence that was never analyzed is analyzed in full first
+    uint64_t sequenceHash = hashAnalyzedSequence(sequence, sequenceLength, geneticCode);
+    DoublyLinkedList* oldOrfs = lookupAnalysisCache(analysisCache, sequenceHash, sequenceLength);
+    DoublyLinkedList* analyzedOrfs = NULL;
+    if (oldOrfs == NULL)
+    {
+        fprintf(output_stream, DIM "The sequence hasn't been analyzed before, so it's analyzed in full first.\n" RESET);
+        char* scannedSequence = strdup(sequence);
+        ScanExtras scanExtras = { .packedBases = packedBases, .normalization = &normalization, .geneticCode = geneticCode };
+        analyzedOrfs = find_all_sequences(output_stream, analysisArena, scannedSequence, sequenceLength, &scanExtras);
+        resetArena(analysisArena);
+        free(scannedSequence);
+        oldOrfs = analyzedOrfs;
+    }
+
+    int numOfEdits = 0;
+    SequenceEdit* edits = readSequenceEdits(output_stream, sequence, sequenceLength, &numOfEdits);
+    DoublyLinkedList* editedOrfs = NULL;
+    if (validateSequenceEdits(output_stream, sequenceLength, edits, numOfEdits))
+    {
+        *editedSequence = applySequenceEdits(sequence, sequenceLength, edits, numOfEdits, editedLength);
+        ReanalysisStats stats;
+        if (*editedSequence != NULL)
+        {
+            editedOrfs = reanalyzeEditedSequence(geneticCode, oldOrfs, sequenceLength, *editedSequence, *editedLength, edits, numOfEdits, &stats);
+        }
+        if (editedOrfs == NULL)
+        {
+            fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the re-analysis.\n%s\a\n" RESET, strerror(errno));
+            free(*editedSequence);
+            *editedSequence = NULL;
+        } else
+        {
+            fprintf(output_stream, DIM "%d edit(s): rescanned %d of %d codons on both strands (%.1f%%), kept %d ORF(s), found %d around the edits.\n" RESET,
+                    numOfEdits, stats.numOfRescannedSlots, 2 * stats.numOfSlots,
+                    stats.numOfSlots > 0 ? 100.0 * stats.numOfRescannedSlots / (2 * stats.numOfSlots) : 0.0,
+                    stats.numOfKeptOrfs, stats.numOfRescannedOrfs);
+        }
+    }
+
+    freeSequenceEdits(edits, numOfEdits);
+    if (analyzedOrfs != NULL) freeList(analyzedOrfs);
+    free(packedBases);
+    free(sequence);
+    return editedOrfs;
+}
+
+
+
+// ****************************************************  Variant effect functions  ***************************************************
+
+// Many candidate substitutions (a VCF subset) against one reference: for each, the ORFs it creates, destroys,
+// truncates or extends. A substitution moves nothing, so only the window between the STOPs flanking its codons can
+// change, on each strand. The flanking STOPs come from the reference's codon site index (the substituted codons are
+// in the window anyway), and the window is scanned on the reference and on a per-thread copy with the variant
+// applied. Variants are shared out to threads in batches
+#define VARIANT_BATCH_SIZE 64
+#define MAX_VARIANT_THREADS 16
+
+typedef enum
+{
+    ORF_CREATED,
+    ORF_DESTROYED,
+    ORF_TRUNCATED,
+    ORF_EXTENDED
+} orfEffectType;
+
+const char* ORF_EFFECT_NAMES[] = { "created", "destroyed", "truncated", "extended" };
+
+typedef struct
+{
+    orfEffectType type;
+    direction strand;
+    int oldFirstBase, oldLastBase;  // 0 if there was no ORF
+    int newFirstBase, newLastBase;  // 0 if there is no ORF
+} OrfEffect;
+
+typedef struct
+{
+    int position;                   // 1-based, as in the VCF
+    char* ref;
+    char* alt;                      // Same length as 'ref'
+    const char* skipReason;         // Why it isn't evaluated, NULL if it is to be
+    bool isEvaluated;
+    OrfEffect* effects;
+    int numOfEffects;
+} Variant;
+
+typedef struct
+{
+    const char* reference;
+    int referenceLength;
+    const GeneticCode* geneticCode; // That the reference is read with
+    CodonSiteIndex* sites;
+    Variant* variants;
+    int numOfVariants;
+    int nextVariant;
+    pthread_mutex_t lock;
+} VariantEffectQueue;
+
+// Scratch space of one thread, reused from one variant to the next
+typedef struct
+{
+    char* sequence;                 // The reference, with the current variant applied while it's evaluated
+    OrfSlotSpan* oldSpans;
+    OrfSlotSpan* newSpans;
+    int oldCapacity, newCapacity;
+} VariantScratch;
+
+void addOrfEffect(Variant* variant, orfEffectType type, direction strand, OrfSlotSpan* oldSpan, OrfSlotSpan* newSpan)
+{
+    OrfEffect* effects = (OrfEffect*) realloc(variant->effects, sizeof(OrfEffect) * (variant->numOfEffects + 1));
+    if (effects == NULL) return;
+    variant->effects = effects;
+
+    OrfEffect* effect = &effects[variant->numOfEffects++];
+    memset(effect, 0, sizeof(OrfEffect));
+    effect->type = type;
+    effect->strand = strand;
+    if (oldSpan != NULL)
+    {
+        getBasesCovered(strand, getSlotPosition(oldSpan->firstSlot, strand), getSlotPosition(oldSpan->stopSlot, strand), &effect->oldFirstBase, &effect->oldLastBase);
+    }
+    if (newSpan != NULL)
+    {
+        getBasesCovered(strand, getSlotPosition(newSpan->firstSlot, strand), getSlotPosition(newSpan->stopSlot, strand), &effect->newFirstBase, &effect->newLastBase);
+    }
+}
+
+// ORFs of one window before and after: the ones starting at the same first START are the same ORF, ending
+// earlier (truncated) or later (extended) if its STOP moved
+void compareWindowOrfs(Variant* variant, direction strand, OrfSlotSpan* oldSpans, int numOfOld, OrfSlotSpan* newSpans, int numOfNew)
+{
+    for (int i = 0; i < numOfOld; i++)
+    {
+        int match = 0;
+        while (match < numOfNew && newSpans[match].firstSlot != oldSpans[i].firstSlot) match++;
+        if (match == numOfNew)
+        {
+            addOrfEffect(variant, ORF_DESTROYED, strand, &oldSpans[i], NULL);
+        } else if (newSpans[match].stopSlot != oldSpans[i].stopSlot)
+        {
+            bool isShorter = abs(newSpans[match].stopSlot - newSpans[match].firstSlot) < abs(oldSpans[i].stopSlot - oldSpans[i].firstSlot);
+            addOrfEffect(variant, isShorter ? ORF_TRUNCATED : ORF_EXTENDED, strand, &oldSpans[i], &newSpans[match]);
+        }
+    }
+    for (int i = 0; i < numOfNew; i++)
+    {
+        int match = 0;
+        while (match < numOfOld && oldSpans[match].firstSlot != newSpans[i].firstSlot) match++;
+        if (match == numOfOld) addOrfEffect(variant, ORF_CREATED, strand, NULL, &newSpans[i]);
+    }
+}
+
+void evaluateVariant(VariantEffectQueue* queue, VariantScratch* scratch, Variant* variant)
+{
+    int numOfSlots = queue->referenceLength / CODONS_LENGTH;
+    int length = strlen(variant->ref);
+    int dirtyFirst = (variant->position - 1) / CODONS_LENGTH, dirtyLast = (variant->position - 1 + length - 1) / CODONS_LENGTH;
+
+    memcpy(&scratch->sequence[variant->position - 1], variant->alt, length);
+    for (int strand = FORWARD; strand <= REVERSE; strand++)
+    {
+        // Slots of the codon grid are frame 0 of the index
+        RankSelectBitvector* stops = &queue->sites->sites[strand][0][STOP];
+        int rank = rankBitvector(stops, dirtyFirst);
+        int below = (rank > 0) ? selectBitvector(stops, rank - 1) : -1;
+        int above = selectBitvector(stops, rankBitvector(stops, dirtyLast + 1));
+        int low, high;
+        if (!getRescanWindow(strand, below, (above < 0) ? numOfSlots : above, numOfSlots, &low, &high)) continue;
+
+        int numOfOld = scanWindowForOrfs(queue->geneticCode, queue->reference, strand, low, high, &scratch->oldSpans, &scratch->oldCapacity);
+        int numOfNew = scanWindowForOrfs(queue->geneticCode, scratch->sequence, strand, low, high, &scratch->newSpans, &scratch->newCapacity);
+        compareWindowOrfs(variant, strand, scratch->oldSpans, numOfOld, scratch->newSpans, numOfNew);
+    }
+    memcpy(&scratch->sequence[variant->position - 1], variant->ref, length);
+    variant->isEvaluated = TRUE;
+}
+
+void* variantEffectThread(void* arg)
+{
+    VariantEffectQueue* queue = (VariantEffectQueue*) arg;
+    VariantScratch scratch = { 0 };
+    scratch.sequence = (char*) malloc(queue->referenceLength + 1);
+    if (scratch.sequence == NULL) return NULL; // The other threads take this one's share
+    memcpy(scratch.sequence, queue->reference, queue->referenceLength + 1);
+
+    while (TRUE)
+    {
+        pthread_mutex_lock(&queue->lock);
+        int first = queue->nextVariant;
+        queue->nextVariant += VARIANT_BATCH_SIZE;
+        pthread_mutex_unlock(&queue->lock);
+        if (first >= queue->numOfVariants) break;
+
+        for (int i = first; i < first + VARIANT_BATCH_SIZE && i < queue->numOfVariants; i++)
+        {
+            if (queue->variants[i].skipReason == NULL) evaluateVariant(queue, &scratch, &queue->variants[i]);
+        }
+    }
+    free(scratch.sequence);
+    free(scratch.oldSpans);
+    free(scratch.newSpans);
+    return NULL;
+}
+
+// Evaluates all variants not marked to skip, in parallel; returns the number of threads used
+int evaluateVariants(const char* reference, int referenceLength, const GeneticCode* geneticCode, CodonSiteIndex* sites, Variant* variants, int numOfVariants)
+{
+    VariantEffectQueue queue = { 0 };
+    queue.reference = reference;
+    queue.referenceLength = referenceLength;
+    queue.geneticCode = geneticCode;
+    queue.sites = sites;
+    queue.variants = variants;
+    queue.numOfVariants = numOfVariants;
+    pthread_mutex_init(&queue.lock, NULL);
+
+
+    long numOfCores = sysconf(_SC_NPROCESSORS_ONLN);
+    int numOfThreads = (numOfCores > 0) ? (int) numOfCores : 1;
+    int numOfBatches = (numOfVariants + VARIANT_BATCH_SIZE - 1) / VARIANT_BATCH_SIZE;
+    if (numOfThreads > numOfBatches) numOfThreads = numOfBatches > 0 ? numOfBatches : 1;
+    if (numOfThreads > MAX_VARIANT_THREADS) numOfThreads = MAX_VARIANT_THREADS;
+
+    pthread_t threads[MAX_VARIANT_THREADS];
+    int numOfStarted = 0;
+    for (int i = 1; i < numOfThreads; i++) // The calling thread evaluates variants too
+    {
+        if (pthread_create(&threads[numOfStarted], NULL, variantEffectThread, &queue) == 0)
+        {
+            numOfStarted++;
+        }
+    }
+    variantEffectThread(&queue);
+    for (int i = 0; i < numOfStarted; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&queue.lock);
+    return numOfStarted + 1;
+}
+
+void freeVariants(Variant* variants, int numOfVariants)
+{
+    for (int i = 0; i < numOfVariants; i++)
+    {
+        free(variants[i].ref);
+        free(variants[i].alt);
+        free(variants[i].effects);
+    }
+    free(variants);
+}
+
+// VCF references and alleles are DNA: T is read as U, like the sequences here
+void dnaToRna(char* bases)
+{
+    toUpperCase(bases);
+    for (char* base = bases; *base; base++)
+    {
+        if (*base == 'T') *base = 'U';
+    }
+}
+
+void addVariant(Variant** variants, int* numOfVariants, int* capacity, int position, const char* ref, const char* alt, const char* skipReason)
+{
+    if (*numOfVariants == *capacity)
+    {
+        *capacity = *capacity ? *capacity * 2 : 256;
+        *variants = (Variant*) realloc(*variants, sizeof(Variant) * *capacity);
+    }
+    Variant* variant = &(*variants)[(*numOfVariants)++];
+    memset(variant, 0, sizeof(Variant));
+    variant->position = position;
+    variant->ref = strdup(ref);
+    variant->alt = strdup(alt);
+    variant->skipReason = skipReason;
+}
+
+// Why a VCF allele can't be evaluated against the reference, NULL if it can
+const char* checkVariant(const char* reference, int referenceLength, int position, const char* ref, const char* alt)
+{
+    int length = strlen(ref);
+    if (alt[0] == '.' || alt[0] == '*' || alt[0] == '<') return "no ALT allele";
+    if ((int) strlen(alt) != length) return "not a substitution (indels are re-analyzed as sequence edits)";
+    if (position < 1 || position - 1 + length > referenceLength) return "outside the reference";
+    if (strncmp(&reference[position - 1], ref, length) != 0) return "REF doesn't match the reference";
+    if (!has_valid_chars((char*) alt, length, VALID_CHARS, NUM_OF_VALID_CHARS)) return "invalid ALT base(s)";
+    return NULL;
+}
+
+// Reads the VCF columns CHROM POS ID REF ALT of every record (the rest are ignored); every ALT allele of a
+// record is a variant of its own. Variants that can't be evaluated are kept, with the reason, to be reported
+Variant* readVariantFile(FILE* output_stream, const char* path, const char* reference, int referenceLength, int* numOfVariants)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't open the variant file %s.\n%s\a\n" RESET, path, strerror(errno));
+        return NULL;
+    }
+    Variant* variants = NULL;
+    int capacity = 0;
+    *numOfVariants = 0;
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    while (getline(&line, &lineCapacity, file) != -1)
+    {
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+
+        char* fields[5];
+        char* savePointer = NULL;
+        int numOfFields = 0;
+        for (char* field = strtok_r(line, "\t\r\n", &savePointer); field != NULL && numOfFields < 5; field = strtok_r(NULL, "\t\r\n", &savePointer))
+        {
+            fields[numOfFields++] = field;
+        }
+        if (numOfFields < 5) continue;
+
+        int position = atoi(fields[1]);
+        dnaToRna(fields[3]);
+        for (char* alt = strtok_r(fields[4], ",", &savePointer); alt != NULL; alt = strtok_r(NULL, ",", &savePointer))
+        {
+            dnaToRna(alt);
+            addVariant(&variants, numOfVariants, &capacity, position, fields[3], alt, checkVariant(reference, referenceLength, position, fields[3], alt));
+        }
+    }
+    free(line);
+    fclose(file);
+    return variants;
+}
+
+// A sequence read from a file: FASTA header lines are skipped and line breaks dropped
+char* readSequenceFile(FILE* file, int* length)
+{
+    size_t capacity = 1024, size = 0;
+    char* sequence = (char*) malloc(capacity);
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t numOfRead;
+    while (sequence != NULL && (numOfRead = getline(&line, &lineCapacity, file)) != -1)
+    {
+        if (line[0] == '>') continue;
+        for (ssize_t i = 0; i < numOfRead; i++)
+        {
+            if (isspace((unsigned char) line[i])) continue;
+            if (size + 1 >= capacity)
+            {
+                capacity *= 2;
+                char* grown = (char*) realloc(sequence, capacity);
+                if (grown == NULL)
+                {
+                    free(sequence);
+                    sequence = NULL;
+                    break;
+                }
+                sequence = grown;
+            }
+            sequence[size++] = line[i];
+        }
+    }
+    free(line);
+    if (sequence == NULL) return NULL;
+    sequence[size] = '\0';
+    *length = (int) size;
+    return sequence;
+}
+
+void printVariantEffects(FILE* report, Variant* variants, int numOfVariants)
+{
+    fprintf(report, "#POS\tREF\tALT\tEFFECT\tSTRAND\tOLD_FIRST\tOLD_LAST\tNEW_FIRST\tNEW_LAST\n");
+    for (int i = 0; i < numOfVariants; i++)
+    {
+        Variant* variant = &variants[i];
+        if (variant->skipReason != NULL || !variant->isEvaluated)
+        {
+            fprintf(report, "%d\t%s\t%s\tskipped: %s\t.\t.\t.\t.\t.\n", variant->position, variant->ref, variant->alt,
+                    variant->skipReason != NULL ? variant->skipReason : "out of memory");
+        } else if (variant->numOfEffects == 0)
+        {
+            fprintf(report, "%d\t%s\t%s\tnone\t.\t.\t.\t.\t.\n", variant->position, variant->ref, variant->alt);
+        }
+        for (int e = 0; e < variant->numOfEffects; e++)
+        {
+            OrfEffect* effect = &variant->effects[e];
+            fprintf(report, "%d\t%s\t%s\t%s\t%s", variant->position, variant->ref, variant->alt, ORF_EFFECT_NAMES[effect->type], effect->strand == FORWARD ? "+" : "-");
+            if (effect->oldFirstBase > 0) fprintf(report, "\t%d\t%d", effect->oldFirstBase, effect->oldLastBase);
+            else fprintf(report, "\t.\t.");
+            if (effect->newFirstBase > 0) fprintf(report, "\t%d\t%d\n", effect->newFirstBase, effect->newLastBase);
+            else fprintf(report, "\t.\t.\n");
+        }
+    }
+}
+
+// Reads a reference (typed in, or a file) and a VCF, then reports the ORF changes of every variant
+void reportVariantEffects(FILE* output_stream, CodonSiteCatalog* codonSiteCatalog, const GeneticCode* geneticCode)
+{
+    int referenceLength = 0;
+    char* reference = readInputLine(output_stream, "Reference sequence, or the path of a file (FASTA or plain) holding it:", &referenceLength);
+    if (reference == NULL) return;
+    FILE* referenceFile = fopen(reference, "r");
+    if (referenceFile != NULL)
+    {
+        free(reference);
+        reference = readSequenceFile(referenceFile, &referenceLength);
+        fclose(referenceFile);
+        if (reference == NULL)
+        {
+            fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the reference.\n%s\a\n" RESET, strerror(errno));
+            return;
+        }
+    }
+    dnaToRna(reference);
+    if (referenceLength == 0 || referenceLength % CODONS_LENGTH != 0 || !has_valid_chars(reference, referenceLength, VALID_CHARS, NUM_OF_VALID_CHARS))
+    {
+        fprintf(output_stream, ERROR_COLOR "The reference must consist of valid characters and be a multiple of %d long.\a\n" RESET, CODONS_LENGTH);
+        free(reference);
+        return;
+    }
+
+    int length;
+    char* variantPath = readInputLine(output_stream, "Variant file (VCF):", &length);
+    char* reportPath = (variantPath != NULL) ? readInputLine(output_stream, "Report file (- for the screen):", &length) : NULL;
+    int numOfVariants = 0;
+    Variant* variants = (reportPath != NULL) ? readVariantFile(output_stream, variantPath, reference, referenceLength, &numOfVariants) : NULL;
+    FILE* report = NULL;
+    if (variants != NULL)
+    {
+        report = (strcmp(reportPath, "-") == 0) ? output_stream : fopen(reportPath, "w");
+        if (report == NULL) fprintf(output_stream, ERROR_COLOR "Couldn't open the report file %s.\n%s\a\n" RESET, reportPath, strerror(errno));
+    }
+
+    // The reference's STOPs: from the index kept for it if it was analyzed, otherwise indexed now
+    CodonSiteIndex* sites = NULL;
+    if (report != NULL)
+    {
+        uint64_t referenceHash = hashAnalyzedSequence(reference, referenceLength, geneticCode);
+        for (int i = 0; codonSiteCatalog != NULL && i < codonSiteCatalog->numOfEntries && sites == NULL; i++)
+        {
+            CodonSiteEntry* entry = &codonSiteCatalog->entries[i];
+            if (entry->sequenceHash == referenceHash && entry->sequenceLength == referenceLength)
+            {
+                sites = loadCodonSiteIndex(output_stream, codonSiteCatalog, entry);
+            }
+        }
+        if (sites == NULL) sites = buildCodonSiteIndex(reference, referenceLength, referenceHash, geneticCode);
+        if (sites == NULL) fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the STOP codon index.\n%s\a\n" RESET, strerror(errno));
+    }
+
+    if (sites != NULL)
+    {
+        struct timespec startTime, endTime;
+        clock_gettime(CLOCK_MONOTONIC, &startTime);
+        int numOfThreads = evaluateVariants(reference, referenceLength, geneticCode, sites, variants, numOfVariants);
+        clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+        printVariantEffects(report, variants, numOfVariants);
+        int counts[ORF_EXTENDED + 1] = { 0 }, numOfSkipped = 0;
+        for (int i = 0; i < numOfVariants; i++)
+        {
+            if (!variants[i].isEvaluated) numOfSkipped++;
+            for (int e = 0; e < variants[i].numOfEffects; e++) counts[variants[i].effects[e].type]++;
+        }
+        fprintf(output_stream, DIM "%d variant(s) evaluated on %d thread(s) in %.1f ms: %d ORF(s) created, %d destroyed, %d truncated, %d extended. %d variant(s) skipped.\n" RESET,
+                numOfVariants - numOfSkipped, numOfThreads,
+                (endTime.tv_sec - startTime.tv_sec) * 1e3 + (endTime.tv_nsec - startTime.tv_nsec) / 1e6,
+                counts[ORF_CREATED], counts[ORF_DESTROYED], counts[ORF_TRUNCATED], counts[ORF_EXTENDED], numOfSkipped);
+        freeCodonSiteIndex(sites);
+    }
+
+    if (report != NULL && report != output_stream) fclose(report);
+    freeVariants(variants, numOfVariants);
+    free(reportPath);
+    free(variantPath);
+    free(reference);
+}
+
+
+
+
+// ****************************************************  Motif search functions  ***************************************************
+
+// Exact and IUPAC-degenerate patterns (promoter boxes, terminators, restriction sites...) read from a pattern file,
+// all found in one pass over each sequence by a single Aho-Corasick automaton. A degenerate pattern goes in as every
+// exact pattern it stands for, and, like the Shine-Dalgarno motifs, twice: as read on the forward strand, and
+// backwards, for the reverse strand. Patterns allowed to match with edits are searched for by bit-vector matchers
+// instead, one per pattern and strand. Sequences are cut into chunks that threads search in parallel
+#define MOTIF_MAX_LENGTH MYERS_MAX_LENGTH
+#define MOTIF_MAX_EXPANSIONS 4096   // Exact patterns that one degenerate pattern may stand for (e.g. NNNNNN)
+#define MOTIF_CHUNK_BASES (256 << 10)
+#define MAX_MOTIF_THREADS 16
+#define STRINGIFY_VALUE(value) #value
+#define STRINGIFY(value) STRINGIFY_VALUE(value)
+
+typedef struct
+{
+    char* name;
+    char* pattern;                  // Upper-cased, as in the pattern file
+    int length;
+    int maxEdits;                   // Mismatches, insertions and deletions a match may have; 0 for exact matches only
+    bool isPalindrome;              // Reads the same backwards, so it's searched (and reported) once for both strands
+} Motif;
+
+// One motif that ends at a state; the ones of a state are linked by 'next' (-1 ends the list)
+typedef struct
+{
+    int motif;
+    direction strand;
+    int next;
+} MotifOutput;
+
+typedef struct
+{
+    int (*next)[4];                 // By base code: failures already folded in
+    int* firstOutput;               // Motifs that end at the state, -1 if none
+    int* outputLink;                // Nearest state down the failure chain that has motifs, 0 if none
+    int numOfStates, stateCapacity;
+    MotifOutput* outputs;
+    int numOfOutputs, outputCapacity;
+    Motif* motifs;
+    int numOfMotifs, motifCapacity;
+    int maxLength;                  // Of the exact motifs
+} MotifAutomaton;
+
+// A sequence to search: a FASTA record, or a sequence typed in
+typedef struct
+{
+    char* name;
+    char* bases;
+    int length;
+} SequenceRecord;
+
+typedef struct
+{
+    int motif;
+    direction strand;
+    int firstBase, lastBase;        // 0-based; the lowest and highest base of the match on either strand
+    int edits;
+} MotifHit;
+
+// Bases [from, to) of one record; it owns the hits that start in it, even if they end in the next chunk
+typedef struct
+{
+    int record;
+    int from, to;
+    MotifHit* hits;
+    int numOfHits, capacity;
+} MotifChunk;
+
+typedef struct
+{
+    MotifAutomaton* automaton;
+    SequenceRecord* records;
+    MotifChunk* chunks;
+    int numOfChunks;
+    int nextChunk;
+    pthread_mutex_t lock;
+} MotifSearchQueue;
+
+void freeMotifAutomaton(MotifAutomaton* automaton)
+{
+    if (automaton == NULL) return;
+    for (int i = 0; i < automaton->numOfMotifs; i++)
+    {
+        free(automaton->motifs[i].name);
+        free(automaton->motifs[i].pattern);
+    }
+    free(automaton->motifs);
+    free(automaton->next);
+    free(automaton->firstOutput);
+    free(automaton->outputLink);
+    free(automaton->outputs);
+    free(automaton);
+}
+
+int addMotifState(MotifAutomaton* automaton)
+{
+    if (automaton->numOfStates == automaton->stateCapacity)
+    {
+        int capacity = automaton->stateCapacity ? automaton->stateCapacity * 2 : 256;
+        int (*next)[4] = realloc(automaton->next, sizeof(int[4]) * capacity);
+        if (next != NULL) automaton->next = next;
+        int* firstOutput = (int*) realloc(automaton->firstOutput, sizeof(int) * capacity);
+        if (firstOutput != NULL) automaton->firstOutput = firstOutput;
+        int* outputLink = (int*) realloc(automaton->outputLink, sizeof(int) * capacity);
+        if (outputLink != NULL) automaton->outputLink = outputLink;
+        if (next == NULL || firstOutput == NULL || outputLink == NULL) return -1;
+        automaton->stateCapacity = capacity;
+    }
+    int state = automaton->numOfStates++;
+    memset(automaton->next[state], 0, sizeof(int[4]));
+    automaton->firstOutput[state] = -1;
+    automaton->outputLink[state] = 0;
+    return state;
+}
+
+bool addMotifOutput(MotifAutomaton* automaton, int state, int motif, direction strand)
+{
+    if (automaton->numOfOutputs == automaton->outputCapacity)
+    {
+        int capacity = automaton->outputCapacity ? automaton->outputCapacity * 2 : 256;
+        MotifOutput* outputs = (MotifOutput*) realloc(automaton->outputs, sizeof(MotifOutput) * capacity);
+        if (outputs == NULL) return FALSE;
+        automaton->outputs = outputs;
+        automaton->outputCapacity = capacity;
+    }
+    MotifOutput* output = &automaton->outputs[automaton->numOfOutputs];
+    output->motif = motif;
+    output->strand = strand;
+    output->next = automaton->firstOutput[state];
+    automaton->firstOutput[state] = automaton->numOfOutputs++;
+    return TRUE;
+}
+
+// Puts every exact pattern that the motif stands for in the trie, read backwards for the reverse strand
+bool addMotifPatterns(MotifAutomaton* automaton, int motif, direction strand)
+{
+    const char* pattern = automaton->motifs[motif].pattern;
+    int length = automaton->motifs[motif].length;
+    int* states = (int*) malloc(sizeof(int) * MOTIF_MAX_EXPANSIONS);
+    int* nextStates = (int*) malloc(sizeof(int) * MOTIF_MAX_EXPANSIONS);
+    bool isAdded = (states != NULL && nextStates != NULL);
+    int numOfStates = 1;
+    if (isAdded) states[0] = 0;
+
+    for (int i = 0; i < length && isAdded; i++)
+    {
+        int mask = IUPAC_BASE_MASKS[(unsigned char) pattern[(strand == FORWARD) ? i : length - 1 - i]];
+        int numOfNext = 0;
+        for (int s = 0; s < numOfStates && isAdded; s++)
+        {
+            for (int code = 0; code < 4 && isAdded; code++)
+            {
+                if (!(mask & (1 << code))) continue;
+                if (automaton->next[states[s]][code] == 0)
+                {
+                    int child = addMotifState(automaton);
+                    if (child < 0) isAdded = FALSE;
+                    else automaton->next[states[s]][code] = child;
+                }
+                if (isAdded) nextStates[numOfNext++] = automaton->next[states[s]][code];
+            }
+        }
+        int* swap = states;
+        states = nextStates;
+        nextStates = swap;
+        numOfStates = numOfNext;
+    }
+    for (int s = 0; s < numOfStates && isAdded; s++)
+    {
+        isAdded = addMotifOutput(automaton, states[s], motif, strand);
+    }
+    free(states);
+    free(nextStates);
+    return isAdded;
+}
+
+// Breadth first, every state's failure (longest proper suffix that is a state) is done before the state
+bool finishMotifAutomaton(MotifAutomaton* automaton)
+{
+    int* failure = (int*) calloc(automaton->numOfStates, sizeof(int));
+    int* queue = (int*) malloc(sizeof(int) * automaton->numOfStates);
+    if (failure == NULL || queue == NULL)
+    {
+        free(failure);
+        free(queue);
+        return FALSE;
+    }
+    int head = 0, tail = 0;
+    for (int code = 0; code < 4; code++)
+    {
+        if (automaton->next[0][code] != 0) queue[tail++] = automaton->next[0][code];
+    }
+    while (head < tail)
+    {
+        int state = queue[head++];
+        for (int code = 0; code < 4; code++)
+        {
+            int child = automaton->next[state][code];
+            if (child != 0)
+            {
+                int childFailure = automaton->next[failure[state]][code];
+                failure[child] = childFailure;
+                automaton->outputLink[child] = (automaton->firstOutput[childFailure] >= 0) ? childFailure : automaton->outputLink[childFailure];
+                queue[tail++] = child;
+            } else
+            {
+                automaton->next[state][code] = automaton->next[failure[state]][code];
+            }
+        }
+    }
+    free(failure);
+    free(queue);
+    return TRUE;
+}
+
+// Why a pattern can't be searched for, NULL if it can. Only exact ones are expanded, so only they are limited in that
+const char* checkMotifPattern(const char* pattern, int length, int maxEdits)
+{
+    if (length > MOTIF_MAX_LENGTH) return "is longer than " STRINGIFY(MOTIF_MAX_LENGTH) " bases";
+    if (maxEdits < 0 || maxEdits >= length) return "must allow fewer edits than it has bases";
+    long numOfExpansions = 1;
+    for (int i = 0; i < length; i++)
+    {
+        int mask = IUPAC_BASE_MASKS[(unsigned char) pattern[i]];
+        if (mask == 0) return "has a character that isn't an IUPAC nucleotide code";
+        numOfExpansions *= __builtin_popcount(mask);
+        if (maxEdits == 0 && numOfExpansions > MOTIF_MAX_EXPANSIONS) return "stands for more than " STRINGIFY(MOTIF_MAX_EXPANSIONS) " exact patterns";
+    }
+    return NULL;
+}
+
+// Pattern file: one "NAME PATTERN [EDITS]" per line (or just PATTERN, which then names itself); # starts a comment
+// line. EDITS, 0 if left out, is how many mismatches, insertions and deletions a match may have
+MotifAutomaton* loadMotifAutomaton(FILE* output_stream, const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't open the pattern file %s.\n%s\a\n" RESET, path, strerror(errno));
+        return NULL;
+    }
+    errno = 0;
+    MotifAutomaton* automaton = (MotifAutomaton*) calloc(1, sizeof(MotifAutomaton));
+    bool isLoaded = (automaton != NULL && addMotifState(automaton) == 0);
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    int lineNumber = 0;
+    while (isLoaded && getline(&line, &lineCapacity, file) != -1)
+    {
+        lineNumber++;
+        char* savePointer = NULL;
+        char* name = strtok_r(line, " \t\r\n", &savePointer);
+        if (name == NULL || name[0] == '#') continue;
+        char* pattern = strtok_r(NULL, " \t\r\n", &savePointer);
+        char* edits = (pattern != NULL) ? strtok_r(NULL, " \t\r\n", &savePointer) : NULL;
+        if (pattern == NULL) pattern = name;
+
+        toUpperCase(pattern);
+        int length = strlen(pattern), maxEdits = (edits != NULL) ? atoi(edits) : 0;
+        const char* invalidReason = checkMotifPattern(pattern, length, maxEdits);
+        if (invalidReason != NULL)
+        {
+            fprintf(output_stream, ERROR_COLOR "Line %d of %s: pattern %s %s.\a\n" RESET, lineNumber, path, pattern, invalidReason);
+            isLoaded = FALSE;
+            break;
+        }
+
+        if (automaton->numOfMotifs == automaton->motifCapacity)
+        {
+            int capacity = automaton->motifCapacity ? automaton->motifCapacity * 2 : 16;
+            Motif* motifs = (Motif*) realloc(automaton->motifs, sizeof(Motif) * capacity);
+            if (motifs == NULL)
+            {
+                isLoaded = FALSE;
+                break;
+            }
+            automaton->motifs = motifs;
+            automaton->motifCapacity = capacity;
+        }
+        Motif* motif = &automaton->motifs[automaton->numOfMotifs++];
+        motif->name = strdup(name);
+        motif->pattern = strdup(pattern);
+        motif->length = length;
+        motif->maxEdits = maxEdits;
+        motif->isPalindrome = TRUE;
+        for (int i = 0; i < length / 2; i++)
+        {
+            if (IUPAC_BASE_MASKS[(unsigned char) pattern[i]] != IUPAC_BASE_MASKS[(unsigned char) pattern[length - 1 - i]]) motif->isPalindrome = FALSE;
+        }
+        if (maxEdits > 0) continue; // Not in the automaton
+
+        if (length > automaton->maxLength) automaton->maxLength = length;
+        isLoaded = addMotifPatterns(automaton, automaton->numOfMotifs - 1, FORWARD);
+        if (isLoaded && !motif->isPalindrome) isLoaded = addMotifPatterns(automaton, automaton->numOfMotifs - 1, REVERSE);
+    }
+    free(line);
+    fclose(file);
+
+    if (isLoaded && automaton->numOfMotifs == 0)
+    {
+        fprintf(output_stream, ERROR_COLOR "The pattern file %s has no patterns.\a\n" RESET, path);
+        isLoaded = FALSE;
+    }
+    if (isLoaded) isLoaded = finishMotifAutomaton(automaton);
+    if (!isLoaded)
+    {
+        if (errno == ENOMEM) fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the motif automaton.\n%s\a\n" RESET, strerror(errno));
+        freeMotifAutomaton(automaton);
+        return NULL;
+    }
+    return automaton;
+}
+
+void addMotifHit(MotifChunk* chunk, int motif, direction strand, int firstBase, int lastBase, int edits)
+{
+    if (chunk->numOfHits == chunk->capacity)
+    {
+        int capacity = chunk->capacity ? chunk->capacity * 2 : 64;
+        MotifHit* hits = (MotifHit*) realloc(chunk->hits, sizeof(MotifHit) * capacity);
+        if (hits == NULL) return;
+        chunk->hits = hits;
+        chunk->capacity = capacity;
+    }
+    MotifHit* hit = &chunk->hits[chunk->numOfHits++];
+    hit->motif = motif;
+    hit->strand = strand;
+    hit->firstBase = firstBase;
+    hit->lastBase = lastBase;
+    hit->edits = edits;
+}
 
-		int startCodonPosition = is_start_codon(forwardCodon);
-		if (startCodonPosition > -1)
-		{
-			forwardSequence->specialCodons[codonsForwardIndex].type = START;
-			forwardSequence->specialCodons[codonsForwardIndex].positionInSequence = seqIndex+1; // human-readable ordering
-			strcpy(forwardSequence->specialCodons[codonsForwardIndex].codonSequence, START_CODONS[startCodonPosition]);
-		}		
+int compareMotifHits(const void* hit1, const void* hit2)
+{
+    const MotifHit* first = (const MotifHit*) hit1;
+    const MotifHit* second = (const MotifHit*) hit2;
+    if (first->firstBase != second->firstBase) return (first->firstBase > second->firstBase) - (first->firstBase < second->firstBase);
+    if (first->motif != second->motif) return first->motif - second->motif;
+    if (first->strand != second->strand) return (int) first->strand - (int) second->strand;
+    return first->lastBase - second->lastBase;
+}
 
-		int stopCodonPosition = is_stop_codon(forwardCodon);
-		if (stopCodonPosition > -1)
-		{
-			forwardSequence->specialCodons[codonsForwardIndex].type = STOP;
-			forwardSequence->specialCodons[codonsForwardIndex].positionInSequence = seqIndex+1;
-			strcpy(forwardSequence->specialCodons[codonsForwardIndex].codonSequence, STOP_CODONS[stopCodonPosition]);
-		}
+// Matches of a motif allowed edits, in one strand, that start in the chunk. A match ends at every base where the
+// distance is low enough; only the base where it's lowest (the first one, if there are several) is reported
+void searchApproximateMotif(Motif* motif, int motifIndex, direction strand, SequenceRecord* record, MotifChunk* chunk)
+{
+    // A match spans fewer than twice the motif's length, so the distances are exact from that far before the chunk
+    int from = (chunk->from > 2 * motif->length) ? chunk->from - 2 * motif->length : 0;
+    int end = (record->length - chunk->to > 2 * motif->length) ? chunk->to + 2 * motif->length : record->length;
+    MyersMatcher matcher;
+    initMyersMatcher(&matcher, motif->pattern, motif->length, strand == REVERSE);
+    int previous = motif->length, current = stepMyersMatcher(&matcher, getBaseCode(record->bases[from]));
+    for (int base = from; base < end; base++)
+    {
+        int next = (base + 1 < end) ? stepMyersMatcher(&matcher, getBaseCode(record->bases[base + 1])) : motif->length;
+        if (current <= motif->maxEdits && current < previous && current <= next)
+        {
+            int firstBase = getApproximateMatchFirst(motif->pattern, motif->length, strand == REVERSE, record->bases, base, current);
+            if (firstBase >= chunk->from && firstBase < chunk->to) addMotifHit(chunk, motifIndex, strand, firstBase, base, current);
+        }
+        previous = current;
+        current = next;
+    }
+}
 
-		if ( (startCodonPosition == -1) && (stopCodonPosition == -1) )
-		{
-    		forwardSequence->specialCodons[codonsForwardIndex].type = PLAIN;
-        	forwardSequence->specialCodons[codonsForwardIndex].positionInSequence = seqIndex+1;
-    		strcpy(forwardSequence->specialCodons[codonsForwardIndex].codonSequence, forwardCodon);
-    	}
+// The chunk's hits, ordered by position. The pass goes on past the chunk to finish the matches that start in it
+void searchMotifChunk(MotifAutomaton* automaton, SequenceRecord* record, MotifChunk* chunk)
+{
+    int end = chunk->to + automaton->maxLength - 1;
+    if (end > record->length) end = record->length;
+    int state = 0;
+    for (int base = chunk->from; base < end && automaton->numOfOutputs > 0; base++)
+    {
+        int code = getBaseCode(record->bases[base]);
+        state = (code < 0) ? 0 : automaton->next[state][code];
+        int matched = (automaton->firstOutput[state] >= 0) ? state : automaton->outputLink[state];
+        for (; matched != 0; matched = automaton->outputLink[matched])
+        {
+            for (int o = automaton->firstOutput[matched]; o >= 0; o = automaton->outputs[o].next)
+            {
+                int firstBase = base - automaton->motifs[automaton->outputs[o].motif].length + 1;
+                if (firstBase < chunk->to) addMotifHit(chunk, automaton->outputs[o].motif, automaton->outputs[o].strand, firstBase, base, 0);
+            }
+        }
+    }
+    for (int m = 0; m < automaton->numOfMotifs; m++)
+    {
+        Motif* motif = &automaton->motifs[m];
+        if (motif->maxEdits == 0) continue;
+        searchApproximateMotif(motif, m, FORWARD, record, chunk);
+        if (!motif->isPalindrome) searchApproximateMotif(motif, m, REVERSE, record, chunk);
+    }
+    if (chunk->numOfHits > 1) qsort(chunk->hits, chunk->numOfHits, sizeof(MotifHit), compareMotifHits);
+}
 
+void* motifSearchThread(void* arg)
+{
+    MotifSearchQueue* queue = (MotifSearchQueue*) arg;
+    while (TRUE)
+    {
+        pthread_mutex_lock(&queue->lock);
+        int chunk = queue->nextChunk++;
+        pthread_mutex_unlock(&queue->lock);
+        if (chunk >= queue->numOfChunks) break;
 
-    	//  ****************************  check reverse codon  **********************************************
+        searchMotifChunk(queue->automaton, &queue->records[queue->chunks[chunk].record], &queue->chunks[chunk]);
+    }
+    return NULL;
+}
 
-    	char* reverseCodon = reverseString(output_stream, &sequence[seqIndex], CODONS_LENGTH);
+// Searches all records, in parallel; returns their chunks (in order, so their hits are too) and the number of threads used
+MotifChunk* searchMotifs(MotifAutomaton* automaton, SequenceRecord* records, int numOfRecords, int* numOfChunks, int* numOfThreads)
+{
+    MotifSearchQueue queue = { 0 };
+    for (int r = 0; r < numOfRecords; r++)
+    {
+        queue.numOfChunks += (records[r].length + MOTIF_CHUNK_BASES - 1) / MOTIF_CHUNK_BASES;
+    }
+    queue.chunks = (MotifChunk*) calloc(queue.numOfChunks > 0 ? queue.numOfChunks : 1, sizeof(MotifChunk));
+    if (queue.chunks == NULL) return NULL;
+    for (int r = 0, c = 0; r < numOfRecords; r++)
+    {
+        for (int from = 0; from < records[r].length; from += MOTIF_CHUNK_BASES, c++)
+        {
+            queue.chunks[c].record = r;
+            queue.chunks[c].from = from;
+            queue.chunks[c].to = (records[r].length - from > MOTIF_CHUNK_BASES) ? from + MOTIF_CHUNK_BASES : records[r].length;
+        }
+    }
+    queue.automaton = automaton;
+    queue.records = records;
+    pthread_mutex_init(&queue.lock, NULL);
+
+    long numOfCores = sysconf(_SC_NPROCESSORS_ONLN);
+    *numOfThreads = (numOfCores > 0) ? (int) numOfCores : 1;
+    if (*numOfThreads > queue.numOfChunks) *numOfThreads = queue.numOfChunks > 0 ? queue.numOfChunks : 1;
+    if (*numOfThreads > MAX_MOTIF_THREADS) *numOfThreads = MAX_MOTIF_THREADS;
+
+    pthread_t threads[MAX_MOTIF_THREADS];
+    int numOfStarted = 0;
+    for (int i = 1; i < *numOfThreads; i++) // The calling thread searches too
+    {
+        if (pthread_create(&threads[numOfStarted], NULL, motifSearchThread, &queue) == 0)
+        {
+            numOfStarted++;
+        }
+    }
+    motifSearchThread(&queue);
+    for (int i = 0; i < numOfStarted; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&queue.lock);
+    *numOfThreads = numOfStarted + 1;
+    *numOfChunks = queue.numOfChunks;
+    return queue.chunks;
+}
 
-		startCodonPosition = -1;
-		startCodonPosition = is_start_codon(reverseCodon);
-		if (startCodonPosition > -1)
-		{
-			backwardSequence->specialCodons[codonsBackwardIndex].type = START;
-			backwardSequence->specialCodons[codonsBackwardIndex].positionInSequence = seqIndex + CODONS_LENGTH; 
-			strcpy(backwardSequence->specialCodons[codonsBackwardIndex].codonSequence, START_CODONS[startCodonPosition]);
-		}
+void freeMotifChunks(MotifChunk* chunks, int numOfChunks)
+{
+    for (int i = 0; chunks != NULL && i < numOfChunks; i++)
+    {
+        free(chunks[i].hits);
+    }
+    free(chunks);
+}
 
-		stopCodonPosition = -1;
-		stopCodonPosition = is_stop_codon(reverseCodon);
-		if (stopCodonPosition > -1)
-		{
-			backwardSequence->specialCodons[codonsBackwardIndex].type = STOP;
-			backwardSequence->specialCodons[codonsBackwardIndex].positionInSequence = seqIndex + CODONS_LENGTH; 
-			strcpy(backwardSequence->specialCodons[codonsBackwardIndex].codonSequence, STOP_CODONS[stopCodonPosition]);
-		}
+// Tab-separated hits; MATCHED gives the bases as read on the hit's strand, EDITS how many they differ by from the
+// pattern. Returns the number of hits
+long printMotifHits(FILE* report, MotifAutomaton* automaton, SequenceRecord* records, MotifChunk* chunks, int numOfChunks)
+{
+    long numOfHits = 0;
+    fprintf(report, "#SEQUENCE\tMOTIF\tPATTERN\tSTRAND\tFIRST\tLAST\tEDITS\tMATCHED\n");
+    for (int c = 0; c < numOfChunks; c++)
+    {
+        SequenceRecord* record = &records[chunks[c].record];
+        for (int h = 0; h < chunks[c].numOfHits; h++)
+        {
+            MotifHit* hit = &chunks[c].hits[h];
+            Motif* motif = &automaton->motifs[hit->motif];
+            const char* strand = motif->isPalindrome ? "+/-" : ((hit->strand == FORWARD) ? "+" : "-");
+            fprintf(report, "%s\t%s\t%s\t%s\t%d\t%d\t%d\t", record->name, motif->name, motif->pattern, strand, hit->firstBase + 1, hit->lastBase + 1, hit->edits);
+            for (int i = 0; i <= hit->lastBase - hit->firstBase; i++)
+            {
+                fputc(record->bases[(hit->strand == FORWARD) ? hit->firstBase + i : hit->lastBase - i], report);
+            }
+            fputc('\n', report);
+        }
+        numOfHits += chunks[c].numOfHits;
+    }
+    return numOfHits;
+}
 
-    	if ( (startCodonPosition == -1) && (stopCodonPosition == -1) )
-    	{
-    		backwardSequence->specialCodons[codonsBackwardIndex].type = PLAIN;
-        	backwardSequence->specialCodons[codonsBackwardIndex].positionInSequence = seqIndex + CODONS_LENGTH; 
-    		strcpy(backwardSequence->specialCodons[codonsBackwardIndex].codonSequence, reverseCodon);
-    	}
+// Searches the records and reports the hits (to 'report'), then how long it took (to 'output_stream')
+void reportMotifHits(FILE* output_stream, FILE* report, MotifAutomaton* automaton, SequenceRecord* records, int numOfRecords)
+{
+    struct timespec startTime, endTime;
+    int numOfChunks = 0, numOfThreads = 0;
+    long numOfBases = 0;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    MotifChunk* chunks = searchMotifs(automaton, records, numOfRecords, &numOfChunks, &numOfThreads);
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+    if (chunks == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the motif search.\n%s\a\n" RESET, strerror(errno));
+        return;
+    }
+    for (int r = 0; r < numOfRecords; r++) numOfBases += records[r].length;
+
+    if (report == output_stream) fprintf(output_stream, BOLD "\nMotif hits\n" RESET);
+    long numOfHits = printMotifHits(report, automaton, records, chunks, numOfChunks);
+    fprintf(output_stream, DIM "%ld hit(s) of %d motif(s) in %d sequence(s) (%ld bases), searched on %d thread(s) in %.1f ms.\n" RESET,
+            numOfHits, automaton->numOfMotifs, numOfRecords, numOfBases, numOfThreads,
+            (endTime.tv_sec - startTime.tv_sec) * 1e3 + (endTime.tv_nsec - startTime.tv_nsec) / 1e6);
+    freeMotifChunks(chunks, numOfChunks);
+}
 
-        seqIndex += CODONS_LENGTH;
-	}
+// The next record of a FASTA file: its name (first word of the header, NULL if there is none) and its bases,
+// line breaks dropped. NULL once the file has no more records. The whole header goes to 'header' unless it's NULL
+char* readFastaRecord(FILE* file, char** name, char** header, int* length)
+{
+    size_t capacity = 1024, size = 0;
+    char* bases = (char*) malloc(capacity);
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t numOfRead;
+    bool hasRecord = FALSE;
+    *name = NULL;
+    if (header != NULL) *header = NULL;
+    while (bases != NULL)
+    {
+        int next = fgetc(file);
+        if (next == EOF) break;
+        ungetc(next, file);
+        if (next == '>' && hasRecord) break; // Header of the next record
+        if ((numOfRead = getline(&line, &lineCapacity, file)) == -1) break;
+        if (line[0] == '>')
+        {
+            *name = strndup(line + 1, strcspn(line + 1, " \t\r\n"));
+            if (header != NULL) *header = strndup(line + 1, strcspn(line + 1, "\r\n"));
+            hasRecord = TRUE;
+            continue;
+        }
+        for (ssize_t i = 0; i < numOfRead; i++)
+        {
+            if (isspace((unsigned char) line[i])) continue;
+            if (size + 1 >= capacity)
+            {
+                capacity *= 2;
+                char* grown = (char*) realloc(bases, capacity);
+                if (grown == NULL)
+                {
+                    free(bases);
+                    bases = NULL;
+                    break;
+                }
+                bases = grown;
+            }
+            bases[size++] = line[i];
+            hasRecord = TRUE;
+        }
+    }
+    free(line);
+    if (bases == NULL || !hasRecord)
+    {
+        free(bases);
+        free(*name);
+        *name = NULL;
+        if (header != NULL)
+        {
+            free(*header);
+            *header = NULL;
+        }
+        return NULL;
+    }
+    bases[size] = '\0';
+    *length = (int) size;
+    return bases;
+}
+
+bool addSequenceRecord(SequenceRecord** records, int* numOfRecords, int* capacity, char* name, char* bases, int length)
+{
+    if (*numOfRecords == *capacity)
+    {
+        int grownCapacity = *capacity ? *capacity * 2 : 16;
+        SequenceRecord* grown = (SequenceRecord*) realloc(*records, sizeof(SequenceRecord) * grownCapacity);
+        if (grown == NULL) return FALSE;
+        *records = grown;
+        *capacity = grownCapacity;
+    }
+    SequenceRecord* record = &(*records)[(*numOfRecords)++];
+    record->name = name;
+    record->bases = bases;
+    record->length = length;
+    return TRUE;
+}
+
+void freeSequenceRecords(SequenceRecord* records, int numOfRecords)
+{
+    for (int i = 0; i < numOfRecords; i++)
+    {
+        free(records[i].name);
+        free(records[i].bases);
+    }
+    free(records);
+}
+
+// Sequences to search, typed in or read from a (multi-)FASTA file, validated like the ones analyzed: DNA is read
+// as RNA, and records with other characters are skipped. Unlike ORFs, motifs don't need whole codons
+SequenceRecord* readSequenceRecords(FILE* output_stream, int* numOfRecords)
+{
+    int length = 0, capacity = 0;
+    *numOfRecords = 0;
+    char* input = readInputLine(output_stream, "Sequence, or the path of a file (FASTA or plain) holding one or more:", &length);
+    if (input == NULL) return NULL;
+    SequenceRecord* records = NULL;
+    FILE* file = fopen(input, "r");
+    if (file == NULL)
+    {
+        addSequenceRecord(&records, numOfRecords, &capacity, strdup("input"), input, length);
+    } else
+    {
+        char* name;
+        char* bases;
+        while ((bases = readFastaRecord(file, &name, NULL, &length)) != NULL)
+        {
+            if (name == NULL) name = strdup(input);
+            if (!addSequenceRecord(&records, numOfRecords, &capacity, name, bases, length))
+            {
+                free(name);
+                free(bases);
+                break;
+            }
+        }
+        fclose(file);
+        free(input);
+    }
+
+    int numOfValid = 0;
+    for (int i = 0; i < *numOfRecords; i++)
+    {
+        dnaToRna(records[i].bases);
+        if (records[i].length > 0 && has_valid_chars(records[i].bases, records[i].length, VALID_CHARS, NUM_OF_VALID_CHARS))
+        {
+            records[numOfValid++] = records[i];
+            continue;
+        }
+        fprintf(output_stream, ERROR_COLOR "Sequence %s is empty or has invalid character(s), so it's skipped.\a\n" RESET, records[i].name);
+        free(records[i].name);
+        free(records[i].bases);
+    }
+    *numOfRecords = numOfValid;
+    return records;
+}
+
+// Reads a pattern file and the sequences, then reports where each pattern is found, on which strand
+void searchSequencesForMotifs(FILE* output_stream)
+{
+    int length;
+    char* patternPath = readInputLine(output_stream, "Pattern file (NAME PATTERN [EDITS] per line, IUPAC codes allowed):", &length);
+    MotifAutomaton* automaton = (patternPath != NULL) ? loadMotifAutomaton(output_stream, patternPath) : NULL;
+    free(patternPath);
+    if (automaton == NULL) return;
+
+    int numOfRecords = 0;
+    SequenceRecord* records = readSequenceRecords(output_stream, &numOfRecords);
+    char* reportPath = (numOfRecords > 0) ? readInputLine(output_stream, "Report file (- for the screen):", &length) : NULL;
+    FILE* report = NULL;
+    if (reportPath != NULL)
+    {
+        report = (strcmp(reportPath, "-") == 0) ? output_stream : fopen(reportPath, "w");
+        if (report == NULL) fprintf(output_stream, ERROR_COLOR "Couldn't open the report file %s.\n%s\a\n" RESET, reportPath, strerror(errno));
+    }
+
+    if (report != NULL)
+    {
+        fprintf(output_stream, DIM "%d motif(s) compiled into an automaton of %d state(s).\n" RESET, automaton->numOfMotifs, automaton->numOfStates);
+        reportMotifHits(output_stream, report, automaton, records, numOfRecords);
+        if (report != output_stream) fclose(report);
+    }
+    free(reportPath);
+    freeSequenceRecords(records, numOfRecords);
+    freeMotifAutomaton(automaton);
+}
+
+
+
+
+// ****************************************************  Top ORF functions  ***************************************************
+
+// The K longest ORFs of sequences too long to analyze whole (e.g. chromosomes). The sequence is streamed from its
+// file codon by codon, in the three frames of both strands, and only the K longest ORFs so far are kept, in a
+// min-heap (one per strand or per frame, if asked for): memory doesn't grow with the sequence, and time is
+// O(n log K). ORFs follow the rules of the analysis, from the first START after a STOP up to the next STOP in
+// reading order; the reverse strand is read backwards, so when streamed forwards its ORFs end at the STOP below them
+// and are only complete once the STOP above them (or the end of the sequence) is reached
+#define MAX_TOP_ORF_HEAPS 6
+
+typedef enum
+{
+    TOP_ORFS_OVERALL,
+    TOP_ORFS_PER_STRAND,
+    TOP_ORFS_PER_FRAME
+} topOrfGrouping;
+
+typedef struct
+{
+    int numOfCodons;
+    direction strand;
+    int frame;
+    int firstBase, lastBase;        // 0-based, lowest and highest base
+    int position;                   // Of its last START, as the analysis gives it (positionInSupersequence)
+    bool isSoftMasked;              // Overlaps soft-masked (lower case) bases
+} OrfSummary;
+
+// Kept ORFs; the one at the root is the first to go when a longer one is found
+typedef struct
+{
+    OrfSummary* orfs;
+    int size, capacity;
+} OrfHeap;
+
+// Where one frame of one strand is in the ORF rules. Bases are those of the codons' first (lowest) base
+typedef struct
+{
+    bool hasStart;                  // Forward: a START since the last STOP. Reverse: a START above the last STOP
+    int firstStart, lastStart;      // In reading order
+    bool hasStop;                   // Reverse only: a STOP was seen, so ORFs above it end at it
+    int stopBase;
+    bool isSoftMasked;              // Reverse only: bases from the STOP up to the highest START are soft-masked
+} FrameScanState;
+
+typedef struct
+{
+    OrfHeap heaps[MAX_TOP_ORF_HEAPS];
+    int numOfHeaps;
+    topOrfGrouping grouping;
+    FrameScanState frames[2][CODONS_LENGTH];
+    const GeneticCode* defaultCode; // For sequences whose header names none
+    const GeneticCode* geneticCode; // Of the current sequence
+    long numOfOrfs;                 // Found in the current sequence, kept or not
+    softMaskMode softMasking;
+    int lastMaskedBase;             // Highest soft-masked base read so far, -1 if none
+    long numOfSkippedOrfs;          // Overlapping soft-masked bases, so left out (SOFT_MASK_SKIPPED)
+} TopOrfScan;
+
+// Longer ORFs rank first, then those further upstream on the forward strand, then forward ones
+bool ranksBelow(const OrfSummary* orf1, const OrfSummary* orf2)
+{
+    if (orf1->numOfCodons != orf2->numOfCodons) return orf1->numOfCodons < orf2->numOfCodons;
+    if (orf1->firstBase != orf2->firstBase) return orf1->firstBase > orf2->firstBase;
+    return orf1->strand > orf2->strand;
+}
+
+int compareOrfRanks(const void* orf1, const void* orf2)
+{
+    if (ranksBelow((const OrfSummary*) orf1, (const OrfSummary*) orf2)) return 1;
+    if (ranksBelow((const OrfSummary*) orf2, (const OrfSummary*) orf1)) return -1;
+    return 0;
+}
+
+void offerToOrfHeap(OrfHeap* heap, const OrfSummary* orf)
+{
+    int i;
+    if (heap->size < heap->capacity) // Not full: sifted up from the bottom
+    {
+        for (i = heap->size++; i > 0 && ranksBelow(orf, &heap->orfs[(i - 1) / 2]); i = (i - 1) / 2)
+        {
+            heap->orfs[i] = heap->orfs[(i - 1) / 2];
+        }
+        heap->orfs[i] = *orf;
+        return;
+    }
+    if (heap->size == 0 || !ranksBelow(&heap->orfs[0], orf)) return;
+
+    // Full: replaces the root, sifted down
+    for (i = 0; 2 * i + 1 < heap->size; )
+    {
+        int child = 2 * i + 1;
+        if (child + 1 < heap->size && ranksBelow(&heap->orfs[child + 1], &heap->orfs[child])) child++;
+        if (!ranksBelow(&heap->orfs[child], orf)) break;
+        heap->orfs[i] = heap->orfs[child];
+        i = child;
+    }
+    heap->orfs[i] = *orf;
+}
+
+TopOrfScan* createTopOrfScan(int k, topOrfGrouping grouping, const GeneticCode* defaultCode, softMaskMode softMasking)
+{
+    TopOrfScan* scan = (TopOrfScan*) calloc(1, sizeof(TopOrfScan));
+    if (scan == NULL) return NULL;
+    scan->grouping = grouping;
+    scan->numOfHeaps = (grouping == TOP_ORFS_OVERALL) ? 1 : (grouping == TOP_ORFS_PER_STRAND) ? 2 : MAX_TOP_ORF_HEAPS;
+    for (int h = 0; h < scan->numOfHeaps; h++)
+    {
+        scan->heaps[h].orfs = (OrfSummary*) malloc(sizeof(OrfSummary) * k);
+        if (scan->heaps[h].orfs == NULL)
+        {
+            for (int i = 0; i < h; i++) free(scan->heaps[i].orfs);
+            free(scan);
+            return NULL;
+        }
+        scan->heaps[h].capacity = k;
+    }
+    scan->defaultCode = scan->geneticCode = defaultCode;
+    scan->softMasking = softMasking;
+    return scan;
+}
+
+void freeTopOrfScan(TopOrfScan* scan)
+{
+    for (int h = 0; scan != NULL && h < scan->numOfHeaps; h++)
+    {
+        free(scan->heaps[h].orfs);
+    }
+    free(scan);
+}
+
+// Starts over, for the next sequence
+void resetTopOrfScan(TopOrfScan* scan)
+{
+    for (int h = 0; h < scan->numOfHeaps; h++) scan->heaps[h].size = 0;
+    memset(scan->frames, 0, sizeof(scan->frames));
+    scan->numOfOrfs = 0;
+    scan->lastMaskedBase = -1;
+    scan->numOfSkippedOrfs = 0;
+}
+
+void addTopOrf(TopOrfScan* scan, direction strand, int frame, int firstBase, int lastBase, int lastStart, bool isSoftMasked)
+{
+    if (isSoftMasked && scan->softMasking == SOFT_MASK_SKIPPED)
+    {
+        scan->numOfSkippedOrfs++;
+        return;
+    }
+    OrfSummary orf = { (lastBase - firstBase + 1) / CODONS_LENGTH, strand, frame, firstBase, lastBase,
+                       lastStart + ((strand == FORWARD) ? 1 : CODONS_LENGTH), isSoftMasked };
+    int heap = (scan->grouping == TOP_ORFS_OVERALL) ? 0 : (scan->grouping == TOP_ORFS_PER_STRAND) ? strand : strand * CODONS_LENGTH + frame;
+    scan->numOfOrfs++;
+    offerToOrfHeap(&scan->heaps[heap], &orf);
+}
+
+void closeReverseTopOrf(TopOrfScan* scan, int frame)
+{
+    FrameScanState* reverse = &scan->frames[REVERSE][frame];
+    if (reverse->hasStop && reverse->hasStart)
+    {
+        addTopOrf(scan, REVERSE, frame, reverse->stopBase, reverse->firstStart + CODONS_LENGTH - 1, reverse->lastStart, reverse->isSoftMasked);
+    }
+    reverse->hasStart = FALSE;
+}
+
+// The codon whose first base is 'base' (in 'frame'), as read on both strands. Its bases are all read, so an ORF that
+// ends (in base order) at it overlaps soft-masked bases if the last of them is at its first base or above
+static inline void scanCodonForTopOrfs(TopOrfScan* scan, int base, int frame, int codonIndex)
+{
+    FrameScanState* forward = &scan->frames[FORWARD][frame];
+    specialCodonType type = (specialCodonType) scan->geneticCode->codonTypes[codonIndex];
+    if (type == START)
+    {
+        if (!forward->hasStart) forward->firstStart = base;
+        forward->hasStart = TRUE;
+        forward->lastStart = base;
+    } else if (type == STOP && forward->hasStart)
+    {
+        addTopOrf(scan, FORWARD, frame, forward->firstStart, base + CODONS_LENGTH - 1, forward->lastStart, scan->lastMaskedBase >= forward->firstStart);
+        forward->hasStart = FALSE;
+    }
+
+    // Streamed against its reading order: the STARTs above a STOP are read before it, the highest first
+    FrameScanState* reverse = &scan->frames[REVERSE][frame];
+    type = (specialCodonType) scan->geneticCode->reverseCodonTypes[codonIndex];
+    if (type == START && reverse->hasStop)
+    {
+        if (!reverse->hasStart) reverse->lastStart = base;
+        reverse->hasStart = TRUE;
+        reverse->firstStart = base;
+        reverse->isSoftMasked = (scan->lastMaskedBase >= reverse->stopBase); // Its highest base is read now
+    } else if (type == STOP)
+    {
+        closeReverseTopOrf(scan, frame);
+        reverse->hasStop = TRUE;
+        reverse->stopBase = base;
+    }
+}
+
+// Streams the next sequence of a file (up to the next FASTA header) through the scan. Lower case and DNA (T) are
+// read like the analysis' input; other characters break the codons they are in. Codons are read with the genetic code
+// that the header names, if any. Returns FALSE at the end of the file
+bool scanNextSequenceForTopOrfs(FILE* output_stream, FILE* file, TopOrfScan* scan, char** name, long* numOfBases, long* numOfInvalid)
+{
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t numOfRead;
+    bool hasSequence = FALSE;
+    int codonIndex = 0, numOfValid = 0, frame = 1; // Frame of the codon that ends at the next base, i.e. (base - 2) % 3
+    int base = 0;
+    *name = NULL;
+    *numOfBases = *numOfInvalid = 0;
+    resetTopOrfScan(scan);
+    scan->geneticCode = scan->defaultCode;
+    while (TRUE)
+    {
+        int next = fgetc(file);
+        if (next == EOF) break;
+        ungetc(next, file);
+        if (next == '>' && hasSequence) break; // Header of the next sequence
+        if ((numOfRead = getline(&line, &lineCapacity, file)) == -1) break;
+        if (line[0] == '>')
+        {
+            *name = strndup(line + 1, strcspn(line + 1, " \t\r\n"));
+            scan->geneticCode = getGeneticCodeOfRecord(output_stream, line, *name, scan->defaultCode);
+            hasSequence = TRUE;
+            continue;
+        }
+        for (ssize_t i = 0; i < numOfRead; i++)
+        {
+            if (isspace((unsigned char) line[i])) continue;
+            int code = getBaseCode(line[i]);
+            if (code < 0)
+            {
+                char upper = (char) toupper((unsigned char) line[i]);
+                code = getBaseCode(upper == 'T' ? 'U' : upper);
+            }
+            if (islower((unsigned char) line[i])) scan->lastMaskedBase = base;
+            if (code < 0)
+            {
+                numOfValid = 0;
+                (*numOfInvalid)++;
+            } else
+            {
+                codonIndex = ((codonIndex << 2) | code) & (NUM_OF_CODON_INDEXES - 1);
+                if (++numOfValid >= CODONS_LENGTH) scanCodonForTopOrfs(scan, base - (CODONS_LENGTH - 1), frame, codonIndex);
+            }
+            frame = (frame == CODONS_LENGTH - 1) ? 0 : frame + 1;
+            base++;
+            hasSequence = TRUE;
+        }
+    }
+    free(line);
+    for (int f = 0; f < CODONS_LENGTH; f++)
+    {
+        closeReverseTopOrf(scan, f); // Reading the reverse strand starts at the end of the sequence
+    }
+    *numOfBases = base;
+    return hasSequence;
+}
+
+void printTopOrfs(FILE* report, const char* name, TopOrfScan* scan)
+{
+    for (int h = 0; h < scan->numOfHeaps; h++)
+    {
+        OrfHeap* heap = &scan->heaps[h];
+        qsort(heap->orfs, heap->size, sizeof(OrfSummary), compareOrfRanks);
+        for (int i = 0; i < heap->size; i++)
+        {
+            OrfSummary* orf = &heap->orfs[i];
+            fprintf(report, "%s\t%d\t%s\t%d\t%d\t%d\t%d\t%d", name, i + 1, (orf->strand == FORWARD) ? "+" : "-", orf->frame,
+                    orf->firstBase + 1, orf->lastBase + 1, orf->position, orf->numOfCodons);
+            if (scan->softMasking == SOFT_MASK_FLAGGED) fprintf(report, "\t%s", orf->isSoftMasked ? "YES" : "NO");
+            fputc('\n', report);
+        }
+        heap->size = 0; // Sorted, so no longer a heap
+    }
+}
+
+// Reads a sequence (typed in, or a FASTA file that may hold many, e.g. a genome) and reports the K longest ORFs of each.
+// Those overlapping soft-masked (lower case) bases are marked in a MASKED column, or left out, as 'softMasking' says
+void findTopOrfs(FILE* output_stream, const GeneticCode* defaultCode, softMaskMode softMasking)
+{
+    int length;
+    char* input = readInputLine(output_stream, "Sequence, or the path of a file (FASTA or plain) holding one or more:", &length);
+    if (input == NULL) return;
+    int k = readQueryNumber(output_stream, "How many of the longest ORFs (K):");
+    char grouping[QUERY_INPUT_SIZE];
+    readQueryToken(output_stream, "Longest overall (a), per strand (s), or per frame (f):", grouping);
+    char* reportPath = (k > 0) ? readInputLine(output_stream, "Report file (- for the screen):", &length) : NULL;
+    if (k <= 0) fprintf(output_stream, ERROR_COLOR "K must be a positive number.\a\n" RESET);
+
+    FILE* file = (reportPath != NULL) ? fopen(input, "r") : NULL;
+    const char* defaultName = (file != NULL) ? input : "input";
+    if (reportPath != NULL && file == NULL) file = fmemopen(input, strlen(input), "r"); // Typed in: streamed from memory all the same
+    FILE* report = NULL;
+    if (file != NULL)
+    {
+        report = (strcmp(reportPath, "-") == 0) ? output_stream : fopen(reportPath, "w");
+        if (report == NULL) fprintf(output_stream, ERROR_COLOR "Couldn't open the report file %s.\n%s\a\n" RESET, reportPath, strerror(errno));
+    }
+    TopOrfScan* scan = NULL;
+    if (report != NULL)
+    {
+        scan = createTopOrfScan(k, (tolower(grouping[0]) == 's') ? TOP_ORFS_PER_STRAND : (tolower(grouping[0]) == 'f') ? TOP_ORFS_PER_FRAME : TOP_ORFS_OVERALL, defaultCode, softMasking);
+        if (scan == NULL) fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for %d ORFs.\n%s\a\n" RESET, k, strerror(errno));
+    }
+
+    if (scan != NULL)
+    {
+        struct timespec startTime, endTime;
+        clock_gettime(CLOCK_MONOTONIC, &startTime);
+        char* name;
+        long numOfBases, numOfInvalid, totalBases = 0, totalOrfs = 0;
+        int numOfSequences = 0;
+        if (report == output_stream) fprintf(output_stream, BOLD "\nLongest ORFs\n" RESET);
+        fprintf(report, "#SEQUENCE\tRANK\tSTRAND\tFRAME\tFIRST\tLAST\tSTART\tCODONS%s\n", (softMasking == SOFT_MASK_FLAGGED) ? "\tMASKED" : "");
+        while (scanNextSequenceForTopOrfs(output_stream, file, scan, &name, &numOfBases, &numOfInvalid))
+        {
+            printTopOrfs(report, (name != NULL) ? name : defaultName, scan);
+            if (scan->geneticCode != scan->defaultCode)
+            {
+                fprintf(output_stream, DIM "%s: read with genetic code %d (%s).\n" RESET, (name != NULL) ? name : defaultName, scan->geneticCode->id, scan->geneticCode->name);
+            }
+            if (numOfInvalid > 0)
+            {
+                fprintf(output_stream, DIM "%s: %ld of %ld bases aren't A/C/G/U (or T), so no codon was read across them.\n" RESET,
+                        (name != NULL) ? name : defaultName, numOfInvalid, numOfBases);
+            }
+            if (scan->numOfSkippedOrfs > 0)
+            {
+                fprintf(output_stream, DIM "%s: %ld ORF(s) overlapping soft-masked (lower case) bases left out.\n" RESET,
+                        (name != NULL) ? name : defaultName, scan->numOfSkippedOrfs);
+            }
+            totalBases += numOfBases;
+            totalOrfs += scan->numOfOrfs;
+            numOfSequences++;
+            free(name);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &endTime);
+        fprintf(output_stream, DIM "%d sequence(s), %ld bases, %ld ORFs in the 6 frames, streamed in %.1f ms keeping at most %d ORF(s) (%zu bytes).\n" RESET,
+                numOfSequences, totalBases, totalOrfs, millisecondsBetween(&startTime, &endTime),
+                k * scan->numOfHeaps, sizeof(OrfSummary) * k * scan->numOfHeaps);
+    }
+
+    if (report != NULL && report != output_stream) fclose(report);
+    if (file != NULL) fclose(file);
+    freeTopOrfScan(scan);
+    free(reportPath);
+    free(input);
+}
+
+
+
+
+// ****************************************************  Coding potential functions  ***************************************************
+
+// Every START...STOP stretch is an ORF, but most of them (above all the short ones) aren't genes. With a trained
+// model, each ORF gets a coding score: how much more likely its bases are under a 5th-order Markov chain of coding
+// sequence (one per codon position, since genes are read in codons) than under one of non-coding sequence, in bits
+// per codon. ORFs that score at least the threshold are taken as coding. The model file keeps the training counts of
+// every 6-base word (5 bases of context and the next base); they are turned into one flat table of log-odds at load
+#define MARKOV_ORDER 5
+#define MARKOV_WORD_LENGTH (MARKOV_ORDER + 1)
+#define MARKOV_NUM_OF_WORDS (1 << (2 * MARKOV_WORD_LENGTH))
+#define CODING_MODEL_HEADER "#WORD\tCODING_1\tCODING_2\tCODING_3\tNONCODING"
+
+typedef struct
+{
+    long coding[CODONS_LENGTH][MARKOV_NUM_OF_WORDS];    // By codon position of the word's last base
+    long nonCoding[MARKOV_NUM_OF_WORDS];
+} CodingModelCounts;
+
+typedef struct
+{
+    float logOdds[CODONS_LENGTH][MARKOV_NUM_OF_WORDS];  // log2 P(base | context) coding, minus non-coding
+} CodingModel;
+
+// Counts the words of 'bases' (in RNA letters) by codon position, counted from the first base, and/or all together.
+// Other letters aren't counted, nor the words they are in
+void countMarkovWords(const char* bases, int length, long (*byCodonPosition)[MARKOV_NUM_OF_WORDS], long* pooled)
+{
+    int word = 0, numOfValid = 0;
+    for (int i = 0; i < length; i++)
+    {
+        int code = getBaseCode(bases[i]);
+        if (code < 0)
+        {
+            numOfValid = 0;
+            continue;
+        }
+        word = ((word << 2) | code) & (MARKOV_NUM_OF_WORDS - 1);
+        if (++numOfValid < MARKOV_WORD_LENGTH) continue;
+        if (byCodonPosition != NULL) byCodonPosition[i % CODONS_LENGTH][word]++;
+        if (pooled != NULL) pooled[word]++;
+    }
+}
+
+// Conditional probabilities with one pseudocount per word, so that words never seen in training aren't impossible
+CodingModel* buildCodingModel(const CodingModelCounts* counts)
+{
+    CodingModel* model = (CodingModel*) malloc(sizeof(CodingModel));
+    if (model == NULL) return NULL;
+    for (int context = 0; context < MARKOV_NUM_OF_WORDS / 4; context++)
+    {
+        long nonCodingTotal = 4;
+        for (int code = 0; code < 4; code++) nonCodingTotal += counts->nonCoding[(context << 2) | code];
+        for (int position = 0; position < CODONS_LENGTH; position++)
+        {
+            long codingTotal = 4;
+            for (int code = 0; code < 4; code++) codingTotal += counts->coding[position][(context << 2) | code];
+            for (int code = 0; code < 4; code++)
+            {
+                int word = (context << 2) | code;
+                model->logOdds[position][word] = (float) (log2((counts->coding[position][word] + 1.0) / codingTotal)
+                                                        - log2((counts->nonCoding[word] + 1.0) / nonCodingTotal));
+            }
+        }
+    }
+    return model;
+}
 
-	givenAndReversedSeq[0] = forwardSequence;
-	givenAndReversedSeq[1] = backwardSequence;
-	// TODO: decide when it's a good time to free the allocated memory
-  	// free(codons);
-  	// Free allocated memory later in the code when no longer needed
-	// for (int i = 0; i < 2; i++) {
-	//     free(givenAndReversedSeq[i]); // Free each Sequence struct
-	// }
-	// free(givenAndReversedSeq); // Free the array of pointers
-	
-	return givenAndReversedSeq;
+// Score of 'length' bases read from 'first' on, forwards (step 1) or backwards (step -1), the first being a codon's first
+double getCodingScoreOfBases(const CodingModel* model, const char* sequence, int first, int step, int length)
+{
+    float sums[CODONS_LENGTH] = { 0 }; // One per codon position, so that the additions don't wait on each other
+    int word = 0, numOfValid = 0;
+    const char* base = sequence + first;
+    for (int codon = 0; codon < length / CODONS_LENGTH; codon++)
+    {
+        for (int position = 0; position < CODONS_LENGTH; position++, base += step)
+        {
+            int code = getBaseCode(*base);
+            numOfValid = (code < 0) ? 0 : numOfValid + 1;
+            word = ((word << 2) | (code & 3)) & (MARKOV_NUM_OF_WORDS - 1);
+            sums[position] += (numOfValid >= MARKOV_WORD_LENGTH) ? model->logOdds[position][word] : 0.0f;
+        }
+    }
+    return (length >= CODONS_LENGTH) ? (sums[0] + sums[1] + sums[2]) / (length / CODONS_LENGTH) : 0.0;
 }
 
-DoublyLinkedList* find_all_sequences(FILE* output_stream, int numOfRuns, char* sequence, int sequenceLength) {
+// An ORF of 'sequence' is read from its first codon on, backwards for the reverse strand
+double getCodingScore(const CodingModel* model, const char* sequence, Sequence* orf)
+{
+    int first = orf->specialCodons[0].positionInSequence - 1; // Forward: the codon's first base; reverse: its last
+    return getCodingScoreOfBases(model, sequence, first, (orf->seqDirection == FORWARD) ? 1 : -1, orf->length);
+}
 
-	Sequence** givenAndReversedSeq = tokenize_seq(output_stream, numOfRuns, sequence, sequenceLength);
-	DoublyLinkedList* validSequencesList = createList();
+// Scores of the ORFs, in list order; NULL if out of memory
+double* scoreCodingPotential(const CodingModel* model, DoublyLinkedList* orfs, const char* sequence)
+{
+    double* scores = (double*) malloc(sizeof(double) * (orfs->size + 1));
+    if (scores == NULL) return NULL;
+    int i = 0;
+    for (ListNode* current = orfs->head; current != NULL; current = current->next)
+    {
+        scores[i++] = getCodingScore(model, sequence, current->data);
+    }
+    return scores;
+}
 
-	Sequence* newValidSequence;
+void setCodingSequenceFlags(DoublyLinkedList* orfs, const double* scores, double threshold)
+{
+    int i = 0;
+    for (ListNode* current = orfs->head; current != NULL; current = current->next)
+    {
+        current->data->isCodingSequence = (scores[i++] >= threshold);
+    }
+}
 
-	SpecialSubsequence* codons = (SpecialSubsequence *) malloc( sizeof(SpecialSubsequence) );
-  	int codonsArraySize = 0;  // Keep track of the current size of the array. Array is dynamically extended in each iteration of the following for-loop
+// The coding flags of an analysis depend on the model and threshold, so their hash goes into the analysis hash:
+// results archived with another model (or none) are not reused
+uint64_t hashCodingModel(const CodingModel* model, double threshold)
+{
+    return hashSequence64((const char*) model->logOdds, sizeof(model->logOdds))
+           ^ (hashSequence64((const char*) &threshold, sizeof(threshold)) * HASH_PRIME_1);
+}
 
-	bool foundStartCodon = FALSE;
-	int positionInSupersequence;
+void printCodingScores(FILE* output_stream, DoublyLinkedList* orfs, const double* scores, double threshold)
+{
+    fprintf(output_stream, BOLD "\nCoding potential\n" RESET);
+    fprintf(output_stream, "ORF\tSTRAND\tPOSITION\tCODONS\tSCORE\tCODING\n");
+    int i = 0, numOfCoding = 0;
+    for (ListNode* current = orfs->head; current != NULL; current = current->next, i++)
+    {
+        bool isCoding = (scores[i] >= threshold);
+        fprintf(output_stream, "%d\t%s\t%d\t%d\t%.3f\t%s\n", i + 1, readDirectionToString(current->data->seqDirection),
+                current->data->positionInSupersequence, current->data->length / CODONS_LENGTH, scores[i], isCoding ? "YES" : "NO");
+        numOfCoding += isCoding;
+    }
+    fprintf(output_stream, DIM "%d of %d ORF(s) score at least %.2f bits per codon, so are taken as coding.\n" RESET, numOfCoding, orfs->size, threshold);
+}
 
-	// *********************     FORWARD SEQUENCE :    ***********************************************************
+bool saveCodingModelCounts(FILE* output_stream, const CodingModelCounts* counts, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't create the model file %s.\n%s\a\n" RESET, path, strerror(errno));
+        return FALSE;
+    }
+    fprintf(file, "# Coding model: counts of %d-base words by the codon position (1-3) of their last base, in genes, and in non-coding sequence\n", MARKOV_WORD_LENGTH);
+    fprintf(file, CODING_MODEL_HEADER "\n");
+    for (int word = 0; word < MARKOV_NUM_OF_WORDS; word++)
+    {
+        char bases[MARKOV_WORD_LENGTH + 1];
+        for (int i = 0; i < MARKOV_WORD_LENGTH; i++) bases[i] = "ACGU"[(word >> (2 * (MARKOV_WORD_LENGTH - 1 - i))) & 3];
+        bases[MARKOV_WORD_LENGTH] = '\0';
+        fprintf(file, "%s\t%ld\t%ld\t%ld\t%ld\n", bases, counts->coding[0][word], counts->coding[1][word], counts->coding[2][word], counts->nonCoding[word]);
+    }
+    if (fclose(file) != 0)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't write the model file %s.\n%s\a\n" RESET, path, strerror(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
 
-	for (int i = 0; i < givenAndReversedSeq[0]->length/CODONS_LENGTH; i++)
-	{
+// Model of a file written by trainCodingModel(); NULL (with a message) if it can't be read
+CodingModel* loadCodingModel(FILE* output_stream, const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't open the model file %s.\n%s\a\n" RESET, path, strerror(errno));
+        return NULL;
+    }
+    CodingModelCounts* counts = (CodingModelCounts*) calloc(1, sizeof(CodingModelCounts));
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    int lineNumber = 0;
+    bool isValid = (counts != NULL);
+    while (isValid && getline(&line, &lineCapacity, file) != -1)
+    {
+        lineNumber++;
+        if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') continue;
+        char bases[MARKOV_WORD_LENGTH + 2];
+        long coding[CODONS_LENGTH], nonCoding;
+        int word = 0;
+        isValid = (sscanf(line, "%7s %ld %ld %ld %ld", bases, &coding[0], &coding[1], &coding[2], &nonCoding) == 5)
+                  && strlen(bases) == MARKOV_WORD_LENGTH && coding[0] >= 0 && coding[1] >= 0 && coding[2] >= 0 && nonCoding >= 0;
+        for (int i = 0; isValid && i < MARKOV_WORD_LENGTH; i++)
+        {
+            int code = getBaseCode(bases[i]);
+            isValid = (code >= 0);
+            word = (word << 2) | code;
+        }
+        if (!isValid)
+        {
+            fprintf(output_stream, ERROR_COLOR "Line %d of the model file %s isn't a %d-base word followed by 4 counts.\a\n" RESET, lineNumber, path, MARKOV_WORD_LENGTH);
+            break;
+        }
+        for (int position = 0; position < CODONS_LENGTH; position++) counts->coding[position][word] = coding[position];
+        counts->nonCoding[word] = nonCoding;
+    }
+    free(line);
+    fclose(file);
+    CodingModel* model = isValid ? buildCodingModel(counts) : NULL;
+    if (isValid && model == NULL) fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the coding model.\n%s\a\n" RESET, strerror(errno));
+    free(counts);
+    return model;
+}
 
-		if ( givenAndReversedSeq[0]->specialCodons[i].type == START )
-		{
-			foundStartCodon = TRUE;
-			positionInSupersequence = givenAndReversedSeq[0]->specialCodons[i].positionInSequence; // TODO: doesn't give the super-sequence's position, but newValidSeq's. Change that! ---> Most probably SOLVED!
-		}
+// Counts the words of every record of a FASTA file (DNA or RNA), as genes (read from their first base) or not
+int countMarkovWordsOfFile(FILE* output_stream, const char* path, CodingModelCounts* counts, bool areGenes, bool poolGenes, long* numOfBases)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't open %s.\n%s\a\n" RESET, path, strerror(errno));
+        return -1;
+    }
+    char* name;
+    char* bases;
+    int length, numOfRecords = 0;
+    while ((bases = readFastaRecord(file, &name, NULL, &length)) != NULL)
+    {
+        dnaToRna(bases);
+        countMarkovWords(bases, length, areGenes ? counts->coding : NULL, (!areGenes || poolGenes) ? counts->nonCoding : NULL);
+        *numOfBases += length;
+        numOfRecords++;
+        free(name);
+        free(bases);
+    }
+    fclose(file);
+    return numOfRecords;
+}
 
-		if (foundStartCodon)
-		{
-			
-			// Reallocate memory for the codons' array to hold one more element
-	        codons = realloc(codons, (codonsArraySize + 1) * sizeof(SpecialSubsequence));
-	        if (codons == NULL)
-	        {
-	            fprintf(output_stream, ERROR_COLOR "Memory allocation failed. Couldn't store codon to the list of sequence's codons.\n%s\a\n" RESET, strerror(errno));
-	            return NULL; // TODO: do not exit, but return to main menu, after flushing all allocated memory
-	        }
-	        codons[codonsArraySize] = givenAndReversedSeq[0]->specialCodons[i];
-			codonsArraySize++;
-
-			if ( givenAndReversedSeq[0]->specialCodons[i].type == STOP )
-			{
+// Run with: <program> --train-coding-model <genes FASTA> <model file> [non-coding FASTA]
+// Without non-coding sequence, the genes' own words, whatever their codon position, stand for it: the model then
+// scores how much a stretch reads like genes in the frame it's read in
+bool trainCodingModel(FILE* output_stream, const char* genesPath, const char* modelPath, const char* nonCodingPath)
+{
+    CodingModelCounts* counts = (CodingModelCounts*) calloc(1, sizeof(CodingModelCounts));
+    if (counts == NULL)
+    {
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the model's counts.\n%s\a\n" RESET, strerror(errno));
+        return FALSE;
+    }
+    long numOfGeneBases = 0, numOfNonCodingBases = 0;
+    int numOfGenes = countMarkovWordsOfFile(output_stream, genesPath, counts, TRUE, nonCodingPath == NULL, &numOfGeneBases);
+    int numOfNonCoding = (nonCodingPath != NULL && numOfGenes > 0) ? countMarkovWordsOfFile(output_stream, nonCodingPath, counts, FALSE, FALSE, &numOfNonCodingBases) : 0;
+    bool isTrained = (numOfGenes > 0 && numOfNonCoding >= 0);
+    if (numOfGenes == 0) fprintf(output_stream, ERROR_COLOR "%s has no sequences to train on.\a\n" RESET, genesPath);
+    if (isTrained) isTrained = saveCodingModelCounts(output_stream, counts, modelPath);
+
+    // How the genes themselves score, as a check of the model and a hint for the threshold
+    CodingModel* model = isTrained ? buildCodingModel(counts) : NULL;
+    FILE* file = (model != NULL) ? fopen(genesPath, "r") : NULL;
+    if (file != NULL)
+    {
+        char* name;
+        char* bases;
+        int length, numOfPositive = 0;
+        double sumOfScores = 0.0;
+        while ((bases = readFastaRecord(file, &name, NULL, &length)) != NULL)
+        {
+            dnaToRna(bases);
+            double score = getCodingScoreOfBases(model, bases, 0, 1, length);
+            sumOfScores += score;
+            numOfPositive += (score >= 0.0);
+            free(name);
+            free(bases);
+        }
+        fclose(file);
+        fprintf(output_stream, SUCCESS_COLOR "Trained an order-%d Markov model on %d gene(s) (%ld bases)", MARKOV_ORDER, numOfGenes, numOfGeneBases);
+        if (nonCodingPath != NULL) fprintf(output_stream, " and %d non-coding sequence(s) (%ld bases)", numOfNonCoding, numOfNonCodingBases);
+        fprintf(output_stream, ", saved to %s.\n" RESET, modelPath);
+        fprintf(output_stream, DIM "The genes score %.3f bits per codon on average; %d of %d score at least 0.\n" RESET,
+                sumOfScores / numOfGenes, numOfPositive, numOfGenes);
+    }
+    free(model);
+    free(counts);
+    return isTrained;
+}
 
-				// Found a valid sequence, so we create the struct that will kepp its info and we store it to the array with all valid sequences
-				newValidSequence = createSequence2(codonsArraySize*CODONS_LENGTH, givenAndReversedSeq[0]->seqDirection, positionInSupersequence, TRUE, codons, codonsArraySize);
-				appendToList(validSequencesList, newValidSequence);
-				foundStartCodon = FALSE;
-				codonsArraySize = 0;
-				free(codons);
-				codons = (SpecialSubsequence *) malloc( sizeof(SpecialSubsequence) );
 
-			}
-		}
-	}
 
-		
-	// *********************     BACKWARD SEQUENCE :    ***********************************************************
 
-	free(codons);
-	codons = (SpecialSubsequence *) malloc( sizeof(SpecialSubsequence) );
-  	codonsArraySize = 0; 
-	foundStartCodon = FALSE;
+// ****************************************************  Translation functions  ***************************************************
 
-	for (int i = 0; i < givenAndReversedSeq[1]->length/CODONS_LENGTH; i++)
-	{
+// Proteins as FASTA: of every ORF of an analysis, or of whole sequences (e.g. genomes) in all six frames. Codons are
+// looked up straight from the bases, in a table with one amino acid per codon index (see codonToIndex()); the
+// reverse strand is read backwards, like everywhere else here
+#define PROTEIN_LINE_LENGTH 60
+#define INVALID_BASE_CODE 4
+#define NUM_OF_TRANSLATION_INDEXES 125      // Codons of 5 symbols: the 4 bases and any other letter
 
-		if ( givenAndReversedSeq[1]->specialCodons[i].type == START )
-		{
-			foundStartCodon = TRUE;
-			positionInSupersequence = givenAndReversedSeq[1]->specialCodons[i].positionInSequence;
-		}
+// The amino acid of every codon of the symbols 0-4, X for those with another letter (INVALID_BASE_CODE) than A/C/G/U
+void buildTranslationTable(const GeneticCode* geneticCode, char* translationTable)
+{
+    for (int i = 0; i < NUM_OF_TRANSLATION_INDEXES; i++)
+    {
+        int first = i / 25, second = (i / 5) % 5, third = i % 5;
+        bool isValid = (first != INVALID_BASE_CODE && second != INVALID_BASE_CODE && third != INVALID_BASE_CODE);
+        translationTable[i] = isValid ? geneticCode->aminoAcids[(first << 4) | (second << 2) | third] : 'X';
+    }
+}
 
-		if (foundStartCodon)
-		{
-			
-			// Reallocate memory for the codons' array to hold one more element
-	        codons = realloc(codons, (codonsArraySize + 1) * sizeof(SpecialSubsequence));
-	        if (codons == NULL)
-	        {
-	            fprintf(output_stream, ERROR_COLOR "Memory allocation failed. Couldn't store codon to the list of sequence's codons.\n%s\a\n" RESET, strerror(errno));
-	            return NULL; // TODO: do not exit, but return to main menu, after flushing all allocated memory
-	        }
-	        codons[codonsArraySize] = givenAndReversedSeq[1]->specialCodons[i];
-			codonsArraySize++;
-
-			if ( givenAndReversedSeq[1]->specialCodons[i].type == STOP )
-			{
+// Protein of an ORF of 'sequence', from its first codon (a START, so read as M) up to its STOP (left out)
+void translateOrf(const GeneticCode* geneticCode, const char* sequence, Sequence* orf, char* protein)
+{
+    int numOfCodons = orf->length / CODONS_LENGTH;
+    int first = orf->specialCodons[0].positionInSequence - 1; // Forward: the codon's first base; reverse: its last
+    for (int i = 0; i < numOfCodons; i++)
+    {
+        int codonIndex = (orf->seqDirection == FORWARD) ? codonToIndex(&sequence[first + CODONS_LENGTH * i])
+                                                        : reverseCodonIndex(codonToIndex(&sequence[first - CODONS_LENGTH * i - (CODONS_LENGTH - 1)]));
+        protein[i] = (codonIndex < 0) ? 'X' : geneticCode->aminoAcids[codonIndex];
+    }
+    if (numOfCodons > 0) protein[0] = 'M';
+    if (numOfCodons > 0 && protein[numOfCodons - 1] == '*') numOfCodons--;
+    protein[numOfCodons] = '\0';
+}
 
-				// Found a valid sequence, so we create the struct that will kepp its info and we store it to the array with all valid sequences
-				newValidSequence = createSequence2(codonsArraySize*CODONS_LENGTH, givenAndReversedSeq[1]->seqDirection, positionInSupersequence, TRUE, codons, codonsArraySize);
-				appendToList(validSequencesList, newValidSequence);
-				foundStartCodon = FALSE;
-				codonsArraySize = 0;
-				free(codons);
-				codons = (SpecialSubsequence *) malloc( sizeof(SpecialSubsequence) );
-			}
-		}		
-	}
+void writeFastaSequence(FILE* file, const char* residues, int length)
+{
+    for (int i = 0; i < length; i += PROTEIN_LINE_LENGTH)
+    {
+        fwrite(residues + i, 1, (length - i < PROTEIN_LINE_LENGTH) ? length - i : PROTEIN_LINE_LENGTH, file);
+        fputc('\n', file);
+    }
+}
 
-	return validSequencesList;
+// Proteins of an analysis' ORFs, named after the sequence's hash and the ORF's number as listed
+void writeOrfProteins(FILE* proteins, const GeneticCode* geneticCode, DoublyLinkedList* orfs, const char* sequence, uint64_t sequenceHash)
+{
+    int longest = 0;
+    for (ListNode* current = orfs->head; current != NULL; current = current->next)
+    {
+        if (current->data->length > longest) longest = current->data->length;
+    }
+    char* protein = (char*) malloc(longest / CODONS_LENGTH + 1);
+    if (protein == NULL) return;
+    int i = 0;
+    for (ListNode* current = orfs->head; current != NULL; current = current->next)
+    {
+        Sequence* orf = current->data;
+        translateOrf(geneticCode, sequence, orf, protein);
+        fprintf(proteins, ">%016" PRIx64 "_ORF%d strand=%s position=%d codons=%d\n", sequenceHash, ++i,
+                readDirectionToString(orf->seqDirection), orf->positionInSupersequence, orf->length / CODONS_LENGTH);
+        writeFastaSequence(proteins, protein, (int) strlen(protein));
+    }
+    fflush(proteins);
+    free(protein);
 }
 
+// One frame of 'codes' (of symbols 0-4), codon after codon; reverse frames are read from the end, each codon backwards.
+// Frame f holds the codons whose lowest base is at f, f+3, ... Returns the number of amino acids
+int translateFrame(const unsigned char* codes, int length, const char* translationTable, direction strand, int frame, char* protein)
+{
+    int numOfCodons = (length > frame) ? (length - frame) / CODONS_LENGTH : 0;
+    if (strand == FORWARD)
+    {
+        const unsigned char* codon = codes + frame;
+        for (int i = 0; i < numOfCodons; i++, codon += CODONS_LENGTH)
+        {
+            protein[i] = translationTable[codon[0] * 25 + codon[1] * 5 + codon[2]];
+        }
+    } else
+    {
+        const unsigned char* codon = codes + frame + CODONS_LENGTH * (numOfCodons - 1);
+        for (int i = 0; i < numOfCodons; i++, codon -= CODONS_LENGTH)
+        {
+            protein[i] = translationTable[codon[2] * 25 + codon[1] * 5 + codon[0]];
+        }
+    }
+    return numOfCodons;
+}
 
+// Reads sequences (typed in, or a FASTA file that may hold many, e.g. a genome) and writes their six-frame translations,
+// each with the genetic code its header names, or else with 'defaultCode'
+void translateSixFrames(FILE* output_stream, const GeneticCode* defaultCode)
+{
+    int length;
+    char* input = readInputLine(output_stream, "Sequence, or the path of a file (FASTA or plain) holding one or more:", &length);
+    if (input == NULL) return;
+    char* proteinsPath = readInputLine(output_stream, "Proteins file (FASTA, - for the screen):", &length);
+    FILE* file = (proteinsPath != NULL) ? fopen(input, "r") : NULL;
+    const char* defaultName = (file != NULL) ? input : "input";
+    if (proteinsPath != NULL && file == NULL) file = fmemopen(input, strlen(input), "r"); // Typed in: read from memory all the same
+    FILE* proteins = NULL;
+    if (file != NULL)
+    {
+        proteins = (strcmp(proteinsPath, "-") == 0) ? output_stream : fopen(proteinsPath, "w");
+        if (proteins == NULL) fprintf(output_stream, ERROR_COLOR "Couldn't open the proteins file %s.\n%s\a\n" RESET, proteinsPath, strerror(errno));
+    }
 
+    char translationTable[NUM_OF_TRANSLATION_INDEXES];
+    const GeneticCode* tableCode = defaultCode; // Whose translation table is built
+    buildTranslationTable(tableCode, translationTable);
+    unsigned char baseCodes[256]; // Lower case and DNA (T) too
+    for (int i = 0; i < 256; i++)
+    {
+        int code = getBaseCode((char) ((toupper(i) == 'T') ? 'U' : toupper(i)));
+        baseCodes[i] = (code < 0) ? INVALID_BASE_CODE : (unsigned char) code;
+    }
+    struct timespec startTime, endTime, translatedTime;
+    double translationTime = 0.0;
+    long totalBases = 0, totalAminoAcids = 0;
+    int numOfSequences = 0;
+    char* name;
+    char* header;
+    char* bases;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    while (proteins != NULL && (bases = readFastaRecord(file, &name, &header, &length)) != NULL)
+    {
+        const GeneticCode* geneticCode = getGeneticCodeOfRecord(output_stream, header, (name != NULL) ? name : defaultName, defaultCode);
+        free(header);
+        if (geneticCode != tableCode)
+        {
+            tableCode = geneticCode;
+            buildTranslationTable(tableCode, translationTable);
+        }
+        struct timespec recordTime;
+        clock_gettime(CLOCK_MONOTONIC, &recordTime);
+        char* protein = (char*) malloc(length / CODONS_LENGTH + 1);
+        if (protein == NULL)
+        {
+            fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the proteins of %s.\n%s\a\n" RESET, (name != NULL) ? name : defaultName, strerror(errno));
+            free(name);
+            free(bases);
+            break;
+        }
+        unsigned char* codes = (unsigned char*) bases; // Encoded in place: the letters aren't needed any more
+        for (int i = 0; i < length; i++)
+        {
+            codes[i] = baseCodes[(unsigned char) bases[i]];
+        }
+        for (int strand = FORWARD; strand <= REVERSE; strand++)
+        {
+            for (int frame = 0; frame < CODONS_LENGTH; frame++)
+            {
+                int numOfAminoAcids = translateFrame(codes, length, translationTable, (direction) strand, frame, protein);
+                clock_gettime(CLOCK_MONOTONIC, &translatedTime);
+                translationTime += millisecondsBetween(&recordTime, &translatedTime);
+                fprintf(proteins, ">%s strand=%s frame=%d", (name != NULL) ? name : defaultName, readDirectionToString((direction) strand), frame);
+                if (geneticCode->id != DEFAULT_GENETIC_CODE) fprintf(proteins, " transl_table=%d", geneticCode->id);
+                fputc('\n', proteins);
+                writeFastaSequence(proteins, protein, numOfAminoAcids);
+                totalAminoAcids += numOfAminoAcids;
+                clock_gettime(CLOCK_MONOTONIC, &recordTime);
+            }
+        }
+        totalBases += length;
+        numOfSequences++;
+        free(protein);
+        free(name);
+        free(bases);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+    if (proteins != NULL)
+    {
+        fprintf(output_stream, DIM "%d sequence(s), %ld bases, %ld amino acids in the 6 frames: translated in %.1f ms (%.0f MB/s over the 6 frames), %.1f ms with reading and writing.\n" RESET,
+                numOfSequences, totalBases, totalAminoAcids, translationTime,
+                (translationTime > 0) ? 6.0 * totalBases / (translationTime * 1000.0) : 0.0, millisecondsBetween(&startTime, &endTime));
+    }
 
+    if (proteins != NULL && proteins != output_stream) fclose(proteins);
+    if (file != NULL) fclose(file);
+    free(proteinsPath);
+    free(input);
+}
 
 
 
 
+// ****************************************************  Analysis session functions  ***************************************************
 
+// A newly analyzed sequence goes to the journal, the cache, the codon site index and the history (which takes 'orfs')
+void recordNewAnalysis(FILE* output_stream, ArchiveJournal* sessionJournal, AnalysisCache* analysisCache, CodonSiteCatalog* codonSiteCatalog,
+                       OrfStore* history, HistoryIndex** historyIndex, const char* sequence, int sequenceLength, const GeneticCode* geneticCode,
+                       uint64_t sequenceHash, DoublyLinkedList* orfs)
+{
+    appendToArchiveJournal(sessionJournal, sequenceHash, sequenceLength, orfs);
+    insertNewAnalysisIntoCache(analysisCache, sequenceHash, sequenceLength, orfs->size);
+    CodonSiteIndex* codonSites = buildCodonSiteIndex(sequence, sequenceLength, sequenceHash, geneticCode);
+    appendCodonSiteIndex(output_stream, codonSiteCatalog, codonSites);
+    freeCodonSiteIndex(codonSites);
+    appendListToOrfStore(history, orfs);
+    freeHistoryIndex(*historyIndex); // Rebuilt on its next use
+    *historyIndex = NULL;
+}
 
+// Rewrites the active shard with the session's results, then drops the journal; seals the shard once it's full
+void saveAnalysisSession(FILE* output_stream, const char* archivePath, ArchiveManifest* archiveManifest, OrfStore* history, int* numOfSealedRecords,
+                         ArchiveJournal* sessionJournal, AnalysisCache* analysisCache, const char* analysisCachePath)
+{
+    syncArchiveJournal(sessionJournal);
+    char* analysisSessionJSON = serializeOrfStoreToJson(output_stream, history, *numOfSealedRecords); // Only the active shard is rewritten
+    int isSuccessfullySaved = saveJsonToFileAtomically(output_stream, archivePath, analysisSessionJSON);
+    if (!isSuccessfullySaved)
+    {
+        fprintf(output_stream, ERROR_COLOR "\aCouldn't save this sequence analysis session to the archive file (in JSON format)" RESET);
+    }
+    closeArchiveJournal(output_stream, sessionJournal, isSuccessfullySaved); // On failure the journal stays, to be recovered on next start
+    if (isSuccessfullySaved && activeShardIsFull(archivePath)
+        && sealActiveShard(output_stream, archivePath, archiveManifest, history, numOfSealedRecords))
+    {
+        moveActiveShardOfAnalysisCache(analysisCache, archiveManifest->shards[archiveManifest->numOfShards - 1].id);
+    }
+    saveAnalysisCache(output_stream, analysisCache, analysisCachePath);
+    free(analysisSessionJSON);
+}
 
 
 
@@ -873,13 +9108,62 @@ DoublyLinkedList* find_all_sequences(FILE* output_stream, int numOfRuns, char* s
 
 int main(int argc, char const *argv[])
 {
+    initGeneticCodes(); // Before any thread is started, so the tables are only ever read concurrently
 
-    FILE *output_stream = NULL, *archiveFile = NULL;
-    DoublyLinkedList* historyListOfSequences;
+    FILE *output_stream = NULL;
+    OrfStore* historyOfSequences = NULL;
+    HistoryIndex* historyIndex = NULL;
     char* sequence;
 	int maxLengthOfSeq = 0;
 	int menuOption = 0, rerunApp = 0;
 
+    // Options may come anywhere; what's left are the positional arguments
+    bool withCodonUsage = FALSE; // Codon counts, GC and GC3 of every ORF found, as extra output columns
+    int rbsWindow = 0;           // Bases searched for a Shine-Dalgarno motif upstream of each START, 0 for no search
+    int rbsEdits = 0;            // Edits allowed in the Shine-Dalgarno consensus, 0 for exact motifs only
+    const char* motifPath = NULL; // Pattern file whose motifs are looked for in every analyzed sequence
+    const char* codingModelPath = NULL; // Trained model that scores every ORF's coding potential
+    double codingThreshold = 0.0; // Bits per codon from which an ORF is taken as coding
+    const char* proteinsPath = NULL; // FASTA file that gets the protein of every ORF found
+    int geneticCodeId = DEFAULT_GENETIC_CODE; // NCBI table that sequences are read with, unless they name their own
+    const char* softMaskOption = NULL; // What's done with ORFs in soft-masked (lower case) bases: "flag" or "skip"
+    int numOfArguments = 0;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--codon-usage") == 0) withCodonUsage = TRUE;
+        else if (strcmp(argv[i], "--rbs") == 0) rbsWindow = RBS_DEFAULT_WINDOW;
+        else if (strncmp(argv[i], "--rbs=", 6) == 0) rbsWindow = (atoi(argv[i] + 6) > 0) ? atoi(argv[i] + 6) : RBS_DEFAULT_WINDOW;
+        else if (strncmp(argv[i], "--rbs-edits=", 12) == 0) rbsEdits = atoi(argv[i] + 12);
+        else if (strncmp(argv[i], "--motifs=", 9) == 0) motifPath = argv[i] + 9;
+        else if (strncmp(argv[i], "--coding-model=", 15) == 0) codingModelPath = argv[i] + 15;
+        else if (strncmp(argv[i], "--coding-threshold=", 19) == 0) codingThreshold = atof(argv[i] + 19);
+        else if (strncmp(argv[i], "--proteins=", 11) == 0) proteinsPath = argv[i] + 11;
+        else if (strncmp(argv[i], "--genetic-code=", 15) == 0) geneticCodeId = atoi(argv[i] + 15);
+        else if (strncmp(argv[i], "--soft-mask=", 12) == 0) softMaskOption = argv[i] + 12;
+        else argv[numOfArguments++] = argv[i];
+    }
+    argc = numOfArguments;
+    if (rbsEdits < 0 || rbsEdits > RBS_MAX_EDITS) rbsEdits = (rbsEdits < 0) ? 0 : RBS_MAX_EDITS;
+    if (rbsEdits > 0 && rbsWindow == 0) rbsWindow = RBS_DEFAULT_WINDOW;
+    const GeneticCode* sessionCode = getGeneticCode(geneticCodeId);
+    if (sessionCode == NULL)
+    {
+        fprintf(stderr, "Genetic code %d isn't supported. The genetic codes (NCBI translation tables) are:\n", geneticCodeId);
+        printGeneticCodes(stderr);
+        return 1;
+    }
+    softMaskMode softMasking = SOFT_MASK_IGNORED;
+    if (softMaskOption != NULL)
+    {
+        if (strcmp(softMaskOption, "flag") == 0) softMasking = SOFT_MASK_FLAGGED;
+        else if (strcmp(softMaskOption, "skip") == 0) softMasking = SOFT_MASK_SKIPPED;
+        else
+        {
+            fprintf(stderr, "Option --soft-mask takes flag or skip, not %s.\n", softMaskOption);
+            return 1;
+        }
+    }
+
 	// Check if enough arguments are provided
     if (argc < 2)
     {
@@ -887,9 +9171,49 @@ int main(int argc, char const *argv[])
         fprintf(stderr, "Options for <output_stream>: stdout, stderr, or a file path.\n");
         fprintf(stderr, "Argument <archive_file> is optional. It can be any file path. If file doesn't exist, a new one is created.\n");
         fprintf(stderr, "If the optional argument, <archive_file> isn't provided, a new archive file is generated in current directory (%s).\n", argv[0]);
+        fprintf(stderr, "Option --codon-usage adds the codon counts, GC and GC3 of every found ORF (and of the input) to the results.\n");
+        fprintf(stderr, "Option --rbs[=window] looks for a Shine-Dalgarno motif up to 'window' (default %d) bases upstream of every START.\n", RBS_DEFAULT_WINDOW);
+        fprintf(stderr, "Option --rbs-edits=N (up to %d, implies --rbs) also accepts the Shine-Dalgarno consensus with up to N mismatches, insertions or deletions.\n", RBS_MAX_EDITS);
+        fprintf(stderr, "Option --motifs=<pattern_file> also reports where the patterns of the file (IUPAC codes allowed) are found in every analyzed sequence.\n");
+        fprintf(stderr, "Option --coding-model=<model_file> scores the coding potential of every ORF (5th-order Markov model); ORFs that score at least --coding-threshold=X (default 0) bits per codon are taken as coding.\n");
+        fprintf(stderr, "Option --proteins=<FASTA_file> writes the protein of every ORF found to the file.\n");
+        fprintf(stderr, "Option --soft-mask=flag|skip lists, or leaves out, the ORFs that overlap soft-masked (lower case) bases, in the analysis and in the K longest ORFs.\n");
+        fprintf(stderr, "Option --genetic-code=N reads sequences with NCBI translation table N, unless they name their own (transl_table=N in a FASTA header, [transl_table=N] before a typed sequence):\n");
+        printGeneticCodes(stderr);
+        fprintf(stderr, "Training of a coding model from known genes: %s --train-coding-model <genes_FASTA> <model_file> [non-coding_FASTA]\n", argv[0]);
+        fprintf(stderr, "Benchmark of the history containers: %s --benchmark-store [number of ORFs]\n", argv[0]);
+        fprintf(stderr, "Benchmark of approximate motif matching (bit-vector vs dynamic programming): %s --benchmark-motifs [number of bases]\n", argv[0]);
+        fprintf(stderr, "Benchmark of the input's normalization (validation, upper case, T to U, 2-bit packing): %s --benchmark-normalization [number of bases]\n", argv[0]);
         return 1;
     }
 
+    if (strcmp(argv[1], "--benchmark-store") == 0)
+    {
+        benchmarkOrfStore(stdout, (argc > 2 && atoi(argv[2]) > 0) ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (strcmp(argv[1], "--benchmark-motifs") == 0)
+    {
+        benchmarkApproximateMatching(stdout, (argc > 2 && atoi(argv[2]) > 0) ? atoi(argv[2]) : 10000000);
+        return 0;
+    }
+    if (strcmp(argv[1], "--benchmark-normalization") == 0)
+    {
+        benchmarkNormalization(stdout, (argc > 2 && atoi(argv[2]) > 0) ? atoi(argv[2]) : 50000000);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "--train-coding-model") == 0)
+    {
+        if (argc < 4)
+        {
+            fprintf(stderr, "Usage: %s --train-coding-model <genes_FASTA> <model_file> [non-coding_FASTA]\n", argv[0]);
+            return 1;
+        }
+        return trainCodingModel(stdout, argv[2], argv[3], (argc > 4) ? argv[4] : NULL) ? 0 : 1;
+    }
+
+    installJsonArenaHooks();
 
     // Determine the output stream
     if (strcmp(argv[1], "stdout") == 0)
@@ -909,20 +9233,78 @@ int main(int argc, char const *argv[])
         }
     }
 
-    // Check if archive file is provided
-    if (argc > 2)
-    {	
-    	archiveFile = getArchiveFile(output_stream, argv[2], 0, "r");
-    } else
-	{
-		archiveFile = getArchiveFile(output_stream, NULL, 1, "r");
-	}
+    // Patterns looked for in every analyzed sequence, compiled once
+    MotifAutomaton* motifAutomaton = NULL;
+    if (motifPath != NULL)
+    {
+        motifAutomaton = loadMotifAutomaton(output_stream, motifPath);
+        if (motifAutomaton == NULL) return 1;
+    }
+    CodingModel* codingModel = NULL;
+    uint64_t codingModelHash = 0;
+    if (codingModelPath != NULL)
+    {
+        codingModel = loadCodingModel(output_stream, codingModelPath);
+        if (codingModel == NULL) return 1;
+        codingModelHash = hashCodingModel(codingModel, codingThreshold);
+    }
+    FILE* proteinsFile = NULL;
+    if (proteinsPath != NULL)
+    {
+        proteinsFile = fopen(proteinsPath, "w");
+        if (proteinsFile == NULL)
+        {
+            fprintf(output_stream, ERROR_COLOR "Couldn't open the proteins file %s.\n%s\a\n" RESET, proteinsPath, strerror(errno));
+            return 1;
+        }
+    }
 
-    // Retrieve history of sequences' analyses from (JSON) archive file
-    char* historyJSON = readJsonFromFile(output_stream, archiveFile);
-    if (historyJSON != NULL && strlen(historyJSON) != 0)
+    // Retrieve history of sequences' analyses from the (JSON) archive: its sealed shards and the active archive file
+    const char* archivePath = (argc > 2) ? argv[2] : "./ARCHIVE_FILE.txt";
+    ArchiveManifest* archiveManifest = loadArchiveManifest(output_stream, archivePath);
+    if (archiveManifest == NULL)
     {
-		historyListOfSequences = deserializeJsonToList(output_stream, historyJSON);	
+        fprintf(output_stream, ERROR_COLOR "Couldn't allocate memory for the archive manifest.\n%s\a\n" RESET, strerror(errno));
+        return 1;
+    }
+    int numOfSealedRecords = 0; // History = records of sealed shards first, then those of the active shard
+    historyOfSequences = loadShardedArchive(output_stream, archivePath, archiveManifest, &numOfSealedRecords);
+
+    // Results of previously analyzed sequences, so that resubmitting one doesn't rerun (and re-archive) the analysis
+    char* analysisCachePath = getSidecarPath(archivePath, ANALYSIS_CACHE_SUFFIX);
+    AnalysisCache* analysisCache = loadAnalysisCache(output_stream, analysisCachePath, archivePath, archiveManifest, historyOfSequences, &numOfSealedRecords);
+
+    // START/STOP positions of every newly analyzed sequence, for window counts and next-codon queries
+    char* codonSitesPath = getSidecarPath(archivePath, CODON_SITES_SUFFIX);
+    CodonSiteCatalog* codonSiteCatalog = openCodonSiteCatalog(output_stream, codonSitesPath);
+    free(codonSitesPath);
+
+    // A journal left behind means the last session didn't get to rewrite the archive, so its results are recovered now
+    int numOfRecovered = replayArchiveJournal(output_stream, archivePath, historyOfSequences, analysisCache);
+    bool isJournalApplied = TRUE;
+    if (numOfRecovered > 0)
+    {
+    	fprintf(output_stream, SUCCESS_COLOR "Recovered %d ORF(s) of an unfinished session from the archive journal.\n" RESET, numOfRecovered);
+    	char* recoveredJSON = serializeOrfStoreToJson(output_stream, historyOfSequences, numOfSealedRecords);
+    	isJournalApplied = saveJsonToFileAtomically(output_stream, archivePath, recoveredJSON);
+    	if (isJournalApplied)
+    	{
+    		saveAnalysisCache(output_stream, analysisCache, analysisCachePath);
+    	}
+    	free(recoveredJSON);
+    }
+    if (isJournalApplied) // Everything in the journal (if any) is in the archive now
+    {
+    	char* journalPath = getSidecarPath(archivePath, JOURNAL_SUFFIX);
+    	remove(journalPath);
+    	free(journalPath);
+    }
+
+    // Results from an earlier period get their own shard, so that new ones start a fresh active shard
+    if (activeShardIsOld(historyOfSequences, numOfSealedRecords)
+        && sealActiveShard(output_stream, archivePath, archiveManifest, historyOfSequences, &numOfSealedRecords))
+    {
+    	moveActiveShardOfAnalysisCache(analysisCache, archiveManifest->shards[archiveManifest->numOfShards - 1].id);
     }
 
     do
@@ -931,21 +9313,30 @@ int main(int argc, char const *argv[])
 	    fprintf(output_stream, BOLD "\n\n\t\t\t*********************\n\t\t\t\tMENU\n\t\t\t*********************\n\n" );
 	    fprintf(output_stream,  "1. Verify input sequences contain prokaryotic coding sequences.\n" );
 	    fprintf(output_stream,  "2. Show history.\n") ;
-	    fprintf(output_stream,  "3. Exit.\n");
+	    fprintf(output_stream,  "3. Compact the archive (remove duplicate ORFs).\n");
+	    fprintf(output_stream,  "4. Show/drop/compress archive shards.\n");
+	    fprintf(output_stream,  "5. Find ORFs by position (overlapping, nested, containing, nearest).\n");
+	    fprintf(output_stream,  "6. Count START/STOP codons in a range, or find the next one in frame.\n");
+	    fprintf(output_stream,  "7. Re-analyze a sequence after edits (substitutions, insertions, deletions).\n");
+	    fprintf(output_stream,  "8. Report the ORFs that variants (VCF) create, destroy or truncate.\n");
+	    fprintf(output_stream,  "9. Search sequences for motifs (exact or IUPAC patterns from a file).\n");
+	    fprintf(output_stream,  "10. Find the K longest ORFs of a sequence or genome (FASTA), in all six frames.\n");
+	    fprintf(output_stream,  "11. Translate a sequence or genome (FASTA) to proteins, in all six frames.\n");
+	    fprintf(output_stream,  "%d. Exit.\n", MENU_EXIT);
 	    fprintf(output_stream, "----------------------------------------------------------------------" RESET);
 	    fprintf(output_stream,  LIGHT_BLUE_BG_WHITE_TEXT "\n\nYour input:\t");
 	    scanf("%d", &menuOption);
 	    fprintf(output_stream,  RESET "\n"); // Reset colors
 
-	    while (menuOption < 1 || menuOption > 3)
+	    while (menuOption < MENU_ANALYZE || menuOption > MENU_EXIT)
 	    {
-	    	fprintf(output_stream, ERROR_COLOR "\aThe number you entered doesn't correspond to any menu option.\nChoose one of the menu options (1-3)" RESET);
+	    	fprintf(output_stream, ERROR_COLOR "\aThe number you entered doesn't correspond to any menu option.\nChoose one of the menu options (1-%d)" RESET, MENU_EXIT);
 	    	fprintf(output_stream,  LIGHT_BLUE_BG_WHITE_TEXT "\n\nYour input:\t");
 	    	scanf("%d", &menuOption);
 	    	fprintf(output_stream,  RESET "\n"); // Reset colors
 	    }
 
-	    if (menuOption == 1)
+	    if (menuOption == MENU_ANALYZE)
 	    {
 	    	fprintf(output_stream, DIM "Before we begin, please enter the maximum length that a sequence can have:\t" RESET);
 	    	int inputIsInteger = scanf("%d", &maxLengthOfSeq);
@@ -964,7 +9355,9 @@ int main(int argc, char const *argv[])
 		    		scanf("%*c"); // Clear newline left in buffer
 		    	}
 	    	sequence = (char*) malloc(1+maxLengthOfSeq*sizeof(char));
-	    	if (sequence == NULL) {
+	    	uint8_t* packedBases = (uint8_t*) malloc(getPackedSize(maxLengthOfSeq)); // Both filled in as the sequence is normalized
+	    	uint8_t* softMask = (softMasking != SOFT_MASK_IGNORED) ? (uint8_t*) malloc(getSoftMaskSize(maxLengthOfSeq)) : NULL;
+	    	if (sequence == NULL || packedBases == NULL || (softMasking != SOFT_MASK_IGNORED && softMask == NULL)) {
 		        fprintf(output_stream, ERROR_COLOR "Couldn't allocate space in memory for storing the sequence! %s\n\a" RESET, strerror(errno));
 		        return 1;
 		    }
@@ -977,16 +9370,29 @@ int main(int argc, char const *argv[])
 
 	    	bool inputOfSeqsCompleted = FALSE;
 	    	int numOfRuns = 0;
+	    	AnalysisCodonUsage codonUsage = { 0 }; // Reused by every sequence of the session
+	    	RbsAnnotations rbsAnnotations = { 0 };
+	    	ScanExtras scanExtras = { .codonUsage = withCodonUsage ? &codonUsage : NULL, .rbsAutomaton = (rbsWindow > 0) ? buildRbsAutomaton(rbsWindow, rbsEdits) : NULL,
+	    	                          .rbsAnnotations = &rbsAnnotations };
+	    	ArchiveJournal* sessionJournal = openArchiveJournal(output_stream, archivePath);
+	    	Arena* analysisArena = createArena(ARENA_BLOCK_SIZE); // Scratch memory of one analysis, reset after each sequence
+	    	if (analysisArena == NULL) {
+		        fprintf(output_stream, ERROR_COLOR "Couldn't allocate space in memory for the analysis! %s\n\a" RESET, strerror(errno));
+		        return 1;
+		    }
 	        do {
 
 	        	int sequenceLength = 0;
 	        	bool hasValidChars = FALSE;
+	        	NormalizationStats normalization; // Of the sequence as typed in
+	        	int recordCodeId = -1; // Genetic code the sequence names, -1 for the session's
 	        	do
 	        	{
 		        	memset(sequence, '\0', maxLengthOfSeq);
 		        	if (numOfRuns != 0) { // For some peculiar reason, input cannot be flushed so it always receives an empty sequence on the first run, the analysis of which we do not store to results
 		        		fprintf(output_stream, "\n%d) Enter a new sequence:\t", numOfRuns);
 		        	}
+		        	commitArchiveJournalBeforeInput(sessionJournal, input_stream);
 			    	fgets(sequence, maxLengthOfSeq+1, input_stream);
 			    	
 	        		sequenceLength = strlen(sequence); // Check how many characters were actually read (ignoring the newline if present)
@@ -1002,6 +9408,7 @@ int main(int argc, char const *argv[])
 			        	clear_input_buffer(input_stream, output_stream, maxLengthOfSeq); // If the user enters more than the buffer size, clear the remaining input
 
 			        }
+			        recordCodeId = takeGeneticCodeTag(sequence, &sequenceLength);
 			        if ( (sequenceLength%CODONS_LENGTH != 0) && (strcmp(sequence, "q") != 0) && (strcmp(sequence, "Q") != 0) )
 			        {
 			        	fprintf(output_stream, ERROR_COLOR "Sequence must be a multiple of %d\nPlease, check the sequence's length and enter it again:\t\a", CODONS_LENGTH);
@@ -1009,7 +9416,7 @@ int main(int argc, char const *argv[])
 		        } while( (sequenceLength%CODONS_LENGTH != 0) && (strcmp(sequence, "q") != 0) && (strcmp(sequence, "Q") != 0) );
 
 		        inputOfSeqsCompleted = (strcmp(sequence, "q") == 0) || (strcmp(sequence, "Q") == 0);
-				hasValidChars = has_valid_chars(sequence, sequenceLength, VALID_CHARS, NUM_OF_VALID_CHARS) || (strcmp(sequence, "q") == 0) || (strcmp(sequence, "Q") == 0);
+				hasValidChars = normalizeSequence(sequence, sequenceLength, packedBases, softMask, &normalization) || (strcmp(sequence, "q") == 0) || (strcmp(sequence, "Q") == 0);
 
 	        	while ( !hasValidChars )
 	        	{
@@ -1018,8 +9425,11 @@ int main(int argc, char const *argv[])
 		        	{
 		        		fprintf(output_stream, "%c\t", VALID_CHARS[i][0]);
 		        	}
+		        	fprintf(output_stream, "\nT is read as U; N and the IUPAC codes R Y S W K M B D H V are accepted too, in either case.");
+		        	fprintf(output_stream, "\nThe first invalid one is '%c', at position %d.", sequence[normalization.firstInvalid], normalization.firstInvalid + 1);
 		        	memset(sequence, '\0', maxLengthOfSeq);
 		        	fprintf(output_stream, "\n\nYou must enter the sequence again. Please enter the correct sequence:\t" RESET);
+		        	commitArchiveJournalBeforeInput(sessionJournal, input_stream);
 			    	fgets(sequence, maxLengthOfSeq+1, input_stream);
 			    	
 	        		sequenceLength = strlen(sequence); // Check how many characters were actually read (ignoring the newline if present)
@@ -1035,8 +9445,9 @@ int main(int argc, char const *argv[])
 			        	clear_input_buffer(input_stream, output_stream, maxLengthOfSeq); // If the user enters more than the buffer size, clear the remaining input
 
 			        }
+			        recordCodeId = takeGeneticCodeTag(sequence, &sequenceLength);
 			        inputOfSeqsCompleted = (strcmp(sequence, "q") == 0) || (strcmp(sequence, "Q") == 0);
-					hasValidChars = has_valid_chars(sequence, sequenceLength, VALID_CHARS, NUM_OF_VALID_CHARS) || (strcmp(sequence, "q") == 0) || (strcmp(sequence, "Q") == 0);
+					hasValidChars = normalizeSequence(sequence, sequenceLength, packedBases, softMask, &normalization) || (strcmp(sequence, "q") == 0) || (strcmp(sequence, "Q") == 0);
 	        	}
 
 	        	if (numOfRuns != 0) // For some peculiar reason, input cannot be flushed so it always receives an empty sequence on the first run, the analysis of which we do not store to results
@@ -1048,56 +9459,255 @@ int main(int argc, char const *argv[])
 
 		        if (!inputOfSeqsCompleted && numOfRuns != 0)
 		        {	
-		        	DoublyLinkedList* validSequencesList;
-		        	validSequencesList = find_all_sequences( output_stream, numOfRuns, sequence, sequenceLength);
-		        	printList(output_stream, validSequencesList);
+		        	const GeneticCode* recordCode = (recordCodeId >= 0) ? getGeneticCode(recordCodeId) : sessionCode;
+		        	if (recordCode == NULL)
+		        	{
+		        		fprintf(output_stream, ERROR_COLOR "Genetic code %d isn't supported, so the sequence is read with code %d.\a\n" RESET, recordCodeId, sessionCode->id);
+		        		recordCode = sessionCode;
+		        	}
+		        	if (recordCode != sessionCode)
+		        	{
+		        		fprintf(output_stream, DIM "Read with genetic code %d (%s).\n" RESET, recordCode->id, recordCode->name);
+		        	}
+		        	printNormalizationStats(output_stream, &normalization); // Already normalized, so DNA or lower case gives the same hash
+		        	uint64_t sequenceHash = hashAnalyzedSequence(sequence, sequenceLength, recordCode);
+		        	bool isSoftMaskSkipped = (softMasking == SOFT_MASK_SKIPPED && normalization.numOfLowerCase > 0);
+		        	bool isSoftMaskFlagged = (softMasking == SOFT_MASK_FLAGGED && normalization.numOfLowerCase > 0);
+		        	scanExtras.softMask = isSoftMaskSkipped ? softMask : NULL;
+		        	scanExtras.packedBases = packedBases;
+		        	scanExtras.normalization = &normalization;
+		        	scanExtras.geneticCode = recordCode;
+		        	if (isSoftMaskSkipped) // Its results lack the masked ORFs, so they're told apart from those of the same bases unmasked
+		        	{
+		        		sequenceHash ^= hashSequence64((const char*) softMask, (sequenceLength + 7) / 8);
+		        	}
+		        	if (codingModel != NULL) // Same for the coding flags, which depend on the model and threshold
+		        	{
+		        		sequenceHash ^= codingModelHash;
+		        	}
+		        	DoublyLinkedList* cachedSequencesList = lookupAnalysisCache(analysisCache, sequenceHash, sequenceLength);
 
-		        	mergeDoublyLinkedLists(historyListOfSequences, validSequencesList);
+		        	if (cachedSequencesList != NULL) // Already analyzed and archived, so just show the stored results
+		        	{
+		        		fprintf(output_stream, DIM "Sequence already analyzed (hash %016" PRIx64 "), showing stored results.\n" RESET, sequenceHash);
+		        		printList(output_stream, cachedSequencesList);
+		        		if (isSoftMaskFlagged) printSoftMaskedOrfs(output_stream, cachedSequencesList, softMask);
+		        		if (withCodonUsage)
+		        		{
+		        			getCodonUsageOfOrfs(cachedSequencesList, sequence, sequenceLength, &codonUsage);
+		        			printCodonUsage(output_stream, cachedSequencesList, &codonUsage);
+		        		}
+		        		if (scanExtras.rbsAutomaton != NULL)
+		        		{
+		        			annotateRbsOfOrfs(scanExtras.rbsAutomaton, analysisArena, cachedSequencesList, sequence, sequenceLength, &rbsAnnotations);
+		        			resetArena(analysisArena);
+		        			printRbsAnnotations(output_stream, cachedSequencesList, &rbsAnnotations, rbsWindow);
+		        		}
+		        		double* codingScores = (codingModel != NULL) ? scoreCodingPotential(codingModel, cachedSequencesList, sequence) : NULL;
+		        		if (codingScores != NULL) // Archived with the same model and threshold, so the flags agree with the scores
+		        		{
+		        			printCodingScores(output_stream, cachedSequencesList, codingScores, codingThreshold);
+		        			free(codingScores);
+		        		}
+		        		if (proteinsFile != NULL)
+		        		{
+		        			writeOrfProteins(proteinsFile, recordCode, cachedSequencesList, sequence, sequenceHash);
+		        		}
+		        	} else
+		        	{
+			        	DoublyLinkedList* validSequencesList;
+			        	validSequencesList = find_all_sequences( output_stream, analysisArena, sequence, sequenceLength, &scanExtras);
+			        	resetArena(analysisArena); // Results live outside the arena, so the scan's memory is reused by the next sequence
+			        	setAnalysisInfoOfList(validSequencesList, sequenceHash, time(NULL));
+			        	double* codingScores = (codingModel != NULL) ? scoreCodingPotential(codingModel, validSequencesList, sequence) : NULL;
+			        	if (codingScores != NULL) setCodingSequenceFlags(validSequencesList, codingScores, codingThreshold);
+			        	printList(output_stream, validSequencesList);
+			        	if (isSoftMaskFlagged) printSoftMaskedOrfs(output_stream, validSequencesList, softMask);
+			        	if (scanExtras.numOfSkippedOrfs > 0)
+			        	{
+			        		fprintf(output_stream, DIM "%d ORF(s) overlapping soft-masked (lower case) bases left out.\n" RESET, scanExtras.numOfSkippedOrfs);
+			        	}
+			        	if (withCodonUsage)
+			        	{
+			        		printCodonUsage(output_stream, validSequencesList, &codonUsage);
+			        	}
+			        	if (scanExtras.rbsAutomaton != NULL)
+			        	{
+			        		printRbsAnnotations(output_stream, validSequencesList, &rbsAnnotations, rbsWindow);
+			        	}
+			        	if (codingScores != NULL)
+			        	{
+			        		printCodingScores(output_stream, validSequencesList, codingScores, codingThreshold);
+			        		free(codingScores);
+			        	}
+			        	if (proteinsFile != NULL)
+			        	{
+			        		writeOrfProteins(proteinsFile, recordCode, validSequencesList, sequence, sequenceHash);
+			        	}
+
+			        	recordNewAnalysis(output_stream, sessionJournal, analysisCache, codonSiteCatalog, historyOfSequences, &historyIndex,
+			        	                  sequence, sequenceLength, recordCode, sequenceHash, validSequencesList);
+		        	}
+		        	if (motifAutomaton != NULL)
+		        	{
+		        		SequenceRecord record = { "input", sequence, sequenceLength };
+		        		reportMotifHits(output_stream, output_stream, motifAutomaton, &record, 1);
+		        	}
 			    }
 
 		        numOfRuns++;
 	    	} while( !inputOfSeqsCompleted );
 			
-			char* analysisSessionJSON = serializeListToJson(historyListOfSequences);
-			if (fileno(archiveFile) == -1) // True if archive file is closed previously
-        	{
-        		if (argc > 2)
-			    {	
-			    	archiveFile = getArchiveFile(output_stream, argv[2], 0, "w");
-			    } else // default archive file (no archive file given)
-				{
-					archiveFile = getArchiveFile(output_stream, NULL, 1, "w");
-				}
-        	}
-        	int isSuccessfullySaved = saveJsonToFile(archiveFile, analysisSessionJSON);
-        	if (!isSuccessfullySaved)
-        	{
-        		fprintf(output_stream, ERROR_COLOR "\aCouldn't save this sequence analysis session to the archive file (in JSON format)" RESET);
-
-        	}
-
-        	free(analysisSessionJSON);
+			saveAnalysisSession(output_stream, archivePath, archiveManifest, historyOfSequences, &numOfSealedRecords,
+			                    sessionJournal, analysisCache, analysisCachePath);
+        	freeAnalysisCodonUsage(&codonUsage);
+        	free(rbsAnnotations.sites);
+        	free(scanExtras.rbsAutomaton);
+        	freeArena(analysisArena);
+	    	free(softMask);
+	    	free(packedBases);
 	    	free(sequence);
 	    	sequence = NULL; // Is this correct here, since we freed memory allocated for 'sequence'?
 
-	    } else if (menuOption == 2)
+	    } else if (menuOption == MENU_HISTORY)
 	    {
 	    	fprintf(output_stream, SUCCESS_COLOR "History of all sequence analyses until %s\n" RESET, getCurrentDatetime());
-	    	if (historyListOfSequences == NULL)
+	    	int numOfCompressedRecords = getNumOfCompressedRecords(archiveManifest);
+	    	if (historyOfSequences == NULL)
 	    	{
 	    		fprintf(output_stream, "\nThe history is empty\n");
-	    	} else if (historyListOfSequences->head == NULL || historyListOfSequences->size <= 0)
+	    	} else if (historyOfSequences->size <= 0 && numOfCompressedRecords == 0)
 	    	{
 	    		fprintf(output_stream, "\nThe history is empty\n");
 	    	} else 
 	    	{
-		    	printList(output_stream, historyListOfSequences);
+	    		if (historyIndex == NULL) // Built on first use and after every change to the history
+	    		{
+	    			historyIndex = buildHistoryIndex(output_stream, historyOfSequences);
+	    		}
+	    		if (historyIndex != NULL)
+	    		{
+	    			fprintf(output_stream, "\n%d ORFs in the history (%d more in compressed shards).\n", historyIndex->numOfRecords, numOfCompressedRecords);
+		    		queryHistory(output_stream, historyIndex, archivePath, archiveManifest);
+	    		}
+	    	}
+
+	    } else if (menuOption == MENU_COMPACT_ARCHIVE)
+	    {
+	    	if (compactArchive(output_stream, archivePath, archiveManifest))
+	    	{
+	    		// History in memory still has the duplicates, so it's reloaded from the compacted archive
+	    		freeOrfStore(historyOfSequences);
+	    		historyOfSequences = loadShardedArchive(output_stream, archivePath, archiveManifest, &numOfSealedRecords);
+	    		linkAnalysisCacheToHistory(analysisCache, historyOfSequences, &numOfSealedRecords);
+	    		freeHistoryIndex(historyIndex);
+	    		historyIndex = NULL;
+	    	}
+
+	    } else if (menuOption == MENU_MANAGE_SHARDS)
+	    {
+	    	printArchiveShards(output_stream, archivePath, archiveManifest, historyOfSequences, numOfSealedRecords);
+	    	fprintf(output_stream, "\nAction (d: drop a shard, c: compress a shard, -: none):\t");
+	    	char shardAction = '-';
+	    	int shardId = -1;
+	    	scanf(" %c", &shardAction);
+	    	if (shardAction == 'd' || shardAction == 'D' || shardAction == 'c' || shardAction == 'C')
+	    	{
+	    		fprintf(output_stream, "Id of the sealed shard:\t");
+	    		if (scanf("%d", &shardId) != 1) shardId = -1;
+	    	}
+	    	bool shardsChanged = FALSE;
+	    	if (shardId >= 0 && (shardAction == 'd' || shardAction == 'D'))
+	    	{
+	    		shardsChanged = dropArchiveShard(output_stream, archivePath, archiveManifest, shardId);
+	    	} else if (shardId >= 0)
+	    	{
+	    		shardsChanged = compressArchiveShard(output_stream, archivePath, archiveManifest, shardId);
+	    	}
+	    	if (shardsChanged)
+	    	{
+	    		freeOrfStore(historyOfSequences);
+	    		historyOfSequences = loadShardedArchive(output_stream, archivePath, archiveManifest, &numOfSealedRecords);
+	    		linkAnalysisCacheToHistory(analysisCache, historyOfSequences, &numOfSealedRecords);
+	    		freeHistoryIndex(historyIndex);
+	    		historyIndex = NULL;
+	    	}
+
+	    } else if (menuOption == MENU_FIND_BY_POSITION)
+	    {
+	    	if (historyOfSequences == NULL || historyOfSequences->size <= 0)
+	    	{
+	    		fprintf(output_stream, "\nThe history is empty\n");
+	    	} else
+	    	{
+	    		if (historyIndex == NULL) // Same index as the history's queries
+	    		{
+	    			historyIndex = buildHistoryIndex(output_stream, historyOfSequences);
+	    		}
+	    		if (historyIndex != NULL)
+	    		{
+	    			findOrfsByPosition(output_stream, historyIndex, getNumOfCompressedRecords(archiveManifest));
+	    		}
 	    	}
 
+	    } else if (menuOption == MENU_CODON_SITES)
+	    {
+	    	queryCodonSites(output_stream, codonSiteCatalog);
+
+	    } else if (menuOption == MENU_REANALYZE_EDITS)
+	    {
+	    	Arena* analysisArena = createArena(ARENA_BLOCK_SIZE);
+	    	if (analysisArena == NULL) {
+		        fprintf(output_stream, ERROR_COLOR "Couldn't allocate space in memory for the analysis! %s\n\a" RESET, strerror(errno));
+		        return 1;
+		    }
+	    	char* editedSequence = NULL;
+	    	int editedLength = 0;
+	    	DoublyLinkedList* editedOrfs = reanalyzeSequenceAfterEdits(output_stream, analysisCache, analysisArena, sessionCode, &editedSequence, &editedLength);
+	    	if (editedOrfs != NULL)
+	    	{
+	    		// The edited sequence is a new analysis like any other, unless it has been analyzed already
+	    		uint64_t editedHash = hashAnalyzedSequence(editedSequence, editedLength, sessionCode);
+	    		if (lookupAnalysisCache(analysisCache, editedHash, editedLength) != NULL)
+	    		{
+	    			fprintf(output_stream, DIM "Edited sequence already analyzed (hash %016" PRIx64 "), showing stored results.\n" RESET, editedHash);
+	    			printList(output_stream, lookupAnalysisCache(analysisCache, editedHash, editedLength));
+	    			freeList(editedOrfs);
+	    		} else
+	    		{
+	    			ArchiveJournal* sessionJournal = openArchiveJournal(output_stream, archivePath);
+	    			setAnalysisInfoOfList(editedOrfs, editedHash, time(NULL));
+	    			printList(output_stream, editedOrfs);
+	    			recordNewAnalysis(output_stream, sessionJournal, analysisCache, codonSiteCatalog, historyOfSequences, &historyIndex,
+	    			                  editedSequence, editedLength, sessionCode, editedHash, editedOrfs);
+	    			saveAnalysisSession(output_stream, archivePath, archiveManifest, historyOfSequences, &numOfSealedRecords,
+	    			                    sessionJournal, analysisCache, analysisCachePath);
+	    		}
+	    	}
+	    	free(editedSequence);
+	    	freeArena(analysisArena);
+
+	    } else if (menuOption == MENU_VARIANT_EFFECTS)
+	    {
+	    	reportVariantEffects(output_stream, codonSiteCatalog, sessionCode);
+
+	    } else if (menuOption == MENU_MOTIF_SEARCH)
+	    {
+	    	searchSequencesForMotifs(output_stream);
+
+	    } else if (menuOption == MENU_TOP_ORFS)
+	    {
+	    	findTopOrfs(output_stream, sessionCode, softMasking);
+
+	    } else if (menuOption == MENU_TRANSLATE)
+	    {
+	    	translateSixFrames(output_stream, sessionCode);
+
 	    } else
 	    {
 	    	fprintf(output_stream, SUCCESS_BLINK "Good... See ya around!\n" RESET);
 
+		    if (proteinsFile != NULL) fclose(proteinsFile);
 		    // Close the file stream if it's not stdout or stderr
 		    if (output_stream != stdout && output_stream != stderr) {
 		        fclose(output_stream);
@@ -1121,6 +9731,7 @@ int main(int argc, char const *argv[])
 
     fprintf(output_stream, SUCCESS_BLINK "Good... See ya around!\n" RESET);
 
+    if (proteinsFile != NULL) fclose(proteinsFile);
     // Close the file stream if it's not stdout or stderr
     if (output_stream != stdout && output_stream != stderr)
     {